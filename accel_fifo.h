@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ACCEL_FIFO_H__
+#define __ACCEL_FIFO_H__
+
+#include "mbed.h"
+
+// Samples the FXOS8700CQ FIFO holds
+#define ACCEL_FIFO_DEPTH 32
+
+struct AccelSample {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+/*
+* Streams accelerometer samples out of the FXOS8700CQ's FIFO.
+*
+* The sensor samples on its own at the configured output data rate and
+* keeps up to ACCEL_FIFO_DEPTH samples. Once `watermark` of them are
+* waiting it pulls INT2 low (PTC13 on the FRDM-K64F) until the FIFO is
+* read below the watermark again; drain() reads everything waiting in
+* one I2C burst. The magnetometer is left off, as the FIFO only holds
+* accelerometer data. Samples are 14-bit, 4096 counts per g.
+*/
+class AccelFifo {
+public:
+    // Output data rates, in the encoding of CTRL_REG1
+    enum Rate {
+        RATE_800HZ,
+        RATE_400HZ,
+        RATE_200HZ,
+        RATE_100HZ,
+        RATE_50HZ,
+        RATE_12_5HZ,
+        RATE_6_25HZ,
+        RATE_1_56HZ
+    };
+
+    // 0x1d is the address with SA0 high, as wired on the FRDM-K64F
+    AccelFifo(PinName sda, PinName scl, uint8_t address=0x1d << 1) : _i2c(sda, scl), _address(address), _overflows(0) {
+        _i2c.frequency(400000);
+    }
+
+    /*
+    * Configures the sensor and starts sampling. Returns false if no
+    * FXOS8700CQ answers.
+    */
+    bool enable(Rate rate, uint8_t watermark) {
+        if (read_register(WHO_AM_I) != WHO_AM_I_VALUE) {
+            return false;
+        }
+        if (watermark == 0 || watermark >= ACCEL_FIFO_DEPTH) {
+            watermark = ACCEL_FIFO_DEPTH / 2;
+        }
+        // Registers can only be changed in standby
+        write_register(CTRL_REG1, 0);
+        write_register(M_CTRL_REG1, 0);                 // accelerometer only
+        write_register(XYZ_DATA_CFG, 0);                // +/-2 g
+        write_register(F_SETUP, F_MODE_CIRCULAR | watermark);
+        write_register(CTRL_REG3, 0);                   // active low, push-pull
+        write_register(CTRL_REG4, INT_EN_FIFO);
+        write_register(CTRL_REG5, 0);                   // FIFO interrupt on INT2
+        write_register(CTRL_REG1, (uint8_t)(rate << 3) | LNOISE | ACTIVE);
+        return true;
+    }
+
+    void disable() {
+        write_register(CTRL_REG1, 0);
+    }
+
+    /*
+    * Moves the samples waiting in the FIFO into `samples`, oldest first,
+    * and returns how many there were. `samples` must have room for
+    * ACCEL_FIFO_DEPTH.
+    */
+    uint8_t drain(AccelSample *samples) {
+        uint8_t status = read_register(F_STATUS);
+        if (status & F_OVF) {
+            // The oldest samples were overwritten since the last drain
+            _overflows++;
+        }
+        uint8_t count = status & F_CNT_MASK;
+        if (count == 0) {
+            return 0;
+        }
+        // The output registers wrap around from Z back to X while the FIFO
+        // is on, so a single burst reads every waiting sample
+        uint8_t data[ACCEL_FIFO_DEPTH * 6];
+        char reg = OUT_X_MSB;
+        _i2c.write(_address, &reg, 1, true);
+        _i2c.read(_address, (char*)data, count * 6);
+        for (uint8_t i = 0; i < count; i++) {
+            const uint8_t *d = data + i * 6;
+            samples[i].x = (int16_t)((d[0] << 8) | d[1]) >> 2;
+            samples[i].y = (int16_t)((d[2] << 8) | d[3]) >> 2;
+            samples[i].z = (int16_t)((d[4] << 8) | d[5]) >> 2;
+        }
+        return count;
+    }
+
+    // Drains that found samples lost to a full FIFO
+    uint32_t overflows() const {
+        return _overflows;
+    }
+
+private:
+    enum {
+        F_STATUS        = 0x00,
+        OUT_X_MSB       = 0x01,
+        F_SETUP         = 0x09,
+        WHO_AM_I        = 0x0d,
+        XYZ_DATA_CFG    = 0x0e,
+        CTRL_REG1       = 0x2a,
+        CTRL_REG3       = 0x2c,
+        CTRL_REG4       = 0x2d,
+        CTRL_REG5       = 0x2e,
+        M_CTRL_REG1     = 0x5b,
+
+        WHO_AM_I_VALUE  = 0xc7,
+        F_OVF           = 0x80,
+        F_CNT_MASK      = 0x3f,
+        F_MODE_CIRCULAR = 0x40,
+        INT_EN_FIFO     = 0x40,
+        LNOISE          = 0x04,
+        ACTIVE          = 0x01
+    };
+
+    uint8_t read_register(char reg) {
+        char value = 0;
+        _i2c.write(_address, &reg, 1, true);
+        _i2c.read(_address, &value, 1);
+        return (uint8_t)value;
+    }
+
+    void write_register(char reg, uint8_t value) {
+        char data[2] = { reg, (char)value };
+        _i2c.write(_address, data, 2);
+    }
+
+    I2C      _i2c;
+    uint8_t  _address;
+    uint32_t _overflows;
+};
+
+#endif // __ACCEL_FIFO_H__
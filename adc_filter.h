@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ADC_FILTER_H__
+#define __ADC_FILTER_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// Builds the SMLAD variant of adc_sum(): on Cortex-M4 and M7 with the DSP
+// extension, and in the host checks against a model of the instruction
+#if !defined(ADC_SUM_SMLAD) && defined(__ARM_FEATURE_DSP) && defined(__MBED__)
+#define ADC_SUM_SMLAD 1
+#endif
+
+#if ADC_SUM_SMLAD
+#include "cmsis.h"
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Extra bits of resolution AdcFilter keeps below the 16 bits of a sample
+#define ADC_FILTER_FRACTION_BITS 8
+
+/*
+* Sum of `count` raw 16-bit samples, one at a time. The reference the
+* vectorized adc_sum() is checked against.
+*/
+inline uint32_t adc_sum_scalar(const uint16_t *samples, uint32_t count) {
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    return sum;
+}
+
+/*
+* The vector variants work on signed 16-bit lanes: flipping the top bit
+* maps 0..65535 onto -32768..32767, the lanes are multiplied by one and
+* added pairwise into 32-bit accumulators, and the offset of 32768 per
+* sample is added back at the end. At most 65536 samples keep the signed
+* accumulators from overflowing.
+*/
+#if ADC_SUM_SMLAD
+inline uint32_t adc_sum_smlad(const uint16_t *samples, uint32_t count) {
+    int32_t sum = 0;
+    uint32_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        uint32_t pair;
+        memcpy(&pair, samples + i, sizeof(pair));
+        sum = (int32_t)__SMLAD(pair ^ 0x80008000u, 0x00010001u, (uint32_t)sum);
+    }
+    return (uint32_t)sum + (uint32_t)i * 32768u + adc_sum_scalar(samples + i, count - i);
+}
+#endif
+
+#if defined(__SSE2__)
+inline uint32_t adc_sum_sse2(const uint16_t *samples, uint32_t count) {
+    const __m128i flip = _mm_set1_epi16((short)0x8000);
+    const __m128i ones = _mm_set1_epi16(1);
+    __m128i sum = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(samples + i));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_xor_si128(v, flip), ones));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (uint32_t)_mm_cvtsi128_si32(sum) + i * 32768u + adc_sum_scalar(samples + i, count - i);
+}
+#endif
+
+/*
+* Sum of `count` raw 16-bit samples, at most 65536 of them: with SMLAD
+* where the core has it, PMADDWD with SSE2 on the host, one at a time
+* otherwise.
+*/
+inline uint32_t adc_sum(const uint16_t *samples, uint32_t count) {
+#if ADC_SUM_SMLAD
+    return adc_sum_smlad(samples, count);
+#elif defined(__SSE2__)
+    return adc_sum_sse2(samples, count);
+#else
+    return adc_sum_scalar(samples, count);
+#endif
+}
+
+/*
+* Turns a burst of raw ADC samples into one low-noise reading.
+*
+* The burst is averaged, a first-order CIC decimator (a moving average
+* decimated by the burst length), which keeps ADC_FILTER_FRACTION_BITS
+* below the sample's least significant bit. An optional exponential
+* moving average then smooths the readings of successive bursts: each
+* reading moves 1/2^ema_shift of the way to the new average. Everything
+* is integer arithmetic; readings are full scale at 65535 << 8.
+*/
+class AdcFilter {
+public:
+    AdcFilter(uint8_t ema_shift=0) : _ema_shift(ema_shift), _primed(false), _value(0) {}
+
+    uint32_t update(const uint16_t *samples, uint32_t count) {
+        if (count == 0) {
+            return _value;
+        }
+        uint32_t sum = adc_sum(samples, count);
+        uint32_t average = (uint32_t)(((uint64_t)sum << ADC_FILTER_FRACTION_BITS) / count);
+        if (!_primed || _ema_shift == 0) {
+            _value = average;
+            _primed = true;
+        } else {
+            int32_t step = (int32_t)(average - _value) / (1 << _ema_shift);
+            _value += step;
+        }
+        return _value;
+    }
+
+    uint32_t value() const {
+        return _value;
+    }
+
+    // The reading as a fraction of full scale, like AnalogIn::read()
+    float fraction() const {
+        return (float)_value / (65535.0f * (1 << ADC_FILTER_FRACTION_BITS));
+    }
+
+private:
+    uint8_t  _ema_shift;
+    bool     _primed;
+    uint32_t _value;
+};
+
+#endif // __ADC_FILTER_H__
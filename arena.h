@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <string>
+#include "mbed.h"
+
+/*
+* Fixed-size blocks carved out of storage given to the constructor, for
+* the client's transient data. Taking and giving back a block is a couple
+* of pointer moves inside a critical section, so a pool can be shared by
+* every thread. When all blocks are in use allocate() returns NULL and the
+* caller goes elsewhere, usually to the heap.
+*/
+class BlockPool {
+public:
+    struct Stats {
+        uint16_t blocks;
+        uint16_t in_use;
+        uint16_t peak;          // most blocks in use at once
+        uint32_t exhausted;     // allocate() calls that found none free
+    };
+
+    // `storage` holds `count` blocks of `block_size` bytes, a multiple of 8
+    BlockPool(void *storage, size_t block_size, uint16_t count)
+        : _storage((uint8_t*)storage), _block_size(block_size), _free(NULL) {
+        _stats.blocks = count;
+        _stats.in_use = 0;
+        _stats.peak = 0;
+        _stats.exhausted = 0;
+        for (uint16_t i = count; i > 0; i--) {
+            Free *block = (Free*)(_storage + (size_t)(i - 1) * block_size);
+            block->next = _free;
+            _free = block;
+        }
+    }
+
+    void *allocate() {
+        core_util_critical_section_enter();
+        Free *block = _free;
+        if (block) {
+            _free = block->next;
+            if (++_stats.in_use > _stats.peak) {
+                _stats.peak = _stats.in_use;
+            }
+        } else {
+            _stats.exhausted++;
+        }
+        core_util_critical_section_exit();
+        return block;
+    }
+
+    void release(void *block) {
+        core_util_critical_section_enter();
+        ((Free*)block)->next = _free;
+        _free = (Free*)block;
+        _stats.in_use--;
+        core_util_critical_section_exit();
+    }
+
+    size_t block_size() const {
+        return _block_size;
+    }
+
+    Stats stats() const {
+        core_util_critical_section_enter();
+        Stats s = _stats;
+        core_util_critical_section_exit();
+        return s;
+    }
+
+private:
+    struct Free {
+        Free *next;
+    };
+
+    uint8_t *_storage;
+    size_t   _block_size;
+    Free    *_free;
+    Stats    _stats;
+};
+
+// A BlockPool with storage of its own for `Count` blocks
+template <size_t BlockSize, uint16_t Count>
+class FixedBlockPool: public BlockPool {
+public:
+    FixedBlockPool() : BlockPool(_storage, BLOCK, Count) {}
+
+private:
+    static const size_t BLOCK = (BlockSize + 7) & ~(size_t)7;
+
+    uint64_t _storage[(BLOCK * (Count ? Count : 1)) / 8];
+};
+
+/*
+* Bump allocation from the blocks of a BlockPool, for data that lives no
+* longer than a cycle of work: a request being handled, a pattern being
+* blinked. Nothing is freed on its own. rewind() and reset() give the
+* blocks taken since back to the pool all at once, so the heap never sees
+* the cycle's temporaries and cannot fragment around them. Freeing the
+* latest allocation takes it back, so a container that reallocates as it
+* grows reuses the space.
+*
+* An allocation larger than a block, or that finds the pool empty, gets
+* NULL; ArenaAllocator then uses the heap and the arena counts it. An
+* arena is for one thread at a time.
+*/
+class Arena {
+public:
+    struct Stats {
+        uint32_t allocations;
+        uint32_t fallbacks;     // allocations that went to the heap instead
+        uint16_t blocks;        // blocks held now
+        uint16_t blocks_peak;
+    };
+
+    // Where rewind() goes back to
+    struct Mark {
+        Mark() : block(NULL), top(0) {}
+
+    private:
+        friend class Arena;
+        void  *block;
+        size_t top;
+    };
+
+    explicit Arena(BlockPool &pool) : _pool(pool), _block(NULL), _top(0) {
+        _stats.allocations = 0;
+        _stats.fallbacks = 0;
+        _stats.blocks = 0;
+        _stats.blocks_peak = 0;
+    }
+
+    ~Arena() {
+        reset();
+    }
+
+    void *allocate(size_t size) {
+        size = round(size);
+        if (size > capacity()) {
+            return NULL;
+        }
+        if (!_block || _top + size > capacity()) {
+            Block *block = (Block*)_pool.allocate();
+            if (!block) {
+                return NULL;
+            }
+            block->previous = _block;
+            _block = block;
+            _top = 0;
+            if (++_stats.blocks > _stats.blocks_peak) {
+                _stats.blocks_peak = _stats.blocks;
+            }
+        }
+        void *p = data(_block) + _top;
+        _top += size;
+        _stats.allocations++;
+        return p;
+    }
+
+    /*
+    * False if `p` did not come from this arena. The space is only taken
+    * back if `p` is the latest allocation; the rest waits for rewind().
+    */
+    bool deallocate(void *p, size_t size) {
+        for (Block *b = _block; b; b = b->previous) {
+            if ((uint8_t*)p >= data(b) && (uint8_t*)p < data(b) + capacity()) {
+                if (b == _block && (uint8_t*)p + round(size) == data(b) + _top) {
+                    _top -= round(size);
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Mark mark() const {
+        Mark m;
+        m.block = _block;
+        m.top = _top;
+        return m;
+    }
+
+    // Frees everything allocated since `m` was taken
+    void rewind(const Mark &m) {
+        while (_block != m.block) {
+            Block *previous = _block->previous;
+            _pool.release(_block);
+            _block = previous;
+            _stats.blocks--;
+        }
+        _top = m.top;
+    }
+
+    void reset() {
+        rewind(Mark());
+    }
+
+    void fell_back() {
+        _stats.fallbacks++;
+    }
+
+    Stats stats() const {
+        return _stats;
+    }
+
+private:
+    struct Block {
+        Block   *previous;
+        uint64_t align;
+    };
+
+    static size_t round(size_t size) {
+        return size ? (size + 7) & ~(size_t)7 : 8;
+    }
+
+    static uint8_t *data(Block *b) {
+        return (uint8_t*)b + sizeof(Block);
+    }
+
+    size_t capacity() const {
+        return _pool.block_size() > sizeof(Block) ? _pool.block_size() - sizeof(Block) : 0;
+    }
+
+    BlockPool &_pool;
+    Block     *_block;      // the newest, whose free space starts at _top
+    size_t     _top;
+    Stats      _stats;
+};
+
+/*
+* Rewinds an arena to where it was when the scope opened. Containers
+* allocating from the arena must go before the scope does, so declare the
+* scope first.
+*/
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena &arena) : _arena(arena), _mark(arena.mark()) {}
+    ~ArenaScope() {
+        _arena.rewind(_mark);
+    }
+
+private:
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator=(const ArenaScope&);
+
+    Arena      &_arena;
+    Arena::Mark _mark;
+};
+
+/*
+* Lets the standard containers allocate from an Arena. What the arena
+* cannot hold goes to the heap, as it would with std::allocator. A
+* default-constructed allocator, which some container operations make,
+* has no arena and always uses the heap.
+*/
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T         value_type;
+    typedef T        *pointer;
+    typedef const T  *const_pointer;
+    typedef T        &reference;
+    typedef const T  &const_reference;
+    typedef size_t    size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    ArenaAllocator() : _arena(NULL) {}
+    explicit ArenaAllocator(Arena &arena) : _arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : _arena(other.arena()) {}
+
+    Arena *arena() const {
+        return _arena;
+    }
+
+    pointer address(reference x) const {
+        return &x;
+    }
+    const_pointer address(const_reference x) const {
+        return &x;
+    }
+
+    pointer allocate(size_type n, const void* = 0) {
+        void *p = _arena ? _arena->allocate(n * sizeof(T)) : NULL;
+        if (!p) {
+            if (_arena) {
+                _arena->fell_back();
+            }
+            p = ::operator new(n * sizeof(T));
+        }
+        return (pointer)p;
+    }
+
+    void deallocate(pointer p, size_type n) {
+        if (!_arena || !_arena->deallocate(p, n * sizeof(T))) {
+            ::operator delete(p);
+        }
+    }
+
+    size_type max_size() const {
+        return (size_type)-1 / sizeof(T);
+    }
+
+    void construct(pointer p, const T &value) {
+        new ((void*)p) T(value);
+    }
+    void destroy(pointer p) {
+        p->~T();
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return _arena == other.arena();
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return _arena != other.arena();
+    }
+
+private:
+    Arena *_arena;
+};
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char> > ArenaString;
+
+#endif // __ARENA_H__
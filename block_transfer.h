@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BLOCK_TRANSFER_H__
+#define __BLOCK_TRANSFER_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "sample_log.h"
+
+// Largest flash program unit StorageSink can align writes to
+#ifndef BLOCK_SINK_PROGRAM_MAX
+#define BLOCK_SINK_PROGRAM_MAX 16
+#endif
+
+/*
+* Source of a large outgoing payload, read in pieces so that it never has
+* to be held in RAM as a whole.
+*/
+class ChunkProducer {
+public:
+    virtual ~ChunkProducer() {}
+
+    /*
+    * Copies up to `size` bytes starting at byte `offset` of the payload
+    * into `buffer` and returns how many were copied. Fewer than `size`
+    * means the payload ends there.
+    */
+    virtual uint32_t read(uint32_t offset, uint8_t *buffer, uint32_t size) = 0;
+};
+
+/*
+* Destination of a large incoming payload. Bytes arrive in order; all
+* calls return 0 on success.
+*/
+class ChunkSink {
+public:
+    virtual ~ChunkSink() {}
+
+    // Starts a payload, or resumes one at `offset` bytes already stored
+    virtual int begin(uint32_t offset) = 0;
+    virtual int write(uint32_t offset, const uint8_t *data, uint32_t size) = 0;
+    // All `size` bytes of the payload have been written
+    virtual int finish(uint32_t size) = 0;
+};
+
+/*
+* Feeds the blocks of block-wise PUTs to a ChunkSink as they arrive.
+*
+* A PUT writes the payload from the offset given to start(), 0 unless a
+* transfer is being resumed. The block size is taken from the first
+* block. Retransmitted blocks are skipped. A block that leaves a gap
+* after a lost one, or that the sink fails to store, stops the transfer:
+* committed() then tells the sender where to resume with another PUT.
+*
+* Every block is stored before the callback returns, and so before it is
+* acknowledged; as block-wise CoAP waits for that acknowledgement before
+* sending the next block, a slow sink slows the sender down instead of
+* blocks piling up in RAM.
+*/
+class BlockReceiver {
+public:
+    enum State {
+        IDLE,
+        RECEIVING,
+        COMPLETE,
+        STOPPED
+    };
+
+    BlockReceiver(ChunkSink &sink)
+        : _sink(sink), _state(IDLE), _start(0), _committed(0), _block_size(0) {}
+
+    // The next PUT writes from `offset`, at most committed()
+    void start(uint32_t offset) {
+        _start = offset < _committed ? offset : _committed;
+        _state = IDLE;
+    }
+
+    State block(uint32_t number, const uint8_t *data, uint32_t size, bool last) {
+        if (number == 0) {
+            _block_size = size;
+            _committed = _start;
+            _state = _sink.begin(_start) == 0 ? RECEIVING : STOPPED;
+        }
+        if (_state != RECEIVING) {
+            return _state;
+        }
+        uint32_t offset = _start + number * _block_size;
+        if (offset + size <= _committed && !last) {
+            return _state;
+        }
+        if (offset > _committed || (!last && size != _block_size)) {
+            _state = STOPPED;
+            return _state;
+        }
+        uint32_t skip = _committed - offset;
+        if (size > skip && _sink.write(_committed, data + skip, size - skip) != 0) {
+            _state = STOPPED;
+            return _state;
+        }
+        _committed = offset + size;
+        if (last) {
+            _state = _sink.finish(_committed) == 0 ? COMPLETE : STOPPED;
+            _start = 0;
+        }
+        return _state;
+    }
+
+    // Bytes stored so far, where a resumed PUT should start
+    uint32_t committed() const {
+        return _committed;
+    }
+
+    State state() const {
+        return _state;
+    }
+
+private:
+    ChunkSink &_sink;
+    State      _state;
+    uint32_t   _start;
+    uint32_t   _committed;
+    uint32_t   _block_size;
+};
+
+/*
+* Stores an incoming payload in a LogStorage region, flash or a file on a
+* host, from its start. Each erase unit is erased just before the first
+* write into it, and writes are programmed in whole program units, the
+* remainder being kept in RAM until the next block or finish(). The
+* payload must fit in the region.
+*/
+class StorageSink: public ChunkSink {
+public:
+    StorageSink(LogStorage &storage, uint32_t program_size=8)
+        : _storage(storage), _program_size(program_size), _written(0), _erased(0), _size(0), _tail_size(0) {
+        if (_program_size == 0 || _program_size > BLOCK_SINK_PROGRAM_MAX) {
+            _program_size = BLOCK_SINK_PROGRAM_MAX;
+        }
+    }
+
+    virtual int begin(uint32_t offset) {
+        if (offset > _written + _tail_size) {
+            return -1;
+        }
+        if (offset < _written) {
+            // Rewinding over programmed data, which is only possible by
+            // erasing it: start over at an erase unit boundary
+            if (offset % _storage.erase_size()) {
+                return -1;
+            }
+            _erased = offset;
+            _written = offset;
+        }
+        _tail_size = offset - _written;
+        _size = 0;
+        return 0;
+    }
+
+    virtual int write(uint32_t offset, const uint8_t *data, uint32_t size) {
+        if (offset != _written + _tail_size || offset + size > _storage.size()) {
+            return -1;
+        }
+        if (_tail_size) {
+            uint32_t n = _program_size - _tail_size;
+            if (n > size) {
+                n = size;
+            }
+            memcpy(_tail + _tail_size, data, n);
+            _tail_size += n;
+            data += n;
+            size -= n;
+            if (_tail_size < _program_size) {
+                return 0;
+            }
+            if (program(_tail, _program_size) != 0) {
+                return -1;
+            }
+            _tail_size = 0;
+        }
+        uint32_t whole = size - size % _program_size;
+        if (whole && program(data, whole) != 0) {
+            return -1;
+        }
+        _tail_size = size - whole;
+        memcpy(_tail, data + whole, _tail_size);
+        return 0;
+    }
+
+    virtual int finish(uint32_t size) {
+        if (_tail_size) {
+            memset(_tail + _tail_size, 0xff, _program_size - _tail_size);
+            if (program(_tail, _program_size) != 0) {
+                return -1;
+            }
+            _written -= _program_size - _tail_size;
+            _tail_size = 0;
+        }
+        _size = size;
+        return 0;
+    }
+
+    // Size of the last complete payload, 0 while one is being received
+    uint32_t size() const {
+        return _size;
+    }
+
+private:
+    int program(const uint8_t *data, uint32_t size) {
+        uint32_t erase_size = _storage.erase_size();
+        while (_erased < _written + size) {
+            if (_storage.erase(_erased, erase_size) != 0) {
+                return -1;
+            }
+            _erased += erase_size;
+        }
+        if (_storage.program(_written, data, size) != 0) {
+            return -1;
+        }
+        _written += size;
+        return 0;
+    }
+
+    LogStorage &_storage;
+    uint32_t    _program_size;
+    uint32_t    _written;
+    uint32_t    _erased;
+    uint32_t    _size;
+    uint32_t    _tail_size;
+    uint8_t     _tail[BLOCK_SINK_PROGRAM_MAX];
+};
+
+#endif // __BLOCK_TRANSFER_H__
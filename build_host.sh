@@ -0,0 +1,35 @@
+#!/bin/bash
+#
+# Builds the example for the Linux host, against the simulated board and
+# the CoAP stand-in for mbed Client in host/, plus the benchmarks:
+#
+#   BUILD/host/mbed-os-example-client   the client, registering with
+#                                       MBED_SERVER_ADDRESS (coap://127.0.0.1:5683)
+#   BUILD/host/bench                    benchmarks, see host/bench.cpp
+#   BUILD/host/bench-trace              the same with hot-path tracing compiled in
+#   BUILD/host/check                    functional checks, see host/check.cpp
+#   BUILD/host/loadgen                  the client under load from a loopback
+#                                       LwM2M server, see host/loadgen.cpp; traced
+#   BUILD/host/soak                     the client's per-cycle work for a long run,
+#                                       watching the heap, see host/soak.cpp
+#   BUILD/host/trace2json               traces to Chrome's JSON, see host/trace2json.cpp
+#   BUILD/host/fleet                    thousands of simulated boards against
+#                                       a loopback LwM2M server, see host/fleet.cpp
+#
+# Extra compiler flags can be given, e.g.
+#   ./build_host.sh -DMBED_SERVER_ADDRESS='"coap://10.0.0.2:5683"'
+set -e
+CXX=${CXX:-g++}
+FLAGS="-std=gnu++98 -O2 -g -pthread -Wall -Wextra -Ihost -I. -DMBED_CONF_APP_NETWORK_INTERFACE=ETHERNET"
+OUT=BUILD/host
+
+mkdir -p $OUT
+echo Compiling with $CXX for the host
+$CXX $FLAGS "$@" main.cpp -o $OUT/mbed-os-example-client
+$CXX $FLAGS "$@" host/bench.cpp -o $OUT/bench
+$CXX $FLAGS -DTRACE_ENABLED=1 "$@" host/bench.cpp -o $OUT/bench-trace
+$CXX $FLAGS "$@" host/check.cpp -o $OUT/check
+$CXX $FLAGS -DTRACE_ENABLED=1 "$@" host/loadgen.cpp -o $OUT/loadgen
+$CXX $FLAGS "$@" host/fleet.cpp -o $OUT/fleet
+$CXX $FLAGS "$@" host/soak.cpp -o $OUT/soak
+$CXX $FLAGS "$@" host/trace2json.cpp -o $OUT/trace2json
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CONNECTION_H__
+#define __CONNECTION_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// The wait before the first attempt to reconnect, in milliseconds; it
+// doubles with every attempt that fails...
+#ifndef RECONNECT_MIN_MS
+#define RECONNECT_MIN_MS 5000
+#endif
+// ...up to this
+#ifndef RECONNECT_MAX_MS
+#define RECONNECT_MAX_MS 300000
+#endif
+
+// An attempt neither answered nor failed after this long is taken as
+// failed; mbed Client gives up on a registration well before that
+#ifndef RECONNECT_ATTEMPT_TIMEOUT_S
+#define RECONNECT_ATTEMPT_TIMEOUT_S 120
+#endif
+
+/*
+* The client's connection to the server, as a state machine:
+*
+*   IDLE --connecting()--> CONNECTING --connected()--> ONLINE
+*                              ^   |                      |
+*                     attempt()|   |lost()          lost()|
+*                              |   v                      |
+*                             WAITING <-------------------+
+*
+* lost() waits a random time between half and all of the backoff, which
+* starts at RECONNECT_MIN_MS and doubles with every failed attempt up to
+* RECONNECT_MAX_MS, so that a fleet that lost the server together does
+* not come back together. due() says when to attempt() again. retry()
+* skips the wait without growing the backoff, for when the link is fine
+* but the attempt must change, from an update to a full registration.
+*
+* Times are milliseconds of a clock such as uptime_ms(). MbedClient keeps
+* one of these and drives it from its callbacks.
+*/
+class ConnectionState {
+public:
+    enum State {
+        IDLE,
+        CONNECTING,
+        ONLINE,
+        WAITING
+    };
+
+    struct Stats {
+        uint32_t disconnects;       // connections lost while online
+        uint32_t attempts;          // to reconnect
+        uint32_t reconnects;        // that succeeded
+        uint32_t offline_ms;        // the last time offline, or so far
+        uint32_t longest_offline_ms;
+    };
+
+    ConnectionState() : _state(IDLE), _failures(0), _since_ms(0), _offline_ms(0), _next_ms(0) {
+        _stats.disconnects = 0;
+        _stats.attempts = 0;
+        _stats.reconnects = 0;
+        _stats.offline_ms = 0;
+        _stats.longest_offline_ms = 0;
+    }
+
+    State state() const {
+        return _state;
+    }
+
+    bool online() const {
+        return _state == ONLINE;
+    }
+
+    // The first registration is on its way
+    void connecting(uint32_t now_ms) {
+        _state = CONNECTING;
+        _since_ms = now_ms;
+    }
+
+    void connected(uint32_t now_ms) {
+        if (_state == ONLINE) {
+            return;
+        }
+        if (_stats.disconnects) {
+            _stats.reconnects++;
+            offline(now_ms);
+        }
+        _state = ONLINE;
+        _failures = 0;
+    }
+
+    // Left on purpose, by de-registering; nothing is attempted
+    void closed() {
+        _state = IDLE;
+    }
+
+    // The connection, or the attempt to make one, failed at `now_ms`
+    void lost(uint32_t now_ms) {
+        if (_state == ONLINE) {
+            _stats.disconnects++;
+            _offline_ms = now_ms;
+        } else if (_state == CONNECTING) {
+            if (_failures < 31) {
+                _failures++;
+            }
+        } else {
+            return;
+        }
+        _state = WAITING;
+        _next_ms = now_ms + delay_ms();
+    }
+
+    // Attempt again right away, the backoff left as it is
+    void retry(uint32_t now_ms) {
+        _state = WAITING;
+        _next_ms = now_ms;
+    }
+
+    // True if it is time to attempt() reconnecting
+    bool due(uint32_t now_ms) {
+        if (_state == CONNECTING && now_ms - _since_ms >= RECONNECT_ATTEMPT_TIMEOUT_S * 1000) {
+            lost(now_ms);
+        }
+        return _state == WAITING && (int32_t)(now_ms - _next_ms) >= 0;
+    }
+
+    void attempt(uint32_t now_ms) {
+        _state = CONNECTING;
+        _since_ms = now_ms;
+        _stats.attempts++;
+    }
+
+    // Milliseconds until the next attempt, 0 if it is due or not waiting
+    uint32_t remaining_ms(uint32_t now_ms) const {
+        return _state == WAITING && (int32_t)(_next_ms - now_ms) > 0 ? _next_ms - now_ms : 0;
+    }
+
+    Stats stats(uint32_t now_ms) const {
+        Stats s = _stats;
+        if (_stats.disconnects && _state != ONLINE) {
+            s.offline_ms = now_ms - _offline_ms;
+        }
+        return s;
+    }
+
+private:
+    // Half the backoff, and up to as much again at random
+    uint32_t delay_ms() const {
+        uint32_t backoff = RECONNECT_MIN_MS;
+        for (uint8_t i = 0; i < _failures && backoff < RECONNECT_MAX_MS; i++) {
+            backoff *= 2;
+        }
+        if (backoff > RECONNECT_MAX_MS) {
+            backoff = RECONNECT_MAX_MS;
+        }
+        return backoff / 2 + (uint32_t)rand() % (backoff / 2 + 1);
+    }
+
+    void offline(uint32_t now_ms) {
+        _stats.offline_ms = now_ms - _offline_ms;
+        if (_stats.offline_ms > _stats.longest_offline_ms) {
+            _stats.longest_offline_ms = _stats.offline_ms;
+        }
+    }
+
+    State    _state;
+    uint8_t  _failures;         // attempts failed in a row
+    uint32_t _since_ms;         // of the attempt
+    uint32_t _offline_ms;       // when the connection was lost
+    uint32_t _next_ms;          // of the next attempt
+    Stats    _stats;
+};
+
+#endif // __CONNECTION_H__
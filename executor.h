@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __EXECUTOR_H__
+#define __EXECUTOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__MBED__)
+#include "mbed.h"
+#endif
+
+// Most jobs an Executor runs at once
+#ifndef EXECUTOR_MAX_JOBS
+#define EXECUTOR_MAX_JOBS 8
+#endif
+
+/*
+* Runs timed sequences of steps, any number of them at once up to
+* EXECUTOR_MAX_JOBS, on the thread that calls run(), so that work which
+* waits between its steps needs no thread of its own.
+*
+* A job is a step function: it is called when the job is due, and returns
+* the number of milliseconds until it is to be called again, or DONE.
+* Like the Scheduler's, delays are counted from when the step was due, not
+* from when it ran.
+*
+* start() and cancel() may be called from any thread. Steps run with the
+* executor locked, so they wait for a step that is running to return,
+* and a cancelled job's step is never called again. A step must not call
+* into code that takes a lock of its own and may call start() or cancel()
+* while holding it, such as mbed Client; a job can be given a `done`
+* function for that, called with the executor unlocked once its last
+* step has returned DONE.
+*
+* All times come from the clock given to the constructor, in
+* microseconds. `wake` is called whenever a job is started, so that a
+* thread sleeping until the next step can take the new one into account.
+*/
+class Executor {
+public:
+    typedef uint32_t (*Step)(void *context);
+    typedef void (*Done)(void *context);
+    typedef uint64_t (*Clock)();
+    typedef void (*Wake)();
+
+    static const uint32_t DONE = 0xffffffff;
+
+    struct Stats {
+        uint32_t started;
+        uint32_t completed;
+        uint32_t cancelled;
+        uint32_t rejected;      // the table was full
+        uint32_t late_max_us;   // worst step start after its due time
+        uint16_t active_max;    // most jobs at once
+    };
+
+    Executor(Clock clock, Wake wake=NULL) : _clock(clock), _wake(wake), _active(0) {
+        for (uint16_t i = 0; i < EXECUTOR_MAX_JOBS; i++) {
+            _jobs[i].step = NULL;
+            _jobs[i].generation = 0;
+        }
+        _stats.started = 0;
+        _stats.completed = 0;
+        _stats.cancelled = 0;
+        _stats.rejected = 0;
+        _stats.late_max_us = 0;
+        _stats.active_max = 0;
+    }
+
+    /*
+    * Starts a job whose first step runs after `delay_ms`, and `done`, if
+    * any, once it has finished. Returns a handle for cancel(), or -1 if
+    * EXECUTOR_MAX_JOBS are running.
+    */
+    int start(Step step, void *context, uint32_t delay_ms=0, Done done=NULL) {
+        lock();
+        int handle = -1;
+        for (uint16_t i = 0; i < EXECUTOR_MAX_JOBS; i++) {
+            Job &j = _jobs[i];
+            if (!j.step) {
+                j.step = step;
+                j.done = done;
+                j.context = context;
+                j.due_us = _clock() + (uint64_t)delay_ms * 1000;
+                j.generation = (j.generation + 1) & GENERATION_MASK;
+                handle = (int)((j.generation << 8) | i);
+                _stats.started++;
+                if (++_active > _stats.active_max) {
+                    _stats.active_max = _active;
+                }
+                break;
+            }
+        }
+        if (handle < 0) {
+            _stats.rejected++;
+        }
+        unlock();
+        if (handle >= 0 && _wake) {
+            _wake();
+        }
+        return handle;
+    }
+
+    /*
+    * Stops a job. Returns false if it had already finished or been
+    * cancelled.
+    */
+    bool cancel(int handle) {
+        if (handle < 0) {
+            return false;
+        }
+        uint16_t index = handle & 0xff;
+        if (index >= EXECUTOR_MAX_JOBS) {
+            return false;
+        }
+        lock();
+        Job &j = _jobs[index];
+        bool running = j.step && j.generation == (uint32_t)handle >> 8;
+        if (running) {
+            j.step = NULL;
+            _active--;
+            _stats.cancelled++;
+        }
+        unlock();
+        return running;
+    }
+
+    /*
+    * Runs every step that is due and returns the number of milliseconds
+    * until the next one, rounded up, or 0xffffffff if no job is running.
+    */
+    uint32_t run() {
+        // The done functions of jobs that finish, called once unlocked
+        Finished finished[EXECUTOR_MAX_JOBS];
+        uint16_t count = 0;
+        lock();
+        uint64_t now = _clock();
+        // Steps left due once `finished` is full run on the next call
+        while (count < EXECUTOR_MAX_JOBS) {
+            Job *due = NULL;
+            for (uint16_t i = 0; i < EXECUTOR_MAX_JOBS; i++) {
+                Job &j = _jobs[i];
+                if (j.step && j.due_us <= now && (!due || j.due_us < due->due_us)) {
+                    due = &j;
+                }
+            }
+            if (!due) {
+                break;
+            }
+            uint64_t late = now - due->due_us;
+            if (late > _stats.late_max_us) {
+                _stats.late_max_us = (uint32_t)late;
+            }
+            uint32_t generation = due->generation;
+            uint32_t delay_ms = due->step(due->context);
+            // Unless the step cancelled its own job
+            if (due->step && due->generation == generation) {
+                if (delay_ms == DONE) {
+                    due->step = NULL;
+                    _active--;
+                    _stats.completed++;
+                    if (due->done) {
+                        finished[count].done = due->done;
+                        finished[count].context = due->context;
+                        count++;
+                    }
+                } else {
+                    due->due_us += (uint64_t)delay_ms * 1000;
+                }
+            }
+            now = _clock();
+        }
+
+        uint64_t next = (uint64_t)-1;
+        for (uint16_t i = 0; i < EXECUTOR_MAX_JOBS; i++) {
+            if (_jobs[i].step && _jobs[i].due_us < next) {
+                next = _jobs[i].due_us;
+            }
+        }
+        unlock();
+        for (uint16_t i = 0; i < count; i++) {
+            finished[i].done(finished[i].context);
+        }
+        if (next == (uint64_t)-1) {
+            return 0xffffffff;
+        }
+        return next > now ? (uint32_t)((next - now + 999) / 1000) : 0;
+    }
+
+    // Jobs running now
+    uint16_t active() const {
+        return _active;
+    }
+
+    const Stats& stats() const {
+        return _stats;
+    }
+
+private:
+    // Keeps handles positive
+    static const uint32_t GENERATION_MASK = 0x7fffff;
+
+    struct Job {
+        Step      step;         // NULL if the slot is free
+        Done      done;
+        void     *context;
+        uint64_t  due_us;
+        uint32_t  generation;   // tells handles of earlier jobs apart
+    };
+
+    struct Finished {
+        Done  done;
+        void *context;
+    };
+
+#if defined(__MBED__)
+    void lock() {
+        _mutex.lock();
+    }
+    void unlock() {
+        _mutex.unlock();
+    }
+    Mutex _mutex;
+#else
+    void lock() {}
+    void unlock() {}
+#endif
+
+    Clock    _clock;
+    Wake     _wake;
+    Job      _jobs[EXECUTOR_MAX_JOBS];
+    uint16_t _active;
+    Stats    _stats;
+};
+
+#endif // __EXECUTOR_H__
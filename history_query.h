@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HISTORY_QUERY_H__
+#define __HISTORY_QUERY_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "payload_writer.h"
+#include "rollup.h"
+#include "sample_value.h"
+#include "timeseries.h"
+
+// Largest page of query results, in bytes
+#ifndef QUERY_PAGE_SIZE
+#define QUERY_PAGE_SIZE 1024
+#endif
+
+/*
+* A time-range query over the stored history of one series, such as
+* "start=0&end=3600000&res=60000&fn=avg".
+*
+*  - start, end: the range [start, end) in milliseconds since boot,
+*    everything by default
+*  - res: bucket width in milliseconds; 0, the default, returns the raw
+*    samples
+*  - fn: what each bucket reports, one of avg (default), min, max, sum,
+*    count or last
+*
+* The answer is computed while it is written: samples are decoded one at
+* a time and folded into the current bucket, so memory does not grow with
+* the range. It comes in pages of at most QUERY_PAGE_SIZE bytes:
+*
+*   {"source":"raw","rows":[[<time>,<value>],...],"next":<time>}
+*
+* "next" is only present if the page is full, and is the start to query
+* from for the rest. A row's time is the start of its bucket, or `start`
+* for a bucket that began before it. Raw samples answer the query if they
+* reach back to `start` or res is 0; otherwise the finest rollup tier
+* whose width divides res does, to the precision of its buckets: a
+* rollup bucket that began before `start` but reaches past it is kept,
+* whole, in the row at `start`.
+*/
+class HistoryQuery {
+public:
+    enum Function {
+        AVG,
+        MIN,
+        MAX,
+        SUM,
+        COUNT,
+        LAST
+    };
+
+    HistoryQuery() : _start(0), _end(0xffffffff), _resolution(0), _function(AVG) {}
+
+    /*
+    * Applies a query string. Returns false, changing nothing, if it cannot
+    * be parsed.
+    */
+    bool parse(const char *query) {
+        static const char *functions[] = { "avg", "min", "max", "sum", "count", "last" };
+        HistoryQuery q;
+        while (*query) {
+            const char *end = strchr(query, '&');
+            size_t len = end ? (size_t)(end - query) : strlen(query);
+            const char *eq = (const char *)memchr(query, '=', len);
+            if (!eq) {
+                return false;
+            }
+            size_t key_len = eq - query;
+            size_t value_len = len - key_len - 1;
+            char value[12];
+            if (value_len == 0 || value_len >= sizeof(value)) {
+                return false;
+            }
+            memcpy(value, eq + 1, value_len);
+            value[value_len] = '\0';
+            if (key_len == 3 && strncmp(query, "res", 3) == 0) {
+                q._resolution = strtoul(value, NULL, 10);
+            } else if (key_len == 5 && strncmp(query, "start", 5) == 0) {
+                q._start = strtoul(value, NULL, 10);
+            } else if (key_len == 3 && strncmp(query, "end", 3) == 0) {
+                q._end = strtoul(value, NULL, 10);
+            } else if (key_len == 2 && strncmp(query, "fn", 2) == 0) {
+                size_t f = 0;
+                while (f < sizeof(functions) / sizeof(functions[0]) && strcmp(value, functions[f]) != 0) {
+                    f++;
+                }
+                if (f == sizeof(functions) / sizeof(functions[0])) {
+                    return false;
+                }
+                q._function = (Function)f;
+            } else {
+                return false;
+            }
+            query += len;
+            if (*query == '&') {
+                query++;
+            }
+        }
+        if (q._end <= q._start) {
+            return false;
+        }
+        *this = q;
+        return true;
+    }
+
+    /*
+    * Writes the page of the answer starting at the query's start into
+    * `out`, which should have room for `page_size` bytes. `raw` and
+    * `rollup` are the stored history of the series; either may be NULL.
+    */
+    void encode(const TimeSeries *raw, const Rollup *rollup, PayloadWriter &out,
+                size_t page_size=QUERY_PAGE_SIZE) const {
+        Source source(raw, rollup, *this);
+        static const char *names[] = { "raw", "minutes", "hours" };
+        out.put("{\"source\":\"");
+        out.put(names[source.tier + 1]);
+        out.put("\",\"rows\":[");
+
+        Item item;
+        bool more = source.next(item);
+        bool first = true;
+        while (more) {
+            uint32_t bucket = _resolution ? item.timestamp - item.timestamp % _resolution : item.timestamp;
+            Item total = item;
+            while ((more = source.next(item)) && _resolution && item.timestamp - item.timestamp % _resolution == bucket) {
+                total.count += item.count;
+                if (item.min < total.min) {
+                    total.min = item.min;
+                }
+                if (item.max > total.max) {
+                    total.max = item.max;
+                }
+                total.sum += item.sum;
+                total.last = item.last;
+            }
+            // Keep room for the row and for closing the page with "next"
+            if (out.size() + ROW_SIZE + TAIL_SIZE > page_size) {
+                out.put("],\"next\":");
+                out.put_uint(bucket < _start ? _start : bucket);
+                out.put('}');
+                return;
+            }
+            out.put(first ? "[" : ",[");
+            first = false;
+            out.put_uint(bucket < _start ? _start : bucket);
+            out.put(',');
+            char text[SAMPLE_TEXT_SIZE];
+            out.put(text, format_value(row_value(total, source.integer), text));
+            out.put(']');
+        }
+        out.put("]}");
+    }
+
+private:
+    // Longest row: ,[4294967295,<value>]
+    static const size_t ROW_SIZE = 14 + SAMPLE_TEXT_SIZE;
+    // Longest end of a page: ],"next":4294967295}
+    static const size_t TAIL_SIZE = 21;
+
+    // A raw sample, or a rollup bucket, inside the query range
+    struct Item {
+        uint32_t timestamp;
+        uint32_t count;
+        double   min;
+        double   max;
+        double   sum;
+        double   last;
+    };
+
+    /*
+    * Produces the items of the query range in time order, from the raw
+    * samples (tier -1) or one rollup tier, including the bucket that
+    * overlaps the start of the range.
+    */
+    class Source {
+    public:
+        Source(const TimeSeries *raw, const Rollup *rollup, const HistoryQuery &query)
+            : tier(-1), integer(raw && raw->encoding() == TimeSeries::INTEGER),
+              _rollup(rollup), _index(0),
+              _start(query._start), _end(query._end) {
+            bool raw_covers = raw && raw->size() && raw->oldest_timestamp() <= query._start;
+            if (rollup && query._resolution && !raw_covers) {
+                uint32_t oldest = raw && raw->size() ? raw->oldest_timestamp() : 0xffffffff;
+                for (int t = Rollup::TIER_COUNT - 1; t >= 0; t--) {
+                    Rollup::Tier candidate = (Rollup::Tier)t;
+                    if (query._resolution % Rollup::width(candidate) || rollup->size(candidate) == 0) {
+                        continue;
+                    }
+                    uint32_t tier_oldest = rollup->bucket(candidate, 0).start;
+                    // The finest tier reaching back to the start, else the oldest data
+                    if (tier_oldest <= query._start || tier_oldest < oldest) {
+                        tier = t;
+                        oldest = tier_oldest;
+                    }
+                }
+            }
+            if (tier < 0 && raw) {
+                _samples = raw->samples_from(query._start);
+            }
+        }
+
+        bool next(Item &item) {
+            for (;;) {
+                uint32_t width = 1;
+                if (tier < 0) {
+                    TimeSeries::Sample sample;
+                    if (!_samples.next(sample)) {
+                        return false;
+                    }
+                    double v = integer ? (double)sample.value.i : (double)sample.value.f;
+                    item.timestamp = sample.timestamp;
+                    item.count = 1;
+                    item.min = item.max = item.sum = item.last = v;
+                } else {
+                    Rollup::Tier t = (Rollup::Tier)tier;
+                    if (_index >= _rollup->size(t)) {
+                        return false;
+                    }
+                    Rollup::Bucket b = _rollup->bucket(t, _index++);
+                    width = Rollup::width(t);
+                    item.timestamp = b.start;
+                    item.count = b.count;
+                    item.min = b.min;
+                    item.max = b.max;
+                    item.sum = b.sum;
+                    item.last = b.last;
+                }
+                if (item.timestamp >= _end) {
+                    return false;
+                }
+                if (item.timestamp >= _start || _start - item.timestamp < width) {
+                    return true;
+                }
+            }
+        }
+
+        int  tier;
+        bool integer;
+
+    private:
+        const Rollup         *_rollup;
+        TimeSeries::Iterator  _samples;
+        uint16_t              _index;
+        uint32_t              _start;
+        uint32_t              _end;
+    };
+
+    SampleValue row_value(const Item &total, bool integer) const {
+        if (_resolution == 0) {
+            return integer ? SampleValue::integer((int32_t)total.last, 0) : SampleValue::real((float)total.last, 0);
+        }
+        double v;
+        switch (_function) {
+            case MIN:   v = total.min; break;
+            case MAX:   v = total.max; break;
+            case SUM:   v = total.sum; break;
+            case COUNT: return SampleValue::integer((int32_t)total.count, 0);
+            case LAST:  v = total.last; break;
+            default:    return SampleValue::real((float)(total.sum / total.count), 0);
+        }
+        return integer ? SampleValue::integer((int32_t)v, 0) : SampleValue::real((float)v, 0);
+    }
+
+    uint32_t _start;
+    uint32_t _end;
+    uint32_t _resolution;
+    Function _function;
+};
+
+#endif // __HISTORY_QUERY_H__
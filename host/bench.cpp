@@ -0,0 +1,956 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmarks of the client's hot paths on the host build: sampling,
+ * serialization, set_value and registration. The example is compiled in
+ * unchanged, its main() renamed, and its classes are driven directly.
+ *
+ * Usage: bench [--udp] [filter]
+ *
+ * Every benchmark is run BENCH_RUNS times and the median and fastest run
+ * are reported per operation, with the heap allocations per operation.
+ * Benchmarks with an allocation budget fail the program when they exceed
+ * it. Simulated inputs follow MBED_HOST_SEED, which is 1 unless set, so
+ * runs see the same data.
+ *
+ * Built with TRACE_ENABLED, as BUILD/host/bench-trace is, it also times
+ * recording trace events; the other benchmarks then include the cost of
+ * the trace points on their paths, whose rings are not drained and drop
+ * what does not fit.
+ */
+
+#define main client_main
+#include "../main.cpp"
+#undef main
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include "lwm2m_server.h"
+
+#ifndef BENCH_RUNS
+#define BENCH_RUNS 7
+#endif
+
+/*
+ * Observes one interface and lets the benchmark wait for its outcomes.
+ */
+class Waiter: public M2MInterfaceObserver {
+public:
+    Waiter() : _failed(false) {}
+
+    bool wait() {
+        bool got = _done.wait(5000) > 0;
+        return got && !_failed;
+    }
+
+    virtual void bootstrap_done(M2MSecurity*) {}
+    virtual void object_registered(M2MSecurity*, const M2MServer&) {
+        _done.release();
+    }
+    virtual void object_unregistered(M2MSecurity*) {
+        _done.release();
+    }
+    virtual void registration_updated(M2MSecurity*, const M2MServer&) {
+        _done.release();
+    }
+    virtual void error(M2MInterface::Error) {
+        _failed = true;
+        _done.release();
+    }
+    virtual void value_updated(M2MBase*, M2MBase::BaseType) {}
+
+private:
+    Semaphore     _done;
+    volatile bool _failed;
+};
+
+// Sends stdout to /dev/null while the example's own logging would
+// drown the results
+class Quiet {
+public:
+    Quiet() {
+        fflush(stdout);
+        _saved = dup(STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    ~Quiet() {
+        fflush(stdout);
+        dup2(_saved, STDOUT_FILENO);
+        close(_saved);
+    }
+
+private:
+    int _saved;
+};
+
+typedef void (*Operation)(void *context, uint32_t i);
+
+static const char *filter = NULL;
+
+// What a benchmark's output measured, besides its time, such as a payload
+// size; operations fill it in and bench() prints it at the end of the line
+static char note[48];
+// Bytes each operation moves, for those that move data; bench() prints
+// the throughput of the median run from it
+static uint32_t op_bytes;
+
+/*
+* Most heap allocations per operation each benchmark may make, by name
+* prefix. Recording and sampling must not allocate at all; serializing
+* allocates what set_value() copies of alldata/0/json and alldata/0/stats.
+* The loopback server's allocations are counted with the client's, so
+* registration round trips have no budget.
+*/
+static const struct {
+    const char *name;
+    double      allocations;
+} budgets[] = {
+    { "record_data/", 0 },
+    { "accel/read_data", 0 },
+    { "analog/sample_all", 0 },
+    { "timeseries/", 0 },
+    { "rollup/", 0 },
+    { "notify/", 15 },
+    { "query/", 0 },
+    { "export/", 0 },
+    { "put/", 0 },
+    { "sample/value", 0 },
+    { "sample/format_value", 0 },
+    { "serialize/", 2 },
+    { "serializer/writer", 0 },
+    { "set_value/unobserved", 1 },
+    { "set_value/observed", 15 },
+};
+
+// Allocations per operation other threads of the process may add
+#define BENCH_ALLOCATION_NOISE 0.01
+
+static uint32_t over_budget = 0;
+// Benchmarks whose output differs from what it must be
+static uint32_t wrong_output = 0;
+
+/*
+ * Runs `operation` `count` times per run and prints the time per
+ * operation of the median and the fastest run. If there is a `prepare`
+ * step it runs untimed before each operation, and each operation is
+ * timed on its own. Whatever the operations leave in `op_bytes` and
+ * `note` is printed after the allocations.
+ */
+static void bench(const char *name, Operation operation, void *context, uint32_t count, bool quiet=true,
+                  Operation prepare=NULL) {
+    if (filter && !strstr(name, filter)) {
+        return;
+    }
+    std::vector<double> runs;
+    note[0] = '\0';
+    op_bytes = 0;
+    uint32_t i = 0;
+    uint64_t allocations = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        uint64_t elapsed = 0;
+        {
+            Quiet *q = quiet ? new Quiet() : NULL;
+            if (prepare) {
+                for (uint32_t n = 0; n < count; n++) {
+                    prepare(context, i);
+                    uint64_t allocated = host_heap_allocations();
+                    uint64_t start = host_now_us();
+                    operation(context, i++);
+                    elapsed += host_now_us() - start;
+                    allocations += host_heap_allocations() - allocated;
+                }
+            } else {
+                uint64_t allocated = host_heap_allocations();
+                uint64_t start = host_now_us();
+                for (uint32_t n = 0; n < count; n++) {
+                    operation(context, i++);
+                }
+                elapsed = host_now_us() - start;
+                allocations += host_heap_allocations() - allocated;
+            }
+            delete q;
+        }
+        runs.push_back(elapsed * 1000.0 / count);
+    }
+    std::sort(runs.begin(), runs.end());
+    double median = runs[runs.size() / 2];
+    const char *unit = "ns";
+    double scale = 1;
+    if (median >= 10000) {
+        unit = "us";
+        scale = 1000;
+    }
+    double per_op = (double)allocations / ((double)BENCH_RUNS * count);
+    printf("%-28s %10.1f %s %10.1f %s %6d x %-6u %9.2f", name, median / scale, unit, runs[0] / scale, unit,
+           BENCH_RUNS, count, per_op);
+    if (op_bytes) {
+        printf("  %.1f MB/s", op_bytes * 1000.0 / median);
+    }
+    if (note[0]) {
+        printf("  %s", note);
+    }
+    for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++) {
+        if (strncmp(name, budgets[b].name, strlen(budgets[b].name)) == 0 &&
+            per_op > budgets[b].allocations + BENCH_ALLOCATION_NOISE) {
+            printf("  over budget of %.2f", budgets[b].allocations);
+            over_budget++;
+            break;
+        }
+    }
+    printf("\n");
+}
+
+struct Sources {
+    ButtonResource        button;
+    AccelerometerResource accel;
+    AnalogInResource      sound;
+    AnalogInResource      temperature;
+    AnalogInResource      light;
+    AnalogInResource      distance;
+    AnalogSampler         sampler;
+    DataAggregator        all_data;
+
+    Sources() : sound(A0, SOUND_LEVEL_SCHEMA), temperature(A1, TEMPERATURE_SCHEMA),
+                light(A2, LIGHT_SCHEMA), distance(A3, DISTANCE_SCHEMA) {
+        sampler.add(&sound);
+        sampler.add(&temperature, TEMPERATURE_EMA_SHIFT);
+        sampler.add(&light);
+        sampler.add(&distance);
+        DataSource *sources[] = { &button, &accel, &sound, &temperature, &light, &distance };
+        for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+            all_data.add_data_source(sources[i]);
+        }
+    }
+};
+
+static void record_int(void *context, uint32_t i) {
+    ((Sources*)context)->button.record_data(0, (int32_t)(i & 0xff));
+}
+
+static void record_float(void *context, uint32_t i) {
+    ((Sources*)context)->temperature.record_data(0, 0.25f + (i & 0xff) / 1024.0f);
+}
+
+static void analog_sample(void *context, uint32_t /*i*/) {
+    AnalogSampler::sample(&((Sources*)context)->sampler);
+}
+
+// Lets the sensor fill its FIFO to the watermark, as between interrupts
+static void accel_wait(void * /*context*/, uint32_t /*i*/) {
+    wait_ms(1000 * ACCEL_WATERMARK / 400 + 5);
+}
+
+// Drains the FIFO and closes the window, as the scheduler does
+static void accel_read_data(void *context, uint32_t /*i*/) {
+    ((Sources*)context)->accel.read_data();
+}
+
+// Every source changes, so every pass serializes everything
+static void change_all(void *context, uint32_t i) {
+    Sources *s = (Sources*)context;
+    float step = (i & 1) ? 0.05f : -0.05f;
+    s->button.record_data(0, (int32_t)(i & 1));
+    for (int r = 0; r < 15; r++) {
+        s->accel.record_data(r, (int32_t)(r * 100 + (i & 1)));
+    }
+    s->sound.record_data(0, 0.5f + step);
+    s->temperature.record_data(0, 0.4f + step);
+    s->light.record_data(0, 0.3f + step);
+    s->distance.record_data(0, 0.2f + step);
+}
+
+static void serialize_all(void *context, uint32_t /*i*/) {
+    ((Sources*)context)->all_data.update_all();
+}
+
+/*
+ * A series sampled every 3 s with +/-3 ms of jitter, as the sources are:
+ * accelerometer-like integer noise, or noisy ADC floats, a few steps of a
+ * 12-bit converter around mid-scale. Or a steady float, exactly on time.
+ */
+struct SeriesBench {
+    enum Kind {
+        INT_NOISE,
+        FLOAT_NOISE,
+        STEADY
+    };
+
+    TimeSeries series;
+    Kind       kind;
+    uint32_t   timestamp;
+    uint32_t   state;
+
+    SeriesBench(Kind k) : series(k == INT_NOISE ? TimeSeries::INTEGER : TimeSeries::FLOAT), kind(k),
+                          timestamp(0), state(host_seed() * 2654435761u | 1) {}
+};
+
+static void series_append(void *context, uint32_t i) {
+    SeriesBench *b = (SeriesBench*)context;
+    if (b->kind == SeriesBench::STEADY) {
+        b->timestamp += 3000;
+        b->series.append(b->timestamp, 0.5f);
+    } else {
+        uint32_t r = host_random(b->state);
+        b->timestamp += 2997 + r % 7;
+        if (b->kind == SeriesBench::INT_NOISE) {
+            b->series.append(b->timestamp, (int32_t)(1000 + (r >> 8) % 33 - 16));
+        } else {
+            b->series.append(b->timestamp, (float)(2048 + (r >> 8) % 9 - 4) / 4096);
+        }
+    }
+    // the compressed size, now and then, as the ring only holds its newest blocks
+    if ((i & 1023) == 0) {
+        snprintf(note, sizeof(note), "%.2f B/sample", (double)b->series.bytes_used() / b->series.size());
+    }
+}
+
+// One sample a tenth of a second into both tiers, as a 10 Hz series does
+static void rollup_add(void *context, uint32_t i) {
+    ((Rollup*)context)->add(i * 100, 0.25f + (i & 0xff) / 1024.0f);
+}
+
+/*
+ * The eight values the example published when alldata/0/json was built
+ * out of std::string, as text the way the sources recorded them then,
+ * and as the SampleValues they record now.
+ */
+static const struct {
+    const char *object;
+    const char *resource;
+    const char *description;
+    const char *text;
+} published[] = {
+    { "3200", "5501", "Button", "7" },
+    { "3313", "5702", "AccelX", "-12" },
+    { "3313", "5703", "AccelY", "4" },
+    { "3313", "5704", "AccelZ", "1016" },
+    { "3324", "5600", "SoundLevel", "0.512" },
+    { "3303", "5600", "Temperature", "0.404" },
+    { "3301", "5600", "Light", "0.298" },
+    { "3330", "5600", "Distance", "0.201" },
+};
+#define PUBLISHED_COUNT (sizeof(published) / sizeof(published[0]))
+
+static std::string old_to_string(int value) {
+    std::ostringstream stream;
+    stream << value;
+    return stream.str();
+}
+
+// A source as DataSource kept it: text values in maps keyed by resource
+struct StringSource {
+    std::string ds_name;
+    int instance_id;
+    std::map<std::string, std::string> data_names;
+    std::map<std::string, std::string> data_values;
+
+    std::string json() {
+        std::string json;
+        bool first = true;
+        for (std::map<std::string,std::string>::iterator it = data_values.begin(); it != data_values.end(); ++it) {
+            if (!first) {
+                json += "    ,\n";
+            }
+            first = false;
+            json += "    {\n        \"uri\":\"/";
+            json += ds_name + "/" + old_to_string(instance_id) + "/" + (*it).first;
+            json += "\",\n        \"desc\":\"";
+            json += data_names[(*it).first] + "\",\n        \"value\":\"";
+            json += (*it).second + "\"\n    }";
+            json += "\n";
+        }
+        return json;
+    }
+};
+
+struct Serializers {
+    std::vector<StringSource> sources;
+    SampleValue               values[PUBLISHED_COUNT];
+    std::string               string_payload;
+    uint8_t                   buffer[ALLDATA_BUFFER_SIZE];
+    size_t                    len;
+
+    Serializers() : len(0) {
+        for (size_t v = 0; v < PUBLISHED_COUNT; v++) {
+            if (sources.empty() || sources.back().ds_name != published[v].object) {
+                sources.push_back(StringSource());
+                sources.back().ds_name = published[v].object;
+                sources.back().instance_id = 0;
+            }
+            sources.back().data_names[published[v].resource] = published[v].description;
+            sources.back().data_values[published[v].resource] = published[v].text;
+            values[v] = strchr(published[v].text, '.') ? SampleValue::real((float)atof(published[v].text), 0)
+                                                       : SampleValue::integer(atoi(published[v].text), 0);
+        }
+    }
+};
+
+// alldata/0/json as DataAggregator::update_all() built it before PayloadWriter
+static void serialize_string(void *context, uint32_t /*i*/) {
+    Serializers *s = (Serializers*)context;
+    bool first = true;
+    std::string json = "[\n";
+    for (std::vector<StringSource>::iterator it = s->sources.begin(); it != s->sources.end(); ++it) {
+        if (!first) {
+            json += "    ,\n";
+        }
+        first = false;
+        json += it->json();
+    }
+    json += "]";
+    s->string_payload = json;
+    snprintf(note, sizeof(note), "%u bytes", (unsigned)json.size());
+}
+
+// The same payload through JsonEncoder into the aggregator's buffer
+static void serialize_writer(void *context, uint32_t /*i*/) {
+    Serializers *s = (Serializers*)context;
+    PayloadWriter out(s->buffer, sizeof(s->buffer));
+    JsonEncoder json(out);
+    json.begin();
+    for (size_t v = 0; v < PUBLISHED_COUNT; v++) {
+        if (v == 0 || strcmp(published[v].object, published[v - 1].object) != 0) {
+            json.begin_source(published[v].object, 0);
+        }
+        json.value(published[v].resource, published[v].description, s->values[v]);
+    }
+    json.end();
+    s->len = out.size();
+    snprintf(note, sizeof(note), "%u bytes", (unsigned)s->len);
+}
+
+/*
+ * One sample kept the way DataSource kept it, as sprintf'd text in a
+ * std::string, and the way it does now, as a SampleValue formatted only
+ * when text is needed. Floats and integers alternate.
+ */
+struct SampleBench {
+    std::string text;
+    SampleValue value;
+    char        formatted[SAMPLE_TEXT_SIZE];
+};
+
+static void sample_sprintf(void *context, uint32_t i) {
+    SampleBench *b = (SampleBench*)context;
+    char buffer[32];
+    if (i & 1) {
+        sprintf(buffer, "%.3f", 0.25f + (i & 0xff) / 1024.0f);
+    } else {
+        sprintf(buffer, "%" PRId32, (int32_t)(i & 0xfff) - 2048);
+    }
+    // record_data() took the text as a std::string
+    b->text = std::string(buffer);
+}
+
+static void sample_value(void *context, uint32_t i) {
+    SampleBench *b = (SampleBench*)context;
+    if (i & 1) {
+        b->value = SampleValue::real(0.25f + (i & 0xff) / 1024.0f, i);
+    } else {
+        b->value = SampleValue::integer((int32_t)(i & 0xfff) - 2048, i);
+    }
+}
+
+static void sample_format(void *context, uint32_t i) {
+    SampleBench *b = (SampleBench*)context;
+    sample_value(context, i);
+    format_value(b->value, b->formatted);
+}
+
+/*
+ * The history of a float series sampled every second, raw and rolled up,
+ * and a history query to page through all of it.
+ */
+struct QueryBench {
+    TimeSeries  raw;
+    Rollup      rollup;
+    const char *query;
+    bool        rollup_only;
+    uint8_t     page[QUERY_PAGE_SIZE + 1];
+
+    QueryBench(uint32_t samples)
+        : raw(TimeSeries::FLOAT, (uint16_t)(samples / 4 + 8)), query(""), rollup_only(false) {
+        uint32_t state = host_seed() * 2654435761u | 1;
+        float value = 20;
+        for (uint32_t n = 0; n < samples; n++) {
+            value += (float)((int32_t)(host_random(state) % 101) - 50) / 1000;
+            raw.append(n * 1000, value);
+            rollup.add(n * 1000, value);
+        }
+    }
+};
+
+// Every page of the answer, each asked for from the last one's "next"
+static void query_pages(void *context, uint32_t /*i*/) {
+    QueryBench *b = (QueryBench*)context;
+    uint32_t start = 0;
+    uint32_t pages = 0;
+    for (;;) {
+        char text[64];
+        snprintf(text, sizeof(text), "start=%" PRIu32 "%s", start, b->query);
+        HistoryQuery query;
+        query.parse(text);
+        PayloadWriter out(b->page, QUERY_PAGE_SIZE);
+        query.encode(b->rollup_only ? NULL : &b->raw, &b->rollup, out);
+        pages++;
+        b->page[out.size()] = '\0';
+        const char *next = strstr((const char *)b->page, "\"next\":");
+        if (!next) {
+            break;
+        }
+        start = strtoul(next + 7, NULL, 10);
+    }
+    snprintf(note, sizeof(note), "%" PRIu32 " page%s", pages, pages == 1 ? "" : "s");
+}
+
+// Sources the export benchmark dumps, each with a full default history
+#define EXPORT_SOURCES 64
+
+/*
+ * A source with one float resource whose history is filled up directly,
+ * one sample a second, rather than sampled on the clock, for
+ * HistoryExport to dump.
+ */
+class ExportSource: public FixedDataSource<1> {
+public:
+    ExportSource(const char *name) : FixedDataSource<1>(name) {
+        set_data_description("5600", "Export", TimeSeries::FLOAT);
+        // history() is read-only for everything but record_data()
+        TimeSeries *series = const_cast<TimeSeries*>(history("5600"));
+        uint32_t state = host_seed() * 2654435761u | 1;
+        // more than the ring holds, so that it is full
+        for (uint32_t n = 0; n < 4096; n++) {
+            series->append(n * 1000, (float)(2048 + host_random(state) % 9 - 4) / 4096);
+        }
+    }
+    virtual void read_data() {}
+};
+
+struct ExportBench {
+    HistoryExport export_csv;
+    uint8_t       window[BIG_PAYLOAD_WINDOW_SIZE];
+};
+
+// The whole CSV export, one BIG_PAYLOAD_WINDOW_SIZE window per GET
+static void export_windows(void *context, uint32_t /*i*/) {
+    ExportBench *b = (ExportBench*)context;
+    uint32_t offset = 0;
+    uint32_t len;
+    do {
+        len = b->export_csv.read(offset, b->window, sizeof(b->window));
+        offset += len;
+    } while (len == sizeof(b->window));
+    op_bytes = offset;
+    snprintf(note, sizeof(note), "%" PRIu32 " KB", offset / 1024);
+}
+
+/*
+ * A block-wise PUT of `size` bytes in blocks of `block_size`, stored in
+ * the simulated flash kept for uploads as BigPayloadResource stores it.
+ */
+struct PutBench {
+    FlashIAPLogStorage log_storage;
+    FlashIAPLogStorage storage;
+    StorageSink        sink;
+    BlockReceiver      receiver;
+    uint8_t           *payload;
+    uint32_t           size;
+    uint32_t           block_size;
+
+    PutBench() : storage(BIG_PAYLOAD_STORAGE_SIZE, &log_storage), sink(storage), receiver(sink),
+                 size(BIG_PAYLOAD_STORAGE_SIZE), block_size(16) {
+        payload = new uint8_t[size];
+        uint32_t state = host_seed() * 2654435761u | 1;
+        for (uint32_t n = 0; n < size; n++) {
+            payload[n] = (uint8_t)host_random(state);
+        }
+    }
+    ~PutBench() {
+        delete[] payload;
+    }
+};
+
+static void put_blocks(void *context, uint32_t /*i*/) {
+    PutBench *b = (PutBench*)context;
+    b->receiver.start(0);
+    for (uint32_t offset = 0, number = 0; offset < b->size; offset += b->block_size, number++) {
+        uint32_t len = b->size - offset < b->block_size ? b->size - offset : b->block_size;
+        b->receiver.block(number, b->payload + offset, len, offset + len == b->size);
+    }
+    op_bytes = b->size;
+    snprintf(note, sizeof(note), "%" PRIu32 " KB", b->size / 1024);
+}
+
+/*
+ * A 1 kHz sensor random-walking over [0, 1000], recorded and published
+ * through the button's source as the scheduler's sampling does, while
+ * the loopback server observes it. Each operation is one sample;
+ * samples are paced a millisecond apart, untimed. `arrived` counts the
+ * notifications the server received, on its own thread.
+ */
+struct NotifyBench {
+    DataSource       *source;
+    const char       *query;
+    uint32_t          samples;      // over all runs
+    int32_t           value;
+    uint32_t          state;
+    uint64_t          next_us;
+    uint64_t          start_us;
+    volatile uint32_t arrived;
+
+    NotifyBench(DataSource *s) : source(s), query(""), samples(0), value(500), state(host_seed() * 2654435761u | 1),
+                                 next_us(0), start_us(0), arrived(0) {}
+};
+
+static void notification_arrived(void *context, const LwM2MServer::Exchange &exchange) {
+    if (exchange.notification) {
+        ((NotifyBench*)context)->arrived++;
+    }
+}
+
+static void notify_pace(void *context, uint32_t i) {
+    NotifyBench *b = (NotifyBench*)context;
+    if (i == 0) {
+        b->source->set_notify_attributes("", b->query);
+        b->value = 500;
+        b->next_us = host_now_us();
+        b->start_us = b->next_us;
+        b->arrived = 0;
+    }
+    uint64_t now = host_now_us();
+    if (now < b->next_us) {
+        wait_us((int)(b->next_us - now));
+    }
+    b->next_us += 1000;
+}
+
+static void notify_sample(void *context, uint32_t i) {
+    NotifyBench *b = (NotifyBench*)context;
+    b->value += (int32_t)(host_random(b->state) % 17) - 8;
+    b->value = b->value < 0 ? 0 : b->value > 1000 ? 1000 : b->value;
+    b->source->record_data(0, b->value);
+    b->source->publish();
+    if (i == b->samples - 1) {
+        double seconds = (host_now_us() - b->start_us) / 1e6;
+        snprintf(note, sizeof(note), "%.2f arrived/s", b->arrived / seconds);
+    }
+}
+
+static void set_value(void *context, uint32_t i) {
+    static const uint8_t *values[] = { (const uint8_t*)"1234", (const uint8_t*)"1235" };
+    ((M2MResource*)context)->set_value(values[i & 1], 4);
+}
+
+#if TRACE_ENABLED
+// One event, and a drain of the ring every half ring so that it never
+// fills up and drops
+static void trace_instant(void * /*context*/, uint32_t i) {
+    static uint8_t buffer[TRACE_HEADER_SIZE + TRACE_RING_HEADER_SIZE * (TRACE_MAX_THREADS + 1) +
+                          TRACE_RECORD_SIZE * TRACE_RING_SIZE];
+    TRACE_INSTANT(TRACE_RECORD, i);
+    if ((i & (TRACE_RING_SIZE / 2 - 1)) == 0) {
+        Trace::instance().drain(buffer, sizeof(buffer));
+    }
+}
+#endif
+
+struct Registration {
+    std::string      uri;
+    bool             tcp;
+    M2MObjectList    objects;
+    uint32_t         failures;
+};
+
+// A new interface registers all the example's objects and de-registers
+static void register_cycle(void *context, uint32_t /*i*/) {
+    Registration *r = (Registration*)context;
+    Waiter waiter;
+    M2MInterface *interface = M2MInterfaceFactory::create_interface(waiter, "bench", "test", 100, 0, "",
+        r->tcp ? M2MInterface::TCP : M2MInterface::UDP, M2MInterface::LwIP_IPv4, "");
+    M2MSecurity *security = M2MInterfaceFactory::create_security(M2MSecurity::M2MServer);
+    security->set_resource_value(M2MSecurity::M2MServerUri, r->uri.c_str());
+    interface->register_object(security, r->objects);
+    if (!waiter.wait()) {
+        r->failures++;
+    }
+    interface->unregister_object(security);
+    if (!waiter.wait()) {
+        r->failures++;
+    }
+    delete interface;
+    delete security;
+}
+
+struct Update {
+    M2MInterface *interface;
+    Waiter       *waiter;
+    uint32_t      failures;
+};
+
+static void update_cycle(void *context, uint32_t /*i*/) {
+    Update *u = (Update*)context;
+    u->interface->update_registration(NULL, 100);
+    if (!u->waiter->wait()) {
+        u->failures++;
+    }
+}
+
+int main(int argc, char **argv) {
+    bool tcp = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--udp") == 0) {
+            tcp = false;
+        } else {
+            filter = argv[i];
+        }
+    }
+    setenv("MBED_HOST_SEED", "1", 0);
+    uptime.start();
+
+    LwM2MServer server(tcp);
+    SOCKET_MODE = tcp ? M2MInterface::TCP : M2MInterface::UDP;
+    printf("mbed Client host benchmarks, %s, seed %s\n", tcp ? "TCP" : "UDP", getenv("MBED_HOST_SEED"));
+    printf("%-28s %13s %13s %15s %9s\n", "benchmark", "median/op", "fastest/op", "runs x ops", "allocs/op");
+
+    Sources *sources;
+    std::string uri = server.uri();
+    M2MObjectList objects;
+    {
+        Quiet quiet;
+        sources = new Sources();
+        objects.push_back(mbed_client.create_device_object());
+        objects.push_back(sources->button.get_object());
+        objects.push_back(sources->accel.get_object());
+        objects.push_back(sources->sound.get_object());
+        objects.push_back(sources->temperature.get_object());
+        objects.push_back(sources->light.get_object());
+        objects.push_back(sources->distance.get_object());
+        objects.push_back(sources->all_data.get_object());
+
+        // The example's own client, registered as on a board, so that
+        // the sources publish what they sample
+        mbed_client.create_interface(uri.c_str(), NULL);
+        M2MSecurity *security = mbed_client.create_register_object();
+        mbed_client.set_register_object(security);
+        mbed_client.test_register(security, objects);
+        for (int i = 0; i < 500 && !mbed_client.register_successful(); i++) {
+            wait_ms(10);
+        }
+    }
+    if (!mbed_client.register_successful()) {
+        printf("Could not register with the server at %s\n", uri.c_str());
+        return 1;
+    }
+
+    // Sampling
+    bench("record_data/int", record_int, sources, 100000);
+    bench("record_data/float", record_float, sources, 100000);
+    bench("analog/sample_all", analog_sample, sources, 2000);
+    bench("accel/read_data", accel_read_data, sources, 10, true, accel_wait);
+#if TRACE_ENABLED
+    bench("trace/instant+drain", trace_instant, NULL, 100000);
+#endif
+    SampleBench sample;
+    bench("sample/sprintf+string", sample_sprintf, &sample, 1000000);
+    bench("sample/value", sample_value, &sample, 1000000);
+    bench("sample/format_value", sample_format, &sample, 1000000);
+    SeriesBench int_noise(SeriesBench::INT_NOISE), float_noise(SeriesBench::FLOAT_NOISE),
+                steady(SeriesBench::STEADY);
+    bench("timeseries/int_noise", series_append, &int_noise, 100000);
+    bench("timeseries/float_noise", series_append, &float_noise, 100000);
+    bench("timeseries/steady", series_append, &steady, 100000);
+    Rollup rollup;
+    bench("rollup/add", rollup_add, &rollup, 1000000);
+
+    // Paging through the whole history of a series
+    static const struct {
+        const char *name;
+        uint32_t    samples;
+        const char *query;
+        bool        rollup_only;
+        uint32_t    count;
+    } queries[] = {
+        { "query/1k/raw", 1000, "", false, 1000 },
+        { "query/1k/res=60s,rollup", 1000, "&res=60000&fn=avg", true, 10000 },
+        { "query/10k/raw", 10000, "", false, 100 },
+        { "query/10k/res=60s", 10000, "&res=60000&fn=avg", false, 100 },
+        { "query/100k/raw", 100000, "", false, 10 },
+        { "query/100k/res=60s", 100000, "&res=60000&fn=avg", false, 10 },
+        { "query/100k/res=10min,count", 100000, "&res=600000&fn=count", false, 10 },
+    };
+    QueryBench *history = NULL;
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        if (filter && !strstr(queries[q].name, filter)) {
+            continue;
+        }
+        if (!history || history->raw.size() != queries[q].samples) {
+            delete history;
+            history = new QueryBench(queries[q].samples);
+        }
+        history->query = queries[q].query;
+        history->rollup_only = queries[q].rollup_only;
+        bench(queries[q].name, query_pages, history, queries[q].count);
+    }
+    delete history;
+
+    // Moving big payloads: the history export out, block-wise PUTs in
+    if (!filter || strstr("export/4k_windows", filter)) {
+        ExportBench *b = new ExportBench();
+        std::vector<ExportSource*> export_sources;
+        static char names[EXPORT_SOURCES][DATA_SOURCE_ID_SIZE];
+        uint32_t lines = 0;
+        for (int n = 0; n < EXPORT_SOURCES; n++) {
+            snprintf(names[n], sizeof(names[n]), "%d", 33000 + n);
+            export_sources.push_back(new ExportSource(names[n]));
+            b->export_csv.add_data_source(export_sources.back());
+            lines += export_sources.back()->history("5600")->size();
+        }
+        bench("export/4k_windows", export_windows, b, 30);
+        // The windows must add up to what a single read returns
+        std::vector<uint8_t> whole(op_bytes + 1), windows;
+        uint32_t len = b->export_csv.read(0, &whole[0], whole.size());
+        for (uint32_t offset = 0, n = sizeof(b->window); n == sizeof(b->window); offset += n) {
+            n = b->export_csv.read(offset, b->window, sizeof(b->window));
+            windows.insert(windows.end(), b->window, b->window + n);
+        }
+        if (len != windows.size() || memcmp(&whole[0], &windows[0], len) != 0 ||
+            (uint32_t)std::count(windows.begin(), windows.end(), '\n') != lines) {
+            printf("export/4k_windows output differs from a single read\n");
+            wrong_output++;
+        }
+        for (size_t n = 0; n < export_sources.size(); n++) {
+            delete export_sources[n];
+        }
+        delete b;
+    }
+    {
+        static const uint32_t block_sizes[] = { 16, 64, 256, 1024 };
+        PutBench *b = new PutBench();
+        for (size_t s = 0; s < sizeof(block_sizes) / sizeof(block_sizes[0]); s++) {
+            char name[32];
+            snprintf(name, sizeof(name), "put/%" PRIu32 "B_blocks", block_sizes[s]);
+            b->block_size = block_sizes[s];
+            bench(name, put_blocks, b, 50);
+            if (filter && !strstr(name, filter)) {
+                continue;
+            }
+            // what was stored must be the payload
+            std::vector<uint8_t> stored(b->size);
+            b->storage.read(0, &stored[0], b->size);
+            if (b->receiver.state() != BlockReceiver::COMPLETE || b->sink.size() != b->size ||
+                memcmp(&stored[0], b->payload, b->size) != 0) {
+                printf("%s did not store the payload\n", name);
+                wrong_output++;
+            }
+        }
+        delete b;
+    }
+
+    // Serialization of all sources into alldata/0/json
+    static const char *formats[] = { "serialize/json", "serialize/senml+json", "serialize/senml+cbor", "serialize/tlv" };
+    for (int f = DataAggregator::FORMAT_JSON; f <= DataAggregator::FORMAT_TLV; f++) {
+        sources->all_data.set_format((DataAggregator::Format)f);
+        bench(formats[f], serialize_all, sources, 5000, true, change_all);
+    }
+    sources->all_data.set_format(DataAggregator::FORMAT_JSON);
+
+    // The JSON serializer before and after PayloadWriter, on the same values
+    Serializers serializers;
+    bench("serializer/std_string", serialize_string, &serializers, 100000);
+    bench("serializer/writer", serialize_writer, &serializers, 100000);
+    if (serializers.string_payload.size() != serializers.len ||
+        memcmp(serializers.string_payload.data(), serializers.buffer, serializers.len) != 0) {
+        printf("serializer/writer output differs from serializer/std_string\n");
+        wrong_output++;
+    }
+
+    // set_value, with and without a notification going out
+    M2MResource *button = sources->button.get_object()->object_instance()->resource("5501");
+    bench("set_value/unobserved", set_value, button, 100000);
+    std::string endpoint;
+    server.wait_for_registration(endpoint, 0);
+    uint32_t observation = server.observe(endpoint, "3200/0/5501", NULL, NULL);
+    for (int i = 0; i < 500 && button->observation_token().empty(); i++) {
+        wait_ms(1);
+    }
+    bench("set_value/observed", set_value, button, 20000);
+    server.stop_observing(observation);
+    button->set_observation_token(std::string());
+
+    // Notifications of a 1 kHz sensor that reach the server, by attributes
+    static const struct {
+        const char *name;
+        const char *query;
+    } attributes[] = {
+        { "notify/pmin=0", "pmin=0&pmax&gt&lt&st" },
+        { "notify/default", "pmin=1&pmax&gt&lt&st" },
+        { "notify/pmin=5", "pmin=5&pmax&gt&lt&st" },
+        { "notify/pmin=1,pmax=10,gt,lt", "pmin=1&pmax=10&gt=900&lt=100&st" },
+    };
+    NotifyBench notify(&sources->button);
+    notify.samples = BENCH_RUNS * 1000;
+    observation = server.observe(endpoint, "3200/0/5501", notification_arrived, &notify);
+    for (int i = 0; i < 500 && button->observation_token().empty(); i++) {
+        wait_ms(1);
+    }
+    for (size_t a = 0; a < sizeof(attributes) / sizeof(attributes[0]); a++) {
+        notify.query = attributes[a].query;
+        bench(attributes[a].name, notify_sample, &notify, 1000, true, notify_pace);
+    }
+    server.stop_observing(observation);
+    button->set_observation_token(std::string());
+    sources->button.set_notify_attributes("", "pmin=1&pmax&gt&lt&st");
+
+    // Registration round trips over the loopback
+    Registration registration;
+    registration.uri = uri;
+    registration.tcp = tcp;
+    registration.objects = objects;
+    registration.failures = 0;
+    bench("register+deregister", register_cycle, &registration, 50, false);
+
+    Waiter waiter;
+    Update update;
+    update.interface = M2MInterfaceFactory::create_interface(waiter, "bench-update", "test", 100, 0, "",
+        SOCKET_MODE, M2MInterface::LwIP_IPv4, "");
+    update.waiter = &waiter;
+    update.failures = 0;
+    M2MSecurity *security = M2MInterfaceFactory::create_security(M2MSecurity::M2MServer);
+    security->set_resource_value(M2MSecurity::M2MServerUri, uri.c_str());
+    update.interface->register_object(security, objects);
+    if (waiter.wait()) {
+        bench("registration_update", update_cycle, &update, 200, false);
+    }
+    if (registration.failures || update.failures) {
+        printf("%" PRIu32 " registration round trips failed\n", registration.failures + update.failures);
+    }
+    delete update.interface;
+    delete security;
+
+    {
+        Quiet quiet;
+        mbed_client.test_unregister();
+        wait_ms(100);
+    }
+    if (over_budget) {
+        printf("%" PRIu32 " benchmarks over their allocation budget\n", over_budget);
+    }
+    return registration.failures || update.failures || over_budget || wrong_output ? 1 : 0;
+}
@@ -0,0 +1,1176 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Functional checks of the client's building blocks on the host build.
+ * The example is compiled in unchanged, its main() renamed, so that its
+ * classes can be checked as the board runs them. Code written for the
+ * Cortex-M DSP instructions is built too, against host/cmsis.h.
+ *
+ * Usage: check [filter]
+ *
+ * Every check prints one line, ok or FAILED, with what it covered; the
+ * first few mismatches of a failing check are printed above it. The
+ * program fails if any check does. Random inputs follow MBED_HOST_SEED,
+ * which is 1 unless set, so runs see the same data.
+ */
+
+#define ADC_SUM_SMLAD 1
+
+#define main client_main
+#include "../main.cpp"
+#undef main
+
+#include <deque>
+#include <stdarg.h>
+#include <vector>
+
+// Mismatches printed per check; the rest are only counted
+#ifndef CHECK_REPORT_MAX
+#define CHECK_REPORT_MAX 10
+#endif
+
+typedef void (*Check)(char *summary, size_t size);
+
+static const char *filter = NULL;
+static uint32_t failures = 0;
+static uint32_t check_failures = 0;
+
+/*
+ * Counts a failure of the check running if `ok` is false, and prints
+ * the first CHECK_REPORT_MAX of them. Returns `ok`.
+ */
+static bool expect(bool ok, const char *format, ...) {
+    if (ok) {
+        return true;
+    }
+    if (check_failures++ < CHECK_REPORT_MAX) {
+        va_list args;
+        va_start(args, format);
+        printf("    ");
+        vprintf(format, args);
+        printf("\n");
+        va_end(args);
+    }
+    return false;
+}
+
+static void check(const char *name, Check run) {
+    if (filter && !strstr(name, filter)) {
+        return;
+    }
+    char summary[160] = "";
+    check_failures = 0;
+    run(summary, sizeof(summary));
+    printf("%-28s %-6s %s\n", name, check_failures ? "FAILED" : "ok", summary);
+    if (check_failures) {
+        failures++;
+    }
+}
+
+/*
+ * NOR flash in RAM whose power fails once a given number of bytes have
+ * been programmed or erased since power_on(). The program or erase under
+ * way stops at that byte, and every program or erase after it fails.
+ */
+class TornFlash: public LogStorage {
+public:
+    TornFlash(uint32_t size, uint32_t erase_size) : _data(size, 0xff), _erase_size(erase_size), _budget(0),
+        _failed(false) {}
+
+    void power_on(uint32_t budget) {
+        _budget = budget;
+        _failed = false;
+    }
+
+    bool failed() const {
+        return _failed;
+    }
+
+    virtual int read(uint32_t addr, void *buffer, uint32_t size) {
+        memcpy(buffer, &_data[addr], size);
+        return 0;
+    }
+    virtual int program(uint32_t addr, const void *buffer, uint32_t size) {
+        uint32_t n = spend(size);
+        const uint8_t *p = (const uint8_t*)buffer;
+        for (uint32_t i = 0; i < n; i++) {
+            _data[addr + i] &= p[i];
+        }
+        return n == size ? 0 : -1;
+    }
+    virtual int erase(uint32_t addr, uint32_t size) {
+        uint32_t n = spend(size);
+        memset(&_data[addr], 0xff, n);
+        return n == size ? 0 : -1;
+    }
+    virtual uint32_t size() const {
+        return (uint32_t)_data.size();
+    }
+    virtual uint32_t erase_size() const {
+        return _erase_size;
+    }
+
+private:
+    // How many of `size` bytes get written before the power fails
+    uint32_t spend(uint32_t size) {
+        if (_failed) {
+            return 0;
+        }
+        if (size > _budget) {
+            size = _budget;
+            _failed = true;
+        }
+        _budget -= size;
+        return size;
+    }
+
+    std::vector<uint8_t> _data;
+    uint32_t             _erase_size;
+    uint32_t             _budget;
+    bool                 _failed;
+};
+
+// Power failures the sample log goes through
+#ifndef CHECK_LOG_ROUNDS
+#define CHECK_LOG_ROUNDS 2000
+#endif
+
+// Longest mount() may take, in microseconds of the host
+#ifndef CHECK_LOG_MOUNT_US
+#define CHECK_LOG_MOUNT_US 10000
+#endif
+
+/*
+ * The sample log through CHECK_LOG_ROUNDS power failures, each at a
+ * random byte of whatever program or erase is under way: a chunk, a
+ * segment header, a seal, a consumed marker or a segment erase.
+ *
+ * Every round mounts the log as after a reboot, replays what it holds
+ * and appends records until the power fails. Records are numbered in
+ * order. A record is durable once the program of its chunk returned;
+ * every durable record must be replayed, in order, unless the ring
+ * overflowed and counted it as dropped. Records replayed before a power
+ * failure may come back after it, as delivery is at-least-once. mount()
+ * must take at most two reads per segment, for the header and consumed
+ * marker, plus one per chunk of the newest segment and three more.
+ */
+static void check_log_power_failures(char *summary, size_t size) {
+    static const uint32_t SEGMENT = 4096;
+    TornFlash flash(SAMPLE_LOG_SIZE, SEGMENT);
+    uint32_t segments = SAMPLE_LOG_SIZE / SEGMENT;
+    uint32_t read_limit = 2 * segments + SEGMENT / (SampleLog::CHUNK_RECORDS * sizeof(SampleLog::Record)) + 3;
+    uint32_t state = host_seed() * 2654435761u | 1;
+
+    std::deque<uint32_t> durable;   // not replayed yet, oldest first
+    uint32_t next = 1;
+    uint32_t delivered = 0;         // highest record replayed
+    uint32_t dropped = 0;
+    uint32_t reported_dropped = 0;
+    uint32_t torn = 0;
+    uint32_t replayed = 0;
+    uint32_t reads_max = 0;
+    uint64_t mount_us_max = 0;
+    for (uint32_t round = 0; round < CHECK_LOG_ROUNDS; round++) {
+        // Mostly long enough to fill a few chunks, at times to erase a
+        // segment or two
+        flash.power_on(host_random(state) % (round & 1 ? 2 * SEGMENT : SEGMENT / 2));
+        SampleLog log(flash);
+        uint64_t start = host_now_us();
+        log.mount();
+        uint64_t mount_us = host_now_us() - start;
+        mount_us_max = std::max(mount_us_max, mount_us);
+        reads_max = std::max(reads_max, log.stats().recovery_reads);
+        expect(log.stats().recovery_reads <= read_limit, "round %" PRIu32 ": mount took %" PRIu32 " reads",
+               round, log.stats().recovery_reads);
+        expect(mount_us <= CHECK_LOG_MOUNT_US, "round %" PRIu32 ": mount took %" PRIu64 " us", round, mount_us);
+        torn += log.stats().torn_chunks;
+
+        // Replay all of it, in batches of a few records
+        SampleLog::Record records[16];
+        uint16_t boot;
+        uint32_t n;
+        while (!flash.failed() && (n = log.read(records, 1 + host_random(state) % 16, &boot)) > 0) {
+            for (uint32_t i = 0; i < n; i++) {
+                uint32_t id = records[i].value;
+                if (id <= delivered) {
+                    continue;
+                }
+                while (!durable.empty() && durable.front() < id) {
+                    durable.pop_front();
+                    dropped++;
+                }
+                expect(!durable.empty() && durable.front() == id, "round %" PRIu32 ": replayed %" PRIu32
+                       " which was not written, or out of order", round, id);
+                if (!durable.empty() && durable.front() == id) {
+                    durable.pop_front();
+                }
+                delivered = id;
+                replayed++;
+            }
+            log.consume(n);
+        }
+        reported_dropped += log.stats().dropped_records;
+        if (flash.failed()) {
+            continue;
+        }
+        expect(durable.empty(), "round %" PRIu32 ": %u durable records from %" PRIu32 " on were not replayed",
+               round, (unsigned)durable.size(), durable.empty() ? 0 : durable.front());
+        dropped += durable.size();
+        durable.clear();
+
+        // Append until the power fails, flushing at times
+        uint32_t buffered = 0;
+        while (!flash.failed()) {
+            SampleLog::Record r;
+            r.object = 3303;
+            r.resource = 5700 | SampleLog::FLOAT_VALUE;
+            r.timestamp = next * 1000;
+            r.value = next++;
+            buffered++;
+            int ret = log.append(r);
+            if (buffered < SampleLog::CHUNK_RECORDS && host_random(state) % 16 == 0) {
+                ret = log.flush();
+            } else if (buffered < SampleLog::CHUNK_RECORDS) {
+                continue;
+            }
+            // The chunk made it even if the power failed on the seal
+            // after it
+            for (uint32_t id = next - buffered; ret == 0 && id < next; id++) {
+                durable.push_back(id);
+            }
+            buffered = 0;
+        }
+    }
+    expect(dropped <= reported_dropped, "%" PRIu32 " records lost, %" PRIu32 " reported dropped", dropped,
+           reported_dropped);
+    expect(torn > 0, "no chunk was ever torn");
+    snprintf(summary, size, "%d power failures, %" PRIu32 " replayed, %" PRIu32 " torn chunks, mount <= %" PRIu32
+             " reads, %" PRIu64 " us", CHECK_LOG_ROUNDS, replayed, torn, reads_max, mount_us_max);
+}
+
+/*
+ * Flash regions on a target with 128 KB sectors, like the top of the
+ * flash of NUCLEO_F429ZI and UBLOX_EVK_ODIN_W2. Regions grow to whole,
+ * aligned sectors and stay clear of the application image; the sample
+ * log refuses to mount on a single sector and works on two.
+ */
+static void check_log_large_sectors(char *summary, size_t size) {
+    static const uint32_t SECTOR = 128 * 1024;
+    char sector[16];
+    snprintf(sector, sizeof(sector), "%" PRIu32, SECTOR);
+    setenv("MBED_HOST_FLASH_SECTOR", sector, 1);
+    {
+        FlashIAPLogStorage small(32 * 1024);
+        expect(small.ok() && small.size() == SECTOR && small.erase_size() == SECTOR &&
+               small.start() == HOST_FLASH_SIZE - SECTOR,
+               "32 KB region: %" PRIu32 " bytes at %" PRIu32 ", erase size %" PRIu32, small.size(), small.start(),
+               small.erase_size());
+        SampleLog refused(small);
+        SampleLog::Record r = { 3303, 5700, 1000, 1 };
+        expect(refused.mount() != 0, "log mounted on a single sector");
+        expect(refused.append(r) == 0 && refused.flush() != 0, "log on a single sector took a chunk");
+
+        FlashIAPLogStorage log_storage(SECTOR + 1);
+        FlashIAPLogStorage upload(256 * 1024, &log_storage);
+        FlashIAPLogStorage overlap(HOST_FLASH_SIZE, &log_storage);
+        expect(log_storage.size() == 2 * SECTOR && log_storage.start() % SECTOR == 0,
+               "region of a sector and a byte: %" PRIu32 " bytes at %" PRIu32, log_storage.size(), log_storage.start());
+        expect(upload.ok() && upload.start() == log_storage.start() - 256 * 1024 && upload.start() % SECTOR == 0,
+               "region below: %" PRIu32 " bytes at %" PRIu32, upload.size(), upload.start());
+        expect(!overlap.ok() && overlap.size() == 0, "region over the application image: %" PRIu32 " bytes at %" PRIu32,
+               overlap.size(), overlap.start());
+
+        SampleLog log(log_storage);
+        expect(log.mount() == 0 && log.stats().segments == 2, "log on two sectors: %" PRIu32 " segments",
+               log.stats().segments);
+        for (uint32_t i = 0; i < 3 * SampleLog::CHUNK_RECORDS; i++) {
+            r.value = i;
+            log.append(r);
+        }
+        SampleLog again(log_storage);
+        again.mount();
+        SampleLog::Record records[4 * SampleLog::CHUNK_RECORDS];
+        uint16_t boot;
+        uint32_t n = again.read(records, 4 * SampleLog::CHUNK_RECORDS, &boot);
+        expect(n == 3 * SampleLog::CHUNK_RECORDS && records[n - 1].value == n - 1,
+               "log on two sectors replayed %" PRIu32 " records", n);
+        log_storage.erase(0, log_storage.size());
+    }
+    unsetenv("MBED_HOST_FLASH_SECTOR");
+    snprintf(summary, size, "32 KB takes a sector and is refused, two sectors replay, overlap refused");
+}
+
+// Task sets the scheduler check runs, for CHECK_SCHEDULER_SECONDS each
+#ifndef CHECK_SCHEDULER_SETS
+#define CHECK_SCHEDULER_SETS 300
+#endif
+#ifndef CHECK_SCHEDULER_SECONDS
+#define CHECK_SCHEDULER_SECONDS 20
+#endif
+
+/*
+ * A task of the scheduler check, and the deadlines it expects: the
+ * check keeps its own copy of every task's next absolute deadline.
+ */
+struct SimTask {
+    uint32_t period_ms;
+    uint32_t phase_ms;
+    uint32_t work_us;           // the simulated clock advances this much per run
+    uint64_t deadline_us;       // next, from the start of the run
+    uint32_t runs;
+    uint32_t overruns;
+    uint64_t late_max_us;
+    uint64_t late_limit_us;
+};
+
+static uint64_t sim_now_us;
+static SimTask *sim_tasks;
+static uint16_t sim_count;
+static uint32_t sim_runs_in_call;
+
+static uint64_t sim_clock() {
+    return sim_now_us;
+}
+
+// Checks the task is due and none due has an earlier deadline, then works
+static void sim_task(void *context) {
+    SimTask *t = (SimTask*)context;
+    expect(t->deadline_us <= sim_now_us, "task of %" PRIu32 " ms ran at %" PRIu64 " us, due at %" PRIu64,
+           t->period_ms, sim_now_us, t->deadline_us);
+    for (uint16_t i = 0; i < sim_count; i++) {
+        const SimTask &u = sim_tasks[i];
+        expect(&u == t || u.deadline_us > sim_now_us || u.deadline_us >= t->deadline_us,
+               "task of %" PRIu32 " ms due at %" PRIu64 " us ran before one of %" PRIu32 " ms due at %" PRIu64,
+               t->period_ms, t->deadline_us, u.period_ms, u.deadline_us);
+    }
+    uint64_t late = sim_now_us - t->deadline_us;
+    t->late_max_us = std::max(t->late_max_us, late);
+    expect(late <= t->late_limit_us, "task of %" PRIu32 " ms ran %" PRIu64 " us late, limit %" PRIu64,
+           t->period_ms, late, t->late_limit_us);
+    sim_now_us += t->work_us;
+    t->runs++;
+    sim_runs_in_call++;
+
+    uint64_t period = (uint64_t)t->period_ms * 1000;
+    t->deadline_us += period;
+    if (t->deadline_us <= sim_now_us) {
+        uint64_t missed = (sim_now_us - t->deadline_us) / period + 1;
+        t->deadline_us += missed * period;
+        t->overruns += (uint32_t)missed;
+    }
+}
+
+/*
+ * The scheduler on a simulated clock, with CHECK_SCHEDULER_SETS random
+ * sets of 2 to 8 tasks that want from half to twice the time there is.
+ * The first set is the board's kind of load plus a task that alone wants
+ * more than all of it. Each run of a task takes a fixed time, and the
+ * caller sleeps as long as run() says.
+ *
+ * Deadlines are absolute: a task's k-th deadline is phase + k * period.
+ * Every run must start once its task is due, with no task due with an
+ * earlier deadline waiting. Runs are not preempted, and a task that
+ * has run is not due again before its next deadline, so while a task
+ * waits every other task runs at most once: it may start at most the
+ * other tasks' work, plus the millisecond of rounding of the sleep,
+ * late. A task whose period is longer than that plus its own work
+ * therefore never misses a deadline, however overloaded the rest. Runs
+ * plus overruns must count every deadline that passed, the scheduler's
+ * statistics must agree with the check's, and run() must return after
+ * running each task at most once.
+ */
+static void check_scheduler_overload(char *summary, size_t size) {
+    uint32_t state = host_seed() * 2654435761u | 1;
+    uint32_t runs = 0;
+    uint32_t overruns = 0;
+    uint32_t calls = 0;
+    uint32_t light = 0;
+    double worst = 0;           // lateness, as a share of its limit
+    for (uint32_t set = 0; set < CHECK_SCHEDULER_SETS; set++) {
+        SimTask tasks[8];
+        memset(tasks, 0, sizeof(tasks));
+        uint16_t count;
+        if (set == 0) {
+            static const uint32_t board[][3] = {
+                { 20, 0, 200 }, { 100, 7, 1000 }, { 1000, 13, 5000 }, { 10000, 29, 2000 }, { 50, 3, 80000 }
+            };
+            count = sizeof(board) / sizeof(board[0]);
+            for (uint16_t i = 0; i < count; i++) {
+                tasks[i].period_ms = board[i][0];
+                tasks[i].phase_ms = board[i][1];
+                tasks[i].work_us = board[i][2];
+            }
+        } else {
+            count = 2 + host_random(state) % 7;
+            double load = 0.5 + (host_random(state) % 1501) / 1000.0;
+            double shares[8];
+            double total = 0;
+            for (uint16_t i = 0; i < count; i++) {
+                tasks[i].period_ms = 1 + host_random(state) % 200;
+                tasks[i].phase_ms = host_random(state) % 50;
+                shares[i] = 1 + host_random(state) % 100;
+                total += shares[i];
+            }
+            for (uint16_t i = 0; i < count; i++) {
+                tasks[i].work_us = (uint32_t)(load * shares[i] / total * tasks[i].period_ms * 1000);
+            }
+        }
+        uint64_t work = 0;
+        for (uint16_t i = 0; i < count; i++) {
+            work += tasks[i].work_us;
+        }
+        Scheduler scheduler(sim_clock);
+        sim_now_us = 0;
+        sim_tasks = tasks;
+        sim_count = count;
+        for (uint16_t i = 0; i < count; i++) {
+            SimTask &t = tasks[i];
+            t.deadline_us = (uint64_t)t.phase_ms * 1000;
+            t.late_limit_us = work - t.work_us + 999;
+            scheduler.add("sim", sim_task, &t, t.period_ms, t.phase_ms);
+        }
+        while (sim_now_us < (uint64_t)CHECK_SCHEDULER_SECONDS * 1000000) {
+            sim_runs_in_call = 0;
+            uint32_t sleep_ms = scheduler.run();
+            calls++;
+            expect(sim_runs_in_call <= count, "one call to run() ran %" PRIu32 " tasks of %u", sim_runs_in_call,
+                   count);
+            sim_now_us += (uint64_t)sleep_ms * 1000;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            const SimTask &t = tasks[i];
+            const Scheduler::TaskStats &s = scheduler.task_stats(i);
+            uint64_t period = (uint64_t)t.period_ms * 1000;
+            expect(s.runs == t.runs && s.overruns == t.overruns && s.late_max_us == t.late_max_us,
+                   "set %" PRIu32 " task %u: scheduler counts %" PRIu32 " runs, %" PRIu32 " overruns, %" PRIu32
+                   " us late; the check %" PRIu32 ", %" PRIu32 ", %" PRIu64, set, i, s.runs, s.overruns,
+                   s.late_max_us, t.runs, t.overruns, t.late_max_us);
+            expect((t.deadline_us - (uint64_t)t.phase_ms * 1000) % period == 0 &&
+                   (t.deadline_us - (uint64_t)t.phase_ms * 1000) / period == t.runs + t.overruns,
+                   "set %" PRIu32 " task %u: %" PRIu32 " runs and %" PRIu32 " overruns for deadlines up to %" PRIu64,
+                   set, i, t.runs, t.overruns, t.deadline_us);
+            if (period > t.late_limit_us + t.work_us) {
+                light++;
+                expect(t.overruns == 0, "set %" PRIu32 " task %u of %" PRIu32 " ms: %" PRIu32 " overruns", set, i,
+                       t.period_ms, t.overruns);
+            }
+            worst = std::max(worst, (double)t.late_max_us / t.late_limit_us);
+            runs += t.runs;
+            overruns += t.overruns;
+        }
+    }
+    snprintf(summary, size, "%d task sets, %" PRIu32 " runs, %" PRIu32 " overruns, %" PRIu32 " tasks with room "
+             "never late, lateness <= %.0f%% of limit", CHECK_SCHEDULER_SETS, runs, overruns, light, worst * 100);
+}
+
+// Random bursts adc_sum() is checked with, besides the edge cases
+#ifndef CHECK_ADC_VECTORS
+#define CHECK_ADC_VECTORS 2000
+#endif
+
+typedef uint32_t (*AdcSum)(const uint16_t *samples, uint32_t count);
+
+static const struct {
+    const char *name;
+    AdcSum      sum;
+} adc_sums[] = {
+    { "smlad", adc_sum_smlad },
+#if defined(__SSE2__)
+    { "sse2", adc_sum_sse2 },
+#endif
+};
+
+// Fills `samples` with one of the patterns adc_sum() is checked with
+static void adc_pattern(uint16_t *samples, uint32_t count, uint32_t pattern, uint32_t &state) {
+    for (uint32_t i = 0; i < count; i++) {
+        switch (pattern) {
+            case 0: samples[i] = 0; break;
+            case 1: samples[i] = 0xffff; break;
+            case 2: samples[i] = 0x8000; break;
+            case 3: samples[i] = 0x7fff; break;
+            case 4: samples[i] = i & 1 ? 0xffff : 0; break;
+            default: samples[i] = (uint16_t)host_random(state); break;
+        }
+    }
+}
+
+// Checks every variant of adc_sum() against the scalar reference
+static void adc_compare(const uint16_t *samples, uint32_t count, const char *what) {
+    uint32_t expected = adc_sum_scalar(samples, count);
+    for (size_t v = 0; v < sizeof(adc_sums) / sizeof(adc_sums[0]); v++) {
+        uint32_t got = adc_sums[v].sum(samples, count);
+        expect(got == expected, "%s of %s, %" PRIu32 " samples at +%u: %" PRIu32 ", expected %" PRIu32,
+               adc_sums[v].name, what, count, (unsigned)((uintptr_t)samples & 15), got, expected);
+    }
+}
+
+/*
+ * adc_sum() and its vector variants, SMLAD on a model of the instruction
+ * and SSE2, against the scalar reference. Every length from 0 to 17 and
+ * around the multiples of the vector widths up to 65536, at every
+ * alignment, is summed for all-zero, full-scale, mid-scale and
+ * alternating bursts and random ones, then CHECK_ADC_VECTORS random
+ * bursts of random length.
+ */
+static void check_adc_sum(char *summary, size_t size) {
+    static const uint32_t lengths[] = { 255, 256, 257, 4095, 4096, 4097, 65534, 65535, 65536 };
+    static const char *patterns[] = { "zeros", "full scale", "0x8000", "0x7fff", "0 and 0xffff", "random" };
+    static uint16_t buffer[65536 + 8];
+    uint32_t state = host_seed() * 2654435761u | 1;
+    uint32_t vectors = 0;
+    for (uint32_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        for (uint32_t offset = 0; offset < 8; offset++) {
+            for (uint32_t count = 0; count <= 17; count++) {
+                adc_pattern(buffer + offset, count, p, state);
+                adc_compare(buffer + offset, count, patterns[p]);
+                vectors++;
+            }
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+                adc_pattern(buffer + offset, lengths[l], p, state);
+                adc_compare(buffer + offset, lengths[l], patterns[p]);
+                vectors++;
+            }
+        }
+    }
+    for (uint32_t n = 0; n < CHECK_ADC_VECTORS; n++) {
+        // half of them bursts of the usual size, the rest up to the limit
+        uint32_t count = host_random(state) % (n & 1 ? 65537 : 257);
+        uint32_t offset = host_random(state) % 8;
+        uint32_t pattern = host_random(state) % 4 ? 5 : host_random(state) % 5;
+        adc_pattern(buffer + offset, count, pattern, state);
+        adc_compare(buffer + offset, count, patterns[pattern]);
+        vectors++;
+    }
+    snprintf(summary, size, "%" PRIu32 " bursts of 0 to 65536 samples at every alignment, %u variants",
+             vectors, (unsigned)(sizeof(adc_sums) / sizeof(adc_sums[0])));
+}
+
+// Random sample runs the rollup check feeds, and queries after each
+#ifndef CHECK_ROLLUP_RUNS
+#define CHECK_ROLLUP_RUNS 40
+#endif
+#ifndef CHECK_ROLLUP_QUERIES
+#define CHECK_ROLLUP_QUERIES 50
+#endif
+
+// What one tier of a Rollup should hold, summed in double precision
+struct RollupModel {
+    uint32_t start;
+    uint32_t count;
+    float    min;
+    float    max;
+    double   sum;
+    float    last;
+};
+
+struct RollupSample {
+    uint32_t timestamp;
+    float    value;
+};
+
+static void rollup_model_add(std::vector<RollupModel> &model, uint32_t width, uint32_t timestamp, float value) {
+    uint32_t start = timestamp - timestamp % width;
+    if (model.empty() || model.back().start != start) {
+        RollupModel b = { start, 0, value, value, 0, value };
+        model.push_back(b);
+    }
+    RollupModel &b = model.back();
+    b.count++;
+    b.min = value < b.min ? value : b.min;
+    b.max = value > b.max ? value : b.max;
+    b.sum += value;
+    b.last = value;
+}
+
+// Buckets of `tier` the rollup should still hold: the ring and the open one
+static size_t rollup_held(const std::vector<RollupModel> &model, Rollup::Tier tier) {
+    size_t ring = tier == Rollup::MINUTES ? ROLLUP_MINUTE_BUCKETS : ROLLUP_HOUR_BUCKETS;
+    return model.size() < ring + 1 ? model.size() : ring + 1;
+}
+
+// Checks every bucket of `tier` against the model, oldest first
+static void rollup_compare(const Rollup &rollup, Rollup::Tier tier, const std::vector<RollupModel> &model,
+                           uint32_t now) {
+    static const char *names[] = { "minutes", "hours" };
+    size_t held = rollup_held(model, tier);
+    if (!expect(rollup.size(tier) == held, "%s at %" PRIu32 ": %u buckets, expected %u",
+                names[tier], now, (unsigned)rollup.size(tier), (unsigned)held)) {
+        return;
+    }
+    for (size_t i = 0; i < held; i++) {
+        const RollupModel &m = model[model.size() - held + i];
+        Rollup::Bucket b = rollup.bucket(tier, (uint16_t)i);
+        expect(b.start == m.start && b.count == m.count && b.min == m.min && b.max == m.max &&
+               b.sum == (float)m.sum && b.last == m.last,
+               "%s at %" PRIu32 ", bucket %u: start %" PRIu32 " count %" PRIu32 " min %g max %g sum %g last %g, "
+               "expected start %" PRIu32 " count %" PRIu32 " min %g max %g sum %g last %g",
+               names[tier], now, (unsigned)i, b.start, b.count, b.min, b.max, b.sum, b.last,
+               m.start, m.count, m.min, m.max, (float)m.sum, m.last);
+    }
+}
+
+/*
+ * Runs one query over `raw` and `rollup` and checks the source it picked
+ * and its rows against the models: the raw samples still held, else the
+ * finest tier whose width divides res and that reaches back to start,
+ * else the tier reaching furthest back if it beats the raw samples.
+ */
+static void rollup_query(const TimeSeries &raw, const Rollup &rollup, const std::vector<RollupSample> &samples,
+                         const std::vector<RollupModel> *models, const char *query, uint32_t *sources) {
+    static const char *names[] = { "raw", "minutes", "hours" };
+    static const char *functions[] = { "avg", "min", "max", "sum", "count", "last" };
+    HistoryQuery q;
+    uint32_t start = 0, end = 0xffffffff, res = 0;
+    char fn[8] = "avg";
+    const char *p;
+    if ((p = strstr(query, "start="))) start = strtoul(p + 6, NULL, 10);
+    if ((p = strstr(query, "end="))) end = strtoul(p + 4, NULL, 10);
+    if ((p = strstr(query, "res="))) res = strtoul(p + 4, NULL, 10);
+    if ((p = strstr(query, "fn="))) sscanf(p + 3, "%7[a-z]", fn);
+    if (!expect(q.parse(query), "%s: not parsed", query)) {
+        return;
+    }
+    int f = 0;
+    while (strcmp(fn, functions[f]) != 0) {
+        f++;
+    }
+
+    // Which source should answer, and what it holds
+    uint32_t raw_oldest = raw.size() ? raw.oldest_timestamp() : 0xffffffff;
+    int source = -1;
+    if (res && raw_oldest > start) {
+        uint32_t oldest = raw_oldest;
+        for (int t = 0; t < Rollup::TIER_COUNT; t++) {
+            Rollup::Tier tier = (Rollup::Tier)t;
+            if (res % Rollup::width(tier) || models[t].empty()) {
+                continue;
+            }
+            uint32_t tier_oldest = models[t][models[t].size() - rollup_held(models[t], tier)].start;
+            if (tier_oldest <= start) {
+                source = t;
+                break;
+            }
+            if (tier_oldest < oldest || (source >= 0 && tier_oldest == oldest)) {
+                source = t;
+                oldest = tier_oldest;
+            }
+        }
+    }
+    std::vector<RollupModel> items;
+    if (source < 0) {
+        for (size_t i = 0; i < samples.size(); i++) {
+            if (samples[i].timestamp >= raw_oldest) {
+                RollupModel item = { samples[i].timestamp, 1, samples[i].value, samples[i].value,
+                                     samples[i].value, samples[i].value };
+                items.push_back(item);
+            }
+        }
+    } else {
+        const std::vector<RollupModel> &model = models[source];
+        for (size_t i = model.size() - rollup_held(model, (Rollup::Tier)source); i < model.size(); i++) {
+            RollupModel item = model[i];
+            item.sum = (float)item.sum;
+            items.push_back(item);
+        }
+    }
+
+    // The rows expected, one per res bucket, or per sample without res
+    // A rollup bucket that began before start but reaches past it counts
+    uint32_t width = source < 0 ? 1 : Rollup::width((Rollup::Tier)source);
+    std::vector<std::pair<uint32_t, double> > rows;
+    for (size_t i = 0; i < items.size(); i++) {
+        const RollupModel &item = items[i];
+        if ((item.start < start && start - item.start >= width) || item.start >= end) {
+            continue;
+        }
+        uint32_t bucket = res ? item.start - item.start % res : item.start;
+        size_t j = i;
+        uint32_t count = 0;
+        double min = item.min, max = item.max, sum = 0, last = 0;
+        while (j < items.size() && items[j].start < end &&
+               (j == i || (res && items[j].start - items[j].start % res == bucket))) {
+            count += items[j].count;
+            min = items[j].min < min ? items[j].min : min;
+            max = items[j].max > max ? items[j].max : max;
+            sum += items[j].sum;
+            last = items[j].last;
+            j++;
+        }
+        double v;
+        switch (res ? f : 5) {
+            case 1:  v = min; break;
+            case 2:  v = max; break;
+            case 3:  v = sum; break;
+            case 4:  v = count; break;
+            case 5:  v = last; break;
+            default: v = sum / count; break;
+        }
+        rows.push_back(std::make_pair(bucket < start ? start : bucket, v));
+        i = j - 1;
+    }
+
+    static uint8_t buffer[16384];
+    PayloadWriter out(buffer, sizeof(buffer) - 1);
+    q.encode(&raw, &rollup, out, sizeof(buffer) - 1);
+    if (!expect(!out.overflowed(), "%s: %u bytes", query, (unsigned)out.size())) {
+        return;
+    }
+    buffer[out.size()] = '\0';
+    char prefix[40];
+    snprintf(prefix, sizeof(prefix), "{\"source\":\"%s\",\"rows\":[", names[source + 1]);
+    if (!expect(strncmp((const char *)buffer, prefix, strlen(prefix)) == 0, "%s: %.60s, expected source %s",
+                query, buffer, names[source + 1])) {
+        return;
+    }
+    sources[source + 1]++;
+    const char *text = (const char *)buffer + strlen(prefix);
+    for (size_t r = 0; r < rows.size(); r++) {
+        unsigned long t;
+        double v;
+        int used = 0;
+        if (!expect(sscanf(text, r ? ",[%lu,%lf]%n" : "[%lu,%lf]%n", &t, &v, &used) == 2 && used,
+                    "%s: row %u missing at \"%.40s\", expected [%" PRIu32 ",%g]",
+                    query, (unsigned)r, text, rows[r].first, rows[r].second)) {
+            return;
+        }
+        double tolerance = 0.0005 + fabs(rows[r].second) * 1e-6;
+        expect(t == rows[r].first && fabs(v - rows[r].second) <= tolerance, "%s: row %u is [%lu,%.4f], expected [%"
+               PRIu32 ",%.4f]", query, (unsigned)r, t, v, rows[r].first, rows[r].second);
+        text += used;
+    }
+    expect(strcmp(text, "]}") == 0, "%s: \"%.40s\" after %u rows", query, text, (unsigned)rows.size());
+}
+
+/*
+ * Rollup tiers and the history queries they answer. Buckets must split
+ * exactly at 60000 and 3600000 ms. Then CHECK_ROLLUP_RUNS random runs of
+ * up to three days, sampled every 250 ms to every ten minutes with gaps
+ * of up to five hours, so that both rings wrap and many buckets stay
+ * empty, are compared bucket by bucket against a model after every
+ * minute. After each run CHECK_ROLLUP_QUERIES random queries, most of
+ * them reaching back past the few minutes of raw samples kept, check
+ * which tier answered and every row it returned.
+ */
+static void check_rollup(char *summary, size_t size) {
+    static const uint32_t periods[] = { 250, 1000, 10000, 59999, 60000, 61000, 600000 };
+    static const uint32_t resolutions[] = { 0, 60000, 120000, 300000, 3600000, 7200000, 86400000 };
+    static const char *functions[] = { "avg", "min", "max", "sum", "count", "last" };
+
+    // Edges: 59999 and 60000 ms in different minutes, 3599999 and 3600000 in different hours
+    {
+        static const uint32_t edges[] = { 0, 59999, 60000, 3599999, 3600000 };
+        static const uint32_t minute_starts[] = { 0, 60000, 3540000, 3600000 };
+        Rollup rollup;
+        for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+            rollup.add(edges[i], (float)i);
+        }
+        bool ok = rollup.size(Rollup::MINUTES) == 4 && rollup.size(Rollup::HOURS) == 2 &&
+                  rollup.bucket(Rollup::HOURS, 0).count == 4 && rollup.bucket(Rollup::HOURS, 1).start == 3600000;
+        for (uint16_t i = 0; ok && i < 4; i++) {
+            ok = rollup.bucket(Rollup::MINUTES, i).start == minute_starts[i] &&
+                 rollup.bucket(Rollup::MINUTES, i).count == (i == 0 ? 2u : 1u);
+        }
+        expect(ok, "samples at 0, 59999, 60000, 3599999 and 3600000 ms bucketed wrongly");
+    }
+
+    uint32_t state = host_seed() * 2654435761u | 1;
+    uint32_t samples_fed = 0, minute_wraps = 0, hour_wraps = 0, empty = 0;
+    uint32_t sources[3] = { 0, 0, 0 };
+    for (uint32_t run = 0; run < CHECK_ROLLUP_RUNS; run++) {
+        Rollup rollup;
+        TimeSeries raw(TimeSeries::FLOAT, 4, 64);
+        std::vector<RollupModel> models[Rollup::TIER_COUNT];
+        std::vector<RollupSample> samples;
+        uint32_t period = periods[run % (sizeof(periods) / sizeof(periods[0]))];
+        uint32_t first = host_random(state) % 7200000;
+        uint32_t last = first + 3 * 86400000u - host_random(state) % 86400000u;
+        uint32_t samples_max = 200000;
+        float value = 20;
+        for (uint32_t t = first; t < last && samples.size() < samples_max; t += period) {
+            if (host_random(state) % 500 == 0) {
+                t += host_random(state) % (5 * 3600000);
+            }
+            value += (float)((int32_t)(host_random(state) % 2001) - 1000) / 1000;
+            RollupSample s = { t, value };
+            bool new_minute = !models[0].empty() && models[0].back().start != t - t % 60000;
+            if (new_minute) {
+                rollup_compare(rollup, Rollup::MINUTES, models[0], t);
+                rollup_compare(rollup, Rollup::HOURS, models[1], t);
+            }
+            rollup.add(t, value);
+            raw.append(t, value);
+            samples.push_back(s);
+            for (int tier = 0; tier < Rollup::TIER_COUNT; tier++) {
+                rollup_model_add(models[tier], Rollup::width((Rollup::Tier)tier), t, value);
+            }
+        }
+        rollup_compare(rollup, Rollup::MINUTES, models[0], last);
+        rollup_compare(rollup, Rollup::HOURS, models[1], last);
+        samples_fed += samples.size();
+        minute_wraps += models[0].size() > ROLLUP_MINUTE_BUCKETS + 1;
+        hour_wraps += models[1].size() > ROLLUP_HOUR_BUCKETS + 1;
+        empty += (samples.back().timestamp / 60000 - samples.front().timestamp / 60000 + 1) - models[0].size();
+
+        // starts from an hour before the first sample to the newest
+        uint32_t newest = samples.back().timestamp;
+        uint32_t oldest = first > 3600000 ? first - 3600000 : 0;
+        for (uint32_t n = 0; n < CHECK_ROLLUP_QUERIES; n++) {
+            uint32_t start = newest - host_random(state) % (newest - oldest + 1);
+            uint32_t end = start + 1 + host_random(state) % (newest - start + 3600000);
+            char query[80];
+            snprintf(query, sizeof(query), "start=%" PRIu32 "&end=%" PRIu32 "&res=%" PRIu32 "&fn=%s", start, end,
+                     resolutions[host_random(state) % (sizeof(resolutions) / sizeof(resolutions[0]))],
+                     functions[host_random(state) % (sizeof(functions) / sizeof(functions[0]))]);
+            rollup_query(raw, rollup, samples, models, query, sources);
+        }
+    }
+    snprintf(summary, size, "%" PRIu32 " samples in %d runs, %" PRIu32 "/%" PRIu32 " minute/hour rings wrapped, %"
+             PRIu32 " empty minutes, %" PRIu32 "/%" PRIu32 "/%" PRIu32 " raw/minute/hour queries",
+             samples_fed, CHECK_ROLLUP_RUNS, minute_wraps, hour_wraps, empty, sources[0], sources[1], sources[2]);
+}
+
+// Float pairs the same_text check compares
+#ifndef CHECK_SAME_TEXT_PAIRS
+#define CHECK_SAME_TEXT_PAIRS 1000000
+#endif
+
+/*
+ * SampleValue::same_text() against the text format_value() prints: two
+ * floats are the same text exactly when their texts match. Pairs are a
+ * float and one a few ulps or thousandths away, at magnitudes from 1e-4
+ * to 1e38, where thousandths no longer fit an int32_t, and the edges:
+ * a million, NaN and the infinities.
+ */
+static void check_same_text(char *summary, size_t size) {
+    static const float edges[] = { 999999.9f, 1e6f, 1e6f + 0.0625f, 2.2e6f, 3e9f, -3e9f, 1e38f, NAN, INFINITY,
+                                   -INFINITY, 0.0005f, 0.0015f, -0.0005f };
+    size_t edge_count = sizeof(edges) / sizeof(edges[0]);
+    uint32_t state = host_seed() * 2654435761u | 1;
+    uint32_t same = 0;
+    for (uint32_t n = 0; n < CHECK_SAME_TEXT_PAIRS + edge_count * edge_count; n++) {
+        float a, b;
+        if (n < edge_count * edge_count) {
+            a = edges[n / edge_count];
+            b = edges[n % edge_count];
+        } else {
+            a = (float)((host_random(state) % 20000) - 10000) * powf(10, (float)(host_random(state) % 42) - 4) / 1000;
+            uint32_t bits;
+            memcpy(&bits, &a, sizeof(bits));
+            if (host_random(state) & 1) {
+                bits += host_random(state) % 5 - 2;
+                memcpy(&b, &bits, sizeof(b));
+            } else {
+                b = a + (float)((int32_t)(host_random(state) % 5) - 2) / 1000;
+            }
+        }
+        SampleValue x = SampleValue::real(a, 0);
+        SampleValue y = SampleValue::real(b, 0);
+        char text_x[SAMPLE_TEXT_SIZE], text_y[SAMPLE_TEXT_SIZE];
+        format_value(x, text_x);
+        format_value(y, text_y);
+        bool texts_match = strcmp(text_x, text_y) == 0;
+        same += texts_match;
+        expect(x.same_text(y) == texts_match, "%.9g and %.9g print %s and %s but same_text() says %s", a, b, text_x,
+               text_y, texts_match ? "they differ" : "they match");
+    }
+    snprintf(summary, size, "%u float pairs up to 1e38 and edges, %" PRIu32 " printing the same",
+             (unsigned)(CHECK_SAME_TEXT_PAIRS + edge_count * edge_count), same);
+}
+
+/*
+ * The values the encoder check writes: an integer of each width TLV and
+ * CBOR distinguish, and a float that is exact in binary, over sources of
+ * one and of several values.
+ */
+static const struct {
+    const char *object;
+    const char *resource;
+    const char *description;
+    bool        real;
+    double      value;
+} encoder_values[] = {
+    { "3200", "5501", "Button", false, 24 },
+    { "3313", "5702", "AccelX", false, -12 },
+    { "3313", "5703", "AccelY", false, 1016 },
+    { "3313", "5704", "AccelZ", false, 100000 },
+    { "3303", "5600", "Temperature", true, 21.5 },
+};
+
+// The bytes each format must produce for encoder_values, written out by hand
+static const char json_expected[] =
+    "[\n"
+    "    {\n        \"uri\":\"/3200/0/5501\",\n        \"desc\":\"Button\",\n        \"value\":\"24\"\n    }\n"
+    "    ,\n"
+    "    {\n        \"uri\":\"/3313/0/5702\",\n        \"desc\":\"AccelX\",\n        \"value\":\"-12\"\n    }\n"
+    "    ,\n"
+    "    {\n        \"uri\":\"/3313/0/5703\",\n        \"desc\":\"AccelY\",\n        \"value\":\"1016\"\n    }\n"
+    "    ,\n"
+    "    {\n        \"uri\":\"/3313/0/5704\",\n        \"desc\":\"AccelZ\",\n        \"value\":\"100000\"\n    }\n"
+    "    ,\n"
+    "    {\n        \"uri\":\"/3303/0/5600\",\n        \"desc\":\"Temperature\",\n        \"value\":\"21.500\"\n    }\n"
+    "]";
+static const char senml_json_expected[] =
+    "[{\"bn\":\"/3200/0/\",\"n\":\"5501\",\"v\":24},"
+    "{\"bn\":\"/3313/0/\",\"n\":\"5702\",\"v\":-12},{\"n\":\"5703\",\"v\":1016},{\"n\":\"5704\",\"v\":100000},"
+    "{\"bn\":\"/3303/0/\",\"n\":\"5600\",\"v\":21.500}]";
+static const uint8_t senml_cbor_expected[] = {
+    0x9f,                                                   // indefinite array
+    0xa3, 0x21, 0x68, '/', '3', '2', '0', '0', '/', '0', '/', // {-2: "/3200/0/",
+    0x00, 0x64, '5', '5', '0', '1', 0x02, 0x18, 0x18,       //  0: "5501", 2: 24}
+    0xa3, 0x21, 0x68, '/', '3', '3', '1', '3', '/', '0', '/',
+    0x00, 0x64, '5', '7', '0', '2', 0x02, 0x2b,             //  2: -12
+    0xa2, 0x00, 0x64, '5', '7', '0', '3', 0x02, 0x19, 0x03, 0xf8, // 2: 1016
+    0xa2, 0x00, 0x64, '5', '7', '0', '4', 0x02, 0x1a, 0x00, 0x01, 0x86, 0xa0, // 2: 100000
+    0xa3, 0x21, 0x68, '/', '3', '3', '0', '3', '/', '0', '/',
+    0x00, 0x64, '5', '6', '0', '0', 0x02, 0xfa, 0x41, 0xac, 0x00, 0x00, // 2: 21.5f
+    0xff                                                    // break
+};
+static const uint8_t tlv_expected[] = {
+    0x10, 0x00, 0x00, 0x08,                                 // instance 0, 8 bytes
+    0xc2, 0x00, 0x0c, 0x80,                                 // resource 0: object 3200
+    0xe1, 0x15, 0x7d, 0x18,                                 // resource 5501: 24
+    0x10, 0x00, 0x00, 0x14,                                 // instance 0, 20 bytes
+    0xc2, 0x00, 0x0c, 0xf1,                                 // object 3313
+    0xe1, 0x16, 0x46, 0xf4,                                 // 5702: -12
+    0xe2, 0x16, 0x47, 0x03, 0xf8,                           // 5703: 1016
+    0xe4, 0x16, 0x48, 0x00, 0x01, 0x86, 0xa0,               // 5704: 100000
+    0x10, 0x00, 0x00, 0x0b,                                 // instance 0, 11 bytes
+    0xc2, 0x00, 0x0c, 0xe7,                                 // object 3303
+    0xe4, 0x15, 0xe0, 0x41, 0xac, 0x00, 0x00,               // 5600: 21.5f
+};
+
+/*
+ * One TLV as OMA LwM2M 1.0 section 6.4.3 lays it out: a type byte, an 8
+ * or 16-bit identifier and a length in the type byte or in 8, 16 or 24
+ * bits. Returns false if it runs past `end`.
+ */
+struct Tlv {
+    uint8_t        type;        // bits 7-6: 0 object instance ... 3 resource
+    uint16_t       id;
+    const uint8_t *value;
+    uint32_t       length;
+};
+
+static bool tlv_read(const uint8_t *&p, const uint8_t *end, Tlv &tlv) {
+    if (p >= end) {
+        return false;
+    }
+    uint8_t type = *p++;
+    uint8_t id_bytes = type & 0x20 ? 2 : 1;
+    uint8_t length_bytes = (type >> 3) & 0x03;
+    if (end - p < id_bytes + length_bytes) {
+        return false;
+    }
+    tlv.type = type >> 6;
+    tlv.id = 0;
+    for (uint8_t i = 0; i < id_bytes; i++) {
+        tlv.id = (uint16_t)((tlv.id << 8) | *p++);
+    }
+    tlv.length = length_bytes ? 0 : type & 0x07;
+    for (uint8_t i = 0; i < length_bytes; i++) {
+        tlv.length = (tlv.length << 8) | *p++;
+    }
+    if ((uint32_t)(end - p) < tlv.length) {
+        return false;
+    }
+    tlv.value = p;
+    p += tlv.length;
+    return true;
+}
+
+// A resource TLV's value as a signed integer of its length, as TLV writes integers
+static int64_t tlv_integer(const Tlv &tlv) {
+    int64_t v = tlv.length ? (int8_t)tlv.value[0] : 0;
+    for (uint32_t i = 1; i < tlv.length; i++) {
+        v = v * 256 + tlv.value[i];
+    }
+    return v;
+}
+
+/*
+ * Decodes a TLV alldata payload as a server would: object instance TLVs
+ * of resource TLVs, resource TlvEncoder::OBJECT_RESOURCE first, and
+ * compares it with the first `count` encoder_values, all of instance
+ * `instance`.
+ */
+static bool tlv_decode(const uint8_t *payload, size_t size, int instance, size_t count) {
+    const uint8_t *p = payload;
+    const uint8_t *end = payload + size;
+    size_t v = 0;
+    while (p < end) {
+        Tlv source;
+        if (!expect(tlv_read(p, end, source) && source.type == 0 && source.id == instance,
+                    "tlv: value %u is not in an object instance %d", (unsigned)v, instance)) {
+            return false;
+        }
+        const uint8_t *r = source.value;
+        const uint8_t *r_end = source.value + source.length;
+        Tlv object;
+        if (!expect(tlv_read(r, r_end, object) && object.type == 3 && object.id == TlvEncoder::OBJECT_RESOURCE,
+                    "tlv: instance before value %u does not start with its object", (unsigned)v)) {
+            return false;
+        }
+        char object_id[8];
+        snprintf(object_id, sizeof(object_id), "%d", (int)tlv_integer(object));
+        while (r < r_end) {
+            Tlv res;
+            if (!expect(tlv_read(r, r_end, res) && res.type == 3 && v < count, "tlv: bad resource TLV after value %u",
+                        (unsigned)v)) {
+                return false;
+            }
+            double value = (double)tlv_integer(res);
+            if (encoder_values[v].real && res.length == 4) {
+                uint32_t bits = (uint32_t)tlv_integer(res);
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                value = f;
+            }
+            if (!expect(strcmp(object_id, encoder_values[v].object) == 0 && res.id == atoi(encoder_values[v].resource) &&
+                        value == encoder_values[v].value,
+                        "tlv: value %u decoded as /%s/%d/%u %g", (unsigned)v, object_id, instance, res.id, value)) {
+                return false;
+            }
+            v++;
+        }
+    }
+    return expect(v == count, "tlv: %u of %u values decoded", (unsigned)v, (unsigned)count);
+}
+
+// NaN and the infinities: left out of SenML-JSON, half floats in SenML-CBOR
+static const char senml_json_non_finite[] = "[{\"bn\":\"/3303/0/\",\"n\":\"5603\",\"v\":1.500}]";
+static const uint8_t senml_cbor_non_finite[] = {
+    0x9f,
+    0xa3, 0x21, 0x68, '/', '3', '3', '0', '3', '/', '0', '/',
+    0x00, 0x64, '5', '6', '0', '1', 0x02, 0xf9, 0x7e, 0x00, // 2: NaN
+    0xa2, 0x00, 0x64, '5', '6', '0', '2', 0x02, 0xf9, 0x7c, 0x00, // 2: inf
+    0xa2, 0x00, 0x64, '5', '7', '0', '0', 0x02, 0xf9, 0xfc, 0x00, // 2: -inf
+    0xa2, 0x00, 0x64, '5', '6', '0', '3', 0x02, 0xfa, 0x3f, 0xc0, 0x00, 0x00, // 2: 1.5f
+    0xff
+};
+
+static bool encode_non_finite(PayloadEncoder &enc, PayloadWriter &out, const uint8_t *expected, size_t length,
+                              const char *name) {
+    static const char *resources[] = { "5601", "5602", "5700", "5603" };
+    float values[] = { NAN, INFINITY, -INFINITY, 1.5f };
+    enc.begin();
+    enc.begin_source("3303", 0);
+    for (int i = 0; i < 4; i++) {
+        enc.value(resources[i], "", SampleValue::real(values[i], 0));
+    }
+    enc.end_source();
+    enc.end();
+    return expect(out.size() == length && memcmp(out.data(), expected, length) == 0,
+                  "%s with NaN and infinities: %u bytes, expected %u", name, (unsigned)out.size(), (unsigned)length);
+}
+
+// Feeds encoder_values to a fresh encoder of `format` writing into `out`
+static void encode_values(int format, PayloadWriter &out, int instance = 0) {
+    JsonEncoder json(out);
+    SenmlJsonEncoder senml_json(out);
+    SenmlCborEncoder senml_cbor(out);
+    TlvEncoder tlv(out);
+    PayloadEncoder *encoders[] = { &json, &senml_json, &senml_cbor, &tlv };
+    PayloadEncoder *enc = encoders[format];
+    size_t count = sizeof(encoder_values) / sizeof(encoder_values[0]);
+    enc->begin();
+    for (size_t v = 0; v < count; v++) {
+        if (v == 0 || strcmp(encoder_values[v].object, encoder_values[v - 1].object) != 0) {
+            enc->begin_source(encoder_values[v].object, instance);
+        }
+        SampleValue value = encoder_values[v].real ? SampleValue::real((float)encoder_values[v].value, 0)
+                                                   : SampleValue::integer((int32_t)encoder_values[v].value, 0);
+        enc->value(encoder_values[v].resource, encoder_values[v].description, value);
+        if (v + 1 == count || strcmp(encoder_values[v].object, encoder_values[v + 1].object) != 0) {
+            enc->end_source();
+        }
+    }
+    enc->end();
+}
+
+/*
+ * Every alldata/0/json format against bytes written out by hand from its
+ * specification. The output must also be the same, cut short, in every
+ * buffer too small for it, with the full size still reported, as the
+ * aggregator relies on that to size its buffer. TLV must also decode to
+ * the values it was given, with a one and a two-byte instance ID. NaN
+ * and the infinities must not make the SenML output invalid.
+ */
+static void check_encoders(char *summary, size_t size) {
+    static const char *names[] = { "json", "senml+json", "senml+cbor", "tlv" };
+    const uint8_t *expected[] = { (const uint8_t *)json_expected, (const uint8_t *)senml_json_expected,
+                                  senml_cbor_expected, tlv_expected };
+    size_t lengths[] = { sizeof(json_expected) - 1, sizeof(senml_json_expected) - 1,
+                         sizeof(senml_cbor_expected), sizeof(tlv_expected) };
+    char sizes[80] = "";
+    for (int f = 0; f < 4; f++) {
+        uint8_t buffer[1024];
+        for (size_t capacity = 0; capacity <= lengths[f]; capacity++) {
+            memset(buffer, 0xee, sizeof(buffer));
+            PayloadWriter out(buffer, capacity);
+            encode_values(f, out);
+            size_t same = 0;
+            while (same < capacity && buffer[same] == expected[f][same]) {
+                same++;
+            }
+            if (!expect(out.size() == lengths[f] && same == capacity && buffer[capacity] == 0xee,
+                        "%s into %u bytes: %u bytes, expected %u, first difference at %u",
+                        names[f], (unsigned)capacity, (unsigned)out.size(), (unsigned)lengths[f], (unsigned)same)) {
+                break;
+            }
+        }
+        snprintf(sizes + strlen(sizes), sizeof(sizes) - strlen(sizes), "%s%s %u", f ? ", " : "", names[f],
+                 (unsigned)lengths[f]);
+    }
+    static const int instances[] = { 0, 300 };
+    for (size_t i = 0; i < sizeof(instances) / sizeof(instances[0]); i++) {
+        uint8_t buffer[1024];
+        PayloadWriter out(buffer, sizeof(buffer));
+        encode_values(3, out, instances[i]);
+        tlv_decode(buffer, out.size(), instances[i], sizeof(encoder_values) / sizeof(encoder_values[0]));
+    }
+    uint8_t buffer[256];
+    PayloadWriter json_out(buffer, sizeof(buffer));
+    SenmlJsonEncoder senml_json(json_out);
+    encode_non_finite(senml_json, json_out, (const uint8_t *)senml_json_non_finite, sizeof(senml_json_non_finite) - 1,
+                      "senml+json");
+    PayloadWriter cbor_out(buffer, sizeof(buffer));
+    SenmlCborEncoder senml_cbor(cbor_out);
+    encode_non_finite(senml_cbor, cbor_out, senml_cbor_non_finite, sizeof(senml_cbor_non_finite), "senml+cbor");
+    snprintf(summary, size, "bytes as specified, also cut short: %s; tlv decodes, NaN and inf as specified", sizes);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        filter = argv[i];
+    }
+    setenv("MBED_HOST_SEED", "1", 0);
+    uptime.start();
+    printf("mbed Client host checks, seed %s\n", getenv("MBED_HOST_SEED"));
+
+    check("sample_log/power_failures", check_log_power_failures);
+    check("sample_log/large_sectors", check_log_large_sectors);
+    check("scheduler/overload", check_scheduler_overload);
+    check("analog/adc_sum", check_adc_sum);
+    check("rollup/tiers", check_rollup);
+    check("alldata/encoders", check_encoders);
+    check("sample/same_text", check_same_text);
+
+    if (failures) {
+        printf("%" PRIu32 " checks failed\n", failures);
+    }
+    return failures ? 1 : 0;
+}
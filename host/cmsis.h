@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_CMSIS_H__
+#define __HOST_CMSIS_H__
+
+#include <stdint.h>
+
+/*
+* The Cortex-M DSP instructions the example uses, bit for bit, so that
+* code written for them can be checked on the host.
+*/
+
+// Dual signed 16-bit multiply, both products added to `acc`, modulo 2^32
+inline uint32_t __SMLAD(uint32_t x, uint32_t y, uint32_t acc) {
+    int32_t low = (int32_t)(int16_t)(x & 0xffff) * (int16_t)(y & 0xffff);
+    int32_t high = (int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16);
+    return acc + (uint32_t)low + (uint32_t)high;
+}
+
+#endif // __HOST_CMSIS_H__
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_COAP_H__
+#define __HOST_COAP_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+* CoAP messages (RFC 7252) and the block options (RFC 7959), as far as
+* LwM2M registration, observation and block-wise transfers need them.
+*
+* Over TCP, mbed Client sends every message in the UDP format behind a
+* 4-byte big-endian length; frame() and unframe() add and strip it.
+*/
+class CoapMessage {
+public:
+    enum Type {
+        CON = 0,
+        NON = 1,
+        ACK = 2,
+        RST = 3
+    };
+
+    enum Code {
+        EMPTY                     = 0x00,
+        GET                       = 0x01,
+        POST                      = 0x02,
+        PUT                       = 0x03,
+        DELETE                    = 0x04,
+        CREATED                   = 0x41,
+        DELETED                   = 0x42,
+        VALID                     = 0x43,
+        CHANGED                   = 0x44,
+        CONTENT                   = 0x45,
+        CONTINUE                  = 0x5f,
+        BAD_REQUEST               = 0x80,
+        NOT_FOUND                 = 0x84,
+        METHOD_NOT_ALLOWED        = 0x85,
+        REQUEST_ENTITY_INCOMPLETE = 0x88,
+        REQUEST_ENTITY_TOO_LARGE  = 0x8d,
+        INTERNAL_SERVER_ERROR     = 0xa0
+    };
+
+    enum Option {
+        OBSERVE         = 6,
+        LOCATION_PATH   = 8,
+        URI_PATH        = 11,
+        CONTENT_FORMAT  = 12,
+        URI_QUERY       = 15,
+        BLOCK2          = 23,
+        BLOCK1          = 27,
+        SIZE2           = 28,
+        SIZE1           = 60
+    };
+
+    struct OptionValue {
+        uint16_t    number;
+        std::string value;
+    };
+
+    CoapMessage(uint8_t type=CON, uint8_t code=EMPTY, uint16_t message_id=0)
+        : type(type), code(code), message_id(message_id) {}
+
+    // Keeps options in number order; repeated options keep their order
+    void add_option(uint16_t number, const std::string &value) {
+        OptionValue o;
+        o.number = number;
+        o.value = value;
+        std::vector<OptionValue>::iterator it = options.begin();
+        while (it != options.end() && it->number <= number) {
+            ++it;
+        }
+        options.insert(it, o);
+    }
+
+    void add_uint_option(uint16_t number, uint32_t value) {
+        std::string bytes;
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            if (bytes.size() || (value >> shift) & 0xff) {
+                bytes += (char)((value >> shift) & 0xff);
+            }
+        }
+        add_option(number, bytes);
+    }
+
+    void remove_option(uint16_t number) {
+        for (size_t i = options.size(); i > 0; i--) {
+            if (options[i - 1].number == number) {
+                options.erase(options.begin() + i - 1);
+            }
+        }
+    }
+
+    // The first option `number`, or NULL
+    const std::string *option(uint16_t number) const {
+        for (size_t i = 0; i < options.size(); i++) {
+            if (options[i].number == number) {
+                return &options[i].value;
+            }
+        }
+        return NULL;
+    }
+
+    bool has_option(uint16_t number) const {
+        return option(number) != NULL;
+    }
+
+    uint32_t uint_option(uint16_t number, uint32_t missing=0) const {
+        const std::string *o = option(number);
+        if (!o) {
+            return missing;
+        }
+        uint32_t value = 0;
+        for (size_t i = 0; i < o->size(); i++) {
+            value = (value << 8) | (uint8_t)(*o)[i];
+        }
+        return value;
+    }
+
+    // Repeated options joined by `separator`: "3200/0/5501", "ep=x&lt=100"
+    std::string joined(uint16_t number, char separator) const {
+        std::string text;
+        for (size_t i = 0; i < options.size(); i++) {
+            if (options[i].number == number) {
+                if (!text.empty()) {
+                    text += separator;
+                }
+                text += options[i].value;
+            }
+        }
+        return text;
+    }
+
+    std::string path() const {
+        return joined(URI_PATH, '/');
+    }
+
+    // Splits `text` on `separator` into repeated options
+    void add_split(uint16_t number, const std::string &text, char separator) {
+        size_t start = 0;
+        while (start <= text.size()) {
+            size_t end = text.find(separator, start);
+            if (end == std::string::npos) {
+                end = text.size();
+            }
+            if (end > start) {
+                add_option(number, text.substr(start, end - start));
+            }
+            start = end + 1;
+        }
+    }
+
+    void set_path(const std::string &path) {
+        remove_option(URI_PATH);
+        add_split(URI_PATH, path, '/');
+    }
+
+    // The value of "name=value" in the Uri-Query options, or ""
+    std::string query(const char *name) const {
+        size_t length = strlen(name);
+        for (size_t i = 0; i < options.size(); i++) {
+            const std::string &o = options[i].value;
+            if (options[i].number == URI_QUERY && o.size() > length && o.compare(0, length, name) == 0 && o[length] == '=') {
+                return o.substr(length + 1);
+            }
+        }
+        return std::string();
+    }
+
+    bool is_request() const {
+        return code >= GET && code <= DELETE;
+    }
+
+    std::string encode() const {
+        std::string out;
+        out += (char)(0x40 | (type << 4) | (token.size() & 0x0f));
+        out += (char)code;
+        out += (char)(message_id >> 8);
+        out += (char)(message_id & 0xff);
+        out += token;
+        uint16_t previous = 0;
+        for (size_t i = 0; i < options.size(); i++) {
+            const OptionValue &o = options[i];
+            uint32_t delta = o.number - previous;
+            uint32_t length = o.value.size();
+            out += (char)((nibble(delta) << 4) | nibble(length));
+            extend(out, delta);
+            extend(out, length);
+            out += o.value;
+            previous = o.number;
+        }
+        if (!payload.empty()) {
+            out += (char)0xff;
+            out += payload;
+        }
+        return out;
+    }
+
+    bool decode(const uint8_t *data, size_t size) {
+        options.clear();
+        token.clear();
+        payload.clear();
+        if (size < 4 || (data[0] >> 6) != 1) {
+            return false;
+        }
+        type = (data[0] >> 4) & 3;
+        size_t token_length = data[0] & 0x0f;
+        code = data[1];
+        message_id = (uint16_t)((data[2] << 8) | data[3]);
+        if (token_length > 8 || 4 + token_length > size) {
+            return false;
+        }
+        token.assign((const char*)data + 4, token_length);
+        size_t at = 4 + token_length;
+        uint32_t number = 0;
+        while (at < size && data[at] != 0xff) {
+            uint32_t delta = data[at] >> 4;
+            uint32_t length = data[at] & 0x0f;
+            at++;
+            if (!extended(data, size, at, delta) || !extended(data, size, at, length) || at + length > size) {
+                return false;
+            }
+            number += delta;
+            OptionValue o;
+            o.number = (uint16_t)number;
+            o.value.assign((const char*)data + at, length);
+            options.push_back(o);
+            at += length;
+        }
+        if (at < size) {
+            if (at + 1 == size) {
+                return false;
+            }
+            payload.assign((const char*)data + at + 1, size - at - 1);
+        }
+        return true;
+    }
+
+    bool decode(const std::string &data) {
+        return decode((const uint8_t*)data.data(), data.size());
+    }
+
+    /*
+    * Block1/Block2 option values: the block number, whether more blocks
+    * follow, and the block size as 16 << szx.
+    */
+    static uint32_t block_value(uint32_t number, bool more, uint32_t size) {
+        uint32_t szx = 0;
+        while ((16u << szx) < size && szx < 6) {
+            szx++;
+        }
+        return (number << 4) | (more ? 0x08 : 0) | szx;
+    }
+    static uint32_t block_number(uint32_t value) {
+        return value >> 4;
+    }
+    static bool block_more(uint32_t value) {
+        return value & 0x08;
+    }
+    static uint32_t block_size(uint32_t value) {
+        return 16u << (value & 0x07);
+    }
+
+    // Prefixes the message with its length, as mbed Client does over TCP
+    static std::string frame(const std::string &message) {
+        std::string out;
+        uint32_t length = message.size();
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            out += (char)((length >> shift) & 0xff);
+        }
+        return out + message;
+    }
+
+    /*
+    * Takes the first complete message off `stream`, a TCP byte stream,
+    * into `message`. Returns false until one has arrived in full.
+    */
+    static bool unframe(std::string &stream, std::string &message) {
+        if (stream.size() < 4) {
+            return false;
+        }
+        uint32_t length = 0;
+        for (int i = 0; i < 4; i++) {
+            length = (length << 8) | (uint8_t)stream[i];
+        }
+        if (stream.size() < 4 + length) {
+            return false;
+        }
+        message = stream.substr(4, length);
+        stream.erase(0, 4 + length);
+        return true;
+    }
+
+    uint8_t                  type;
+    uint8_t                  code;
+    uint16_t                 message_id;
+    std::string              token;
+    std::vector<OptionValue> options;
+    std::string              payload;
+
+private:
+    static uint8_t nibble(uint32_t value) {
+        return value < 13 ? value : value < 269 ? 13 : 14;
+    }
+
+    static void extend(std::string &out, uint32_t value) {
+        if (value >= 269) {
+            value -= 269;
+            out += (char)(value >> 8);
+            out += (char)(value & 0xff);
+        } else if (value >= 13) {
+            out += (char)(value - 13);
+        }
+    }
+
+    static bool extended(const uint8_t *data, size_t size, size_t &at, uint32_t &value) {
+        if (value == 13) {
+            if (at + 1 > size) {
+                return false;
+            }
+            value = 13 + data[at++];
+        } else if (value == 14) {
+            if (at + 2 > size) {
+                return false;
+            }
+            value = 269 + ((data[at] << 8) | data[at + 1]);
+            at += 2;
+        } else if (value == 15) {
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif // __HOST_COAP_H__
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_EASY_CONNECT_H__
+#define __HOST_EASY_CONNECT_H__
+
+#include "mbed.h"
+
+/*
+* The host's own network stack, already up.
+*/
+inline NetworkInterface *easy_connect(bool log_messages=false) {
+    static NetworkInterface network;
+    if (log_messages) {
+        printf("[EasyConnect] Using the host network\n");
+        printf("[EasyConnect] IP address %s\n", network.get_ip_address());
+    }
+    return &network;
+}
+
+#endif // __HOST_EASY_CONNECT_H__
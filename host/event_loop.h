@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_EVENT_LOOP_H__
+#define __HOST_EVENT_LOOP_H__
+
+#include <sys/epoll.h>
+#include <map>
+#include <vector>
+#include "mbed.h"
+
+// How often every watched socket gets a tick, for retransmissions
+#ifndef HOST_EVENT_LOOP_TICK_MS
+#define HOST_EVENT_LOOP_TICK_MS 50
+#endif
+
+// Most readiness events taken from epoll at once
+#define HOST_EVENT_LOOP_BATCH 64
+
+/*
+* One thread waiting on the sockets of every mbed Client interface in the
+* process with epoll, as mbed Client's single event thread does on a
+* board. A watched socket's `readable` handler is called when it has
+* something to read, or has been closed, and its `tick` handler every
+* HOST_EVENT_LOOP_TICK_MS. Handlers run one at a time on the loop's
+* thread, which is started on first use. The loop is never destroyed,
+* so interfaces destroyed by static destructors can still unwatch their
+* sockets.
+*
+* Sockets may be watched and unwatched from any thread, including from a
+* handler. Unwatching from another thread waits for a handler of that
+* socket that is running to return, so the handler's context may be
+* freed straight after.
+*/
+class HostEventLoop {
+public:
+    typedef void (*Handler)(void *context);
+
+    static HostEventLoop &instance() {
+        static HostEventLoop *loop = new HostEventLoop();
+        return *loop;
+    }
+
+    bool watch(int fd, Handler readable, Handler tick, void *context) {
+        pthread_mutex_lock(&_mutex);
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        bool added = _running && epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+        if (added) {
+            Watch &w = _watched[fd];
+            w.readable = readable;
+            w.tick = tick;
+            w.context = context;
+        }
+        pthread_mutex_unlock(&_mutex);
+        return added;
+    }
+
+    void unwatch(int fd) {
+        pthread_mutex_lock(&_mutex);
+        if (_watched.erase(fd)) {
+            epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, NULL);
+        }
+        if (!pthread_equal(pthread_self(), _thread)) {
+            while (_current == fd) {
+                pthread_cond_wait(&_idle, &_mutex);
+            }
+        }
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    // Sockets being watched
+    size_t size() {
+        pthread_mutex_lock(&_mutex);
+        size_t count = _watched.size();
+        pthread_mutex_unlock(&_mutex);
+        return count;
+    }
+
+    // The loop's thread, for measuring the CPU time it takes
+    pthread_t thread() const {
+        return _thread;
+    }
+
+private:
+    struct Watch {
+        Handler readable;
+        Handler tick;
+        void   *context;
+    };
+
+    HostEventLoop() : _current(-1) {
+        pthread_mutex_init(&_mutex, NULL);
+        pthread_condattr_t attributes;
+        pthread_condattr_init(&attributes);
+        pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+        pthread_cond_init(&_idle, &attributes);
+        pthread_condattr_destroy(&attributes);
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        _thread = pthread_self();
+        _running = _epoll >= 0 && pthread_create(&_thread, NULL, &HostEventLoop::run, this) == 0;
+    }
+
+    static void *run(void *loop) {
+        ((HostEventLoop*)loop)->serve();
+        return NULL;
+    }
+
+    void serve() {
+        host_thread_started();
+        struct epoll_event events[HOST_EVENT_LOOP_BATCH];
+        std::vector<int> ticked;
+        uint64_t next_tick = host_now_us() + HOST_EVENT_LOOP_TICK_MS * 1000;
+        for (;;) {
+            uint64_t now = host_now_us();
+            int timeout = next_tick > now ? (int)((next_tick - now + 999) / 1000) : 0;
+            int ready = epoll_wait(_epoll, events, HOST_EVENT_LOOP_BATCH, timeout);
+            for (int i = 0; i < ready; i++) {
+                dispatch(events[i].data.fd, false);
+            }
+            now = host_now_us();
+            if (now < next_tick) {
+                continue;
+            }
+            next_tick = now + HOST_EVENT_LOOP_TICK_MS * 1000;
+            ticked.clear();
+            pthread_mutex_lock(&_mutex);
+            for (std::map<int, Watch>::iterator w = _watched.begin(); w != _watched.end(); ++w) {
+                ticked.push_back(w->first);
+            }
+            pthread_mutex_unlock(&_mutex);
+            for (size_t i = 0; i < ticked.size(); i++) {
+                dispatch(ticked[i], true);
+            }
+        }
+    }
+
+    // Calls a handler of `fd`, if it is still watched
+    void dispatch(int fd, bool tick) {
+        pthread_mutex_lock(&_mutex);
+        std::map<int, Watch>::iterator found = _watched.find(fd);
+        if (found == _watched.end()) {
+            pthread_mutex_unlock(&_mutex);
+            return;
+        }
+        Watch w = found->second;
+        _current = fd;
+        pthread_mutex_unlock(&_mutex);
+
+        Handler handler = tick ? w.tick : w.readable;
+        if (handler) {
+            handler(w.context);
+        }
+
+        pthread_mutex_lock(&_mutex);
+        _current = -1;
+        pthread_cond_broadcast(&_idle);
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    int                  _epoll;
+    bool                 _running;
+    pthread_t            _thread;
+    pthread_mutex_t      _mutex;
+    pthread_cond_t       _idle;
+    int                  _current;      // socket whose handler is running
+    std::map<int, Watch> _watched;
+};
+
+#endif // __HOST_EVENT_LOOP_H__
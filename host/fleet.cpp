@@ -0,0 +1,645 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A fleet of simulated boards in one process, registered with the
+ * loopback LwM2M server of lwm2m_server.h, for loading the server side
+ * the way many devices do rather than the way one busy device does.
+ *
+ * Every endpoint is a board of its own: an MbedClient named fleet-<n>
+ * with the device object, the button (3200), the four analog inputs
+ * (3324, 3303, 3301, 3330) read by their AnalogSampler from simulated
+ * ADC pins, and alldata, all driven by a Scheduler of the endpoint's.
+ * The button is pressed every `click` milliseconds, and the registration
+ * checked every REGISTRATION_CHECK_PERIOD_MS and updated when its
+ * lifetime calls for it, as on the board; each endpoint's tasks start at
+ * a random phase, as boards do not boot together.
+ *
+ * The sockets of all endpoints are served by the one HostEventLoop
+ * thread (epoll), as mbed Client's event thread would be; their
+ * schedulers run on `workers` threads, each taking a share of the
+ * endpoints earliest deadline first.
+ *
+ * Usage: fleet [--udp] [--endpoints N] [--seconds S] [--rate R] [--workers W]
+ *              [--observe path,...] [--click ms] [--lifetime S] [--queue] [--outage S] [--verbose]
+ *
+ * The endpoints are made, registered R per second (all at once if 0),
+ * the server observes `observe` paths on each (FLEET_OBSERVE by
+ * default), and the fleet runs for S seconds before it de-registers.
+ * The endpoints register with a lifetime of --lifetime seconds
+ * (REGISTRATION_LIFETIME_S by default), in queue mode with --queue.
+ *
+ * With --outage, the server is taken off the network a third of the way
+ * into the run, for that many seconds (see LwM2MServer::set_reachable()),
+ * and the fleet waits for every endpoint to be back before it goes on.
+ * Over TCP the endpoints notice at once; over UDP only when an update
+ * goes unanswered, so give a short --lifetime. Reported are the times
+ * from the server's return to each endpoint's, the registrations and
+ * updates it took, the attempts, and the updates of alldata held while
+ * offline and replayed.
+ * Reported are registrations per second and their latency, notifications
+ * per second, registration updates and messages per endpoint per hour,
+ * resident memory per endpoint, and CPU time per endpoint on the client
+ * threads (workers and event loop) and the server thread.
+ */
+
+#include <string>
+#include <stdint.h>
+
+// The endpoints register with the server the fleet starts
+static const char *fleet_server_address = "";
+#define MBED_SERVER_ADDRESS fleet_server_address
+
+#define main client_main
+#include "../main.cpp"
+#undef main
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <sys/resource.h>
+#include "lwm2m_server.h"
+
+// What the server observes on every endpoint
+#ifndef FLEET_OBSERVE
+#define FLEET_OBSERVE "alldata/0/json,3200/0/5501,3303/0/5600"
+#endif
+
+// How long registering and de-registering may take, all endpoints together
+#ifndef FLEET_REGISTRATION_TIMEOUT_MS
+#define FLEET_REGISTRATION_TIMEOUT_MS 60000
+#endif
+
+// Longest a worker sleeps, so that it notices being stopped
+#define FLEET_WORKER_POLL_MS 10
+
+// Nearest-rank percentile of sorted `values`
+static uint32_t percentile(const std::vector<uint32_t> &values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)ceil(p * values.size());
+    return values[rank ? rank - 1 : 0];
+}
+
+// Resident set size of the process, in bytes
+static uint64_t resident_bytes() {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (statm) {
+        if (fscanf(statm, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(statm);
+    }
+    return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+// CPU time `thread` has taken, in microseconds
+static uint64_t cpu_us(pthread_t thread) {
+    clockid_t clock;
+    struct timespec t;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &t) != 0) {
+        return 0;
+    }
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+/*
+ * The endpoint's MbedClient, timing its registration.
+ */
+class FleetClient: public MbedClient {
+public:
+    FleetClient(struct MbedClientDevice device) : MbedClient(device), requested_us(0), registered_us(0) {}
+
+    virtual void object_registered(M2MSecurity *security, const M2MServer &server) {
+        MbedClient::object_registered(security, server);
+        if (!registered_us) {
+            registered_us = host_now_us();
+            __sync_fetch_and_add(&registrations, 1);
+        }
+    }
+
+    virtual void object_unregistered(M2MSecurity *security) {
+        MbedClient::object_unregistered(security);
+        __sync_fetch_and_add(&deregistrations, 1);
+    }
+
+    volatile uint64_t requested_us;
+    volatile uint64_t registered_us;
+
+    // Over the whole fleet
+    static volatile uint32_t registrations;
+    static volatile uint32_t deregistrations;
+};
+
+volatile uint32_t FleetClient::registrations = 0;
+volatile uint32_t FleetClient::deregistrations = 0;
+
+/*
+ * One simulated board.
+ */
+class FleetEndpoint {
+public:
+    FleetEndpoint(uint32_t number, uint32_t click_ms, uint32_t &random)
+        : _sound(A0, SOUND_LEVEL_SCHEMA), _temperature(A1, TEMPERATURE_SCHEMA), _light(A2, LIGHT_SCHEMA),
+          _distance(A3, DISTANCE_SCHEMA), _scheduler(uptime_us) {
+        snprintf(_name, sizeof(_name), "fleet-%u", number);
+        struct MbedClientDevice board = device;
+        board.SerialNumber = _name;
+        _client = new FleetClient(board);
+
+        DataSource *sources[] = { &_button, &_sound, &_temperature, &_light, &_distance };
+        for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+            sources[i]->set_client(*_client);
+            _all_data.add_data_source(sources[i]);
+        }
+        _all_data.set_client(*_client);
+        _sampler.add(&_sound);
+        _sampler.add(&_temperature, TEMPERATURE_EMA_SHIFT);
+        _sampler.add(&_light);
+        _sampler.add(&_distance);
+
+        _scheduler.add("3200", DataSource::sample, &_button, _button.period_ms(),
+                       host_random(random) % _button.period_ms());
+        _scheduler.add("analog", AnalogSampler::sample, &_sampler, ANALOG_IN_PERIOD_MS,
+                       host_random(random) % ANALOG_IN_PERIOD_MS);
+        _scheduler.add("alldata", publish_all_data, &_all_data, ALLDATA_PERIOD_MS,
+                       host_random(random) % ALLDATA_PERIOD_MS);
+        _scheduler.add("register", update, this, REGISTRATION_CHECK_PERIOD_MS,
+                       host_random(random) % REGISTRATION_CHECK_PERIOD_MS);
+        if (click_ms) {
+            _scheduler.add("click", click, this, click_ms, host_random(random) % click_ms);
+        }
+
+        _client->create_interface(fleet_server_address, NULL, _name);
+        _security = _client->create_register_object();
+        _device = _client->create_device_object();
+        _client->set_register_object(_security);
+        _objects.push_back(_device);
+        _objects.push_back(_button.get_object());
+        _objects.push_back(_sound.get_object());
+        _objects.push_back(_temperature.get_object());
+        _objects.push_back(_light.get_object());
+        _objects.push_back(_distance.get_object());
+        _objects.push_back(_all_data.get_object());
+    }
+
+    ~FleetEndpoint() {
+        // The interface goes first, as it lets go of the objects
+        delete _client;
+        for (size_t i = 0; i < _objects.size(); i++) {
+            delete _objects[i];
+        }
+    }
+
+    void register_now() {
+        _client->requested_us = host_now_us();
+        _client->test_register(_security, _objects);
+    }
+
+    void unregister_now() {
+        _client->test_unregister();
+    }
+
+    // Runs the tasks that are due; returns the milliseconds to the next
+    uint32_t run() {
+        return _scheduler.run();
+    }
+
+    const char *name() const {
+        return _name;
+    }
+
+    bool registered() {
+        return _client->register_successful();
+    }
+
+    // When it was registered, 0 if it is not
+    uint64_t registered_us() const {
+        return _client->registered_us;
+    }
+
+    // Microseconds from asking to register to being registered, 0 if not
+    uint64_t registration_us() const {
+        return _client->registered_us ? _client->registered_us - _client->requested_us : 0;
+    }
+
+    ConnectionState::Stats connection_stats() const {
+        return _client->connection_stats();
+    }
+
+    NotificationQueue::Stats offline_stats() const {
+        return _all_data.offline_stats();
+    }
+
+private:
+    static void update(void *endpoint) {
+        ((FleetEndpoint*)endpoint)->_client->maintain_registration();
+    }
+
+    static void click(void *endpoint) {
+        ((FleetEndpoint*)endpoint)->_button.handle_button_inc();
+    }
+
+    char              _name[24];
+    ButtonResource    _button;
+    AnalogInResource  _sound;
+    AnalogInResource  _temperature;
+    AnalogInResource  _light;
+    AnalogInResource  _distance;
+    AnalogSampler     _sampler;
+    DataAggregator    _all_data;
+    Scheduler         _scheduler;
+    FleetClient      *_client;
+    M2MSecurity      *_security;        // owned by _client
+    M2MDevice        *_device;
+    M2MObjectList     _objects;
+};
+
+/*
+ * Runs the schedulers of a share of the endpoints on a thread of its own.
+ */
+class FleetWorker {
+public:
+    FleetWorker() : _stop(false), _running(false) {}
+
+    void add(FleetEndpoint *endpoint) {
+        _endpoints.push_back(endpoint);
+    }
+
+    bool start() {
+        _running = pthread_create(&_thread, NULL, &FleetWorker::work, this) == 0;
+        return _running;
+    }
+
+    void stop() {
+        _stop = true;
+        if (_running) {
+            pthread_join(_thread, NULL);
+            _running = false;
+        }
+    }
+
+    uint64_t cpu_time_us() const {
+        return _running ? cpu_us(_thread) : 0;
+    }
+
+private:
+    typedef std::pair<uint64_t, size_t> Due;      // deadline, endpoint
+
+    static void *work(void *worker) {
+        ((FleetWorker*)worker)->serve();
+        return NULL;
+    }
+
+    void serve() {
+        std::priority_queue<Due, std::vector<Due>, std::greater<Due> > due;
+        for (size_t i = 0; i < _endpoints.size(); i++) {
+            due.push(Due(0, i));
+        }
+        while (!_stop) {
+            uint64_t now = host_now_us();
+            while (!due.empty() && due.top().first <= now) {
+                size_t i = due.top().second;
+                due.pop();
+                uint32_t next_ms = _endpoints[i]->run();
+                if (next_ms > 1000) {
+                    next_ms = 1000;
+                }
+                now = host_now_us();
+                due.push(Due(now + (uint64_t)next_ms * 1000, i));
+            }
+            uint64_t wake = now + FLEET_WORKER_POLL_MS * 1000;
+            if (!due.empty() && due.top().first < wake) {
+                wake = due.top().first;
+            }
+            host_sleep_until_us(wake);
+        }
+    }
+
+    std::vector<FleetEndpoint*> _endpoints;
+    volatile bool               _stop;
+    bool                        _running;
+    pthread_t                   _thread;
+};
+
+// Splits "a,b,c"
+static std::vector<std::string> split(const std::string &text) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        if (end > start) {
+            items.push_back(text.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return items;
+}
+
+// Waits for `count` to reach `target`; false on timing out
+static bool wait_for(volatile uint32_t &count, uint32_t target, uint32_t timeout_ms) {
+    uint64_t deadline = host_now_us() + (uint64_t)timeout_ms * 1000;
+    while (count < target) {
+        if (host_now_us() > deadline) {
+            return false;
+        }
+        wait_ms(1);
+    }
+    return true;
+}
+
+/*
+ * Takes the server off the network for `seconds`, then waits for every
+ * endpoint to come back, and reports how that went.
+ */
+static void run_outage(FILE *out, LwM2MServer &server, std::vector<FleetEndpoint*> &fleet, uint32_t seconds) {
+    size_t count = fleet.size();
+    std::vector<uint32_t> attempts_before(count);
+    uint32_t queued_before = 0;
+    uint32_t replayed_before = 0;
+    for (size_t i = 0; i < count; i++) {
+        attempts_before[i] = fleet[i]->connection_stats().attempts;
+        queued_before += fleet[i]->offline_stats().queued;
+        replayed_before += fleet[i]->offline_stats().replayed;
+    }
+    server.set_reachable(false);
+    host_sleep_until_us(host_now_us() + (uint64_t)seconds * 1000000);
+    uint32_t noticed = 0;
+    for (size_t i = 0; i < count; i++) {
+        noticed += fleet[i]->registered() ? 0 : 1;
+    }
+    LwM2MServer::Stats before = server.stats();
+    server.set_reachable(true);
+
+    // Back once registered, and the updates held while offline replayed
+    uint64_t restored_us = host_now_us();
+    uint64_t deadline = restored_us + (uint64_t)FLEET_REGISTRATION_TIMEOUT_MS * 1000 * 10;
+    std::vector<uint32_t> back;
+    std::vector<bool> done(count, false);
+    while (back.size() < count && host_now_us() < deadline) {
+        for (size_t i = 0; i < count; i++) {
+            NotificationQueue::Stats held = fleet[i]->offline_stats();
+            if (!done[i] && fleet[i]->registered() && held.entries == 0) {
+                done[i] = true;
+                back.push_back((uint32_t)((host_now_us() - restored_us) / 1000));
+            }
+        }
+        wait_ms(10);
+    }
+    std::sort(back.begin(), back.end());
+    LwM2MServer::Stats after = server.stats();
+    std::vector<uint32_t> attempts;
+    uint32_t queued = 0;
+    uint32_t replayed = 0;
+    uint32_t dropped = 0;
+    for (size_t i = 0; i < count; i++) {
+        attempts.push_back(fleet[i]->connection_stats().attempts - attempts_before[i]);
+        NotificationQueue::Stats held = fleet[i]->offline_stats();
+        queued += held.queued;
+        replayed += held.replayed;
+        dropped += held.dropped;
+    }
+    std::sort(attempts.begin(), attempts.end());
+    fprintf(out, "outage of %u s, noticed by %u of %u: %u back in ms p50 %u p99 %u max %u after the server returned\n",
+            seconds, noticed, (unsigned)count, (unsigned)back.size(), percentile(back, 0.5), percentile(back, 0.99),
+            back.empty() ? 0 : back.back());
+    fprintf(out, "recovery: %u registrations, %u updates, attempts per endpoint p50 %u max %u; "
+                 "%u updates of alldata held, %u replayed, %u dropped\n",
+            after.registrations - before.registrations, after.updates - before.updates, percentile(attempts, 0.5),
+            attempts.empty() ? 0 : attempts.back(), queued - queued_before, replayed - replayed_before, dropped);
+    fflush(out);
+}
+
+int main(int argc, char **argv) {
+    bool tcp = true;
+    bool verbose = false;
+    uint32_t endpoints = 1000;
+    uint32_t seconds = 30;
+    uint32_t rate = 0;
+    uint32_t workers = 1;
+    uint32_t click_ms = 15000;
+    uint32_t outage = 0;
+    const char *observe = FLEET_OBSERVE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--udp") == 0) {
+            tcp = false;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "--endpoints") == 0 && i + 1 < argc) {
+            endpoints = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--observe") == 0 && i + 1 < argc) {
+            observe = argv[++i];
+        } else if (strcmp(argv[i], "--click") == 0 && i + 1 < argc) {
+            click_ms = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lifetime") == 0 && i + 1 < argc) {
+            REGISTRATION_LIFETIME = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--queue") == 0) {
+            QUEUE_MODE = true;
+        } else if (strcmp(argv[i], "--outage") == 0 && i + 1 < argc) {
+            outage = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "Usage: %s [--udp] [--endpoints N] [--seconds S] [--rate R] [--workers W]\n"
+                            "          [--observe path,...] [--click ms] [--lifetime S] [--queue] [--outage S]\n"
+                            "          [--verbose]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (!endpoints || !workers) {
+        fprintf(stderr, "Nothing to run\n");
+        return 2;
+    }
+    setenv("MBED_HOST_SEED", "1", 0);
+
+    // Every endpoint takes a socket, and over TCP so does the server's
+    // end of its connection
+    struct rlimit files;
+    getrlimit(RLIMIT_NOFILE, &files);
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+    uint64_t needed = (uint64_t)endpoints * (tcp ? 2 : 1) + 64;
+    if (files.rlim_cur != RLIM_INFINITY && needed > files.rlim_cur) {
+        fprintf(stderr, "%u endpoints need %" PRIu64 " file descriptors, the limit is %" PRIu64 "\n", endpoints,
+                needed, (uint64_t)files.rlim_cur);
+        return 1;
+    }
+
+    // The report goes to stdout; the endpoints' own logging, unless
+    // --verbose, to /dev/null
+    fflush(stdout);
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!verbose) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+
+    LwM2MServer server(tcp);
+    if (!server.listening()) {
+        fprintf(out, "Could not listen\n");
+        return 1;
+    }
+    std::string address = server.uri();
+    fleet_server_address = address.c_str();
+    SOCKET_MODE = tcp ? M2MInterface::TCP : M2MInterface::UDP;
+    uptime.start();
+    std::vector<std::string> paths = split(observe);
+    fprintf(out, "fleet: %u endpoints over %s%s, lifetime %u s, %u s, %u workers, seed %s\n", endpoints,
+            tcp ? "TCP" : "UDP", QUEUE_MODE ? " in queue mode" : "", (unsigned)REGISTRATION_LIFETIME, seconds, workers,
+            getenv("MBED_HOST_SEED"));
+    fflush(out);
+
+    // Made
+    uint64_t resident_before = resident_bytes();
+    uint32_t random = host_seed() * 2654435761u + 1;
+    if (random == 0) {
+        random = 1;
+    }
+    std::vector<FleetEndpoint*> fleet;
+    std::vector<FleetWorker> pool(workers);
+    for (uint32_t i = 0; i < endpoints; i++) {
+        fleet.push_back(new FleetEndpoint(i, click_ms, random));
+        pool[i % workers].add(fleet.back());
+    }
+    uint64_t resident_made = resident_bytes();
+    for (uint32_t w = 0; w < workers; w++) {
+        pool[w].start();
+    }
+
+    // Registered
+    uint64_t registering_us = host_now_us();
+    for (uint32_t i = 0; i < endpoints; i++) {
+        if (rate) {
+            host_sleep_until_us(registering_us + (uint64_t)i * 1000000 / rate);
+        }
+        fleet[i]->register_now();
+    }
+    bool all_registered = wait_for(FleetClient::registrations, endpoints, FLEET_REGISTRATION_TIMEOUT_MS);
+    std::vector<uint32_t> latencies;
+    uint64_t last_us = registering_us;
+    for (uint32_t i = 0; i < endpoints; i++) {
+        uint64_t latency = fleet[i]->registration_us();
+        if (latency) {
+            latencies.push_back((uint32_t)latency);
+            last_us = std::max(last_us, fleet[i]->registered_us());
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    // From the first request to the last endpoint registered
+    double registering_s = (last_us - registering_us) / 1000000.0;
+    fprintf(out, "registered %u of %u in %.2f s: %.0f per s, latency p50 %u us p99 %u us max %u us\n",
+            (unsigned)latencies.size(), endpoints, registering_s,
+            registering_s > 0 ? latencies.size() / registering_s : 0.0, percentile(latencies, 0.5),
+            percentile(latencies, 0.99), latencies.empty() ? 0 : latencies.back());
+    fflush(out);
+
+    // Observed
+    uint32_t observations = 0;
+    for (uint32_t i = 0; i < endpoints; i++) {
+        for (size_t p = 0; p < paths.size(); p++) {
+            if (server.observe(fleet[i]->name(), paths[p], NULL, NULL)) {
+                observations++;
+            }
+        }
+    }
+    wait_ms(1000);
+
+    // Running
+    uint64_t resident_running = resident_bytes();
+    LwM2MServer::Stats before = server.stats();
+    uint64_t worker_cpu_before = 0;
+    for (uint32_t w = 0; w < workers; w++) {
+        worker_cpu_before += pool[w].cpu_time_us();
+    }
+    uint64_t loop_cpu_before = cpu_us(HostEventLoop::instance().thread());
+    uint64_t server_cpu_before = cpu_us(server.thread());
+    uint64_t start_us = host_now_us();
+    if (outage) {
+        host_sleep_until_us(start_us + (uint64_t)seconds * 1000000 / 3);
+        run_outage(out, server, fleet, outage);
+    }
+    host_sleep_until_us(start_us + (uint64_t)seconds * 1000000);
+    double elapsed = (host_now_us() - start_us) / 1000000.0;
+    LwM2MServer::Stats after = server.stats();
+    uint64_t worker_cpu = 0;
+    for (uint32_t w = 0; w < workers; w++) {
+        worker_cpu += pool[w].cpu_time_us();
+    }
+    worker_cpu -= worker_cpu_before;
+    uint64_t loop_cpu = cpu_us(HostEventLoop::instance().thread()) - loop_cpu_before;
+    uint64_t server_cpu = cpu_us(server.thread()) - server_cpu_before;
+    uint64_t resident_end = resident_bytes();
+
+    uint32_t notifications = after.notifications - before.notifications;
+    fprintf(out, "observations: %u; notifications %u, %.0f per s, %.2f per endpoint per s\n", observations,
+            notifications, notifications / elapsed, notifications / elapsed / endpoints);
+    fprintf(out, "server: %u updates, %.0f messages in and %.0f out per s, %.0f and %.0f bytes per s, "
+                 "%u timeouts, %u retransmitted, %u expired\n",
+            after.updates - before.updates, (after.messages_received - before.messages_received) / elapsed,
+            (after.messages_sent - before.messages_sent) / elapsed, (after.bytes_received - before.bytes_received) / elapsed,
+            (after.bytes_sent - before.bytes_sent) / elapsed, after.timeouts - before.timeouts,
+            after.retransmitted - before.retransmitted, after.expired - before.expired);
+    double hours = elapsed / 3600.0 * endpoints;
+    uint32_t messages = (after.messages_received - before.messages_received) + (after.messages_sent - before.messages_sent);
+    fprintf(out, "per endpoint per hour: %.1f registration updates, %.0f messages in and out; "
+                 "%u requests held while asleep\n",
+            (after.updates - before.updates) / hours, messages / hours, after.queued - before.queued);
+    fprintf(out, "memory per endpoint: %.1f KiB made, %.1f KiB registered and observed, %.1f KiB at the end "
+                 "(resident, client and server)\n",
+            (resident_made - resident_before) / 1024.0 / endpoints,
+            (resident_running - resident_before) / 1024.0 / endpoints,
+            (resident_end - resident_before) / 1024.0 / endpoints);
+    fprintf(out, "cpu per endpoint: %.1f us/s on the workers, %.1f us/s on the event loop, %.1f us/s on the server; "
+                 "%.1f%% of a core in all\n",
+            worker_cpu / elapsed / endpoints, loop_cpu / elapsed / endpoints, server_cpu / elapsed / endpoints,
+            (worker_cpu + loop_cpu + server_cpu) / elapsed / 10000.0);
+    fflush(out);
+
+    // De-registered
+    for (uint32_t w = 0; w < workers; w++) {
+        pool[w].stop();
+    }
+    uint64_t deregistering_us = host_now_us();
+    uint32_t registered = 0;
+    for (uint32_t i = 0; i < endpoints; i++) {
+        if (fleet[i]->registered()) {
+            fleet[i]->unregister_now();
+            registered++;
+        }
+    }
+    bool all_deregistered = wait_for(FleetClient::deregistrations, registered, FLEET_REGISTRATION_TIMEOUT_MS);
+    double deregistering_s = (host_now_us() - deregistering_us) / 1000000.0;
+    fprintf(out, "de-registered %u of %u in %.2f s: %.0f per s\n", FleetClient::deregistrations, registered,
+            deregistering_s, deregistering_s > 0 ? FleetClient::deregistrations / deregistering_s : 0.0);
+    fflush(out);
+
+    for (uint32_t i = 0; i < endpoints; i++) {
+        delete fleet[i];
+    }
+    return all_registered && all_deregistered ? 0 : 1;
+}
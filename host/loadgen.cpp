@@ -0,0 +1,583 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * End-to-end load on the client: the example runs unchanged, its main()
+ * renamed, registered with the loopback LwM2M server of lwm2m_server.h,
+ * and the server sends it a weighted mix of requests from `concurrency`
+ * request loops. Latency percentiles and throughput are reported per
+ * operation, along with the notifications of the observed resources.
+ *
+ * Usage: loadgen [--udp] [--seconds S] [--concurrency N] [--mix op=weight,...]
+ *                [--observe prefix] [--listen port] [--trace file] [--verbose]
+ *
+ * Operations, and their weights unless --mix gives others:
+ *
+ *   get=6       GET alldata/0/json
+ *   big=1       GET 1000/0/1, BIG_PAYLOAD_WINDOW_SIZE bytes in blocks
+ *   upload=1    PUT LOADGEN_UPLOAD_SIZE bytes to 1000/0/1 in blocks
+ *   pattern=1   PUT LOADGEN_PATTERN to 3201/0/5853
+ *   blink=1     POST 3201/0/5850, answered once the pattern has blinked
+ *   click=1     press SW2; done when the notification of 3200/0/5501,
+ *               the click count, arrives at the server
+ *
+ * blink, click, big and upload each work on state the client keeps once,
+ * so only one of each runs at a time; a loop that picks one while it is
+ * running waits for its turn. The resources under `prefix` (3313, the
+ * accelerometer, by default) are observed throughout.
+ *
+ * With --listen the server takes the given port and waits for a client
+ * of its own, such as BUILD/host/mbed-os-example-client, rather than
+ * running one; SW2 is then out of reach and click is left out.
+ *
+ * Built with TRACE_ENABLED, --trace writes the client's hot-path trace
+ * for the whole run to `file`, for host/trace2json.
+ */
+
+#include <string>
+#include <stdint.h>
+
+// The example registers with the server the load generator starts
+static const char *loadgen_server_address = "";
+#define MBED_SERVER_ADDRESS loadgen_server_address
+
+// Rings that hold a few milliseconds of a busy client between drains
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 4096
+#endif
+
+#define main client_main
+#include "../main.cpp"
+#undef main
+
+#include <algorithm>
+#include "lwm2m_server.h"
+
+// What the pattern and upload operations write
+#ifndef LOADGEN_PATTERN
+#define LOADGEN_PATTERN "1:1"
+#endif
+#ifndef LOADGEN_UPLOAD_SIZE
+#define LOADGEN_UPLOAD_SIZE 4096
+#endif
+
+// How often the trace is drained to its file
+#ifndef LOADGEN_TRACE_DRAIN_MS
+#define LOADGEN_TRACE_DRAIN_MS 10
+#endif
+
+enum {
+    GET,
+    BIG,
+    UPLOAD,
+    PATTERN,
+    BLINK,
+    CLICK,
+    OPERATIONS
+};
+
+class Load;
+
+struct Operation {
+    const char           *name;
+    bool                  exclusive;
+    uint32_t              weight;
+    Load                 *load;
+    bool                  busy;
+    uint32_t              waiting;      // loops waiting for their turn
+    uint32_t              errors;
+    std::vector<uint32_t> latencies_us;
+};
+
+struct Observed {
+    std::string           path;
+    uint32_t              notifications;
+    uint64_t              last_us;
+    std::vector<uint32_t> intervals_us;
+};
+
+// Nearest-rank percentile of sorted `values`
+static uint32_t percentile(const std::vector<uint32_t> &values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t rank = (size_t)ceil(p * values.size());
+    return values[rank ? rank - 1 : 0];
+}
+
+class Load {
+public:
+    Load(LwM2MServer &server, const std::string &endpoint, uint32_t seconds)
+        : _server(server), _endpoint(endpoint), _loops(0), _clicked_us(0), _random(host_seed() * 2654435761u + 1),
+          _upload(LOADGEN_UPLOAD_SIZE, 'x') {
+        static const char *names[] = { "get", "big", "upload", "pattern", "blink", "click" };
+        static const uint32_t weights[] = { 6, 1, 1, 1, 1, 1 };
+        for (int i = 0; i < OPERATIONS; i++) {
+            Operation &op = _operations[i];
+            op.name = names[i];
+            op.exclusive = i == BIG || i == UPLOAD || i == BLINK || i == CLICK;
+            op.weight = weights[i];
+            op.load = this;
+            op.busy = false;
+            op.waiting = 0;
+            op.errors = 0;
+        }
+        _seconds = seconds;
+        if (_random == 0) {
+            _random = 1;
+        }
+    }
+
+    ~Load() {
+        for (size_t i = 0; i < _observed.size(); i++) {
+            delete _observed[i];
+        }
+    }
+
+    Operation &operation(int i) {
+        return _operations[i];
+    }
+
+    // Observes the resources whose path starts with `prefix`
+    void observe(const std::string &prefix) {
+        LwM2MServer::Endpoint e;
+        if (!_server.endpoint(_endpoint, e)) {
+            return;
+        }
+        size_t at = 0;
+        while ((at = e.links.find("</", at)) != std::string::npos) {
+            size_t end = e.links.find('>', at);
+            size_t next = e.links.find(",<", at);
+            std::string path = e.links.substr(at + 2, end - at - 2);
+            std::string attributes = e.links.substr(end, next == std::string::npos ? next : next - end);
+            at = end;
+            if (path.compare(0, prefix.size(), prefix) != 0 || attributes.find(";obs") == std::string::npos) {
+                continue;
+            }
+            Observed *o = new Observed();
+            o->path = path;
+            o->notifications = 0;
+            o->last_us = 0;
+            _observed.push_back(o);
+            _server.observe(_endpoint, path, &Load::notified, o);
+        }
+    }
+
+    // The click count is observed for click to wait on
+    void observe_clicks() {
+        _server.observe(_endpoint, "3200/0/5501", &Load::clicked, &_operations[CLICK]);
+    }
+
+    void run(uint32_t concurrency) {
+        _lock.lock();
+        _start_us = host_now_us();
+        _end_us = _start_us + (uint64_t)_seconds * 1000000;
+        _last_us = _start_us;
+        _loops = concurrency;
+        for (uint32_t i = 0; i < concurrency; i++) {
+            next();
+        }
+        _lock.unlock();
+
+        // Clicks that were lost time out here; the rest end in handlers
+        for (;;) {
+            wait_ms(10);
+            _lock.lock();
+            Operation &click = _operations[CLICK];
+            if (click.busy && host_now_us() > _clicked_us + (uint64_t)LWM2M_SERVER_TIMEOUT_MS * 1000) {
+                click.errors++;
+                done(click);
+            }
+            bool finished = _loops == 0;
+            _lock.unlock();
+            if (finished) {
+                break;
+            }
+        }
+    }
+
+    void report(FILE *out) {
+        double seconds = (_last_us - _start_us) / 1000000.0;
+        fprintf(out, "%-10s %8s %7s %9s %9s %9s %9s %9s\n", "operation", "count", "errors", "p50 us", "p99 us",
+                "p999 us", "max us", "per s");
+        std::vector<uint32_t> all;
+        uint32_t errors = 0;
+        for (int i = 0; i < OPERATIONS; i++) {
+            Operation &op = _operations[i];
+            if (!op.weight) {
+                continue;
+            }
+            print(out, op.name, op.latencies_us, op.errors, seconds);
+            all.insert(all.end(), op.latencies_us.begin(), op.latencies_us.end());
+            errors += op.errors;
+        }
+        print(out, "all", all, errors, seconds);
+
+        uint32_t notifications = 0;
+        std::vector<uint32_t> intervals;
+        for (size_t i = 0; i < _observed.size(); i++) {
+            notifications += _observed[i]->notifications;
+            intervals.insert(intervals.end(), _observed[i]->intervals_us.begin(), _observed[i]->intervals_us.end());
+        }
+        std::sort(intervals.begin(), intervals.end());
+        fprintf(out, "notifications of %u observed resources: %u, %.1f per s, interval p50 %u us p99 %u us\n",
+                (unsigned)_observed.size(), notifications, seconds > 0 ? notifications / seconds : 0.0,
+                percentile(intervals, 0.5), percentile(intervals, 0.99));
+    }
+
+private:
+    static void print(FILE *out, const char *name, std::vector<uint32_t> &latencies, uint32_t errors, double seconds) {
+        std::sort(latencies.begin(), latencies.end());
+        fprintf(out, "%-10s %8u %7u %9u %9u %9u %9u %9.1f\n", name, (unsigned)latencies.size(), errors,
+                percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 0.999),
+                latencies.empty() ? 0 : latencies.back(), seconds > 0 ? latencies.size() / seconds : 0.0);
+    }
+
+    Operation &pick() {
+        uint32_t total = 0;
+        for (int i = 0; i < OPERATIONS; i++) {
+            total += _operations[i].weight;
+        }
+        uint32_t r = host_random(_random) % total;
+        int i = 0;
+        while (r >= _operations[i].weight) {
+            r -= _operations[i].weight;
+            i++;
+        }
+        return _operations[i];
+    }
+
+    // The calling loop goes on with another operation, or ends
+    void next() {
+        if (host_now_us() >= _end_us) {
+            _loops--;
+            return;
+        }
+        Operation &op = pick();
+        if (op.exclusive && op.busy) {
+            op.waiting++;
+            return;
+        }
+        start(op);
+    }
+
+    void start(Operation &op) {
+        op.busy = true;
+        uint32_t sent = 1;
+        switch (&op - _operations) {
+            case GET:
+                sent = _server.send(_endpoint, LwM2MServer::request(CoapMessage::GET, "alldata/0/json"), &Load::answered, &op);
+                break;
+            case BIG:
+                sent = _server.send(_endpoint, LwM2MServer::request(CoapMessage::GET, "1000/0/1"), &Load::answered, &op);
+                break;
+            case UPLOAD:
+                sent = _server.send(_endpoint, LwM2MServer::request(CoapMessage::PUT, "1000/0/1", _upload), &Load::answered, &op);
+                break;
+            case PATTERN:
+                sent = _server.send(_endpoint, LwM2MServer::request(CoapMessage::PUT, "3201/0/5853", LOADGEN_PATTERN),
+                                    &Load::answered, &op);
+                break;
+            case BLINK:
+                sent = _server.send(_endpoint, LwM2MServer::request(CoapMessage::POST, "3201/0/5850"), &Load::answered, &op);
+                break;
+            case CLICK:
+                _clicked_us = host_now_us();
+                host_pin_fall(SW2);
+                break;
+        }
+        if (!sent) {
+            // The endpoint is gone; so is this loop
+            op.errors++;
+            op.busy = false;
+            _loops--;
+        }
+    }
+
+    void done(Operation &op) {
+        op.busy = false;
+        _last_us = host_now_us();
+        if (op.waiting && host_now_us() < _end_us) {
+            op.waiting--;
+            start(op);
+        } else {
+            // Time is up for the loops waiting as well
+            _loops -= op.waiting;
+            op.waiting = 0;
+        }
+        next();
+    }
+
+    static void answered(void *context, const LwM2MServer::Exchange &exchange) {
+        Operation &op = *(Operation*)context;
+        Load &load = *op.load;
+        load._lock.lock();
+        if (exchange.succeeded()) {
+            op.latencies_us.push_back((uint32_t)exchange.latency_us());
+        } else {
+            op.errors++;
+        }
+        load.done(op);
+        load._lock.unlock();
+    }
+
+    static void clicked(void *context, const LwM2MServer::Exchange &exchange) {
+        Operation &op = *(Operation*)context;
+        Load &load = *op.load;
+        load._lock.lock();
+        if (exchange.notification && op.busy) {
+            op.latencies_us.push_back((uint32_t)(exchange.done_us - load._clicked_us));
+            load.done(op);
+        }
+        load._lock.unlock();
+    }
+
+    static void notified(void *context, const LwM2MServer::Exchange &exchange) {
+        Observed &o = *(Observed*)context;
+        if (!exchange.notification) {
+            return;
+        }
+        o.notifications++;
+        if (o.last_us) {
+            o.intervals_us.push_back((uint32_t)(exchange.done_us - o.last_us));
+        }
+        o.last_us = exchange.done_us;
+    }
+
+    LwM2MServer            &_server;
+    std::string             _endpoint;
+    Mutex                   _lock;
+    Operation               _operations[OPERATIONS];
+    std::vector<Observed*>  _observed;
+    uint32_t                _seconds;
+    uint32_t                _loops;
+    uint64_t                _start_us;
+    uint64_t                _end_us;
+    uint64_t                _last_us;
+    uint64_t                _clicked_us;
+    uint32_t                _random;
+    std::string             _upload;
+};
+
+#if TRACE_ENABLED
+// Drains the trace into a file until told to stop, then drains the rest
+class TraceWriter {
+public:
+    TraceWriter(FILE *file) : _file(file), _stop(false), _bytes(0) {
+        pthread_create(&_thread, NULL, &TraceWriter::run, this);
+    }
+
+    // Bytes written
+    uint64_t stop() {
+        _stop = true;
+        pthread_join(_thread, NULL);
+        fclose(_file);
+        return _bytes;
+    }
+
+private:
+    static void *run(void *writer) {
+        ((TraceWriter*)writer)->drain();
+        return NULL;
+    }
+
+    void drain() {
+        static uint8_t buffer[64 * 1024];
+        for (;;) {
+            bool stopping = _stop;
+            size_t len;
+            while ((len = Trace::instance().drain(buffer, sizeof(buffer))) > TRACE_HEADER_SIZE) {
+                _bytes += fwrite(buffer, 1, len, _file);
+            }
+            if (stopping) {
+                return;
+            }
+            wait_ms(LOADGEN_TRACE_DRAIN_MS);
+        }
+    }
+
+    FILE         *_file;
+    pthread_t     _thread;
+    volatile bool _stop;
+    uint64_t      _bytes;
+};
+#endif
+
+static void *run_client(void *) {
+    // stands in for the board's main thread, stack statistics included
+    host_thread_started();
+    client_main();
+    return NULL;
+}
+
+// Applies "get=4,blink=1": the weights of the operations named, and 0
+// for the others
+static bool set_mix(Load &load, const char *mix) {
+    for (int i = 0; i < OPERATIONS; i++) {
+        load.operation(i).weight = 0;
+    }
+    std::string text(mix);
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        std::string item = text.substr(start, end - start);
+        size_t equals = item.find('=');
+        int i = 0;
+        while (i < OPERATIONS && (equals == std::string::npos || item.compare(0, equals, load.operation(i).name) != 0 ||
+                                  strlen(load.operation(i).name) != equals)) {
+            i++;
+        }
+        if (i == OPERATIONS) {
+            return false;
+        }
+        load.operation(i).weight = strtoul(item.c_str() + equals + 1, NULL, 10);
+        start = end + 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    bool tcp = true;
+    bool verbose = false;
+    uint32_t seconds = 10;
+    uint32_t concurrency = 4;
+    uint16_t listen_port = 0;
+    const char *mix = NULL;
+    const char *prefix = "3313";
+    const char *trace = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--udp") == 0) {
+            tcp = false;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            concurrency = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+            mix = argv[++i];
+        } else if (strcmp(argv[i], "--observe") == 0 && i + 1 < argc) {
+            prefix = argv[++i];
+        } else if (strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listen_port = (uint16_t)strtoul(argv[++i], NULL, 10);
+        } else if (TRACE_ENABLED && strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--udp] [--seconds S] [--concurrency N] [--mix op=weight,...]\n"
+                            "          [--observe prefix] [--listen port] [--trace file] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    setenv("MBED_HOST_SEED", "1", 0);
+
+    // The report goes to stdout; the example's own logging, unless
+    // --verbose, to /dev/null
+    fflush(stdout);
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!verbose) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+
+#if TRACE_ENABLED
+    TraceWriter *trace_writer = NULL;
+    if (trace) {
+        FILE *file = fopen(trace, "wb");
+        if (!file) {
+            fprintf(out, "Could not write %s\n", trace);
+            return 1;
+        }
+        trace_writer = new TraceWriter(file);
+    }
+#endif
+
+    LwM2MServer server(tcp, listen_port);
+    if (!server.listening()) {
+        fprintf(out, "Could not listen on port %u\n", listen_port);
+        return 1;
+    }
+    std::string address = server.uri();
+    pthread_t client;
+    if (!listen_port) {
+        loadgen_server_address = address.c_str();
+        SOCKET_MODE = tcp ? M2MInterface::TCP : M2MInterface::UDP;
+        pthread_create(&client, NULL, run_client, NULL);
+    } else {
+        fprintf(out, "Waiting for a client to register at %s (%s)\n", address.c_str(), tcp ? "TCP" : "UDP");
+        fflush(out);
+    }
+    std::string endpoint;
+    if (!server.wait_for_registration(endpoint, listen_port ? 600000 : 10000)) {
+        fprintf(out, "No client registered at %s\n", address.c_str());
+        return 1;
+    }
+
+    Load load(server, endpoint, seconds);
+    if (mix && !set_mix(load, mix)) {
+        fprintf(out, "Bad mix \"%s\"; operations are get, big, upload, pattern, blink and click\n", mix);
+        return 2;
+    }
+    if (listen_port) {
+        load.operation(CLICK).weight = 0;
+    }
+    uint32_t total = 0;
+    for (int i = 0; i < OPERATIONS; i++) {
+        total += load.operation(i).weight;
+    }
+    if (!total || !concurrency) {
+        fprintf(out, "Nothing to run\n");
+        return 2;
+    }
+
+    // Blinks are kept short, so that they measure the client rather than
+    // the pattern
+    LwM2MServer::Exchange result;
+    server.exchange(endpoint, LwM2MServer::request(CoapMessage::PUT, "3201/0/5853", LOADGEN_PATTERN), result);
+    load.observe(prefix);
+    if (load.operation(CLICK).weight) {
+        load.observe_clicks();
+    }
+    wait_ms(100);
+
+    fprintf(out, "loadgen: endpoint %s over %s, %u s, %u loops, seed %s\n", endpoint.c_str(), tcp ? "TCP" : "UDP",
+            seconds, concurrency, getenv("MBED_HOST_SEED"));
+    fflush(out);
+    load.run(concurrency);
+    load.report(out);
+
+    LwM2MServer::Stats stats = server.stats();
+    fprintf(out, "server: %u registrations, %u updates, %u requests, %u timeouts, %u retransmitted, "
+                 "%" PRIu64 " messages in (%" PRIu64 " bytes), %" PRIu64 " out (%" PRIu64 " bytes)\n",
+            stats.registrations, stats.updates, stats.requests, stats.timeouts, stats.retransmitted,
+            stats.messages_received, stats.bytes_received, stats.messages_sent, stats.bytes_sent);
+#if TRACE_ENABLED
+    if (trace_writer) {
+        uint64_t bytes = trace_writer->stop();
+        fprintf(out, "trace: %" PRIu64 " bytes written to %s\n", bytes, trace);
+    }
+#endif
+    fflush(out);
+
+    if (!listen_port) {
+        unregister();
+        pthread_join(client, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,963 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_LWM2M_SERVER_H__
+#define __HOST_LWM2M_SERVER_H__
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "mbed.h"
+#include "coap.h"
+
+// How long a request to an endpoint may take before it fails
+#ifndef LWM2M_SERVER_TIMEOUT_MS
+#define LWM2M_SERVER_TIMEOUT_MS 5000
+#endif
+
+// First retransmission of a confirmable request over UDP; the interval
+// doubles for every one after it
+#ifndef LWM2M_SERVER_ACK_TIMEOUT_MS
+#define LWM2M_SERVER_ACK_TIMEOUT_MS 2000
+#endif
+#ifndef LWM2M_SERVER_MAX_RETRANSMIT
+#define LWM2M_SERVER_MAX_RETRANSMIT 4
+#endif
+
+// Block size of block-wise PUTs and POSTs the server sends
+#ifndef LWM2M_SERVER_BLOCK_SIZE
+#define LWM2M_SERVER_BLOCK_SIZE 1024
+#endif
+
+// Readiness events, and datagrams, taken at once
+#ifndef LWM2M_SERVER_EVENTS
+#define LWM2M_SERVER_EVENTS 64
+#endif
+
+// Receive buffer asked for the UDP socket; the kernel may give less
+#ifndef LWM2M_SERVER_UDP_BUFFER
+#define LWM2M_SERVER_UDP_BUFFER (4 * 1024 * 1024)
+#endif
+
+// Lifetime of a registration that does not give one, in seconds
+#ifndef LWM2M_SERVER_DEFAULT_LIFETIME
+#define LWM2M_SERVER_DEFAULT_LIFETIME 86400
+#endif
+
+// How long an endpoint in queue mode stays reachable after it was last
+// heard from; CoAP's MAX_TRANSMIT_WAIT, as LwM2M suggests
+#ifndef LWM2M_SERVER_QUEUE_AWAKE_MS
+#define LWM2M_SERVER_QUEUE_AWAKE_MS 93000
+#endif
+
+/*
+* An LwM2M server on the loopback interface, standing in for mbed Device
+* Connector in host builds. It takes registrations, updates and
+* de-registrations on /rd, and sends GET, PUT and POST requests and
+* observations to registered endpoints.
+*
+* Block-wise transfers are done by the server: a response in several
+* Block2 blocks, or a notification, is fetched block by block and a
+* request payload larger than LWM2M_SERVER_BLOCK_SIZE goes out in Block1
+* blocks. Handlers see the whole payload once. Separate responses, such
+* as the delayed response to a POST, complete the request they answer.
+*
+* An endpoint registered in queue mode (binding UQ or TQ) is taken to be
+* asleep LWM2M_SERVER_QUEUE_AWAKE_MS after the server last heard from it.
+* Requests to it are held until it registers, updates its registration,
+* notifies or answers again, and they only time out once its lifetime has
+* passed as well.
+*
+* Everything runs on one thread of the server's, waiting on every socket
+* with epoll so that a fleet of endpoints can connect, which also calls
+* the handlers, without the server's lock held, so handlers may send further
+* requests. exchange() waits on that thread and must not be called from
+* a handler.
+*/
+class LwM2MServer {
+public:
+    struct Endpoint {
+        std::string name;
+        std::string type;
+        std::string location;       // "rd/7"
+        std::string links;          // registered resources, CoRE link format
+        std::string binding;        // "U" or "T"
+        uint32_t    lifetime;       // seconds
+        uint32_t    updates;
+        uint64_t    registered_us;
+        uint64_t    updated_us;
+        uint64_t    awake_until_us; // in queue mode, reachable until then
+
+        bool queue_mode() const {
+            return binding.find('Q') != std::string::npos;
+        }
+    };
+
+    // A request to an endpoint, once answered, or a notification
+    struct Exchange {
+        Exchange() : id(0), method(0), code(0), content_format(0), blocks(0), notification(false), sent_us(0),
+                     done_us(0) {}
+
+        uint32_t    id;             // as returned by send() and observe()
+        std::string endpoint;
+        std::string path;
+        uint8_t     method;
+        uint8_t     code;           // of the response; EMPTY if none came
+        uint32_t    content_format;
+        uint32_t    blocks;         // messages the payloads took
+        bool        notification;
+        std::string payload;
+        uint64_t    sent_us;        // for a notification, when it arrived
+        uint64_t    done_us;
+
+        uint64_t latency_us() const {
+            return done_us - sent_us;
+        }
+        bool succeeded() const {
+            return code >= CoapMessage::CREATED && code < CoapMessage::BAD_REQUEST;
+        }
+    };
+
+    typedef void (*Handler)(void *context, const Exchange &exchange);
+
+    struct Stats {
+        uint32_t registrations;
+        uint32_t updates;
+        uint32_t deregistrations;
+        uint32_t expired;           // registrations whose lifetime ran out
+        uint32_t queued;            // requests held for endpoints asleep in queue mode
+        uint32_t requests;          // sent, not counting further blocks
+        uint32_t responses;
+        uint32_t timeouts;
+        uint32_t notifications;
+        uint32_t retransmitted;
+        uint64_t messages_received;
+        uint64_t messages_sent;
+        uint64_t bytes_received;
+        uint64_t bytes_sent;
+    };
+
+    // Listens on 127.0.0.1:`port`, an ephemeral port if 0
+    LwM2MServer(bool tcp, uint16_t port=0)
+        : _tcp(tcp), _stop(false), _unreachable(false), _epoll(-1), _port(0), _running(false), _locations(0),
+          _tokens(0), _exchanges(0), _expiry_us(0), _queued(0) {
+        memset(&_stats, 0, sizeof(_stats));
+        pthread_mutex_init(&_mutex, NULL);
+        _message_id = (uint16_t)host_seed();
+        _listener = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+        int on = 1;
+        setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (!tcp) {
+            // Room for a fleet's worth of datagrams arriving at once
+            int size = LWM2M_SERVER_UDP_BUFFER;
+            setsockopt(_listener, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (_listener < 0 || bind(_listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+            (tcp && listen(_listener, SOMAXCONN) != 0)) {
+            return;
+        }
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll < 0 || !watch(_listener)) {
+            return;
+        }
+        socklen_t length = sizeof(address);
+        getsockname(_listener, (struct sockaddr*)&address, &length);
+        _port = ntohs(address.sin_port);
+        _running = pthread_create(&_thread, NULL, &LwM2MServer::run, this) == 0;
+    }
+
+    ~LwM2MServer() {
+        _stop = true;
+        if (_port && _running) {
+            pthread_join(_thread, NULL);
+        }
+        for (std::map<int, std::string>::iterator s = _streams.begin(); s != _streams.end(); ++s) {
+            close(s->first);
+        }
+        if (_epoll >= 0) {
+            close(_epoll);
+        }
+        if (_listener >= 0) {
+            close(_listener);
+        }
+        pthread_mutex_destroy(&_mutex);
+    }
+
+    // The server's thread, for measuring the CPU time it takes
+    pthread_t thread() const {
+        return _thread;
+    }
+
+    // False if the port could not be bound
+    bool listening() const {
+        return _port != 0 && _running;
+    }
+
+    uint16_t port() const {
+        return _port;
+    }
+
+    std::string uri() const {
+        char text[40];
+        snprintf(text, sizeof(text), "coap://127.0.0.1:%u", _port);
+        return text;
+    }
+
+    /*
+    * Takes the server off the network, or brings it back, as a link that
+    * goes down would: while unreachable it drops every datagram both ways
+    * and closes TCP connections, new ones as they come. Registrations are
+    * kept until their lifetimes run out, so an endpoint that comes back
+    * in time may update its registration rather than register again.
+    */
+    void set_reachable(bool reachable) {
+        pthread_mutex_lock(&_mutex);
+        _unreachable = !reachable;
+        if (_unreachable && _tcp) {
+            for (std::map<int, std::string>::iterator s = _streams.begin(); s != _streams.end(); ++s) {
+                epoll_ctl(_epoll, EPOLL_CTL_DEL, s->first, NULL);
+                close(s->first);
+            }
+            _streams.clear();
+            // the descriptors will be reused for other connections
+            for (std::map<std::string, Registration>::iterator r = _registrations.begin(); r != _registrations.end();
+                 ++r) {
+                r->second.peer.fd = -1;
+            }
+        }
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    /*
+    * Waits until endpoint `name` is registered, or any endpoint if `name`
+    * is empty, in which case `name` is set to the first one there is.
+    */
+    bool wait_for_registration(std::string &name, uint32_t timeout_ms) {
+        uint64_t deadline = host_now_us() + (uint64_t)timeout_ms * 1000;
+        pthread_mutex_lock(&_mutex);
+        bool found = false;
+        for (;;) {
+            if (name.empty() && !_names.empty()) {
+                name = _names.begin()->first;
+                found = true;
+            } else if (!name.empty()) {
+                found = _names.count(name) != 0;
+            }
+            if (found || host_now_us() >= deadline) {
+                break;
+            }
+            pthread_mutex_unlock(&_mutex);
+            usleep(1000);
+            pthread_mutex_lock(&_mutex);
+        }
+        pthread_mutex_unlock(&_mutex);
+        return found;
+    }
+
+    bool endpoint(const std::string &name, Endpoint &copy) {
+        pthread_mutex_lock(&_mutex);
+        Registration *r = registration_of(name);
+        if (r) {
+            copy = r->endpoint;
+        }
+        pthread_mutex_unlock(&_mutex);
+        return r != NULL;
+    }
+
+    size_t registered() {
+        pthread_mutex_lock(&_mutex);
+        size_t count = _registrations.size();
+        pthread_mutex_unlock(&_mutex);
+        return count;
+    }
+
+    // A request for send(): `method` on `path`, e.g. "3201/0/5850"
+    static CoapMessage request(uint8_t method, const std::string &path, const std::string &payload=std::string()) {
+        CoapMessage message(CoapMessage::CON, method);
+        message.set_path(path);
+        message.payload = payload;
+        return message;
+    }
+
+    /*
+    * Sends `message` to endpoint `name`; `handler` is called with the
+    * response once it is complete or the request times out. Returns the
+    * exchange's id, or 0 if `name` is not registered.
+    */
+    uint32_t send(const std::string &name, const CoapMessage &message, Handler handler, void *context) {
+        pthread_mutex_lock(&_mutex);
+        Registration *r = registration_of(name);
+        uint32_t id = 0;
+        if (r) {
+            Outstanding o;
+            o.exchange.id = id = ++_exchanges;
+            o.exchange.endpoint = name;
+            o.exchange.path = message.path();
+            o.exchange.method = message.code;
+            o.exchange.sent_us = host_now_us();
+            o.handler = handler;
+            o.context = context;
+            o.peer = r->peer;
+            o.message = message;
+            o.message.type = CoapMessage::CON;
+            o.message.token = next_token();
+            o.observe = message.has_option(CoapMessage::OBSERVE) && message.uint_option(CoapMessage::OBSERVE) == 0;
+            o.deadline_us = o.exchange.sent_us + (uint64_t)LWM2M_SERVER_TIMEOUT_MS * 1000;
+            if (message.payload.size() > LWM2M_SERVER_BLOCK_SIZE) {
+                o.body = message.payload;
+                set_block1(o.message, o.body, 0);
+                o.message.add_uint_option(CoapMessage::SIZE1, o.body.size());
+            }
+            _stats.requests++;
+            if (r->endpoint.queue_mode() && o.exchange.sent_us >= r->endpoint.awake_until_us) {
+                o.queued = true;
+                o.deadline_us += (uint64_t)r->endpoint.lifetime * 1000000;
+                _outstanding[o.message.token] = o;
+                _queued++;
+                _stats.queued++;
+            } else {
+                transmit(_outstanding[o.message.token] = o);
+            }
+        }
+        pthread_mutex_unlock(&_mutex);
+        return id;
+    }
+
+    /*
+    * Observes `path` of endpoint `name`: `handler` gets the response to
+    * the GET, then every notification until stop_observing().
+    */
+    uint32_t observe(const std::string &name, const std::string &path, Handler handler, void *context) {
+        CoapMessage message = request(CoapMessage::GET, path);
+        message.add_uint_option(CoapMessage::OBSERVE, 0);
+        return send(name, message, handler, context);
+    }
+
+    // Further notifications for the observation are answered with RST
+    void stop_observing(uint32_t id) {
+        pthread_mutex_lock(&_mutex);
+        for (std::map<std::string, Observation>::iterator o = _observations.begin(); o != _observations.end(); ++o) {
+            if (o->second.id == id) {
+                _observations.erase(o);
+                break;
+            }
+        }
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    /*
+    * Sends `message` and waits for the outcome. Not to be called from a
+    * handler, as handlers run on the thread that completes exchanges.
+    */
+    bool exchange(const std::string &name, const CoapMessage &message, Exchange &result) {
+        Waiting w;
+        if (!send(name, message, &LwM2MServer::completed, &w)) {
+            return false;
+        }
+        w.done.wait();
+        result = w.result;
+        return result.succeeded();
+    }
+
+    Stats stats() {
+        pthread_mutex_lock(&_mutex);
+        Stats stats = _stats;
+        pthread_mutex_unlock(&_mutex);
+        return stats;
+    }
+
+private:
+    // Where an endpoint's messages come from: a TCP stream, or a UDP address
+    struct Peer {
+        int                     fd;
+        struct sockaddr_storage address;
+        socklen_t               length;
+    };
+
+    struct Registration {
+        Endpoint endpoint;
+        Peer     peer;
+    };
+
+    // A request the server waits on the response to
+    struct Outstanding {
+        Outstanding() : handler(NULL), context(NULL), observe(false), queued(false), acknowledged(true),
+                        retransmissions(0), interval_ms(0), retransmit_us(0), deadline_us(0) {}
+
+        Exchange    exchange;
+        Handler     handler;
+        void       *context;
+        Peer        peer;
+        CoapMessage message;        // the last one sent
+        std::string bytes;
+        std::string body;           // the whole payload of a block-wise request
+        bool        observe;
+        bool        queued;         // not sent yet, the endpoint is asleep
+        bool        acknowledged;
+        uint8_t     retransmissions;
+        uint32_t    interval_ms;
+        uint64_t    retransmit_us;
+        uint64_t    deadline_us;
+    };
+
+    struct Observation {
+        uint32_t    id;
+        Handler     handler;
+        void       *context;
+        std::string endpoint;
+        std::string path;
+    };
+
+    // The answer to a confirmable request, sent again if the request is
+    struct Answered {
+        Peer        peer;
+        uint16_t    message_id;
+        std::string bytes;
+    };
+
+    struct Completion {
+        Handler  handler;
+        void    *context;
+        Exchange exchange;
+    };
+
+    struct Waiting {
+        Semaphore done;
+        Exchange  result;
+    };
+
+    static void completed(void *context, const Exchange &exchange) {
+        Waiting *w = (Waiting*)context;
+        w->result = exchange;
+        w->done.release();
+    }
+
+    static void *run(void *server) {
+        ((LwM2MServer*)server)->serve();
+        return NULL;
+    }
+
+    Registration *registration_of(const std::string &name) {
+        std::map<std::string, std::string>::iterator n = _names.find(name);
+        if (n == _names.end()) {
+            return NULL;
+        }
+        return &_registrations[n->second];
+    }
+
+    std::string next_token() {
+        uint64_t token = ++_tokens;
+        std::string bytes;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            bytes += (char)((token >> shift) & 0xff);
+        }
+        return bytes;
+    }
+
+    static void set_block1(CoapMessage &message, const std::string &body, uint32_t number) {
+        uint32_t offset = number * LWM2M_SERVER_BLOCK_SIZE;
+        message.payload = body.substr(offset, LWM2M_SERVER_BLOCK_SIZE);
+        message.remove_option(CoapMessage::BLOCK1);
+        message.add_uint_option(CoapMessage::BLOCK1, CoapMessage::block_value(number,
+            offset + LWM2M_SERVER_BLOCK_SIZE < body.size(), LWM2M_SERVER_BLOCK_SIZE));
+    }
+
+    void send_to(const Peer &peer, const std::string &message) {
+        if (_unreachable) {
+            return;
+        }
+        ssize_t sent;
+        if (_tcp) {
+            std::string framed = CoapMessage::frame(message);
+            sent = ::send(peer.fd, framed.data(), framed.size(), MSG_NOSIGNAL);
+        } else {
+            sent = sendto(_listener, message.data(), message.size(), 0, (const struct sockaddr*)&peer.address, peer.length);
+        }
+        if (sent > 0) {
+            _stats.messages_sent++;
+            _stats.bytes_sent += sent;
+        }
+    }
+
+    // Sends the next message of `o`, with a new message id
+    void transmit(Outstanding &o) {
+        o.message.message_id = ++_message_id;
+        o.bytes = o.message.encode();
+        o.acknowledged = _tcp;
+        o.retransmissions = 0;
+        o.interval_ms = LWM2M_SERVER_ACK_TIMEOUT_MS;
+        o.retransmit_us = host_now_us() + (uint64_t)o.interval_ms * 1000;
+        o.exchange.blocks++;
+        send_to(o.peer, o.bytes);
+    }
+
+    bool watch(int fd) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        return epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    void serve() {
+        uint8_t buffer[HOST_COAP_MAX_MESSAGE];
+        struct epoll_event events[LWM2M_SERVER_EVENTS];
+        std::vector<Completion> done;
+        while (!_stop) {
+            int ready = epoll_wait(_epoll, events, LWM2M_SERVER_EVENTS, 10);
+            pthread_mutex_lock(&_mutex);
+            for (int i = 0; i < ready; i++) {
+                int fd = events[i].data.fd;
+                if (fd != _listener) {
+                    receive(fd, buffer, sizeof(buffer), done);
+                } else if (_tcp) {
+                    int s = accept(_listener, NULL, NULL);
+                    if (s >= 0 && _unreachable) {
+                        close(s);
+                    } else if (s >= 0) {
+                        int on = 1;
+                        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                        if (watch(s)) {
+                            _streams[s];
+                        } else {
+                            close(s);
+                        }
+                    }
+                } else {
+                    // Every datagram waiting, up to a batch's worth
+                    for (int n = 0; n < LWM2M_SERVER_EVENTS; n++) {
+                        Peer peer;
+                        peer.fd = _listener;
+                        peer.length = sizeof(peer.address);
+                        ssize_t got = recvfrom(_listener, buffer, sizeof(buffer), MSG_DONTWAIT,
+                                               (struct sockaddr*)&peer.address, &peer.length);
+                        if (got <= 0) {
+                            break;
+                        }
+                        if (!_unreachable) {
+                            handle(peer, buffer, got, done);
+                        }
+                    }
+                }
+            }
+            expire(done);
+            pthread_mutex_unlock(&_mutex);
+
+            for (size_t i = 0; i < done.size(); i++) {
+                if (done[i].handler) {
+                    done[i].handler(done[i].context, done[i].exchange);
+                }
+            }
+            done.clear();
+        }
+    }
+
+    // Reads what arrived on a TCP stream and handles the messages it completes
+    void receive(int fd, uint8_t *buffer, size_t size, std::vector<Completion> &done) {
+        std::map<int, std::string>::iterator s = _streams.find(fd);
+        if (s == _streams.end()) {
+            return;
+        }
+        ssize_t got = recv(fd, buffer, size, MSG_DONTWAIT);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return;
+        }
+        if (got <= 0) {
+            closed(fd);
+            epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, NULL);
+            close(fd);
+            _streams.erase(s);
+            return;
+        }
+        s->second.append((const char*)buffer, got);
+        Peer peer;
+        peer.fd = fd;
+        peer.length = 0;
+        std::string message;
+        while (CoapMessage::unframe(s->second, message)) {
+            handle(peer, (const uint8_t*)message.data(), message.size(), done);
+        }
+    }
+
+    static bool same(const Peer &a, const Peer &b) {
+        return a.fd == b.fd && a.length == b.length && memcmp(&a.address, &b.address, a.length) == 0;
+    }
+
+    void handle(const Peer &peer, const uint8_t *data, size_t size, std::vector<Completion> &done) {
+        CoapMessage m;
+        _stats.messages_received++;
+        _stats.bytes_received += size;
+        if (!m.decode(data, size)) {
+            return;
+        }
+        if (m.is_request()) {
+            if (!_tcp && m.type == CoapMessage::CON) {
+                for (size_t i = 0; i < _answered.size(); i++) {
+                    if (_answered[i].message_id == m.message_id && same(_answered[i].peer, peer)) {
+                        send_to(peer, _answered[i].bytes);
+                        return;
+                    }
+                }
+            }
+            std::string heard;
+            CoapMessage response = answer(peer, m, heard);
+            std::string bytes = response.encode();
+            if (!_tcp && m.type == CoapMessage::CON) {
+                Answered a;
+                a.peer = peer;
+                a.message_id = m.message_id;
+                a.bytes = bytes;
+                _answered.push_back(a);
+                if (_answered.size() > 32) {
+                    _answered.erase(_answered.begin());
+                }
+            }
+            send_to(peer, bytes);
+            if (!heard.empty()) {
+                heard_from(heard);
+            }
+            return;
+        }
+
+        std::map<std::string, Outstanding>::iterator o = _outstanding.end();
+        if (m.type == CoapMessage::ACK || m.type == CoapMessage::RST) {
+            for (o = _outstanding.begin(); o != _outstanding.end(); ++o) {
+                if (o->second.message.message_id == m.message_id && same(o->second.peer, peer)) {
+                    break;
+                }
+            }
+            if (o != _outstanding.end() && m.type == CoapMessage::RST) {
+                finish(o, done);
+                return;
+            }
+            if (m.code == CoapMessage::EMPTY) {
+                // A separate response follows
+                if (o != _outstanding.end()) {
+                    o->second.acknowledged = true;
+                }
+                return;
+            }
+        }
+        if (m.code == CoapMessage::EMPTY) {
+            return;
+        }
+        o = _outstanding.find(m.token);
+        std::map<std::string, Observation>::iterator n = _observations.find(m.token);
+        if (o == _outstanding.end() && n == _observations.end()) {
+            if (m.type == CoapMessage::CON || m.has_option(CoapMessage::OBSERVE)) {
+                // Nobody is waiting for it: a notification of a cancelled
+                // observation or a response given up on
+                CoapMessage reset(m.has_option(CoapMessage::OBSERVE) ? CoapMessage::RST : CoapMessage::ACK,
+                                  CoapMessage::EMPTY, m.message_id);
+                send_to(peer, reset.encode());
+            }
+            return;
+        }
+        if (m.type == CoapMessage::CON) {
+            send_to(peer, CoapMessage(CoapMessage::ACK, CoapMessage::EMPTY, m.message_id).encode());
+        }
+        // Only an endpoint in queue mode needs to be known to be awake;
+        // the name is copied as respond() may free it
+        const std::string &name = o != _outstanding.end() ? o->second.exchange.endpoint : n->second.endpoint;
+        Registration *r = registration_of(name);
+        std::string awake = r && r->endpoint.queue_mode() ? name : std::string();
+        if (o != _outstanding.end()) {
+            respond(o, m, done);
+        } else {
+            notify(peer, n->second, m, done);
+        }
+        if (!awake.empty()) {
+            heard_from(awake);
+        }
+    }
+
+    // Endpoint `name` is awake: sends what was held for it
+    void heard_from(const std::string &name) {
+        Registration *r = registration_of(name);
+        if (!r || !r->endpoint.queue_mode()) {
+            return;
+        }
+        uint64_t now = host_now_us();
+        r->endpoint.awake_until_us = now + (uint64_t)LWM2M_SERVER_QUEUE_AWAKE_MS * 1000;
+        if (!_queued) {
+            return;
+        }
+        for (std::map<std::string, Outstanding>::iterator o = _outstanding.begin(); o != _outstanding.end(); ++o) {
+            Outstanding &out = o->second;
+            if (out.queued && out.exchange.endpoint == name) {
+                out.queued = false;
+                _queued--;
+                out.peer = r->peer;
+                out.deadline_us = now + (uint64_t)LWM2M_SERVER_TIMEOUT_MS * 1000;
+                transmit(out);
+            }
+        }
+    }
+
+    // The next block of a request, the next block of a response, or the end
+    void respond(std::map<std::string, Outstanding>::iterator o, const CoapMessage &m, std::vector<Completion> &done) {
+        Outstanding &out = o->second;
+        if (m.code == CoapMessage::CONTINUE && !out.body.empty() && m.has_option(CoapMessage::BLOCK1)) {
+            uint32_t next = CoapMessage::block_number(out.message.uint_option(CoapMessage::BLOCK1)) + 1;
+            if ((size_t)next * LWM2M_SERVER_BLOCK_SIZE < out.body.size()) {
+                out.message.remove_option(CoapMessage::SIZE1);
+                set_block1(out.message, out.body, next);
+                transmit(out);
+                return;
+            }
+        }
+        out.exchange.payload += m.payload;
+        out.exchange.code = m.code;
+        if (m.has_option(CoapMessage::CONTENT_FORMAT)) {
+            out.exchange.content_format = m.uint_option(CoapMessage::CONTENT_FORMAT);
+        }
+        if (out.observe && !out.exchange.notification && m.code == CoapMessage::CONTENT &&
+            m.has_option(CoapMessage::OBSERVE)) {
+            Observation n;
+            n.id = out.exchange.id;
+            n.handler = out.handler;
+            n.context = out.context;
+            n.endpoint = out.exchange.endpoint;
+            n.path = out.exchange.path;
+            _observations[o->first] = n;
+            out.observe = false;
+        }
+        if (m.has_option(CoapMessage::BLOCK2) && CoapMessage::block_more(m.uint_option(CoapMessage::BLOCK2))) {
+            // Asks for the next block, under a token of its own if the
+            // first is now the observation's
+            uint32_t block = m.uint_option(CoapMessage::BLOCK2);
+            Outstanding next = out;
+            next.message = request(CoapMessage::GET, out.exchange.path);
+            next.message.token = _observations.count(o->first) ? next_token() : o->first;
+            next.message.add_uint_option(CoapMessage::BLOCK2, CoapMessage::block_value(
+                CoapMessage::block_number(block) + 1, false, CoapMessage::block_size(block)));
+            next.body.clear();
+            if (next.message.token != o->first) {
+                _outstanding.erase(o);
+            }
+            transmit(_outstanding[next.message.token] = next);
+            return;
+        }
+        finish(o, done);
+    }
+
+    void notify(const Peer &peer, const Observation &n, const CoapMessage &m, std::vector<Completion> &done) {
+        _stats.notifications++;
+        Outstanding o;
+        o.exchange.id = n.id;
+        o.exchange.endpoint = n.endpoint;
+        o.exchange.path = n.path;
+        o.exchange.method = CoapMessage::GET;
+        o.exchange.code = m.code;
+        o.exchange.content_format = m.uint_option(CoapMessage::CONTENT_FORMAT);
+        o.exchange.blocks = 1;
+        o.exchange.notification = true;
+        o.exchange.payload = m.payload;
+        o.exchange.sent_us = host_now_us();
+        o.handler = n.handler;
+        o.context = n.context;
+        o.peer = peer;
+        o.deadline_us = o.exchange.sent_us + (uint64_t)LWM2M_SERVER_TIMEOUT_MS * 1000;
+        std::string token = next_token();
+        if (m.has_option(CoapMessage::BLOCK2) && CoapMessage::block_more(m.uint_option(CoapMessage::BLOCK2))) {
+            // The rest of a notification too large for one message
+            uint32_t block = m.uint_option(CoapMessage::BLOCK2);
+            o.message = request(CoapMessage::GET, n.path);
+            o.message.token = token;
+            o.message.add_uint_option(CoapMessage::BLOCK2, CoapMessage::block_value(
+                CoapMessage::block_number(block) + 1, false, CoapMessage::block_size(block)));
+            transmit(_outstanding[token] = o);
+            return;
+        }
+        _outstanding[token] = o;
+        finish(_outstanding.find(token), done);
+    }
+
+    void finish(std::map<std::string, Outstanding>::iterator o, std::vector<Completion> &done) {
+        Completion c;
+        c.handler = o->second.handler;
+        c.context = o->second.context;
+        c.exchange = o->second.exchange;
+        c.exchange.done_us = host_now_us();
+        if (c.exchange.code != CoapMessage::EMPTY && !c.exchange.notification) {
+            _stats.responses++;
+        }
+        done.push_back(c);
+        if (o->second.queued) {
+            _queued--;
+        }
+        _outstanding.erase(o);
+    }
+
+    // Retransmits what is due and fails what has run out of time
+    void expire(std::vector<Completion> &done) {
+        uint64_t now = host_now_us();
+        for (std::map<std::string, Outstanding>::iterator o = _outstanding.begin(); o != _outstanding.end();) {
+            Outstanding &out = o->second;
+            std::map<std::string, Outstanding>::iterator current = o++;
+            if (now >= out.deadline_us) {
+                _stats.timeouts++;
+                out.exchange.code = CoapMessage::EMPTY;
+                finish(current, done);
+            } else if (!out.queued && !out.acknowledged && now >= out.retransmit_us &&
+                       out.retransmissions < LWM2M_SERVER_MAX_RETRANSMIT) {
+                out.retransmissions++;
+                out.interval_ms *= 2;
+                out.retransmit_us = now + (uint64_t)out.interval_ms * 1000;
+                _stats.retransmitted++;
+                send_to(out.peer, out.bytes);
+            }
+        }
+        // Lifetimes are checked once a second
+        if (now < _expiry_us) {
+            return;
+        }
+        _expiry_us = now + 1000000;
+        for (std::map<std::string, Registration>::iterator r = _registrations.begin(); r != _registrations.end();) {
+            const Endpoint &e = r->second.endpoint;
+            std::map<std::string, Registration>::iterator current = r++;
+            if (now > e.updated_us + (uint64_t)e.lifetime * 1000000) {
+                _stats.expired++;
+                remove(current);
+            }
+        }
+    }
+
+    void remove(std::map<std::string, Registration>::iterator r) {
+        std::map<std::string, std::string>::iterator n = _names.find(r->second.endpoint.name);
+        if (n != _names.end() && n->second == r->first) {
+            _names.erase(n);
+        }
+        _registrations.erase(r);
+    }
+
+    // Endpoints registered over a TCP connection go with it
+    void closed(int fd) {
+        for (std::map<std::string, Registration>::iterator r = _registrations.begin(); r != _registrations.end();) {
+            std::map<std::string, Registration>::iterator current = r++;
+            if (current->second.peer.fd == fd) {
+                remove(current);
+            }
+        }
+    }
+
+    // The registration interface
+    // `heard` is set to the endpoint that registered or updated
+    CoapMessage answer(const Peer &peer, const CoapMessage &m, std::string &heard) {
+        CoapMessage response(m.type == CoapMessage::CON ? CoapMessage::ACK : CoapMessage::NON, CoapMessage::NOT_FOUND,
+                             m.type == CoapMessage::CON ? m.message_id : ++_message_id);
+        response.token = m.token;
+        std::string path = m.path();
+        uint64_t now = host_now_us();
+        if (m.code == CoapMessage::POST && path == "rd") {
+            std::string name = m.query("ep");
+            if (name.empty()) {
+                response.code = CoapMessage::BAD_REQUEST;
+                return response;
+            }
+            Registration *previous = registration_of(name);
+            if (previous) {
+                remove(_registrations.find(previous->endpoint.location));
+            }
+            char location[16];
+            snprintf(location, sizeof(location), "rd/%u", ++_locations);
+            Registration &r = _registrations[location];
+            r.peer = peer;
+            r.endpoint.name = name;
+            r.endpoint.type = m.query("et");
+            r.endpoint.location = location;
+            r.endpoint.links = m.payload;
+            r.endpoint.binding = m.query("b").empty() ? "U" : m.query("b");
+            std::string lifetime = m.query("lt");
+            r.endpoint.lifetime = lifetime.empty() ? LWM2M_SERVER_DEFAULT_LIFETIME : strtoul(lifetime.c_str(), NULL, 10);
+            r.endpoint.updates = 0;
+            r.endpoint.registered_us = r.endpoint.updated_us = now;
+            r.endpoint.awake_until_us = 0;
+            _names[name] = location;
+            _stats.registrations++;
+            heard = name;
+            response.code = CoapMessage::CREATED;
+            response.add_split(CoapMessage::LOCATION_PATH, location, '/');
+            return response;
+        }
+        std::map<std::string, Registration>::iterator r = _registrations.find(path);
+        if (r == _registrations.end()) {
+            return response;
+        }
+        if (m.code == CoapMessage::POST) {
+            Endpoint &e = r->second.endpoint;
+            std::string lifetime = m.query("lt");
+            if (!lifetime.empty()) {
+                e.lifetime = strtoul(lifetime.c_str(), NULL, 10);
+            }
+            if (!m.query("b").empty()) {
+                e.binding = m.query("b");
+            }
+            if (!m.payload.empty()) {
+                e.links = m.payload;
+            }
+            // The endpoint may have moved, behind a NAT for instance
+            r->second.peer = peer;
+            e.updates++;
+            e.updated_us = now;
+            _stats.updates++;
+            heard = e.name;
+            response.code = CoapMessage::CHANGED;
+        } else if (m.code == CoapMessage::DELETE) {
+            remove(r);
+            _stats.deregistrations++;
+            response.code = CoapMessage::DELETED;
+        } else {
+            response.code = CoapMessage::METHOD_NOT_ALLOWED;
+        }
+        return response;
+    }
+
+    bool                                 _tcp;
+    volatile bool                        _stop;
+    bool                                 _unreachable;      // see set_reachable()
+    int                                  _listener;
+    int                                  _epoll;
+    uint16_t                             _port;
+    bool                                 _running;
+    pthread_t                            _thread;
+    pthread_mutex_t                      _mutex;
+    uint16_t                             _message_id;
+    uint32_t                             _locations;
+    uint64_t                             _tokens;
+    uint32_t                             _exchanges;
+    uint64_t                             _expiry_us;
+    uint32_t                             _queued;           // held in _outstanding
+    std::map<int, std::string>           _streams;          // bytes not yet making a message, by socket
+    std::map<std::string, Registration>  _registrations;    // by location
+    std::map<std::string, std::string>   _names;            // endpoint name to location
+    std::map<std::string, Outstanding>   _outstanding;      // by token
+    std::map<std::string, Observation>   _observations;     // by token
+    std::vector<Answered>                _answered;
+    Stats                                _stats;
+};
+
+#endif // __HOST_LWM2M_SERVER_H__
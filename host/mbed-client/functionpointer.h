@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_FUNCTIONPOINTER_H__
+#define __HOST_FUNCTIONPOINTER_H__
+
+#include <stddef.h>
+#include <string.h>
+
+/*
+* The function pointer templates mbed Client takes its callbacks as: a
+* function, or a method of an object, taking one or three arguments.
+*/
+template <typename R, typename A1>
+class FP1 {
+public:
+    FP1(R (*function)(A1)=NULL) : _function(function), _object(NULL), _thunk(NULL) {}
+
+    template <typename T>
+    FP1(T *object, R (T::*method)(A1)) : _function(NULL), _object(object), _thunk(&thunk<T>) {
+        memcpy(_method, &method, sizeof(method));
+    }
+
+    R call(A1 a1) const {
+        return _thunk ? _thunk(_object, _method, a1) : _function(a1);
+    }
+
+    R operator()(A1 a1) const {
+        return call(a1);
+    }
+
+    operator bool() const {
+        return _function || _thunk;
+    }
+
+private:
+    template <typename T>
+    static R thunk(void *object, const char *method, A1 a1) {
+        R (T::*m)(A1);
+        memcpy(&m, method, sizeof(m));
+        return (((T*)object)->*m)(a1);
+    }
+
+    struct Any {};
+
+    R (*_function)(A1);
+    void *_object;
+    R (*_thunk)(void*, const char*, A1);
+    char _method[sizeof(void (Any::*)())];
+};
+
+template <typename R, typename A1, typename A2, typename A3>
+class FP3 {
+public:
+    FP3(R (*function)(A1, A2, A3)=NULL) : _function(function), _object(NULL), _thunk(NULL) {}
+
+    template <typename T>
+    FP3(T *object, R (T::*method)(A1, A2, A3)) : _function(NULL), _object(object), _thunk(&thunk<T>) {
+        memcpy(_method, &method, sizeof(method));
+    }
+
+    R call(A1 a1, A2 a2, A3 a3) const {
+        return _thunk ? _thunk(_object, _method, a1, a2, a3) : _function(a1, a2, a3);
+    }
+
+    R operator()(A1 a1, A2 a2, A3 a3) const {
+        return call(a1, a2, a3);
+    }
+
+    operator bool() const {
+        return _function || _thunk;
+    }
+
+private:
+    template <typename T>
+    static R thunk(void *object, const char *method, A1 a1, A2 a2, A3 a3) {
+        R (T::*m)(A1, A2, A3);
+        memcpy(&m, method, sizeof(m));
+        return (((T*)object)->*m)(a1, a2, a3);
+    }
+
+    struct Any {};
+
+    R (*_function)(A1, A2, A3);
+    void *_object;
+    R (*_thunk)(void*, const char*, A1, A2, A3);
+    char _method[sizeof(void (Any::*)())];
+};
+
+#endif // __HOST_FUNCTIONPOINTER_H__
@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_BASE_H__
+#define __HOST_M2M_BASE_H__
+
+#include <stdint.h>
+#include <string>
+#include "mbed-client/functionpointer.h"
+#include "mbed-client/m2mstring.h"
+
+class M2MBase;
+
+typedef FP1<void, const char*> value_updated_callback;
+
+/*
+* Implemented by the interface an object is registered through: told
+* when an observed value changes and when a delayed POST response is due.
+*/
+class M2MObservationHandler {
+public:
+    virtual ~M2MObservationHandler() {}
+    virtual void value_changed(M2MBase *base) = 0;
+    // `token` is that of the POST being answered
+    virtual void send_delayed_response(M2MBase *base, const std::string &token) = 0;
+};
+
+/*
+* What objects, object instances and resources have in common: a name, a
+* path, the operations allowed on it and its observation.
+*/
+class M2MBase {
+public:
+    enum BaseType {
+        Object = 0x0,
+        Resource = 0x1,
+        ObjectInstance = 0x2,
+        ResourceInstance = 0x3
+    };
+
+    enum Operation {
+        NOT_ALLOWED              = 0x00,
+        GET_ALLOWED              = 0x01,
+        PUT_ALLOWED              = 0x02,
+        GET_PUT_ALLOWED          = 0x03,
+        POST_ALLOWED             = 0x04,
+        GET_POST_ALLOWED         = 0x05,
+        PUT_POST_ALLOWED         = 0x06,
+        GET_PUT_POST_ALLOWED     = 0x07,
+        DELETE_ALLOWED           = 0x08
+    };
+
+    M2MBase(BaseType type, const String &name, const String &path, const String &resource_type=String())
+        : _base_type(type), _name(name), _path(path), _resource_type(resource_type), _operation(NOT_ALLOWED),
+          _observable(false), _content_type(0), _handler(NULL), _observation_number(0) {}
+
+    virtual ~M2MBase() {}
+
+    const char *name() const {
+        return _name.c_str();
+    }
+    const char *uri_path() const {
+        return _path.c_str();
+    }
+    const char *resource_type() const {
+        return _resource_type.c_str();
+    }
+    BaseType base_type() const {
+        return _base_type;
+    }
+
+    void set_operation(Operation operation) {
+        _operation = operation;
+    }
+    Operation operation() const {
+        return _operation;
+    }
+    bool allows(Operation operation) const {
+        return (_operation & operation) == operation;
+    }
+
+    void set_observable(bool observable) {
+        _observable = observable;
+    }
+    bool is_observable() const {
+        return _observable;
+    }
+
+    void set_coap_content_type(uint8_t content_type) {
+        _content_type = content_type;
+    }
+    uint8_t coap_content_type() const {
+        return _content_type;
+    }
+
+    void set_value_updated_function(value_updated_callback callback) {
+        _value_updated = callback;
+    }
+    bool is_value_updated_function_set() const {
+        return _value_updated;
+    }
+    void execute_value_updated(const String &name) {
+        if (_value_updated) {
+            _value_updated(name.c_str());
+        }
+    }
+
+    void set_observation_handler(M2MObservationHandler *handler) {
+        _handler = handler;
+    }
+    M2MObservationHandler *observation_handler() const {
+        return _handler;
+    }
+
+    // The token of the observation, empty while the base is not observed
+    void set_observation_token(const std::string &token) {
+        _observation_token = token;
+        _observation_number = 0;
+    }
+    const std::string &observation_token() const {
+        return _observation_token;
+    }
+    bool is_under_observation() const {
+        return !_observation_token.empty();
+    }
+    uint32_t next_observation_number() {
+        return ++_observation_number & 0xffffff;
+    }
+
+private:
+    M2MBase(const M2MBase&);
+    M2MBase& operator=(const M2MBase&);
+
+    BaseType               _base_type;
+    String                 _name;
+    String                 _path;
+    String                 _resource_type;
+    Operation              _operation;
+    bool                   _observable;
+    uint8_t                _content_type;
+    value_updated_callback _value_updated;
+    M2MObservationHandler *_handler;
+    std::string            _observation_token;
+    uint32_t               _observation_number;
+};
+
+#endif // __HOST_M2M_BASE_H__
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_BLOCK_MESSAGE_H__
+#define __HOST_M2M_BLOCK_MESSAGE_H__
+
+#include <stdint.h>
+
+/*
+* One block of a block-wise PUT, as handed to an incoming block message
+* callback. The data is only valid during the callback.
+*/
+class M2MBlockMessage {
+public:
+    enum Error {
+        ErrorNone = 0,
+        EntityTooLarge
+    };
+
+    M2MBlockMessage() : _data(NULL), _size(0), _total(0), _number(0), _last(false), _error(ErrorNone) {}
+
+    void set(const uint8_t *data, uint32_t size, uint32_t total, uint32_t number, bool last, Error error) {
+        _data = data;
+        _size = size;
+        _total = total;
+        _number = number;
+        _last = last;
+        _error = error;
+    }
+
+    bool is_block_message() const {
+        return true;
+    }
+    uint16_t block_number() const {
+        return (uint16_t)_number;
+    }
+    uint32_t total_message_size() const {
+        return _total;
+    }
+    bool is_last_block() const {
+        return _last;
+    }
+    uint8_t *block_message_data() const {
+        return (uint8_t*)_data;
+    }
+    uint16_t block_message_size() const {
+        return (uint16_t)_size;
+    }
+    Error error_code() const {
+        return _error;
+    }
+
+private:
+    const uint8_t *_data;
+    uint32_t       _size;
+    uint32_t       _total;
+    uint32_t       _number;
+    bool           _last;
+    Error          _error;
+};
+
+#endif // __HOST_M2M_BLOCK_MESSAGE_H__
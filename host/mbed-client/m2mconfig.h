@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_CONFIG_H__
+#define __HOST_M2M_CONFIG_H__
+
+#include "mbed_client_config.h"
+
+// The loopback server of the host build rather than mbed Device Connector
+#ifndef MBED_SERVER_ADDRESS
+#define MBED_SERVER_ADDRESS "coap://127.0.0.1:5683"
+#endif
+
+#ifndef SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE
+#define SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE 1024
+#endif
+
+#ifndef SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE
+#define SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE 65535
+#endif
+
+#endif // __HOST_M2M_CONFIG_H__
@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_DEVICE_H__
+#define __HOST_M2M_DEVICE_H__
+
+#include "mbed-client/m2mobject.h"
+
+/*
+* The LwM2M Device object, 3.
+*/
+class M2MDevice: public M2MObject {
+public:
+    enum DeviceResource {
+        Manufacturer,
+        DeviceType,
+        ModelNumber,
+        SerialNumber
+    };
+
+    M2MDevice() : M2MObject("3") {
+        create_object_instance();
+    }
+
+    M2MResource *create_resource(DeviceResource resource, const String &value) {
+        static const char *ids[] = { "0", "17", "1", "2" };
+        M2MResource *res = object_instance()->create_dynamic_resource(ids[resource], "", M2MResourceInstance::STRING, false);
+        if (res) {
+            res->set_operation(M2MBase::GET_ALLOWED);
+            res->set_value((const uint8_t*)value.data(), value.size());
+        }
+        return res;
+    }
+};
+
+#endif // __HOST_M2M_DEVICE_H__
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_INTERFACE_H__
+#define __HOST_M2M_INTERFACE_H__
+
+#include <stdint.h>
+#include "mbed-client/m2mobject.h"
+#include "mbed-client/m2msecurity.h"
+
+/*
+* The client side of LwM2M: registers objects with a server and serves
+* the server's requests on them.
+*/
+class M2MInterface {
+public:
+    enum Error {
+        ErrorNone = 0,
+        AlreadyExists,
+        BootstrapFailed,
+        InvalidParameters,
+        NotRegistered,
+        Timeout,
+        NetworkError,
+        ResponseParseFailed,
+        UnknownError,
+        MemoryFail,
+        NotAllowed,
+        SecureConnectionFailed,
+        DnsResolvingFailed
+    };
+
+    enum BindingMode {
+        NOT_SET = 0,
+        UDP = 0x01,
+        UDP_QUEUE = 0x03,
+        SMS = 0x04,
+        SMS_QUEUE = 0x06,
+        UDP_SMS_QUEUE = 0x07,
+        TCP = 0x09,
+        TCP_QUEUE = 0x0b
+    };
+
+    enum NetworkStack {
+        Uninitialized = 0,
+        LwIP_IPv4,
+        LwIP_IPv6,
+        Reserved,
+        Nanostack_IPv6,
+        Unknown
+    };
+
+    virtual ~M2MInterface() {}
+
+    virtual void register_object(M2MSecurity *security, const M2MObjectList &objects) = 0;
+    virtual void update_registration(M2MSecurity *security, const uint32_t lifetime=0) = 0;
+    virtual void unregister_object(M2MSecurity *security) = 0;
+    virtual void set_platform_network_handler(void *handler) = 0;
+};
+
+#endif // __HOST_M2M_INTERFACE_H__
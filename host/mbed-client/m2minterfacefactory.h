@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_INTERFACE_FACTORY_H__
+#define __HOST_M2M_INTERFACE_FACTORY_H__
+
+#include "mbed-client/m2mdevice.h"
+#include "mbed-client/m2minterfaceimpl.h"
+
+class M2MInterfaceFactory {
+public:
+    static M2MInterface *create_interface(M2MInterfaceObserver &observer,
+                                          const String &endpoint_name,
+                                          const String &endpoint_type="",
+                                          const int32_t life_time=-1,
+                                          const uint16_t listen_port=5683,
+                                          const String &domain="",
+                                          M2MInterface::BindingMode mode=M2MInterface::NOT_SET,
+                                          M2MInterface::NetworkStack /*stack*/=M2MInterface::LwIP_IPv4,
+                                          const String &/*context_address*/="") {
+        return new M2MInterfaceImpl(observer, endpoint_name, endpoint_type, life_time, listen_port, domain, mode);
+    }
+
+    static M2MSecurity *create_security(M2MSecurity::ServerType server_type) {
+        return new M2MSecurity(server_type);
+    }
+
+    static M2MServer *create_server() {
+        return new M2MServer();
+    }
+
+    // One per call, so that several clients can live in one process
+    static M2MDevice *create_device() {
+        return new M2MDevice();
+    }
+
+    static M2MObject *create_object(const String &name) {
+        return new M2MObject(name);
+    }
+};
+
+#endif // __HOST_M2M_INTERFACE_FACTORY_H__
@@ -0,0 +1,871 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_INTERFACE_IMPL_H__
+#define __HOST_M2M_INTERFACE_IMPL_H__
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "mbed.h"
+#include "coap.h"
+#include "event_loop.h"
+#include "trace.h"
+#include "mbed-client/m2mconfig.h"
+#include "mbed-client/m2minterface.h"
+#include "mbed-client/m2minterfaceobserver.h"
+
+// Largest CoAP message the host client receives
+#ifndef HOST_COAP_MAX_MESSAGE
+#define HOST_COAP_MAX_MESSAGE 2048
+#endif
+
+/*
+* M2MInterface over plain CoAP on a UDP or TCP socket, received from on
+* the HostEventLoop thread every interface in the process shares, like
+* mbed Client's event thread does on a board.
+*
+* It registers with "POST /rd", keeps the location the server returns
+* for updates and de-registration, and serves GET (with Observe and
+* Block2), PUT (with Block1) and POST on the resources of the registered
+* objects. Confirmable messages over UDP are retransmitted
+* M2M_CLIENT_RECONNECTION_COUNT times, M2M_CLIENT_RECONNECTION_INTERVAL
+* seconds apart at first and doubling. Over TCP every message is sent
+* behind a 4-byte length, as mbed Client does.
+*
+* Unlike mbed Client it never updates the registration on its own; the
+* application's updates are all there is. Nor does it reconnect on its
+* own: once the connection is lost, register_object() or
+* update_registration() opens a new one. Queue mode is only announced,
+* with binding UQ or TQ: the socket stays open, as a board's would while
+* its radio sleeps, and the server decides when to send.
+*
+* Application callbacks run on the event loop's thread without the
+* interface's lock held, so they may set values and send delayed
+* responses; like any event handler, they hold up every other interface
+* while they run.
+*/
+class M2MInterfaceImpl: public M2MInterface, public M2MObservationHandler {
+public:
+    struct Stats {
+        uint32_t sent;
+        uint32_t received;
+        uint32_t retransmitted;
+        uint32_t notifications;
+        uint32_t requests;          // served for the server
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+    };
+
+    M2MInterfaceImpl(M2MInterfaceObserver &observer, const String &endpoint_name, const String &endpoint_type,
+                     int32_t lifetime, uint16_t listen_port, const String &domain, BindingMode mode)
+        : _observer(observer), _endpoint_name(endpoint_name), _endpoint_type(endpoint_type), _lifetime(lifetime),
+          _listen_port(listen_port), _domain(domain), _tcp(mode == TCP || mode == TCP_QUEUE),
+          _queue(mode == UDP_QUEUE || mode == TCP_QUEUE), _socket(-1),
+          _state(IDLE), _security(NULL) {
+        static uint32_t instances = 0;
+        _random = host_seed() * 2246822519u + ++instances;
+        if (_random == 0) {
+            _random = 1;
+        }
+        _message_id = (uint16_t)host_random(_random);
+        memset(&_stats, 0, sizeof(_stats));
+        pthread_mutex_init(&_mutex, NULL);
+    }
+
+    virtual ~M2MInterfaceImpl() {
+        pthread_mutex_lock(&_mutex);
+        int s = _socket;
+        _socket = -1;
+        pthread_mutex_unlock(&_mutex);
+        if (s >= 0) {
+            HostEventLoop::instance().unwatch(s);
+            close(s);
+        }
+        for (size_t o = 0; o < _objects.size(); o++) {
+            attach(_objects[o], NULL);
+        }
+        pthread_mutex_destroy(&_mutex);
+    }
+
+    virtual void register_object(M2MSecurity *security, const M2MObjectList &objects) {
+        if (!security) {
+            _observer.error(InvalidParameters);
+            return;
+        }
+        _security = security;
+        _objects = objects;
+        for (size_t o = 0; o < _objects.size(); o++) {
+            attach(_objects[o], this);
+        }
+        // before the socket is watched, so that losing it right away is noticed
+        _state = REGISTERING;
+        Error error = open(security->resource_value_string(M2MSecurity::M2MServerUri));
+        if (error != ErrorNone) {
+            _state = IDLE;
+            _observer.error(error);
+            return;
+        }
+
+        CoapMessage request(CoapMessage::CON, CoapMessage::POST);
+        request.set_path("rd");
+        request.add_option(CoapMessage::URI_QUERY, "ep=" + _endpoint_name);
+        if (!_endpoint_type.empty()) {
+            request.add_option(CoapMessage::URI_QUERY, "et=" + _endpoint_type);
+        }
+        if (_lifetime > 0) {
+            request.add_option(CoapMessage::URI_QUERY, "lt=" + number(_lifetime));
+        }
+        if (!_domain.empty()) {
+            request.add_option(CoapMessage::URI_QUERY, "d=" + _domain);
+        }
+        std::string binding = _tcp ? "b=T" : "b=U";
+        request.add_option(CoapMessage::URI_QUERY, _queue ? binding + "Q" : binding);
+        request.add_uint_option(CoapMessage::CONTENT_FORMAT, 40);   // application/link-format
+        request.payload = links();
+        send_request(request, REGISTER);
+    }
+
+    /*
+    * Updates the registration. After the connection was lost, the
+    * update reconnects and resumes the registration the server may still
+    * hold; if it does not, the server's 4.04 ends in error(NotRegistered).
+    */
+    virtual void update_registration(M2MSecurity * /*security*/, const uint32_t lifetime=0) {
+        if (_state == IDLE && !_location.empty() && _security) {
+            _state = RESUMING;
+            Error error = open(_security->resource_value_string(M2MSecurity::M2MServerUri));
+            if (error != ErrorNone) {
+                _state = IDLE;
+                _observer.error(error);
+                return;
+            }
+        } else if (_state != REGISTERED) {
+            _observer.error(NotRegistered);
+            return;
+        }
+        CoapMessage request(CoapMessage::CON, CoapMessage::POST);
+        request.set_path(_location);
+        if (lifetime) {
+            _lifetime = lifetime;
+            request.add_option(CoapMessage::URI_QUERY, "lt=" + number(lifetime));
+        }
+        send_request(request, UPDATE);
+    }
+
+    virtual void unregister_object(M2MSecurity * /*security*/) {
+        if (_state != REGISTERED) {
+            _observer.error(NotRegistered);
+            return;
+        }
+        CoapMessage request(CoapMessage::CON, CoapMessage::DELETE);
+        request.set_path(_location);
+        _state = UNREGISTERING;
+        send_request(request, UNREGISTER);
+    }
+
+    virtual void set_platform_network_handler(void * /*handler*/) {}
+
+    // Sends a notification of an observed resource's new value
+    virtual void value_changed(M2MBase *base) {
+        if (_state != REGISTERED || base->base_type() == M2MBase::Object) {
+            return;
+        }
+        M2MResourceInstance *res = (M2MResourceInstance*)base;
+        CoapMessage notification(CoapMessage::NON, CoapMessage::CONTENT);
+        notification.token = res->observation_token();
+        notification.add_uint_option(CoapMessage::OBSERVE, res->next_observation_number());
+        notification.add_uint_option(CoapMessage::CONTENT_FORMAT, res->coap_content_type());
+        set_block2(notification, std::string((const char*)res->value(), res->value_length()), 0,
+                   SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE);
+        pthread_mutex_lock(&_mutex);
+        notification.message_id = next_message_id();
+        _notified[notification.message_id] = base;
+        if (_notified.size() > 64) {
+            _notified.erase(_notified.begin());
+        }
+        _stats.notifications++;
+        pthread_mutex_unlock(&_mutex);
+        send(notification);
+    }
+
+    virtual void send_delayed_response(M2MBase * /*base*/, const std::string &token) {
+        CoapMessage response(CoapMessage::CON, CoapMessage::CHANGED);
+        response.token = token;
+        send_request(response, RESPONSE);
+    }
+
+    Stats stats() {
+        pthread_mutex_lock(&_mutex);
+        Stats stats = _stats;
+        pthread_mutex_unlock(&_mutex);
+        return stats;
+    }
+
+    bool registered() const {
+        return _state == REGISTERED;
+    }
+
+private:
+    enum State {
+        IDLE,
+        REGISTERING,
+        RESUMING,           // updating a registration from before the connection was lost
+        REGISTERED,
+        UNREGISTERING
+    };
+
+    // What a confirmable message the client sent was for
+    enum Kind {
+        REGISTER,
+        UPDATE,
+        UNREGISTER,
+        RESPONSE
+    };
+
+    struct Pending {
+        Kind        kind;
+        uint16_t    message_id;
+        std::string token;
+        std::string bytes;
+        uint64_t    due_us;         // next retransmission
+        uint32_t    interval_ms;
+        uint8_t     retransmissions;
+        bool        acknowledged;   // waiting for a separate response
+    };
+
+    static std::string number(uint32_t value) {
+        char text[12];
+        snprintf(text, sizeof(text), "%u", value);
+        return text;
+    }
+
+    /*
+    * Makes `handler` the observation handler of `object` and everything in
+    * it. With NULL, only what still has this interface as its handler is
+    * detached, as the objects may since have been registered elsewhere.
+    */
+    void attach(M2MObject *object, M2MObservationHandler *handler) {
+        set_handler(object, handler);
+        const M2MObjectInstanceList &instances = object->instances();
+        for (size_t i = 0; i < instances.size(); i++) {
+            set_handler(instances[i], handler);
+            const M2MResourceList &resources = instances[i]->resources();
+            for (size_t r = 0; r < resources.size(); r++) {
+                set_handler(resources[r], handler);
+            }
+        }
+    }
+
+    void set_handler(M2MBase *base, M2MObservationHandler *handler) {
+        if (handler || base->observation_handler() == this) {
+            base->set_observation_handler(handler);
+        }
+    }
+
+    // The registered resources in CoRE link format
+    std::string links() const {
+        std::string out;
+        for (size_t o = 0; o < _objects.size(); o++) {
+            const M2MObjectInstanceList &instances = _objects[o]->instances();
+            for (size_t i = 0; i < instances.size(); i++) {
+                const M2MResourceList &resources = instances[i]->resources();
+                for (size_t r = 0; r < resources.size(); r++) {
+                    if (!out.empty()) {
+                        out += ',';
+                    }
+                    out += "</";
+                    out += resources[r]->uri_path();
+                    out += '>';
+                    if (*resources[r]->resource_type()) {
+                        out += ";rt=\"";
+                        out += resources[r]->resource_type();
+                        out += '"';
+                    }
+                    if (resources[r]->is_observable()) {
+                        out += ";obs";
+                    }
+                }
+            }
+        }
+        return out;
+    }
+
+    // Connects to "coap://host:port" and starts receiving
+    Error open(const String &uri) {
+        if (_socket >= 0) {
+            return ErrorNone;
+        }
+        size_t scheme = uri.find("://");
+        std::string address = scheme == std::string::npos ? std::string(uri) : uri.substr(scheme + 3);
+        std::string port = uri.compare(0, 6, "coaps:") == 0 ? "5684" : "5683";
+        if (address.size() && address[0] == '[') {
+            // "[::1]:5683"
+            size_t end = address.find(']');
+            if (end != std::string::npos && end + 1 < address.size() && address[end + 1] == ':') {
+                port = address.substr(end + 2);
+            }
+            address = address.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+        } else if (address.find(':') != std::string::npos && address.find(':') == address.rfind(':')) {
+            port = address.substr(address.find(':') + 1);
+            address = address.substr(0, address.find(':'));
+        }
+
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = _tcp ? SOCK_STREAM : SOCK_DGRAM;
+        struct addrinfo *found = NULL;
+        if (getaddrinfo(address.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+            return DnsResolvingFailed;
+        }
+        int s = socket(found->ai_family, found->ai_socktype, 0);
+        bool connected = false;
+        if (s >= 0) {
+            if (_listen_port) {
+                struct sockaddr_storage local;
+                memset(&local, 0, sizeof(local));
+                local.ss_family = found->ai_family;
+                if (found->ai_family == AF_INET6) {
+                    ((struct sockaddr_in6*)&local)->sin6_port = htons(_listen_port);
+                } else {
+                    ((struct sockaddr_in*)&local)->sin_port = htons(_listen_port);
+                }
+                bind(s, (struct sockaddr*)&local, found->ai_addrlen);
+            }
+            connected = connect(s, found->ai_addr, found->ai_addrlen) == 0;
+            if (connected && _tcp) {
+                int on = 1;
+                setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+            }
+        }
+        freeaddrinfo(found);
+        if (!connected) {
+            if (s >= 0) {
+                close(s);
+            }
+            return NetworkError;
+        }
+        _socket = s;
+        if (!HostEventLoop::instance().watch(s, &M2MInterfaceImpl::readable, &M2MInterfaceImpl::tick, this)) {
+            _socket = -1;
+            close(s);
+            return UnknownError;
+        }
+        return ErrorNone;
+    }
+
+    uint16_t next_message_id() {
+        return ++_message_id;
+    }
+
+    void send(const CoapMessage &message) {
+        std::string bytes = message.encode();
+        send_bytes(_tcp ? CoapMessage::frame(bytes) : bytes);
+    }
+
+    void send_bytes(const std::string &bytes) {
+        pthread_mutex_lock(&_mutex);
+        if (_socket >= 0 && ::send(_socket, bytes.data(), bytes.size(), MSG_NOSIGNAL) == (ssize_t)bytes.size()) {
+            TRACE_INSTANT(TRACE_COAP_SEND, bytes.size());
+            _stats.sent++;
+            _stats.bytes_sent += bytes.size();
+        }
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    // Sends a confirmable message the client waits on the answer to
+    void send_request(CoapMessage &message, Kind kind) {
+        Pending p;
+        pthread_mutex_lock(&_mutex);
+        message.message_id = next_message_id();
+        if (message.token.empty()) {
+            uint32_t token = host_random(_random);
+            message.token.assign((const char*)&token, sizeof(token));
+        }
+        p.kind = kind;
+        p.message_id = message.message_id;
+        p.token = message.token;
+        p.bytes = _tcp ? CoapMessage::frame(message.encode()) : message.encode();
+        p.interval_ms = M2M_CLIENT_RECONNECTION_INTERVAL * 1000;
+        p.due_us = host_now_us() + (uint64_t)p.interval_ms * 1000;
+        p.retransmissions = 0;
+        // TCP is reliable: only the response is waited for
+        p.acknowledged = _tcp;
+        _pending.push_back(p);
+        pthread_mutex_unlock(&_mutex);
+        send_bytes(p.bytes);
+    }
+
+    void reply(const CoapMessage &request, CoapMessage &response) {
+        response.token = request.token;
+        if (request.type == CoapMessage::CON) {
+            response.type = CoapMessage::ACK;
+            response.message_id = request.message_id;
+        } else {
+            response.type = CoapMessage::NON;
+            pthread_mutex_lock(&_mutex);
+            response.message_id = next_message_id();
+            pthread_mutex_unlock(&_mutex);
+        }
+        std::string bytes = response.encode();
+        if (request.type == CoapMessage::CON) {
+            pthread_mutex_lock(&_mutex);
+            _duplicates.push_back(std::make_pair(request.message_id, bytes));
+            if (_duplicates.size() > SN_COAP_DUPLICATION_MAX_MSGS_COUNT) {
+                _duplicates.erase(_duplicates.begin());
+            }
+            pthread_mutex_unlock(&_mutex);
+        }
+        send_bytes(_tcp ? CoapMessage::frame(bytes) : bytes);
+    }
+
+    void reply(const CoapMessage &request, uint8_t code) {
+        CoapMessage response(CoapMessage::ACK, code);
+        reply(request, response);
+    }
+
+    // Puts block `number` of `payload` in `message`, or all of it if it fits
+    static void set_block2(CoapMessage &message, const std::string &payload, uint32_t number, uint32_t size) {
+        if (payload.size() <= size && number == 0) {
+            message.payload = payload;
+            return;
+        }
+        uint32_t offset = number * size;
+        if (offset > payload.size()) {
+            offset = payload.size();
+        }
+        message.payload = payload.substr(offset, size);
+        bool more = offset + size < payload.size();
+        message.add_uint_option(CoapMessage::BLOCK2, CoapMessage::block_value(number, more, size));
+        if (number == 0) {
+            message.add_uint_option(CoapMessage::SIZE2, payload.size());
+        }
+    }
+
+    M2MResource *find(const std::string &path, M2MObject *&object, M2MObjectInstance *&instance) const {
+        std::vector<std::string> segments;
+        size_t start = 0;
+        while (start < path.size()) {
+            size_t end = path.find('/', start);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            segments.push_back(path.substr(start, end - start));
+            start = end + 1;
+        }
+        object = NULL;
+        instance = NULL;
+        for (size_t o = 0; o < _objects.size() && !object; o++) {
+            if (segments.size() && segments[0] == _objects[o]->name()) {
+                object = _objects[o];
+            }
+        }
+        if (object && segments.size() > 1) {
+            instance = object->object_instance((uint16_t)atoi(segments[1].c_str()));
+        }
+        return instance && segments.size() == 3 ? instance->resource(segments[2]) : NULL;
+    }
+
+    void serve(const CoapMessage &request) {
+        pthread_mutex_lock(&_mutex);
+        _stats.requests++;
+        for (size_t i = 0; i < _duplicates.size(); i++) {
+            if (request.type == CoapMessage::CON && _duplicates[i].first == request.message_id) {
+                std::string bytes = _duplicates[i].second;
+                pthread_mutex_unlock(&_mutex);
+                send_bytes(_tcp ? CoapMessage::frame(bytes) : bytes);
+                return;
+            }
+        }
+        pthread_mutex_unlock(&_mutex);
+
+        M2MObject *object;
+        M2MObjectInstance *instance;
+        M2MResource *res = find(request.path(), object, instance);
+        if (!res) {
+            reply(request, object ? CoapMessage::METHOD_NOT_ALLOWED : CoapMessage::NOT_FOUND);
+            return;
+        }
+        switch (request.code) {
+            case CoapMessage::GET:
+                serve_get(request, res);
+                break;
+            case CoapMessage::PUT:
+                serve_put(request, res);
+                break;
+            case CoapMessage::POST:
+                serve_post(request, object, instance, res);
+                break;
+            default:
+                reply(request, CoapMessage::METHOD_NOT_ALLOWED);
+                break;
+        }
+    }
+
+    void serve_get(const CoapMessage &request, M2MResource *res) {
+        if (!res->allows(M2MBase::GET_ALLOWED)) {
+            reply(request, CoapMessage::METHOD_NOT_ALLOWED);
+            return;
+        }
+        CoapMessage response(CoapMessage::ACK, CoapMessage::CONTENT);
+        if (request.has_option(CoapMessage::OBSERVE)) {
+            if (request.uint_option(CoapMessage::OBSERVE) == 0 && res->is_observable()) {
+                res->set_observation_token(request.token);
+                response.add_uint_option(CoapMessage::OBSERVE, res->next_observation_number());
+            } else if (request.token == res->observation_token()) {
+                res->set_observation_token(std::string());
+            }
+        }
+        uint32_t size = SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE;
+        uint32_t number = 0;
+        if (request.has_option(CoapMessage::BLOCK2)) {
+            uint32_t block = request.uint_option(CoapMessage::BLOCK2);
+            number = CoapMessage::block_number(block);
+            if (CoapMessage::block_size(block) < size) {
+                size = CoapMessage::block_size(block);
+            }
+        }
+        std::string payload;
+        if (res->has_outgoing_block_callback()) {
+            // The payload is produced once, on the first block, and kept
+            // for the rest
+            pthread_mutex_lock(&_mutex);
+            std::map<M2MBase*, std::string>::iterator kept = _outgoing.find(res);
+            bool produce = number == 0 || kept == _outgoing.end();
+            if (!produce) {
+                payload = kept->second;
+            }
+            pthread_mutex_unlock(&_mutex);
+            if (produce) {
+                uint8_t *data = NULL;
+                uint32_t length = 0;
+                res->outgoing_block(String(res->uri_path()), data, length);
+                if (data) {
+                    payload.assign((const char*)data, length);
+                    free(data);
+                }
+                pthread_mutex_lock(&_mutex);
+                if (payload.size() > size) {
+                    _outgoing[res] = payload;
+                } else {
+                    _outgoing.erase(res);
+                }
+                pthread_mutex_unlock(&_mutex);
+            }
+        } else {
+            payload.assign((const char*)res->value(), res->value_length());
+        }
+        response.add_uint_option(CoapMessage::CONTENT_FORMAT, res->coap_content_type());
+        set_block2(response, payload, number, size);
+        reply(request, response);
+    }
+
+    void serve_put(const CoapMessage &request, M2MResource *res) {
+        if (!res->allows(M2MBase::PUT_ALLOWED)) {
+            reply(request, CoapMessage::METHOD_NOT_ALLOWED);
+            return;
+        }
+        if (!request.has_option(CoapMessage::BLOCK1)) {
+            res->set_value((const uint8_t*)request.payload.data(), request.payload.size());
+            res->execute_value_updated(res->name());
+            _observer.value_updated(res, M2MBase::Resource);
+            reply(request, CoapMessage::CHANGED);
+            return;
+        }
+
+        uint32_t block = request.uint_option(CoapMessage::BLOCK1);
+        uint32_t number = CoapMessage::block_number(block);
+        bool more = CoapMessage::block_more(block);
+        uint32_t size = CoapMessage::block_size(block);
+        bool too_large = (uint64_t)number * size + request.payload.size() > SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE;
+        CoapMessage response(CoapMessage::ACK, more ? CoapMessage::CONTINUE : CoapMessage::CHANGED);
+        response.add_uint_option(CoapMessage::BLOCK1, block);
+        if (res->has_incoming_block_callback()) {
+            M2MBlockMessage message;
+            message.set((const uint8_t*)request.payload.data(), request.payload.size(),
+                        request.uint_option(CoapMessage::SIZE1), number, !more,
+                        too_large ? M2MBlockMessage::EntityTooLarge : M2MBlockMessage::ErrorNone);
+            res->incoming_block(&message);
+            if (too_large) {
+                response.code = CoapMessage::REQUEST_ENTITY_TOO_LARGE;
+            }
+            reply(request, response);
+            return;
+        }
+
+        // Without a callback the blocks are put together into the value
+        pthread_mutex_lock(&_mutex);
+        std::string &incoming = _incoming[res];
+        if (number == 0) {
+            incoming.clear();
+        }
+        bool in_order = incoming.size() == (size_t)number * size;
+        if (in_order && !too_large) {
+            incoming += request.payload;
+        }
+        std::string value;
+        if (!more || !in_order || too_large) {
+            value.swap(incoming);
+            _incoming.erase(res);
+        }
+        pthread_mutex_unlock(&_mutex);
+        if (too_large || !in_order) {
+            response.code = too_large ? CoapMessage::REQUEST_ENTITY_TOO_LARGE : CoapMessage::REQUEST_ENTITY_INCOMPLETE;
+        } else if (!more) {
+            res->set_value((const uint8_t*)value.data(), value.size());
+            res->execute_value_updated(res->name());
+            _observer.value_updated(res, M2MBase::Resource);
+        }
+        reply(request, response);
+    }
+
+    void serve_post(const CoapMessage &request, M2MObject *object, M2MObjectInstance *instance, M2MResource *res) {
+        if (!res->allows(M2MBase::POST_ALLOWED)) {
+            reply(request, CoapMessage::METHOD_NOT_ALLOWED);
+            return;
+        }
+        M2MResource::M2MExecuteParameter parameter(object->name(), res->name(), instance->instance_id(),
+                                                   (const uint8_t*)request.payload.data(),
+                                                   (uint16_t)request.payload.size());
+        if (res->delayed_response()) {
+            // Acknowledged now, answered by send_delayed_post_response()
+            res->set_delayed_token(request.token);
+            if (request.type == CoapMessage::CON) {
+                CoapMessage ack(CoapMessage::ACK, CoapMessage::EMPTY, request.message_id);
+                send(ack);
+            }
+            res->execute(&parameter);
+            return;
+        }
+        res->execute(&parameter);
+        reply(request, CoapMessage::CHANGED);
+    }
+
+    void answered(const CoapMessage &response) {
+        pthread_mutex_lock(&_mutex);
+        bool found = false;
+        Pending p;
+        for (size_t i = 0; i < _pending.size(); i++) {
+            if (_pending[i].token == response.token) {
+                p = _pending[i];
+                _pending.erase(_pending.begin() + i);
+                found = true;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&_mutex);
+        if (!found) {
+            return;
+        }
+        bool success = response.code >= CoapMessage::CREATED && response.code < CoapMessage::BAD_REQUEST;
+        switch (p.kind) {
+            case REGISTER:
+                if (success) {
+                    _location = response.joined(CoapMessage::LOCATION_PATH, '/');
+                    _state = REGISTERED;
+                    _observer.object_registered(_security, _server);
+                } else {
+                    _state = IDLE;
+                    _observer.error(InvalidParameters);
+                }
+                break;
+            case UPDATE:
+                if (success) {
+                    _state = REGISTERED;
+                    _observer.registration_updated(_security, _server);
+                } else {
+                    _state = IDLE;
+                    _observer.error(NotRegistered);
+                }
+                break;
+            case UNREGISTER:
+                _state = IDLE;
+                _location.clear();
+                if (success) {
+                    _observer.object_unregistered(_security);
+                } else {
+                    _observer.error(NotRegistered);
+                }
+                break;
+            case RESPONSE:
+                break;
+        }
+    }
+
+    void handle(const uint8_t *data, size_t size) {
+        CoapMessage message;
+        if (!message.decode(data, size)) {
+            return;
+        }
+        pthread_mutex_lock(&_mutex);
+        _stats.received++;
+        _stats.bytes_received += size;
+        pthread_mutex_unlock(&_mutex);
+
+        if (message.is_request()) {
+            serve(message);
+            return;
+        }
+        if (message.type == CoapMessage::RST) {
+            // The server no longer wants what the reset message was for
+            pthread_mutex_lock(&_mutex);
+            std::map<uint16_t, M2MBase*>::iterator n = _notified.find(message.message_id);
+            if (n != _notified.end()) {
+                n->second->set_observation_token(std::string());
+                _notified.erase(n);
+            }
+            pthread_mutex_unlock(&_mutex);
+            return;
+        }
+        if (message.type == CoapMessage::ACK) {
+            pthread_mutex_lock(&_mutex);
+            for (size_t i = 0; i < _pending.size(); i++) {
+                if (_pending[i].message_id == message.message_id) {
+                    if (message.code == CoapMessage::EMPTY && _pending[i].kind != RESPONSE) {
+                        _pending[i].acknowledged = true;
+                    } else if (_pending[i].kind == RESPONSE) {
+                        _pending.erase(_pending.begin() + i);
+                    }
+                    break;
+                }
+            }
+            pthread_mutex_unlock(&_mutex);
+            if (message.code == CoapMessage::EMPTY) {
+                return;
+            }
+        } else if (message.type == CoapMessage::CON) {
+            CoapMessage ack(CoapMessage::ACK, CoapMessage::EMPTY, message.message_id);
+            send(ack);
+        }
+        answered(message);
+    }
+
+    // Resends the confirmable messages that are due, gives up on the rest
+    void retransmit() {
+        std::vector<std::string> resend;
+        std::vector<Kind> expired;
+        uint64_t now = host_now_us();
+        pthread_mutex_lock(&_mutex);
+        for (size_t i = _pending.size(); i > 0; i--) {
+            Pending &p = _pending[i - 1];
+            if (p.acknowledged || p.due_us > now) {
+                continue;
+            }
+            if (p.retransmissions == M2M_CLIENT_RECONNECTION_COUNT) {
+                expired.push_back(p.kind);
+                _pending.erase(_pending.begin() + i - 1);
+                continue;
+            }
+            p.retransmissions++;
+            p.interval_ms *= 2;
+            p.due_us = now + (uint64_t)p.interval_ms * 1000;
+            resend.push_back(p.bytes);
+            _stats.retransmitted++;
+        }
+        pthread_mutex_unlock(&_mutex);
+        for (size_t i = 0; i < resend.size(); i++) {
+            send_bytes(resend[i]);
+        }
+        for (size_t i = 0; i < expired.size(); i++) {
+            if (expired[i] != RESPONSE) {
+                _state = IDLE;
+                _observer.error(Timeout);
+            }
+        }
+    }
+
+    // Event loop handlers
+    static void readable(void *interface) {
+        ((M2MInterfaceImpl*)interface)->receive();
+    }
+
+    static void tick(void *interface) {
+        ((M2MInterfaceImpl*)interface)->retransmit();
+    }
+
+    void receive() {
+        uint8_t buffer[HOST_COAP_MAX_MESSAGE];
+        ssize_t got = recv(_socket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (got <= 0) {
+            bool again = got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+            if (!again && (_tcp || (got < 0 && errno != ECONNREFUSED))) {
+                lost();
+            }
+            return;
+        }
+        TRACE_INSTANT(TRACE_COAP_RECEIVE, got);
+        if (!_tcp) {
+            handle(buffer, got);
+            return;
+        }
+        _stream.append((const char*)buffer, got);
+        std::string message;
+        while (CoapMessage::unframe(_stream, message)) {
+            handle((const uint8_t*)message.data(), message.size());
+        }
+    }
+
+    // The connection is gone, until the application registers or updates
+    // the registration again. Only an error while registered or about to be.
+    void lost() {
+        pthread_mutex_lock(&_mutex);
+        HostEventLoop::instance().unwatch(_socket);
+        close(_socket);
+        _socket = -1;
+        _pending.clear();
+        _stream.clear();
+        pthread_mutex_unlock(&_mutex);
+        State state = _state;
+        _state = IDLE;
+        if (state != IDLE) {
+            _observer.error(NetworkError);
+        }
+    }
+
+    M2MInterfaceObserver &_observer;
+    String                _endpoint_name;
+    String                _endpoint_type;
+    int32_t               _lifetime;
+    uint16_t              _listen_port;
+    String                _domain;
+    bool                  _tcp;
+    bool                  _queue;       // binding UQ or TQ
+    int                   _socket;
+    volatile State        _state;
+    std::string           _location;
+    M2MSecurity          *_security;
+    M2MServer             _server;
+    M2MObjectList         _objects;
+
+    pthread_mutex_t       _mutex;
+    uint32_t              _random;
+    uint16_t              _message_id;
+    std::string           _stream;      // TCP bytes not yet making a message
+    std::vector<Pending>  _pending;
+    std::vector<std::pair<uint16_t, std::string> > _duplicates;
+    std::map<uint16_t, M2MBase*>        _notified;
+    std::map<M2MBase*, std::string>     _outgoing;
+    std::map<M2MBase*, std::string>     _incoming;
+    Stats                 _stats;
+};
+
+#endif // __HOST_M2M_INTERFACE_IMPL_H__
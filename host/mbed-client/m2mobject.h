@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_OBJECT_H__
+#define __HOST_M2M_OBJECT_H__
+
+#include <stdio.h>
+#include <vector>
+#include "mbed-client/m2mobjectinstance.h"
+
+typedef std::vector<M2MObjectInstance*> M2MObjectInstanceList;
+
+class M2MObject: public M2MBase {
+public:
+    M2MObject(const String &name) : M2MBase(M2MBase::Object, name, name) {}
+
+    virtual ~M2MObject() {
+        for (size_t i = 0; i < _instances.size(); i++) {
+            delete _instances[i];
+        }
+    }
+
+    M2MObjectInstance *create_object_instance(uint16_t instance_id=0) {
+        if (object_instance(instance_id)) {
+            return NULL;
+        }
+        char path[16];
+        snprintf(path, sizeof(path), "/%u", instance_id);
+        M2MObjectInstance *inst = new M2MObjectInstance(name(), instance_id, String(uri_path()) + path);
+        _instances.push_back(inst);
+        return inst;
+    }
+
+    M2MObjectInstance *object_instance(uint16_t instance_id=0) const {
+        for (size_t i = 0; i < _instances.size(); i++) {
+            if (_instances[i]->instance_id() == instance_id) {
+                return _instances[i];
+            }
+        }
+        return NULL;
+    }
+
+    const M2MObjectInstanceList &instances() const {
+        return _instances;
+    }
+
+private:
+    M2MObjectInstanceList _instances;
+};
+
+typedef std::vector<M2MObject*> M2MObjectList;
+
+#endif // __HOST_M2M_OBJECT_H__
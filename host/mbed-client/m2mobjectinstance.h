@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_OBJECT_INSTANCE_H__
+#define __HOST_M2M_OBJECT_INSTANCE_H__
+
+#include <vector>
+#include "mbed-client/m2mresource.h"
+
+typedef std::vector<M2MResource*> M2MResourceList;
+
+class M2MObjectInstance: public M2MBase {
+public:
+    M2MObjectInstance(const String &object_name, uint16_t instance_id, const String &path)
+        : M2MBase(M2MBase::ObjectInstance, object_name, path), _instance_id(instance_id) {}
+
+    virtual ~M2MObjectInstance() {
+        for (size_t i = 0; i < _resources.size(); i++) {
+            delete _resources[i];
+        }
+    }
+
+    M2MResource *create_dynamic_resource(const String &name, const String &resource_type,
+                                         M2MResourceInstance::ResourceType type, bool observable, bool /*multiple*/=false) {
+        if (resource(name)) {
+            return NULL;
+        }
+        M2MResource *res = new M2MResource(name, String(uri_path()) + "/" + name, resource_type, type, observable);
+        _resources.push_back(res);
+        return res;
+    }
+
+    M2MResource *resource(const String &name) const {
+        for (size_t i = 0; i < _resources.size(); i++) {
+            if (name == _resources[i]->name()) {
+                return _resources[i];
+            }
+        }
+        return NULL;
+    }
+
+    const M2MResourceList &resources() const {
+        return _resources;
+    }
+
+    uint16_t instance_id() const {
+        return _instance_id;
+    }
+
+private:
+    uint16_t        _instance_id;
+    M2MResourceList _resources;
+};
+
+#endif // __HOST_M2M_OBJECT_INSTANCE_H__
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_RESOURCE_H__
+#define __HOST_M2M_RESOURCE_H__
+
+#include <string>
+#include "mbed-client/m2mresourceinstance.h"
+
+/*
+* A single-instance resource. A resource with a delayed response answers
+* a POST with an empty acknowledgement, and with the result once the
+* application calls send_delayed_post_response().
+*/
+class M2MResource: public M2MResourceInstance {
+public:
+    /*
+    * The argument a POST passes to the execute function.
+    */
+    class M2MExecuteParameter {
+    public:
+        M2MExecuteParameter(const String &object_name, const String &resource_name, uint16_t instance_id,
+                            const uint8_t *value, uint16_t length)
+            : _object_name(object_name), _resource_name(resource_name), _instance_id(instance_id),
+              _value((uint8_t*)value), _length(length) {}
+
+        uint8_t *get_argument_value() const {
+            return _value;
+        }
+        uint16_t get_argument_value_length() const {
+            return _length;
+        }
+        const String &get_argument_object_name() const {
+            return _object_name;
+        }
+        const String &get_argument_resource_name() const {
+            return _resource_name;
+        }
+        uint16_t get_argument_object_instance_id() const {
+            return _instance_id;
+        }
+
+    private:
+        String   _object_name;
+        String   _resource_name;
+        uint16_t _instance_id;
+        uint8_t *_value;
+        uint16_t _length;
+    };
+
+    M2MResource(const String &name, const String &path, const String &resource_type, ResourceType type, bool observable)
+        : M2MResourceInstance(name, path, resource_type, type), _delayed_response(false) {
+        set_observable(observable);
+    }
+
+    void set_delayed_response(bool delayed) {
+        _delayed_response = delayed;
+    }
+    bool delayed_response() const {
+        return _delayed_response;
+    }
+
+    // Token of the POST awaiting its delayed response; the latest one only
+    void set_delayed_token(const std::string &token) {
+        _delayed_token = token;
+    }
+    const std::string &delayed_token() const {
+        return _delayed_token;
+    }
+
+    bool send_delayed_post_response() {
+        if (!_delayed_response || _delayed_token.empty() || !observation_handler()) {
+            return false;
+        }
+        // Taken before the response goes out: the next POST may arrive, and
+        // set its token, as soon as it has
+        std::string token;
+        token.swap(_delayed_token);
+        observation_handler()->send_delayed_response(this, token);
+        return true;
+    }
+
+private:
+    bool        _delayed_response;
+    std::string _delayed_token;
+};
+
+#endif // __HOST_M2M_RESOURCE_H__
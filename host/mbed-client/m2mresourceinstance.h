@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_RESOURCE_INSTANCE_H__
+#define __HOST_M2M_RESOURCE_INSTANCE_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mbed-client/m2mbase.h"
+#include "mbed-client/m2mblockmessage.h"
+
+typedef FP1<void, void*> execute_callback;
+typedef FP1<void, M2MBlockMessage*> incoming_block_message_callback;
+typedef FP3<void, const String&, uint8_t*&, uint32_t&> outgoing_block_message_callback;
+
+/*
+* A resource value. Values are kept as text, the way LwM2M carries them
+* in text/plain; setting a changed value of an observed resource sends a
+* notification.
+*/
+class M2MResourceInstance: public M2MBase {
+public:
+    enum ResourceType {
+        STRING,
+        INTEGER,
+        FLOAT,
+        BOOLEAN,
+        OPAQUE,
+        TIME,
+        OBJLINK
+    };
+
+    M2MResourceInstance(const String &name, const String &path, const String &resource_type, ResourceType type)
+        : M2MBase(M2MBase::ResourceInstance, name, path, resource_type), _type(type), _value(NULL), _length(0) {}
+
+    virtual ~M2MResourceInstance() {
+        free(_value);
+    }
+
+    ResourceType resource_instance_type() const {
+        return _type;
+    }
+
+    bool set_value(const uint8_t *value, uint32_t length) {
+        bool changed = length != _length || (length && memcmp(value, _value, length) != 0);
+        if (!changed) {
+            return true;
+        }
+        uint8_t *copy = (uint8_t*)malloc(length + 1);
+        if (!copy) {
+            return false;
+        }
+        if (length) {
+            memcpy(copy, value, length);
+        }
+        copy[length] = '\0';
+        free(_value);
+        _value = copy;
+        _length = length;
+        if (is_under_observation() && observation_handler()) {
+            observation_handler()->value_changed(this);
+        }
+        return true;
+    }
+
+    bool set_value(int64_t value) {
+        char text[24];
+        int length = snprintf(text, sizeof(text), "%lld", (long long)value);
+        return set_value((const uint8_t*)text, length);
+    }
+
+    void clear_value() {
+        free(_value);
+        _value = NULL;
+        _length = 0;
+    }
+
+    // A copy of the value for the caller to free()
+    void get_value(uint8_t *&value, uint32_t &length) {
+        value = (uint8_t*)malloc(_length + 1);
+        length = 0;
+        if (value) {
+            if (_length) {
+                memcpy(value, _value, _length);
+            }
+            value[_length] = '\0';
+            length = _length;
+        }
+    }
+
+    String get_value_string() const {
+        return _value ? String((const char*)_value, _length) : String();
+    }
+
+    int64_t get_value_int() const {
+        return _value ? strtoll((const char*)_value, NULL, 10) : 0;
+    }
+
+    uint8_t *value() const {
+        return _value;
+    }
+
+    uint32_t value_length() const {
+        return _length;
+    }
+
+    void set_execute_function(execute_callback callback) {
+        _execute = callback;
+    }
+    void execute(void *argument) {
+        if (_execute) {
+            _execute(argument);
+        }
+    }
+
+    void set_incoming_block_message_callback(incoming_block_message_callback callback) {
+        _incoming_block = callback;
+    }
+    bool has_incoming_block_callback() const {
+        return _incoming_block;
+    }
+    void incoming_block(M2MBlockMessage *message) {
+        _incoming_block(message);
+    }
+
+    void set_outgoing_block_message_callback(outgoing_block_message_callback callback) {
+        _outgoing_block = callback;
+    }
+    bool has_outgoing_block_callback() const {
+        return _outgoing_block;
+    }
+    void outgoing_block(const String &name, uint8_t *&data, uint32_t &length) {
+        _outgoing_block(name, data, length);
+    }
+
+private:
+    ResourceType                    _type;
+    uint8_t                        *_value;
+    uint32_t                        _length;
+    execute_callback                _execute;
+    incoming_block_message_callback _incoming_block;
+    outgoing_block_message_callback _outgoing_block;
+};
+
+#endif // __HOST_M2M_RESOURCE_INSTANCE_H__
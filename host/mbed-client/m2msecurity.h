@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_SECURITY_H__
+#define __HOST_M2M_SECURITY_H__
+
+#include "mbed-client/m2mobject.h"
+
+/*
+* The LwM2M Security object, 0: where the server is and how to connect
+* to it. The host build talks plain CoAP, so the keys are kept but not
+* used.
+*/
+class M2MSecurity: public M2MObject {
+public:
+    enum ServerType {
+        Bootstrap,
+        M2MServer
+    };
+
+    enum SecurityResource {
+        M2MServerUri,
+        BootstrapServer,
+        SecurityMode,
+        PublicKey,
+        ServerPublicKey,
+        Secretkey
+    };
+
+    enum SecurityModeType {
+        SecurityNotSet = -1,
+        Psk = 0,
+        Certificate = 2,
+        NoSecurity = 3
+    };
+
+    M2MSecurity(ServerType type) : M2MObject("0"), _server_type(type) {
+        M2MObjectInstance *inst = create_object_instance();
+        for (int r = M2MServerUri; r <= Secretkey; r++) {
+            char id[4];
+            snprintf(id, sizeof(id), "%d", r);
+            inst->create_dynamic_resource(id, "", r == SecurityMode ? M2MResourceInstance::INTEGER
+                                                                    : M2MResourceInstance::OPAQUE, false);
+        }
+    }
+
+    bool set_resource_value(SecurityResource resource, const String &value) {
+        return set_resource_value(resource, (const uint8_t*)value.data(), value.size());
+    }
+    bool set_resource_value(SecurityResource resource, uint32_t value) {
+        return get_resource(resource)->set_value((int64_t)value);
+    }
+    bool set_resource_value(SecurityResource resource, const uint8_t *value, uint16_t length) {
+        return get_resource(resource)->set_value(value, length);
+    }
+
+    String resource_value_string(SecurityResource resource) const {
+        return get_resource(resource)->get_value_string();
+    }
+    uint32_t resource_value_int(SecurityResource resource) const {
+        return (uint32_t)get_resource(resource)->get_value_int();
+    }
+
+    ServerType server_type() const {
+        return _server_type;
+    }
+
+private:
+    M2MResource *get_resource(SecurityResource resource) const {
+        char id[4];
+        snprintf(id, sizeof(id), "%d", (int)resource);
+        return object_instance()->resource(id);
+    }
+
+    ServerType _server_type;
+};
+
+#endif // __HOST_M2M_SECURITY_H__
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_SERVER_H__
+#define __HOST_M2M_SERVER_H__
+
+#include "mbed-client/m2mobject.h"
+
+/*
+* The LwM2M Server object, 1, as reported on registration.
+*/
+class M2MServer: public M2MObject {
+public:
+    M2MServer() : M2MObject("1") {
+        create_object_instance();
+    }
+};
+
+#endif // __HOST_M2M_SERVER_H__
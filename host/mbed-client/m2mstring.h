@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_M2M_STRING_H__
+#define __HOST_M2M_STRING_H__
+
+#include <string>
+
+/*
+* mbed Client's string class. On the host it is std::string.
+*/
+class String: public std::string {
+public:
+    String() {}
+    String(const char *text) : std::string(text ? text : "") {}
+    String(const char *text, size_t length) : std::string(text, length) {}
+    String(const std::string &text) : std::string(text) {}
+};
+
+#endif // __HOST_M2M_STRING_H__
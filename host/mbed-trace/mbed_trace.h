@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_MBED_TRACE_H__
+#define __HOST_MBED_TRACE_H__
+
+// Tracing is off in the host build, as in mbed_app.json
+inline int mbed_trace_init() {
+    return 0;
+}
+
+inline void mbed_trace_free() {}
+
+#endif // __HOST_MBED_TRACE_H__
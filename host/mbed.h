@@ -0,0 +1,1040 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_MBED_H__
+#define __HOST_MBED_H__
+
+/*
+* The parts of the mbed OS 5 API the example uses, for building it on a
+* Linux host: a simulated FRDM-K64F whose RTOS primitives map onto POSIX
+* threads and whose peripherals are models. Interrupt handlers run on the
+* thread that raises the interrupt, which must not be the thread they
+* wake up.
+*
+* Simulated inputs are deterministic for a given MBED_HOST_SEED
+* environment variable (1 by default):
+*
+*  - AnalogIn: a slow sine per pin plus uniform noise, 16 bits. Every
+*    four inputs made count as another board, whose sines are out of
+*    phase with the others' and whose noise differs
+*  - I2C: an FXOS8700CQ at 0x1d, see sim_fxos8700cq.h, whose INT2 drives
+*    PTC13
+*  - FlashIAP: 1 MiB of NOR flash in RAM, or in the file named by
+*    MBED_HOST_FLASH so that it survives restarts
+*  - SW2: pressed every MBED_HOST_SW2_PERIOD_MS milliseconds, if set
+*
+* Heap and stack statistics are kept as mbed OS keeps them with
+* MBED_HEAP_STATS_ENABLED and MBED_STACK_STATS_ENABLED, for the whole
+* process.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef __MBED__
+#define __MBED__ 1
+#endif
+#ifndef DEVICE_FLASH
+#define DEVICE_FLASH 1
+#endif
+#ifndef TARGET_K64F
+#define TARGET_K64F 1
+#endif
+
+// Size of the simulated internal flash
+#ifndef HOST_FLASH_SIZE
+#define HOST_FLASH_SIZE (1024 * 1024)
+#endif
+
+// Flash taken by the simulated application image, from the start
+#ifndef HOST_FLASH_APP_SIZE
+#define HOST_FLASH_APP_SIZE (384 * 1024)
+#endif
+#define FLASHIAP_APP_ROM_END_ADDR HOST_FLASH_APP_SIZE
+
+// Most InterruptIns that can be attached at once
+#define HOST_MAX_INTERRUPTS 8
+
+typedef enum {
+    LED1, LED2, LED3, LED4,
+    SW2, SW3,
+    A0, A1, A2, A3, A4, A5,
+    D0, D1,
+    PTE24, PTE25, PTC13,
+    NC = -1
+} PinName;
+
+typedef enum {
+    osOK = 0,
+    osEventSignal = 0x08,
+    osEventTimeout = 0x40,
+    osErrorParameter = 0x80,
+    osErrorResource = 0x81,
+    osErrorTimeoutResource = 0xC1
+} osStatus;
+
+typedef enum {
+    osPriorityIdle = -3,
+    osPriorityLow = -2,
+    osPriorityBelowNormal = -1,
+    osPriorityNormal = 0,
+    osPriorityAboveNormal = 1,
+    osPriorityHigh = 2,
+    osPriorityRealtime = 3
+} osPriority;
+
+#define osWaitForever 0xFFFFFFFFu
+
+typedef void *osThreadId;
+
+inline osThreadId osThreadGetId() {
+    return (osThreadId)pthread_self();
+}
+
+// Microseconds of CLOCK_MONOTONIC
+inline uint64_t host_now_us() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+inline void host_sleep_until_us(uint64_t deadline) {
+    struct timespec t;
+    t.tv_sec = deadline / 1000000;
+    t.tv_nsec = (deadline % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR) {
+    }
+}
+
+inline uint32_t host_seed() {
+    const char *seed = getenv("MBED_HOST_SEED");
+    return seed ? (uint32_t)strtoul(seed, NULL, 0) : 1;
+}
+
+// xorshift32; `state` must not be 0
+inline uint32_t host_random(uint32_t &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Interrupts are threads on the host, so a critical section is a lock
+// all of them share. Like the board's, it nests.
+inline pthread_mutex_t *host_critical_section() {
+    static pthread_mutex_t mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+    return &mutex;
+}
+
+inline void core_util_critical_section_enter() {
+    pthread_mutex_lock(host_critical_section());
+}
+
+inline void core_util_critical_section_exit() {
+    pthread_mutex_unlock(host_critical_section());
+}
+
+// mbed OS's heap and stack statistics, platform/mbed_stats.h, which
+// mbed_app.json turns on for the board
+#define MBED_HEAP_STATS_ENABLED 1
+#define MBED_STACK_STATS_ENABLED 1
+
+typedef struct {
+    uint32_t current_size;      // bytes allocated now
+    uint32_t max_size;          // most bytes allocated at once
+    uint32_t total_size;        // bytes ever allocated
+    uint32_t alloc_cnt;         // blocks allocated now
+    uint32_t alloc_fail_cnt;    // allocations that failed
+} mbed_stats_heap_t;
+
+typedef struct {
+    uint32_t thread_id;
+    uint32_t max_size;          // most stack the thread used
+    uint32_t reserved_size;     // size of its stack
+    uint32_t stack_cnt;
+} mbed_stats_stack_t;
+
+struct HostHeap {
+    mbed_stats_heap_t stats;
+    uint64_t          allocations;  // ever made, which mbed OS does not count
+    int               lock;         // a spin lock, as a mutex would allocate
+};
+
+// Zero-initialized before any constructor runs, as malloc() may be
+// called before main()
+inline HostHeap &host_heap() {
+    static HostHeap heap;
+    return heap;
+}
+
+inline HostHeap &host_heap_lock() {
+    HostHeap &heap = host_heap();
+    while (__atomic_exchange_n(&heap.lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&heap.lock, __ATOMIC_RELAXED)) {
+            sched_yield();
+        }
+    }
+    return heap;
+}
+
+inline void host_heap_unlock(HostHeap &heap) {
+    __atomic_store_n(&heap.lock, 0, __ATOMIC_RELEASE);
+}
+
+inline void host_heap_add(size_t size) {
+    HostHeap &heap = host_heap_lock();
+    heap.stats.current_size += (uint32_t)size;
+    heap.stats.total_size += (uint32_t)size;
+    heap.stats.alloc_cnt++;
+    heap.allocations++;
+    if (heap.stats.current_size > heap.stats.max_size) {
+        heap.stats.max_size = heap.stats.current_size;
+    }
+    host_heap_unlock(heap);
+}
+
+inline void host_heap_remove(size_t size) {
+    HostHeap &heap = host_heap_lock();
+    heap.stats.current_size -= (uint32_t)size;
+    heap.stats.alloc_cnt--;
+    host_heap_unlock(heap);
+}
+
+inline void *host_heap_allocated(void *ptr) {
+    if (ptr) {
+        host_heap_add(malloc_usable_size(ptr));
+    } else {
+        HostHeap &heap = host_heap_lock();
+        heap.stats.alloc_fail_cnt++;
+        host_heap_unlock(heap);
+    }
+    return ptr;
+}
+
+inline void mbed_stats_heap_get(mbed_stats_heap_t *stats) {
+    HostHeap &heap = host_heap_lock();
+    *stats = heap.stats;
+    host_heap_unlock(heap);
+}
+
+// Allocations made since the program started, for the benchmarks'
+// allocation budgets
+inline uint64_t host_heap_allocations() {
+    HostHeap &heap = host_heap_lock();
+    uint64_t allocations = heap.allocations;
+    host_heap_unlock(heap);
+    return allocations;
+}
+
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+/*
+* Every allocation in the process is counted, as on the board, by
+* replacing malloc() and friends with ones that count the blocks glibc
+* hands out, in usable bytes. The host builds compile one translation
+* unit per program, so these are defined once. Sanitizer builds keep the
+* sanitizer's allocator, and their heap statistics read zero.
+*/
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) throw() {
+    return host_heap_allocated(__libc_malloc(size));
+}
+
+void *calloc(size_t count, size_t size) throw() {
+    return host_heap_allocated(__libc_calloc(count, size));
+}
+
+void *realloc(void *ptr, size_t size) throw() {
+    size_t old = ptr ? malloc_usable_size(ptr) : 0;
+    void *moved = __libc_realloc(ptr, size);
+    if (moved || !size) {
+        if (ptr) {
+            host_heap_remove(old);
+        }
+        if (moved) {
+            host_heap_allocated(moved);
+        }
+    } else {
+        host_heap_allocated(NULL);
+    }
+    return moved;
+}
+
+void *memalign(size_t alignment, size_t size) throw() {
+    return host_heap_allocated(__libc_memalign(alignment, size));
+}
+
+void *aligned_alloc(size_t alignment, size_t size) throw() {
+    return host_heap_allocated(__libc_memalign(alignment, size));
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) throw() {
+    if (alignment % sizeof(void*) || alignment & (alignment - 1)) {
+        return EINVAL;
+    }
+    *ptr = host_heap_allocated(__libc_memalign(alignment, size));
+    return *ptr ? 0 : ENOMEM;
+}
+
+void free(void *ptr) throw() {
+    if (ptr) {
+        host_heap_remove(malloc_usable_size(ptr));
+        __libc_free(ptr);
+    }
+}
+}
+#endif
+
+// Most threads whose stacks mbed_stats_stack_get_each() reports
+#define HOST_MAX_THREADS 32
+
+/*
+* The threads standing in for the board's RTOS threads: main() and every
+* Thread, plus the thread standing in for mbed Client's event thread.
+* Ticker threads stand in for interrupts, which have no stack of their
+* own on the board, and are not listed.
+*/
+struct HostThreads {
+    pthread_mutex_t mutex;
+    size_t          count;
+    pthread_t       threads[HOST_MAX_THREADS];
+};
+
+inline HostThreads &host_threads() {
+    static HostThreads threads = { PTHREAD_MUTEX_INITIALIZER, 0, {} };
+    return threads;
+}
+
+inline void host_thread_started() {
+    HostThreads &t = host_threads();
+    pthread_mutex_lock(&t.mutex);
+    if (t.count < HOST_MAX_THREADS) {
+        t.threads[t.count++] = pthread_self();
+    }
+    pthread_mutex_unlock(&t.mutex);
+}
+
+inline void host_thread_stopped() {
+    HostThreads &t = host_threads();
+    pthread_mutex_lock(&t.mutex);
+    for (size_t i = 0; i < t.count; i++) {
+        if (pthread_equal(t.threads[i], pthread_self())) {
+            t.threads[i] = t.threads[--t.count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&t.mutex);
+}
+
+static struct HostMainThread {
+    HostMainThread() {
+        host_thread_started();
+    }
+} host_main_thread;
+
+/*
+* The stack `thread` has used, from the top of its stack down to the
+* lowest page the kernel has had to map in. Like the board's painted
+* stacks, pages once touched stay in, so this is a high-water mark.
+*/
+inline bool host_stack_usage(pthread_t thread, uint32_t &used, uint32_t &reserved) {
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(thread, &attributes) != 0) {
+        return false;
+    }
+    void *base;
+    size_t size;
+    pthread_attr_getstack(&attributes, &base, &size);
+    pthread_attr_destroy(&attributes);
+
+    const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    const uintptr_t bottom = ((uintptr_t)base + page - 1) & ~(page - 1);
+    const uintptr_t top = ((uintptr_t)base + size) & ~(page - 1);
+    // page by page, as the main thread's stack is only mapped as far
+    // down as it has grown
+    uintptr_t lowest = top;
+    unsigned char resident;
+    while (lowest > bottom && mincore((void*)(lowest - page), page, &resident) == 0 && (resident & 1)) {
+        lowest -= page;
+    }
+    used = (uint32_t)(top - lowest);
+    reserved = (uint32_t)size;
+    return true;
+}
+
+inline size_t mbed_stats_stack_get_each(mbed_stats_stack_t *stats, size_t count) {
+    HostThreads &t = host_threads();
+    size_t filled = 0;
+    // held while measuring, so none of the threads can go away meanwhile
+    pthread_mutex_lock(&t.mutex);
+    for (size_t i = 0; i < t.count && filled < count; i++) {
+        mbed_stats_stack_t &s = stats[filled];
+        if (host_stack_usage(t.threads[i], s.max_size, s.reserved_size)) {
+            s.thread_id = (uint32_t)(uintptr_t)t.threads[i];
+            s.stack_cnt = 1;
+            filled++;
+        }
+    }
+    pthread_mutex_unlock(&t.mutex);
+    return filled;
+}
+
+// Interrupt handlers run on threads of their own on the host
+inline bool core_util_is_isr_active() {
+    return false;
+}
+
+// The board's free-running microsecond counter
+inline uint32_t us_ticker_read() {
+    return (uint32_t)host_now_us();
+}
+
+inline void wait_ms(int ms) {
+    usleep(ms * 1000);
+}
+
+inline void wait_us(int us) {
+    usleep(us);
+}
+
+inline void wait(float s) {
+    usleep((useconds_t)(s * 1000000));
+}
+
+template <typename F>
+class Callback;
+
+/*
+* A function, or a method of an object, taking and returning nothing.
+*/
+template <>
+class Callback<void()> {
+public:
+    Callback() : _function(NULL), _object(NULL), _thunk(NULL) {}
+
+    Callback(void (*function)()) : _function(function), _object(NULL), _thunk(NULL) {}
+
+    template <typename T>
+    Callback(T *object, void (T::*method)()) : _function(NULL), _object(object), _thunk(&method_thunk<T>) {
+        memcpy(_method, &method, sizeof(method));
+    }
+
+    void call() const {
+        if (_thunk) {
+            _thunk(_object, _method);
+        } else if (_function) {
+            _function();
+        }
+    }
+
+    void operator()() const {
+        call();
+    }
+
+    operator bool() const {
+        return _function || _thunk;
+    }
+
+private:
+    template <typename T>
+    static void method_thunk(void *object, const char *method) {
+        void (T::*m)();
+        memcpy(&m, method, sizeof(m));
+        (((T*)object)->*m)();
+    }
+
+    void (*_function)();
+    void *_object;
+    void (*_thunk)(void*, const char*);
+    char _method[sizeof(void (Callback::*)())];
+};
+
+template <typename T>
+Callback<void()> callback(T *object, void (T::*method)()) {
+    return Callback<void()>(object, method);
+}
+
+inline Callback<void()> callback(void (*function)()) {
+    return Callback<void()>(function);
+}
+
+class Mutex {
+public:
+    Mutex() {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&_mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+    ~Mutex() {
+        pthread_mutex_destroy(&_mutex);
+    }
+    osStatus lock(uint32_t /*millisec*/=osWaitForever) {
+        pthread_mutex_lock(&_mutex);
+        return osOK;
+    }
+    bool trylock() {
+        return pthread_mutex_trylock(&_mutex) == 0;
+    }
+    osStatus unlock() {
+        pthread_mutex_unlock(&_mutex);
+        return osOK;
+    }
+
+private:
+    Mutex(const Mutex&);
+    Mutex& operator=(const Mutex&);
+
+    pthread_mutex_t _mutex;
+};
+
+class Semaphore {
+public:
+    Semaphore(int32_t count=0) : _count(count) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&_cond, &attr);
+        pthread_condattr_destroy(&attr);
+        pthread_mutex_init(&_mutex, NULL);
+    }
+    ~Semaphore() {
+        pthread_cond_destroy(&_cond);
+        pthread_mutex_destroy(&_mutex);
+    }
+
+    // Tokens available before taking one, or 0 on timeout
+    int32_t wait(uint32_t millisec=osWaitForever) {
+        pthread_mutex_lock(&_mutex);
+        if (millisec == osWaitForever) {
+            while (_count == 0) {
+                pthread_cond_wait(&_cond, &_mutex);
+            }
+        } else {
+            uint64_t deadline = host_now_us() + (uint64_t)millisec * 1000;
+            struct timespec t;
+            t.tv_sec = deadline / 1000000;
+            t.tv_nsec = (deadline % 1000000) * 1000;
+            while (_count == 0 && pthread_cond_timedwait(&_cond, &_mutex, &t) != ETIMEDOUT) {
+            }
+        }
+        int32_t available = _count;
+        if (_count > 0) {
+            _count--;
+        }
+        pthread_mutex_unlock(&_mutex);
+        return available;
+    }
+
+    osStatus release() {
+        pthread_mutex_lock(&_mutex);
+        _count++;
+        pthread_cond_signal(&_cond);
+        pthread_mutex_unlock(&_mutex);
+        return osOK;
+    }
+
+private:
+    Semaphore(const Semaphore&);
+    Semaphore& operator=(const Semaphore&);
+
+    pthread_mutex_t _mutex;
+    pthread_cond_t  _cond;
+    int32_t         _count;
+};
+
+/*
+* A POSIX thread. Priorities and stack sizes are accepted and ignored.
+*/
+class Thread {
+public:
+    Thread(osPriority /*priority*/=osPriorityNormal, uint32_t /*stack_size*/=0, unsigned char * /*stack_mem*/=NULL)
+        : _started(false), _joined(false) {}
+
+    ~Thread() {
+        join();
+    }
+
+    osStatus start(Callback<void()> task) {
+        if (_started) {
+            return osErrorResource;
+        }
+        _task = task;
+        if (pthread_create(&_thread, NULL, &Thread::run, this) != 0) {
+            return osErrorResource;
+        }
+        _started = true;
+        return osOK;
+    }
+
+    osStatus join() {
+        if (_started && !_joined && !pthread_equal(_thread, pthread_self())) {
+            pthread_join(_thread, NULL);
+            _joined = true;
+        }
+        return osOK;
+    }
+
+    static osStatus wait(uint32_t millisec) {
+        usleep(millisec * 1000);
+        return osEventTimeout;
+    }
+
+    static osStatus yield() {
+        sched_yield();
+        return osOK;
+    }
+
+private:
+    Thread(const Thread&);
+    Thread& operator=(const Thread&);
+
+    static void *run(void *thread) {
+        host_thread_started();
+        ((Thread*)thread)->_task();
+        host_thread_stopped();
+        return NULL;
+    }
+
+    Callback<void()> _task;
+    pthread_t        _thread;
+    bool             _started;
+    bool             _joined;
+};
+
+class Timer {
+public:
+    Timer() : _running(false), _start(0), _elapsed(0) {}
+
+    void start() {
+        if (!_running) {
+            _start = host_now_us();
+            _running = true;
+        }
+    }
+    void stop() {
+        if (_running) {
+            _elapsed += host_now_us() - _start;
+            _running = false;
+        }
+    }
+    void reset() {
+        _start = host_now_us();
+        _elapsed = 0;
+    }
+    uint64_t read_high_resolution_us() {
+        return _elapsed + (_running ? host_now_us() - _start : 0);
+    }
+    int read_us() {
+        return (int)read_high_resolution_us();
+    }
+    int read_ms() {
+        return (int)(read_high_resolution_us() / 1000);
+    }
+    float read() {
+        return read_high_resolution_us() / 1000000.0f;
+    }
+
+private:
+    bool     _running;
+    uint64_t _start;
+    uint64_t _elapsed;
+};
+
+/*
+* Calls a function periodically, from a thread of its own standing in
+* for the timer interrupt.
+*/
+class Ticker {
+public:
+    Ticker() : _period_us(0), _once(false), _attached(false), _running(false) {
+        pthread_mutex_init(&_mutex, NULL);
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&_changed, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+    virtual ~Ticker() {
+        detach();
+        pthread_cond_destroy(&_changed);
+        pthread_mutex_destroy(&_mutex);
+    }
+
+    void attach(Callback<void()> func, float t) {
+        attach_us(func, (uint64_t)(t * 1000000.0f));
+    }
+
+    template <typename T, typename M>
+    void attach(T *object, M method, float t) {
+        attach(callback(object, method), t);
+    }
+
+    void attach_us(Callback<void()> func, uint64_t t) {
+        detach();
+        pthread_mutex_lock(&_mutex);
+        _handler = func;
+        _period_us = t;
+        _next_us = host_now_us() + t;
+        _attached = true;
+        pthread_mutex_unlock(&_mutex);
+        if (!_running) {
+            _running = pthread_create(&_thread, NULL, &Ticker::run, this) == 0;
+        }
+    }
+
+    template <typename T, typename M>
+    void attach_us(T *object, M method, uint64_t t) {
+        attach_us(callback(object, method), t);
+    }
+
+    void detach() {
+        pthread_mutex_lock(&_mutex);
+        _attached = false;
+        pthread_cond_signal(&_changed);
+        pthread_mutex_unlock(&_mutex);
+        if (_running && !pthread_equal(_thread, pthread_self())) {
+            pthread_join(_thread, NULL);
+            _running = false;
+        }
+    }
+
+protected:
+    // Sleeps until the next call is due or detach() wakes it up
+    static void *run(void *ticker) {
+        Ticker *self = (Ticker*)ticker;
+        pthread_mutex_lock(&self->_mutex);
+        while (self->_attached) {
+            uint64_t next = self->_next_us;
+            if (host_now_us() < next) {
+                struct timespec t;
+                t.tv_sec = next / 1000000;
+                t.tv_nsec = (next % 1000000) * 1000;
+                pthread_cond_timedwait(&self->_changed, &self->_mutex, &t);
+                continue;
+            }
+            Callback<void()> handler = self->_handler;
+            self->_next_us += self->_period_us;
+            if (self->_once) {
+                self->_attached = false;
+            }
+            pthread_mutex_unlock(&self->_mutex);
+            handler();
+            pthread_mutex_lock(&self->_mutex);
+        }
+        pthread_mutex_unlock(&self->_mutex);
+        return NULL;
+    }
+
+    pthread_mutex_t  _mutex;
+    pthread_cond_t   _changed;
+    pthread_t        _thread;
+    Callback<void()> _handler;
+    uint64_t         _period_us;
+    uint64_t         _next_us;
+    bool             _once;
+    volatile bool    _attached;
+    bool             _running;
+};
+
+class Timeout: public Ticker {
+public:
+    Timeout() {
+        _once = true;
+    }
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName /*pin*/, int value=0) : _value(value) {}
+    void write(int value) {
+        _value = value;
+    }
+    int read() {
+        return _value;
+    }
+    DigitalOut& operator=(int value) {
+        write(value);
+        return *this;
+    }
+    operator int() {
+        return read();
+    }
+
+private:
+    volatile int _value;
+};
+
+/*
+* Edge interrupts are raised with host_pin_fall() and host_pin_rise().
+*/
+class InterruptIn {
+public:
+    InterruptIn(PinName pin) : _pin(pin) {
+        Mutex &lock = registry_lock();
+        lock.lock();
+        InterruptIn **slots = registry();
+        for (int i = 0; i < HOST_MAX_INTERRUPTS; i++) {
+            if (!slots[i]) {
+                slots[i] = this;
+                break;
+            }
+        }
+        lock.unlock();
+    }
+    ~InterruptIn() {
+        Mutex &lock = registry_lock();
+        lock.lock();
+        InterruptIn **slots = registry();
+        for (int i = 0; i < HOST_MAX_INTERRUPTS; i++) {
+            if (slots[i] == this) {
+                slots[i] = NULL;
+            }
+        }
+        lock.unlock();
+    }
+
+    void fall(Callback<void()> func) {
+        _fall = func;
+        if (_pin == SW2 && getenv("MBED_HOST_SW2_PERIOD_MS")) {
+            _presses.attach_us(&host_press_sw2, strtoul(getenv("MBED_HOST_SW2_PERIOD_MS"), NULL, 0) * 1000);
+        }
+    }
+    void rise(Callback<void()> func) {
+        _rise = func;
+    }
+    template <typename T, typename M>
+    void fall(T *object, M method) {
+        fall(callback(object, method));
+    }
+    template <typename T, typename M>
+    void rise(T *object, M method) {
+        rise(callback(object, method));
+    }
+
+    static void raise(PinName pin, bool falling) {
+        Mutex &lock = registry_lock();
+        lock.lock();
+        InterruptIn **slots = registry();
+        for (int i = 0; i < HOST_MAX_INTERRUPTS; i++) {
+            if (slots[i] && slots[i]->_pin == pin) {
+                Callback<void()> handler = falling ? slots[i]->_fall : slots[i]->_rise;
+                lock.unlock();
+                handler();
+                return;
+            }
+        }
+        lock.unlock();
+    }
+
+private:
+    static InterruptIn **registry() {
+        static InterruptIn *slots[HOST_MAX_INTERRUPTS];
+        return slots;
+    }
+    static Mutex &registry_lock() {
+        static Mutex lock;
+        return lock;
+    }
+    static void host_press_sw2() {
+        raise(SW2, true);
+    }
+
+    PinName          _pin;
+    Callback<void()> _fall;
+    Callback<void()> _rise;
+    Ticker           _presses;
+};
+
+inline void host_pin_fall(PinName pin) {
+    InterruptIn::raise(pin, true);
+}
+
+inline void host_pin_rise(PinName pin) {
+    InterruptIn::raise(pin, false);
+}
+
+/*
+* 0.5 +- 0.3 full scale, a sine with a period of a few seconds that
+* differs per pin, plus +-1% of uniform noise.
+*/
+class AnalogIn {
+public:
+    AnalogIn(PinName pin) : _pin(pin) {
+        static uint32_t instances = 0;
+        uint32_t instance = instances++ / 4;
+        _noise = host_seed() * 2654435761u + pin + 1 + instance * 40503u;
+        if (_noise == 0) {
+            _noise = 1;
+        }
+        _phase = (instance * 0.618034 - (int)(instance * 0.618034)) * 2 * M_PI;
+    }
+    uint16_t read_u16() {
+        double t = host_now_us() / 1000000.0;
+        double v = 0.5 + 0.3 * sin(2 * M_PI * t / (3.0 + _pin) + _phase) +
+                   ((host_random(_noise) % 2001) / 1000.0 - 1.0) * 0.01;
+        if (v < 0) {
+            v = 0;
+        } else if (v > 1) {
+            v = 1;
+        }
+        return (uint16_t)(v * 65535);
+    }
+    float read() {
+        return read_u16() / 65535.0f;
+    }
+    operator float() {
+        return read();
+    }
+
+private:
+    PinName  _pin;
+    uint32_t _noise;
+    double   _phase;
+};
+
+/*
+* NOR flash: erased bytes read 0xff and programming can only clear bits.
+* Sectors are 4 KB, or MBED_HOST_FLASH_SECTOR bytes to stand in for
+* targets with larger ones.
+*/
+class FlashIAP {
+public:
+    int init() {
+        return storage() ? 0 : -1;
+    }
+    int deinit() {
+        return 0;
+    }
+    int read(void *buffer, uint32_t addr, uint32_t size) {
+        if (!in_range(addr, size)) {
+            return -1;
+        }
+        memcpy(buffer, storage() + addr, size);
+        return 0;
+    }
+    int program(const void *buffer, uint32_t addr, uint32_t size) {
+        if (!in_range(addr, size) || addr % get_page_size() || size % get_page_size()) {
+            return -1;
+        }
+        uint8_t *flash = storage() + addr;
+        const uint8_t *data = (const uint8_t*)buffer;
+        for (uint32_t i = 0; i < size; i++) {
+            flash[i] &= data[i];
+        }
+        return 0;
+    }
+    int erase(uint32_t addr, uint32_t size) {
+        if (!in_range(addr, size) || addr % sector_size() || size % sector_size()) {
+            return -1;
+        }
+        memset(storage() + addr, 0xff, size);
+        return 0;
+    }
+    uint32_t get_flash_start() const {
+        return 0;
+    }
+    uint32_t get_flash_size() const {
+        return HOST_FLASH_SIZE;
+    }
+    uint32_t get_sector_size(uint32_t addr) const {
+        return addr < HOST_FLASH_SIZE ? sector_size() : 0;
+    }
+    uint32_t get_page_size() const {
+        return 8;
+    }
+
+private:
+    static uint32_t sector_size() {
+        const char *size = getenv("MBED_HOST_FLASH_SECTOR");
+        return size ? (uint32_t)strtoul(size, NULL, 0) : 4096;
+    }
+
+    static bool in_range(uint32_t addr, uint32_t size) {
+        return addr <= HOST_FLASH_SIZE && size <= HOST_FLASH_SIZE - addr;
+    }
+
+    static uint8_t *storage() {
+        static uint8_t *flash = NULL;
+        if (!flash) {
+            const char *path = getenv("MBED_HOST_FLASH");
+            if (path) {
+                flash = map_file(path);
+            } else {
+                flash = (uint8_t*)malloc(HOST_FLASH_SIZE);
+                if (flash) {
+                    memset(flash, 0xff, HOST_FLASH_SIZE);
+                }
+            }
+        }
+        return flash;
+    }
+
+    // Maps `path`, extending it with erased flash up to HOST_FLASH_SIZE
+    static uint8_t *map_file(const char *path) {
+        int fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return NULL;
+        }
+        off_t size = lseek(fd, 0, SEEK_END);
+        void *map = MAP_FAILED;
+        if (size >= 0 && (size >= HOST_FLASH_SIZE || ftruncate(fd, HOST_FLASH_SIZE) == 0)) {
+            map = mmap(NULL, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (map == MAP_FAILED) {
+            return NULL;
+        }
+        if (size < HOST_FLASH_SIZE) {
+            memset((uint8_t*)map + size, 0xff, HOST_FLASH_SIZE - size);
+        }
+        return (uint8_t*)map;
+    }
+};
+
+class NetworkInterface {
+public:
+    virtual ~NetworkInterface() {}
+    virtual int connect() {
+        return 0;
+    }
+    virtual int disconnect() {
+        return 0;
+    }
+    virtual const char *get_ip_address() {
+        return "127.0.0.1";
+    }
+};
+
+#include "sim_fxos8700cq.h"
+
+#endif // __HOST_MBED_H__
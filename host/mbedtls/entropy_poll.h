@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __HOST_ENTROPY_POLL_H__
+#define __HOST_ENTROPY_POLL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MBEDTLS_ENTROPY_HARDWARE_ALT
+
+/*
+* Entropy from /dev/urandom, or a sequence fixed by MBED_HOST_SEED so
+* that runs can be repeated.
+*/
+inline int mbedtls_hardware_poll(void * /*data*/, unsigned char *output, size_t len, size_t *olen) {
+    *olen = 0;
+    const char *seed = getenv("MBED_HOST_SEED");
+    if (seed) {
+        uint32_t state = (uint32_t)strtoul(seed, NULL, 0) * 2654435761u + 1;
+        for (size_t i = 0; i < len; i++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            output[i] = (unsigned char)state;
+        }
+        *olen = len;
+        return 0;
+    }
+    FILE *random = fopen("/dev/urandom", "rb");
+    if (!random) {
+        return -1;
+    }
+    *olen = fread(output, 1, len, random);
+    fclose(random);
+    return *olen == len ? 0 : -1;
+}
+
+#endif // __HOST_ENTROPY_POLL_H__
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SIM_FXOS8700CQ_H__
+#define __SIM_FXOS8700CQ_H__
+
+// Included by the host mbed.h
+
+/*
+* Register-level model of the FXOS8700CQ accelerometer, as far as
+* AccelFifo uses it: WHO_AM_I, the output data rates of CTRL_REG1, the
+* FIFO in circular mode with its watermark and overflow flag, the
+* wrap-around burst read of the output registers and the FIFO interrupt
+* on INT2, wired to PTC13 as on the FRDM-K64F.
+*
+* Samples are produced at the configured rate from the time the sensor
+* is made active: 1 g on Z plus small sines on X (13 Hz) and Y (7 Hz) and
+* a few counts of noise, 14 bits at 4096 counts per g.
+*/
+class SimFXOS8700CQ {
+public:
+    // As on the FRDM-K64F, where SA0 is high
+    static const uint8_t ADDRESS = 0x1d << 1;
+
+    static SimFXOS8700CQ& instance() {
+        static SimFXOS8700CQ sensor;
+        return sensor;
+    }
+
+    // An I2C write: a register address, then values for it and the next
+    int write(const uint8_t *data, int length) {
+        pthread_mutex_lock(&_mutex);
+        if (length > 0) {
+            _pointer = data[0];
+        }
+        for (int i = 1; i < length; i++) {
+            write_register(_pointer++, data[i]);
+        }
+        pthread_mutex_unlock(&_mutex);
+        return 0;
+    }
+
+    // An I2C read from the register address set by the last write
+    int read(uint8_t *data, int length) {
+        pthread_mutex_lock(&_mutex);
+        produce();
+        for (int i = 0; i < length; i++) {
+            data[i] = read_register();
+        }
+        pthread_mutex_unlock(&_mutex);
+        return 0;
+    }
+
+private:
+    enum {
+        F_STATUS        = 0x00,
+        OUT_X_MSB       = 0x01,
+        OUT_Z_LSB       = 0x06,
+        F_SETUP         = 0x09,
+        WHO_AM_I        = 0x0d,
+        CTRL_REG1       = 0x2a,
+        CTRL_REG4       = 0x2d,
+
+        FIFO_DEPTH      = 32,
+        F_OVF           = 0x80,
+        F_WMRK_FLAG     = 0x40,
+        INT_EN_FIFO     = 0x40,
+        ACTIVE          = 0x01
+    };
+
+    SimFXOS8700CQ() : _pointer(0), _head(0), _count(0), _produced(0), _start_us(0), _overflow(false),
+                      _int_low(false), _running(false), _noise(host_seed() * 747796405u + 1) {
+        memset(_registers, 0, sizeof(_registers));
+        _registers[WHO_AM_I] = 0xc7;
+        pthread_mutex_init(&_mutex, NULL);
+    }
+
+    bool active() const {
+        return _registers[CTRL_REG1] & ACTIVE;
+    }
+
+    uint8_t watermark() const {
+        return _registers[F_SETUP] & 0x3f;
+    }
+
+    double rate_hz() const {
+        static const double rates[] = { 800, 400, 200, 100, 50, 12.5, 6.25, 1.5625 };
+        return rates[(_registers[CTRL_REG1] >> 3) & 7];
+    }
+
+    void write_register(uint8_t reg, uint8_t value) {
+        bool was_active = active();
+        _registers[reg & 0x7f] = value;
+        if (!was_active && active()) {
+            _start_us = host_now_us();
+            _produced = 0;
+            _count = 0;
+            _overflow = false;
+            if (!_running) {
+                _running = pthread_create(&_thread, NULL, &SimFXOS8700CQ::interrupts, this) == 0;
+                if (_running) {
+                    pthread_detach(_thread);
+                }
+            }
+        }
+    }
+
+    uint8_t read_register() {
+        uint8_t reg = _pointer;
+        uint8_t value;
+        if (reg == F_STATUS) {
+            value = (_overflow ? F_OVF : 0) | (_count >= watermark() && watermark() ? F_WMRK_FLAG : 0) | _count;
+            _overflow = false;
+            _pointer++;
+        } else if (reg >= OUT_X_MSB && reg <= OUT_Z_LSB) {
+            // With the FIFO on, reading past Z wraps to X of the next sample
+            const int16_t *s = _fifo[(_head + FIFO_DEPTH - _count) % FIFO_DEPTH];
+            int16_t axis = _count ? s[(reg - OUT_X_MSB) / 2] : 0;
+            uint16_t left = (uint16_t)(axis << 2);
+            value = (reg - OUT_X_MSB) % 2 == 0 ? left >> 8 : left & 0xff;
+            if (reg == OUT_Z_LSB) {
+                if (_count) {
+                    _count--;
+                }
+                _pointer = OUT_X_MSB;
+            } else {
+                _pointer++;
+            }
+        } else {
+            value = _registers[reg & 0x7f];
+            _pointer++;
+        }
+        return value;
+    }
+
+    // Adds the samples due since the last call to the FIFO
+    void produce() {
+        if (!active()) {
+            return;
+        }
+        uint64_t due = (uint64_t)((host_now_us() - _start_us) * rate_hz() / 1000000.0);
+        for (; _produced < due; _produced++) {
+            double t = _produced / rate_hz();
+            int16_t *s = _fifo[_head];
+            s[0] = (int16_t)(205 * sin(2 * M_PI * 13 * t)) + noise();
+            s[1] = (int16_t)(82 * sin(2 * M_PI * 7 * t)) + noise();
+            s[2] = 4096 + noise();
+            _head = (_head + 1) % FIFO_DEPTH;
+            if (_count == FIFO_DEPTH) {
+                _overflow = true;
+            } else {
+                _count++;
+            }
+        }
+    }
+
+    int16_t noise() {
+        return (int16_t)(host_random(_noise) % 9) - 4;
+    }
+
+    // Pulls INT2 low while the FIFO is at its watermark
+    static void *interrupts(void *sensor) {
+        SimFXOS8700CQ *self = (SimFXOS8700CQ*)sensor;
+        for (;;) {
+            pthread_mutex_lock(&self->_mutex);
+            self->produce();
+            bool low = self->active() && (self->_registers[CTRL_REG4] & INT_EN_FIFO) &&
+                       self->watermark() && self->_count >= self->watermark();
+            bool falling = low && !self->_int_low;
+            self->_int_low = low;
+            double period_us = self->active() ? 1000000.0 / self->rate_hz() : 10000.0;
+            pthread_mutex_unlock(&self->_mutex);
+            if (falling) {
+                host_pin_fall(PTC13);
+            }
+            usleep((useconds_t)(period_us < 1000 ? period_us : 1000));
+        }
+        return NULL;
+    }
+
+    pthread_mutex_t _mutex;
+    pthread_t       _thread;
+    uint8_t         _registers[0x80];
+    uint8_t         _pointer;
+    int16_t         _fifo[FIFO_DEPTH][3];
+    uint8_t         _head;          // where the next sample goes
+    uint8_t         _count;
+    uint64_t        _produced;
+    uint64_t        _start_us;
+    bool            _overflow;
+    bool            _int_low;
+    bool            _running;
+    uint32_t        _noise;
+};
+
+/*
+* I2C master. Only the simulated FXOS8700CQ answers; other addresses
+* NACK.
+*/
+class I2C {
+public:
+    I2C(PinName /*sda*/, PinName /*scl*/) {}
+
+    void frequency(int /*hz*/) {}
+
+    int write(int address, const char *data, int length, bool /*repeated*/=false) {
+        if ((address & 0xfe) != SimFXOS8700CQ::ADDRESS) {
+            return -1;
+        }
+        return SimFXOS8700CQ::instance().write((const uint8_t*)data, length);
+    }
+
+    int read(int address, char *data, int length, bool /*repeated*/=false) {
+        if ((address & 0xfe) != SimFXOS8700CQ::ADDRESS) {
+            return -1;
+        }
+        return SimFXOS8700CQ::instance().read((uint8_t*)data, length);
+    }
+};
+
+#endif // __SIM_FXOS8700CQ_H__
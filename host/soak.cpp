@@ -0,0 +1,286 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Soak test of the client's per-cycle work on the host build, to show
+ * whether weeks of uptime would wear the heap down.
+ *
+ * Usage: soak [--seconds S] [--report S] [--verbose]
+ *
+ * Each cycle samples the analog inputs, the accelerometer and the button
+ * and publishes alldata, as the scheduler does, back to back. Every
+ * SOAK_REQUEST_CYCLES cycles it also handles one of the requests a
+ * server makes, in turn: notification attributes, a format change, a
+ * blink pattern of random length and a history query, through the
+ * callbacks mbed Client would call.
+ *
+ * Every --report seconds it prints the heap allocations and bytes per
+ * cycle, the heap in use, what glibc holds for it, and the share of that
+ * which is free space between blocks, the fragmentation. The transient
+ * block pool's peak and the request arena's trips to the heap follow.
+ * The test fails if, after the first report, the heap in use grows by
+ * more than SOAK_GROWTH_LIMIT bytes or the heap held by more than
+ * SOAK_HELD_GROWTH_LIMIT.
+ */
+
+#define main client_main
+#include "../main.cpp"
+#undef main
+
+#include <malloc.h>
+#include "lwm2m_server.h"
+
+#ifndef SOAK_REQUEST_CYCLES
+#define SOAK_REQUEST_CYCLES 10
+#endif
+
+#ifndef SOAK_GROWTH_LIMIT
+#define SOAK_GROWTH_LIMIT 4096
+#endif
+
+#ifndef SOAK_HELD_GROWTH_LIMIT
+#define SOAK_HELD_GROWTH_LIMIT 65536
+#endif
+
+struct Soak {
+    Executor              executor;
+    ButtonResource        button;
+    LedResource           led;
+    AccelerometerResource accel;
+    AnalogInResource      sound;
+    AnalogInResource      temperature;
+    AnalogInResource      light;
+    AnalogInResource      distance;
+    AnalogSampler         sampler;
+    DataAggregator        all_data;
+    HistoryResource       history;
+    uint32_t              random;
+
+    Soak() : executor(uptime_us), led(executor), sound(A0, SOUND_LEVEL_SCHEMA),
+             temperature(A1, TEMPERATURE_SCHEMA), light(A2, LIGHT_SCHEMA), distance(A3, DISTANCE_SCHEMA),
+             random(1) {
+        sampler.add(&sound);
+        sampler.add(&temperature, TEMPERATURE_EMA_SHIFT);
+        sampler.add(&light);
+        sampler.add(&distance);
+        DataSource *sources[] = { &button, &accel, &sound, &temperature, &light, &distance };
+        for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+            all_data.add_data_source(sources[i]);
+            history.add_data_source(sources[i]);
+        }
+    }
+
+    void objects(M2MObjectList &list) {
+        list.push_back(button.get_object());
+        list.push_back(led.get_object());
+        list.push_back(accel.get_object());
+        list.push_back(sound.get_object());
+        list.push_back(temperature.get_object());
+        list.push_back(light.get_object());
+        list.push_back(distance.get_object());
+        list.push_back(all_data.get_object());
+        list.push_back(history.get_object());
+    }
+
+    void cycle(uint32_t i) {
+        AnalogSampler::sample(&sampler);
+        DataSource::sample(&accel);
+        DataSource::sample(&button);
+        all_data.update_all();
+        executor.run();
+        if (i % SOAK_REQUEST_CYCLES == 0) {
+            request(i / SOAK_REQUEST_CYCLES);
+        }
+    }
+
+private:
+    // A PUT of `value` to `path`, as mbed Client hands it over
+    static M2MResource *put(M2MObject *object, const char *resource, const char *value) {
+        M2MResource *res = object->object_instance()->resource(resource);
+        res->set_value((const uint8_t*)value, strlen(value));
+        res->execute_value_updated(res->name());
+        return res;
+    }
+
+    void request(uint32_t n) {
+        char text[256];
+        switch (n % 4) {
+            case 0:
+                snprintf(text, sizeof(text), "/3313/0/%u?pmin=1&pmax=%u&st=%u", 5702 + n % 3, 30 + n % 60, n % 50);
+                put(all_data.get_object(), "notify", text);
+                break;
+            case 1:
+                put(all_data.get_object(), "format", (n & 4) ? "senml+json" : "json");
+                break;
+            case 2: {
+                // 2 to 40 steps of 1 to 999 ms
+                uint32_t steps = 2 + next() % 39;
+                size_t len = 0;
+                for (uint32_t s = 0; s < steps && len < sizeof(text) - 5; s++) {
+                    len += snprintf(text + len, sizeof(text) - len, s ? ":%u" : "%u", 1 + next() % 999);
+                }
+                put(led.get_object(), "5853", text);
+                led.get_object()->object_instance()->resource("5850")->execute(NULL);
+                break;
+            }
+            default: {
+                snprintf(text, sizeof(text), "/3303/0/5600?start=0&end=%u&res=%u&fn=avg", uptime_ms(),
+                         1000 * (1 + n % 10));
+                put(history.get_object(), "query", text);
+                M2MResource *result = history.get_object()->object_instance()->resource("result");
+                uint8_t *data = NULL;
+                uint32_t length = 0;
+                result->outgoing_block(String("history/0/result"), data, length);
+                free(data);
+                break;
+            }
+        }
+    }
+
+    uint32_t next() {
+        random = random * 1103515245 + 12345;
+        return random >> 16;
+    }
+};
+
+struct Sample {
+    double   seconds;
+    uint64_t cycles;
+    uint64_t allocations;
+    uint64_t bytes;
+    size_t   in_use;
+    size_t   held;
+    size_t   free;
+};
+
+static Sample sample(uint64_t cycles, double seconds) {
+    Sample s;
+    mbed_stats_heap_t heap;
+    mbed_stats_heap_get(&heap);
+    struct mallinfo2 info = mallinfo2();
+    s.seconds = seconds;
+    s.cycles = cycles;
+    s.allocations = host_heap_allocations();
+    s.bytes = heap.total_size;
+    s.in_use = heap.current_size;
+    s.held = info.arena + info.hblkhd;
+    s.free = info.fordblks;
+    return s;
+}
+
+static void print(FILE *out, const Sample &from, const Sample &to) {
+    double cycles = (double)(to.cycles - from.cycles);
+    BlockPool::Stats pool = transient_pool.stats();
+    fprintf(out, "%7.0f %10" PRIu64 " %10.2f %10.1f %10zu %10zu %7.1f%% %6u/%-3u %9" PRIu32 "\n",
+            to.seconds, to.cycles, cycles ? (to.allocations - from.allocations) / cycles : 0.0,
+            cycles ? (to.bytes - from.bytes) / cycles : 0.0, to.in_use, to.held,
+            to.held ? 100.0 * to.free / to.held : 0.0, pool.peak, pool.blocks, request_arena.stats().fallbacks);
+    fflush(out);
+}
+
+int main(int argc, char **argv) {
+    uint32_t seconds = 60;
+    uint32_t report = 10;
+    bool verbose = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            report = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--seconds S] [--report S] [--verbose]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (report == 0) {
+        report = 1;
+    }
+    setenv("MBED_HOST_SEED", "1", 0);
+    // one glibc arena for every thread, so that mallinfo2() sees the
+    // whole heap
+    mallopt(M_ARENA_MAX, 1);
+    uptime.start();
+
+    fflush(stdout);
+    FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!verbose) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+
+    LwM2MServer server(true);
+    std::string uri = server.uri();
+    Soak *soak = new Soak();
+    M2MObjectList objects;
+    objects.push_back(mbed_client.create_device_object());
+    soak->objects(objects);
+    mbed_client.create_interface(uri.c_str(), NULL);
+    M2MSecurity *security = mbed_client.create_register_object();
+    mbed_client.set_register_object(security);
+    mbed_client.test_register(security, objects);
+    for (int i = 0; i < 500 && !mbed_client.register_successful(); i++) {
+        wait_ms(10);
+    }
+    if (!mbed_client.register_successful()) {
+        fprintf(out, "Could not register with the server at %s\n", uri.c_str());
+        return 1;
+    }
+
+    fprintf(out, "mbed Client host soak, %" PRIu32 " s, a request every %d cycles\n", seconds, SOAK_REQUEST_CYCLES);
+    fprintf(out, "%7s %10s %10s %10s %10s %10s %8s %10s %9s\n", "seconds", "cycles", "allocs/cyc", "bytes/cyc",
+            "in use", "held", "frag", "pool peak", "fallbacks");
+    Timer timer;
+    timer.start();
+    uint64_t cycles = 0;
+    Sample start = sample(0, 0);
+    Sample last = start;
+    Sample first;
+    bool reported = false;
+    size_t in_use_max = 0;
+    size_t held_max = 0;
+    for (uint32_t next = report; next <= seconds; next += report) {
+        while (timer.read() < next) {
+            soak->cycle((uint32_t)cycles++);
+        }
+        Sample now = sample(cycles, timer.read());
+        print(out, last, now);
+        if (!reported) {
+            first = now;
+            reported = true;
+        }
+        in_use_max = std::max(in_use_max, now.in_use);
+        held_max = std::max(held_max, now.held);
+        last = now;
+    }
+    if (reported) {
+        fprintf(out, "overall %.2f allocations and %.1f bytes a cycle\n",
+                (double)(last.allocations - start.allocations) / cycles, (double)(last.bytes - start.bytes) / cycles);
+    }
+
+    mbed_client.test_unregister();
+    wait_ms(100);
+    delete soak;
+
+    if (reported && (in_use_max > first.in_use + SOAK_GROWTH_LIMIT || held_max > first.held + SOAK_HELD_GROWTH_LIMIT)) {
+        fprintf(out, "The heap grew after the first report: in use %zu to %zu, held %zu to %zu\n",
+                first.in_use, in_use_max, first.held, held_max);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Turns hot-path trace records, see trace.h, into Chrome's trace event
+ * JSON, which chrome://tracing and ui.perfetto.dev open.
+ *
+ * Usage: trace2json [file...] > trace.json
+ *
+ * Each file, or stdin, holds either what reads of trace/0/data returned,
+ * one after the other, or a serial log with "TRACE <hex>" lines among
+ * other output. Timestamps are in microseconds of the board's ticker,
+ * made monotonic across its 32-bit wrap by the time of each drain.
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static bool read_all(FILE *in, std::string &data) {
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        data.append(buffer, got);
+    }
+    return !ferror(in);
+}
+
+// The bytes of the "TRACE <hex>" lines of a serial log
+static std::string from_log(const std::string &log) {
+    std::string bytes;
+    size_t at = 0;
+    while ((at = log.find("TRACE ", at)) != std::string::npos) {
+        at += 6;
+        while (at + 1 < log.size() && isxdigit((unsigned char)log[at]) && isxdigit((unsigned char)log[at + 1])) {
+            char hex[3] = { log[at], log[at + 1], 0 };
+            bytes += (char)strtoul(hex, NULL, 16);
+            at += 2;
+        }
+    }
+    return bytes;
+}
+
+class Converter {
+public:
+    Converter() : _first(true), _drains(0), _records(0), _dropped(0), _unowned(0), _last_now(0), _now(0) {}
+
+    /*
+    * Converts the drains in `data`; false if it stops making sense, as a
+    * log cut short in the middle of a drain does. The records before
+    * that point are kept.
+    */
+    bool convert(const std::string &data) {
+        const uint8_t *p = (const uint8_t*)data.data();
+        const uint8_t *end = p + data.size();
+        while (p < end) {
+            if (end - p < TRACE_HEADER_SIZE || memcmp(p, TRACE_MAGIC, 4) != 0 || p[4] != TRACE_VERSION ||
+                p[5] != TRACE_RECORD_SIZE) {
+                return false;
+            }
+            uint16_t rings = get16(p + 6);
+            uint32_t now = get32(p + 8);
+            _now = _drains++ ? _now + (uint32_t)(now - _last_now) : now;
+            _last_now = now;
+            _unowned += get32(p + 12);
+            p += TRACE_HEADER_SIZE;
+            for (uint16_t r = 0; r < rings; r++) {
+                if (end - p < TRACE_RING_HEADER_SIZE) {
+                    return false;
+                }
+                uint32_t thread = get32(p);
+                uint16_t count = get16(p + 4);
+                _dropped += get32(p + 8);
+                p += TRACE_RING_HEADER_SIZE;
+                if ((size_t)(end - p) < (size_t)count * TRACE_RECORD_SIZE) {
+                    return false;
+                }
+                int tid = thread_index(thread);
+                for (uint16_t n = 0; n < count; n++, p += TRACE_RECORD_SIZE) {
+                    event(tid, now, get32(p), get16(p + 4), p[6], get32(p + 8));
+                }
+            }
+        }
+        return true;
+    }
+
+    void finish() {
+        if (_first) {
+            printf("{\"traceEvents\":[");
+        }
+        printf("\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"drains\":%" PRIu32 ",\"records\":%" PRIu32
+               ",\"dropped\":%" PRIu32 ",\"unowned\":%" PRIu32 "}}\n", _drains, _records, _dropped, _unowned);
+        fprintf(stderr, "trace2json: %" PRIu32 " records from %" PRIu32 " drains of %u threads, %" PRIu32
+                " dropped to full rings, %" PRIu32 " from threads without one\n", _records, _drains,
+                (unsigned)_threads.size(), _dropped, _unowned);
+    }
+
+private:
+    // Small thread numbers in order of appearance, with a name for each
+    int thread_index(uint32_t thread) {
+        std::map<uint32_t, int>::iterator found = _threads.find(thread);
+        if (found != _threads.end()) {
+            return found->second;
+        }
+        int tid = (int)_threads.size() + 1;
+        _threads[thread] = tid;
+        separate();
+        if (thread) {
+            printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %08" PRIx32
+                   "\"}}", tid, thread);
+        } else {
+            printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"interrupts\"}}", tid);
+        }
+        return tid;
+    }
+
+    void event(int tid, uint32_t now, uint32_t time_us, uint16_t id, uint8_t phase, uint32_t arg) {
+        // records are older than the drain that took them
+        uint64_t ts = _now - (uint32_t)(now - time_us);
+        separate();
+        printf("{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64 ",\"pid\":1,\"tid\":%d", trace_event_name(id),
+               phase, ts, tid);
+        if (phase == TRACE_PHASE_INSTANT) {
+            printf(",\"s\":\"t\"");
+        }
+        if (phase != TRACE_PHASE_END || arg) {
+            printf(",\"args\":{\"arg\":%" PRIu32 "}", arg);
+        }
+        printf("}");
+        _records++;
+    }
+
+    void separate() {
+        printf(_first ? "{\"traceEvents\":[\n" : ",\n");
+        _first = false;
+    }
+
+    bool                    _first;
+    uint32_t                _drains;
+    uint32_t                _records;
+    uint32_t                _dropped;
+    uint32_t                _unowned;
+    uint32_t                _last_now;
+    uint64_t                _now;       // of the drain, made monotonic
+    std::map<uint32_t, int> _threads;
+};
+
+int main(int argc, char **argv) {
+    std::vector<std::string> inputs;
+    if (argc < 2) {
+        inputs.push_back(std::string());
+        if (!read_all(stdin, inputs.back())) {
+            fprintf(stderr, "trace2json: could not read stdin\n");
+            return 1;
+        }
+    }
+    for (int i = 1; i < argc; i++) {
+        FILE *in = fopen(argv[i], "rb");
+        inputs.push_back(std::string());
+        if (!in || !read_all(in, inputs.back())) {
+            fprintf(stderr, "trace2json: could not read %s\n", argv[i]);
+            return 1;
+        }
+        fclose(in);
+    }
+
+    Converter converter;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const std::string &data = inputs[i];
+        bool binary = data.compare(0, 4, TRACE_MAGIC) == 0;
+        if (!converter.convert(binary ? data : from_log(data))) {
+            fprintf(stderr, "trace2json: %s is not a trace past this point, or was cut short\n",
+                    argc < 2 ? "stdin" : argv[i + 1]);
+        }
+    }
+    converter.finish();
+    return 0;
+}
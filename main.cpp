@@ -16,12 +16,32 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include "simpleclient.h"
+#include "payload_writer.h"
+#include "payload_encoders.h"
+#include "timeseries.h"
+#include "sample_log.h"
+#include "scheduler.h"
+#include "notify_attributes.h"
+#include "sample_value.h"
+#include "rollup.h"
+#include "history_query.h"
+#include "block_transfer.h"
+#include "executor.h"
+#include "mem_stats.h"
+#include "trace.h"
+#include "arena.h"
+#include "resource_schema.h"
+#include "notification_queue.h"
+#include <algorithm>
 #include <string>
-#include <sstream>
 #include <vector>
 #include <map>
+#include <math.h>
 #include "mbed-trace/mbed_trace.h"
 #include "mbedtls/entropy_poll.h"
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+#include "mbedtls/platform.h"
+#endif
 
 #include "security.h"
 
@@ -33,7 +53,9 @@
 #include "easy-connect/easy-connect.h"
 
 // K64F Accelerometer
-#include "FXOS8700CQ.h"
+#include "accel_fifo.h"
+#include "window_stats.h"
+#include "adc_filter.h"
 
 #ifdef TARGET_STM
 #define RED_LED (LED3)
@@ -90,467 +112,2161 @@ MbedClient mbed_client(device);
 // Set up Hardware interrupt button.
 InterruptIn inc_button(SW2);
 InterruptIn dec_button(SW3);
+// FXOS8700CQ INT2, pulled low while the FIFO is at its watermark
+InterruptIn accel_int(PTC13);
 #else
 //In non K64F boards , set up a timer to simulate updating resource,
 // there is no functionality to decrement.
 Ticker timer;
 #endif
 
+// Blocks for the client's transient data, see arena.h
+#ifndef TRANSIENT_BLOCK_SIZE
+#define TRANSIENT_BLOCK_SIZE 256
+#endif
+#ifndef TRANSIENT_BLOCKS
+#define TRANSIENT_BLOCKS 8
+#endif
+
+FixedBlockPool<TRANSIENT_BLOCK_SIZE, TRANSIENT_BLOCKS> transient_pool;
+
+// Scratch space of the callbacks mbed Client makes on its event thread;
+// each rewinds it when it returns
+Arena request_arena(transient_pool);
+
+// The value of `res` as text in `arena`, rather than in a String copy
+ArenaString value_text(M2MResource *res, Arena &arena) {
+    const char *value = (const char*)res->value();
+    return ArenaString(value ? value : "", value ? res->value_length() : 0, ArenaAllocator<char>(arena));
+}
+
+/*
+ * Pattern of a "blink" run and how far it has got. The pattern lives in
+ * an arena of its own, emptied when the next pattern is parsed.
+ */
+class BlinkArgs {
+public:
+    typedef std::vector<uint32_t, ArenaAllocator<uint32_t> > Pattern;
+
+    BlinkArgs() : arena(transient_pool), blink_pattern(ArenaAllocator<uint32_t>(arena)) {
+        clear();
+    }
+    void clear() {
+        position = 0;
+        {
+            Pattern empty((ArenaAllocator<uint32_t>(arena)));
+            blink_pattern.swap(empty);
+        }
+        arena.reset();
+    }
+    // Parses "500:200:500" in place, each field as atoi() would
+    void parse(const char *text, uint32_t length) {
+        clear();
+        if (length == 0) {
+            return;
+        }
+        blink_pattern.reserve(1 + std::count(text, text + length, ':'));
+        uint32_t value = 0;
+        bool digits = false;
+        bool ended = false;
+        for (uint32_t i = 0; i <= length; i++) {
+            char c = i < length ? text[i] : ':';
+            if (c == ':') {
+                blink_pattern.push_back(value);
+                value = 0;
+                digits = ended = false;
+            } else if (!ended && c >= '0' && c <= '9') {
+                value = value * 10 + (c - '0');
+                digits = true;
+            } else if (digits || !isspace((unsigned char)c)) {
+                ended = true;
+            }
+        }
+    }
+    Arena arena;
+    uint16_t position;
+    Pattern blink_pattern;
+};
+
+// Microseconds since boot. Timer counts microseconds in 32 bits and wraps
+// after ~71 minutes, so elapsed time is folded into a wider counter on
+// every call; the scheduler wakes up far more often than that. The
+// client's event thread calls it too, hence the critical section.
+Timer uptime;
+uint64_t uptime_us() {
+    static uint64_t elapsed_us = 0;
+    static uint32_t last_us = 0;
+    core_util_critical_section_enter();
+    uint32_t now_us = (uint32_t)uptime.read_us();
+    elapsed_us += (uint32_t)(now_us - last_us);
+    last_us = now_us;
+    uint64_t now = elapsed_us;
+    core_util_critical_section_exit();
+    return now;
+}
+
+// Milliseconds since boot
+uint32_t uptime_ms() {
+    return (uint32_t)(uptime_us() / 1000);
+}
+
+// Samples recorded while the client is not registered are kept here until
+// they can be replayed. NULL on targets without flash.
+SampleLog *sample_log = NULL;
+
+/*
+ * The objects of the sensors and the LED, as constant tables; see
+ * resource_schema.h. Creating an object, declaring its data source and
+ * the order alldata serializes its values in all follow the rows.
+ */
+
+// 3200 = digital input; 5501 = its counter
+static const ResourceSchema button_resources[] = {
+    { "5501", "Button", M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED, true, "0", SCHEMA_HISTORY }
+};
+static const ObjectSchema BUTTON_SCHEMA = { "3200", button_resources, SCHEMA_COUNT(button_resources) };
+
+// 3201 = digital output; 5853 = multi-state output, the blink pattern.
+// There's no LwM2M execute resource that matches blinking, so 5850 it is.
+enum { LED_PATTERN, LED_BLINK };
+static const ResourceSchema led_resources[] = {
+    // toggle every 500ms, 7 toggles in total
+    { "5853", "Pattern", M2MResourceInstance::STRING, M2MBase::GET_PUT_ALLOWED, false,
+      "500:500:500:500:500:500:500", SCHEMA_PLAIN },
+    { "5850", "Blink", M2MResourceInstance::OPAQUE, M2MBase::POST_ALLOWED, false, NULL, SCHEMA_PLAIN }
+};
+static const ObjectSchema LED_SCHEMA = { "3201", led_resources, SCHEMA_COUNT(led_resources) };
+
+/*
+ * 3313 = accelerometer. Each axis has its mean, the standard 5702-5704,
+ * then its minimum, maximum, RMS and peak-to-peak at 27000 + 10 * axis + 1
+ * to 4. Only the means keep a history and rollups, as the axis values
+ * always did.
+ */
+#define ACCEL_AXIS_SCHEMA(mean, base, axis) \
+    { mean, "Accel" axis, M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED, true, "0", SCHEMA_HISTORY }, \
+    { base "1", "Accel" axis "Min", M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED, true, "0", SCHEMA_SAMPLED }, \
+    { base "2", "Accel" axis "Max", M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED, true, "0", SCHEMA_SAMPLED }, \
+    { base "3", "Accel" axis "Rms", M2MResourceInstance::FLOAT, M2MBase::GET_ALLOWED, true, "0", SCHEMA_SAMPLED }, \
+    { base "4", "Accel" axis "P2P", M2MResourceInstance::INTEGER, M2MBase::GET_ALLOWED, true, "0", SCHEMA_SAMPLED }
+static const ResourceSchema accel_resources[] = {
+    ACCEL_AXIS_SCHEMA("5702", "2700", "X"),
+    ACCEL_AXIS_SCHEMA("5703", "2701", "Y"),
+    ACCEL_AXIS_SCHEMA("5704", "2702", "Z")
+};
+#undef ACCEL_AXIS_SCHEMA
+static const ObjectSchema ACCEL_SCHEMA = { "3313", accel_resources, SCHEMA_COUNT(accel_resources) };
+
+// An analog input's object has one reading, 5600 = sensor value
+#define ANALOG_SCHEMA(name) \
+    { "5600", name, M2MResourceInstance::FLOAT, M2MBase::GET_ALLOWED, true, "0", SCHEMA_HISTORY }
+static const ResourceSchema analog_in_resources[] = { ANALOG_SCHEMA("AnalogIn") };
+static const ResourceSchema sound_level_resources[] = { ANALOG_SCHEMA("SoundLevel") };
+static const ResourceSchema temperature_resources[] = { ANALOG_SCHEMA("Temperature") };
+static const ResourceSchema light_resources[] = { ANALOG_SCHEMA("Light") };
+static const ResourceSchema distance_resources[] = { ANALOG_SCHEMA("Distance") };
+#undef ANALOG_SCHEMA
+static const ObjectSchema ANALOG_IN_SCHEMA = { "3203", analog_in_resources, 1 };
+static const ObjectSchema SOUND_LEVEL_SCHEMA = { "3324", sound_level_resources, 1 };
+static const ObjectSchema TEMPERATURE_SCHEMA = { "3303", temperature_resources, 1 };
+static const ObjectSchema LIGHT_SCHEMA = { "3301", light_resources, 1 };
+static const ObjectSchema DISTANCE_SCHEMA = { "3330", distance_resources, 1 };
+
+// Room for a resource id ("5702", "27011") and the terminating NUL
+#define DATA_SOURCE_ID_SIZE 6
+
+/*
+ * Base class of the sensor objects. Resources are kept in a fixed table,
+ * sized by the FixedDataSource the sensor derives from, in the order they
+ * were declared, and are addressed by their index in it; recording and
+ * publishing samples never looks a resource up by name nor allocates.
+ */
+class DataSource {
+public:
+    enum Deadband {
+        DEADBAND_ABSOLUTE,
+        DEADBAND_PERCENT
+    };
+
+protected:
+    struct Change {
+        double   reported;
+        float    deadband;
+        Deadband type;
+        bool     reported_once;
+        bool     changed;
+        NotifyGate gate;
+    };
+
+    struct Resource {
+        const char  *id;                // both from a schema or literals,
+        const char  *description;       // never copied
+        uint16_t     number;            // id as a number, for the sample log
+        bool         recorded;          // `latest` holds a sample
+        SampleValue  latest;
+        TimeSeries  *history;
+        Rollup      *rollup;
+        M2MResource *object_resource;   // looked up on first publish, unless created here
+        Change       change;
+
+        Resource() : history(NULL), rollup(NULL) {}
+        ~Resource() {
+            delete history;
+            delete rollup;
+        }
+    };
+
+    // `table` has room for `capacity` resources; it and `name` outlive the source
+    DataSource(const char *name, Resource *table, uint8_t capacity)
+        : client(&mbed_client), ds_name(name), instance_id(0), object_id((uint16_t)atoi(name)), resources(table),
+          resource_capacity(capacity), resource_count(0), sample_period(3000), sample_phase(0), recorded_samples(0),
+          suppressed_samples(0) {}
+
+    /*
+     * Creates the object `schema` describes, declares its sampled rows in
+     * table order, so the first is resource 0, and adds the rollup
+     * resources. Nothing is formatted or copied: the source keeps pointers
+     * to the schema's strings.
+     */
+    M2MObject *create_object(const ObjectSchema &schema) {
+        M2MObject *object = M2MInterfaceFactory::create_object(schema.id);
+        M2MObjectInstance *inst = object->create_object_instance();
+        for (uint8_t i = 0; i < schema.count; i++) {
+            const ResourceSchema &row = schema.resources[i];
+            M2MResource *res = schema.create_resource(inst, i);
+            if (row.sampling == SCHEMA_PLAIN) {
+                continue;
+            }
+            int index = set_data_description(row.id, row.type,
+                row.value_type == M2MResourceInstance::FLOAT ? TimeSeries::FLOAT : TimeSeries::INTEGER,
+                row.sampling == SCHEMA_HISTORY);
+            if (index >= 0) {
+                resources[index].object_resource = res;
+            }
+        }
+        add_rollup_resources(inst);
+        return object;
+    }
+
+    // The resource create_object() made for `resource`
+    M2MResource *object_resource(int resource) const {
+        return resources[resource].object_resource;
+    }
+
+public:
+    virtual ~DataSource() {}
+    /*
+     * Declares a resource of this source and returns its index, which
+     * record_data() and the other per-resource calls take. Resources are
+     * numbered from 0 in declaration order. Returns -1 if the table is
+     * full. Unless `keep_history` is false, its history and rollups are
+     * allocated here, once, so recording samples later never allocates.
+     * `id` and `description` are kept, not copied.
+     */
+    int set_data_description(const char *id, const char *description,
+                             TimeSeries::Encoding encoding=TimeSeries::INTEGER, bool keep_history=true) {
+        MemScope scope(MEM_DATA_SOURCES);
+        int index = find(id);
+        if (index < 0) {
+            if (resource_count == resource_capacity) {
+                printf("DataSource %s: no room for resource %s\n", ds_name, id);
+                return -1;
+            }
+            index = resource_count++;
+            Resource &r = resources[index];
+            r.id = id;
+            r.number = (uint16_t)atoi(id);
+            r.recorded = false;
+            r.history = keep_history ? new TimeSeries(encoding) : NULL;
+            r.rollup = keep_history ? new Rollup() : NULL;
+            r.object_resource = NULL;
+        }
+        Resource &r = resources[index];
+        r.description = description;
+        Change &change = r.change;
+        change.reported = 0;
+        change.deadband = 0;
+        change.type = DEADBAND_ABSOLUTE;
+        change.reported_once = false;
+        change.changed = false;
+        return index;
+    }
+    /*
+     * Samples of `resource` that differ from the last reported value by
+     * no more than `amount` (in units of the value, or percent of the
+     * reported value) do not count as a change.
+     */
+    void set_deadband(int resource, float amount, Deadband type=DEADBAND_ABSOLUTE) {
+        if (resource >= 0 && resource < resource_count) {
+            resources[resource].change.deadband = amount;
+            resources[resource].change.type = type;
+        }
+    }
+    /*
+     * Records a sample as the latest value of `resource` and appends it to
+     * the resource's history. The value is kept in binary; it is only
+     * turned into text when a resource or a text payload needs it.
+     */
+    void record_data(int resource, int32_t value) {
+        Resource &r = resources[resource];
+        TRACE_INSTANT(TRACE_RECORD, r.number);
+        uint32_t now = uptime_ms();
+        if (r.history) {
+            r.history->append(now, value);
+            r.rollup->add(now, (float)value);
+        }
+        log_sample(r, now, 0, (uint32_t)value);
+        record(r, SampleValue::integer(value, now));
+    }
+    void record_data(int resource, float value) {
+        Resource &r = resources[resource];
+        TRACE_INSTANT(TRACE_RECORD, r.number);
+        uint32_t now = uptime_ms();
+        if (r.history) {
+            r.history->append(now, value);
+            r.rollup->add(now, value);
+        }
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        log_sample(r, now, SampleLog::FLOAT_VALUE, bits);
+        record(r, SampleValue::real(value, now));
+    }
+    /*
+     * True if `resource` moved past its deadband since the changes were
+     * last cleared.
+     */
+    bool changed(int resource) const {
+        return resources[resource].change.changed;
+    }
+    bool changed() const {
+        for (uint8_t i = 0; i < resource_count; i++) {
+            if (resources[i].change.changed) {
+                return true;
+            }
+        }
+        return false;
+    }
+    // Called once the changed values have been published
+    void clear_changes() {
+        for (uint8_t i = 0; i < resource_count; i++) {
+            resources[i].change.changed = false;
+        }
+    }
+    uint32_t samples() const {
+        return recorded_samples;
+    }
+    // Samples that stayed within their deadband
+    uint32_t suppressed() const {
+        return suppressed_samples;
+    }
+    /*
+     * Applies LwM2M notification attributes ("pmin=5&pmax=60&st=0.5") to
+     * resource `id`, or to all resources of this source if `id` is empty.
+     */
+    bool set_notify_attributes(const char *id, const char *query) {
+        bool found = false;
+        for (uint8_t i = 0; i < resource_count; i++) {
+            if (!*id || strcmp(id, resources[i].id) == 0) {
+                NotifyGate &gate = resources[i].change.gate;
+                NotifyAttributes attributes = gate.attributes();
+                if (!attributes.parse(query)) {
+                    return false;
+                }
+                gate.set_attributes(attributes);
+                found = true;
+            }
+        }
+        return found;
+    }
+    // Milliseconds until publish() has a notification to send, or
+    // NotifyGate::NEVER
+    uint32_t notification_due_in() const {
+        uint32_t now = uptime_ms();
+        uint32_t wait = NotifyGate::NEVER;
+        for (uint8_t i = 0; i < resource_count; i++) {
+            uint32_t w = resources[i].recorded ? resources[i].change.gate.due_in(now) : NotifyGate::NEVER;
+            wait = w < wait ? w : wait;
+        }
+        return wait;
+    }
+    // Notifications sent, and samples coalesced into them
+    uint32_t notifications() const {
+        uint32_t n = 0;
+        for (uint8_t i = 0; i < resource_count; i++) {
+            n += resources[i].change.gate.sent();
+        }
+        return n;
+    }
+    uint32_t coalesced() const {
+        uint32_t n = 0;
+        for (uint8_t i = 0; i < resource_count; i++) {
+            n += resources[i].change.gate.coalesced();
+        }
+        return n;
+    }
+    const char* name() const {
+        return ds_name;
+    }
+    // Number of resources declared, and the id of each
+    uint8_t declared() const {
+        return resource_count;
+    }
+    const char* id(uint8_t index) const {
+        return resources[index].id;
+    }
+    /*
+     * The recorded history of resource `id`, or NULL if no such resource
+     * was declared or it keeps no history.
+     */
+    const TimeSeries* history(const char *id) const {
+        int index = find(id);
+        return index >= 0 ? resources[index].history : NULL;
+    }
+    const Rollup* rollup(const char *id) const {
+        int index = find(id);
+        return index >= 0 ? resources[index].rollup : NULL;
+    }
+    /*
+     * Writes the buckets of one rollup tier of every resource that keeps
+     * a history, oldest first:
+     *
+     *   {"width":60000,"series":{"5702":[[<start>,<count>,<min>,<max>,<sum>,<last>],...],...}}
+     *
+     * Bucket starts are milliseconds since boot; the last bucket of each
+     * series is still open.
+     */
+    void encode_rollup(Rollup::Tier tier, PayloadWriter &out) const {
+        out.put("{\"width\":");
+        out.put_uint(Rollup::width(tier));
+        out.put(",\"series\":{");
+        bool first = true;
+        for (uint8_t i = 0; i < resource_count; i++) {
+            const Resource &r = resources[i];
+            if (!r.rollup) {
+                continue;
+            }
+            if (!first) {
+                out.put(',');
+            }
+            first = false;
+            out.put('"');
+            out.put(r.id);
+            out.put("\":[");
+            bool integer = r.history->encoding() == TimeSeries::INTEGER;
+            for (uint16_t b = 0; b < r.rollup->size(tier); b++) {
+                Rollup::Bucket bucket = r.rollup->bucket(tier, b);
+                out.put(b ? ",[" : "[");
+                out.put_uint(bucket.start);
+                out.put(',');
+                out.put_uint(bucket.count);
+                float values[] = { bucket.min, bucket.max, bucket.sum, bucket.last };
+                for (int v = 0; v < 4; v++) {
+                    char text[SAMPLE_TEXT_SIZE];
+                    SampleValue value = integer ? SampleValue::integer((int32_t)lrintf(values[v]), 0)
+                                                : SampleValue::real(values[v], 0);
+                    out.put(',');
+                    out.put(text, format_value(value, text));
+                }
+                out.put(']');
+            }
+            out.put(']');
+        }
+        out.put("}}");
+    }
+    /*
+     * Hands the recorded values to `enc`, which streams them into its
+     * output in whatever content format it implements. With
+     * `changed_only` only the changed values are handed over, and a
+     * source without changes is left out entirely.
+     */
+    void encode(PayloadEncoder &enc, bool changed_only=false) const {
+        if (changed_only && !changed()) {
+            return;
+        }
+        enc.begin_source(ds_name, instance_id);
+        for (uint8_t i = 0; i < resource_count; i++) {
+            const Resource &r = resources[i];
+            if (!r.recorded || (changed_only && !r.change.changed)) {
+                continue;
+            }
+            enc.value(r.id, r.description, r.latest);
+        }
+        enc.end_source();
+    }
+    /*
+     * How often read_data() is called, and how long after start-up it is
+     * called first. Different phases keep sources with the same period
+     * from all being read at once.
+     */
+    void set_period(uint32_t period_ms, uint32_t phase_ms=0) {
+        sample_period = period_ms;
+        sample_phase = phase_ms;
+    }
+    uint32_t period_ms() const {
+        return sample_period;
+    }
+    uint32_t phase_ms() const {
+        return sample_phase;
+    }
+    // The client whose registration decides whether samples are
+    // published or logged; mbed_client unless set
+    void set_client(MbedClient &c) {
+        client = &c;
+    }
+    // Scheduler entry point
+    static void sample(void *source) {
+        MemScope scope(MEM_DATA_SOURCES);
+        DataSource *ds = (DataSource*)source;
+        TRACE_SCOPE(TRACE_SAMPLE, ds->object_id);
+        ds->read_data();
+        if (ds->client->register_successful()) {
+            ds->publish();
+        }
+    }
+    /*
+     * Takes a sample of every resource. Called every period_ms(), whether
+     * registered or not.
+     */
+    virtual void read_data() = 0;
+    /*
+     * Pushes values to the source's own resources where their
+     * notification attributes allow it. Called after every sample while
+     * registered, so pmin and pmax are only as precise as the sampling
+     * period.
+     */
+    virtual void publish() {}
+protected:
+    /*
+     * Adds the rollup tiers of the source's resources to `inst`: 27100
+     * holds the one-minute buckets and 27101 the one-hour buckets, both
+     * formatted by encode_rollup() when read.
+     */
+    void add_rollup_resources(M2MObjectInstance *inst) {
+        static const char *ids[Rollup::TIER_COUNT] = { "27100", "27101" };
+        static const char *names[Rollup::TIER_COUNT] = { "RollupMinutes", "RollupHours" };
+        for (int tier = 0; tier < Rollup::TIER_COUNT; tier++) {
+            M2MResource* res = inst->create_dynamic_resource(ids[tier], names[tier],
+                M2MResourceInstance::STRING, false);
+            res->set_operation(M2MBase::GET_ALLOWED);
+            res->set_outgoing_block_message_callback(
+                outgoing_block_message_callback(this, &DataSource::rollup_requested));
+        }
+    }
+
+    // set_value()s every resource of `object` whose notification is due
+    void publish_changes(M2MObject *object) {
+        uint32_t now = uptime_ms();
+        for (uint8_t i = 0; i < resource_count; i++) {
+            Resource &r = resources[i];
+            if (!r.recorded || !r.change.gate.due(now)) {
+                continue;
+            }
+            if (!r.object_resource) {
+                r.object_resource = object->object_instance()->resource(r.id);
+            }
+            char text[SAMPLE_TEXT_SIZE];
+            size_t len = format_value(r.latest, text);
+            {
+                MemScope coap(MEM_COAP);
+                TRACE_SCOPE(TRACE_SET_VALUE, len);
+                r.object_resource->set_value((const uint8_t*)text, len);
+            }
+            r.change.gate.notified(now);
+        }
+    }
+
+    MbedClient *client;
+
+private:
+    /*
+     * Serves a GET of a rollup resource. mbed Client sends `data`, block by
+     * block if needed, and frees it afterwards.
+     */
+    void rollup_requested(const String &resource, uint8_t *&data, uint32_t &len) {
+        Rollup::Tier tier = strstr(resource.c_str(), "27101") ? Rollup::HOURS : Rollup::MINUTES;
+        PayloadWriter sizing(NULL, 0);
+        encode_rollup(tier, sizing);
+        data = (uint8_t*)malloc(sizing.size());
+        len = 0;
+        if (data) {
+            PayloadWriter out(data, sizing.size());
+            encode_rollup(tier, out);
+            len = out.size();
+        }
+    }
+
+    int find(const char *id) const {
+        for (uint8_t i = 0; i < resource_count; i++) {
+            if (strcmp(resources[i].id, id) == 0) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    void record(Resource &r, const SampleValue &sample) {
+        track_change(r, sample);
+        r.latest = sample;
+        r.recorded = true;
+    }
+
+    /*
+     * Marks `r` changed if `sample` left the deadband around the last
+     * reported value. Values that print the same as the previous sample
+     * are never a change.
+     */
+    void track_change(Resource &r, const SampleValue &sample) {
+        recorded_samples++;
+        Change &change = r.change;
+        double value = sample.as_double();
+        double threshold = change.deadband;
+        if (change.type == DEADBAND_PERCENT) {
+            threshold = fabs(change.reported) * change.deadband / 100;
+        }
+        if (!change.reported_once || (fabs(value - change.reported) > threshold && !sample.same_text(r.latest))) {
+            change.reported = value;
+            change.reported_once = true;
+            change.changed = true;
+            change.gate.offer(value);
+        } else {
+            suppressed_samples++;
+        }
+    }
+
+    // Samples taken while offline would never reach the server otherwise
+    void log_sample(const Resource &r, uint32_t now, uint16_t flags, uint32_t value) {
+        if (sample_log && !client->register_successful()) {
+            SampleLog::Record record;
+            record.object = object_id;
+            record.resource = r.number | flags;
+            record.timestamp = now;
+            record.value = value;
+            sample_log->append(record);
+        }
+    }
+
+    const char *ds_name;
+    int instance_id;
+    uint16_t object_id;
+    Resource *resources;
+    uint8_t resource_capacity;
+    uint8_t resource_count;
+    uint32_t sample_period;
+    uint32_t sample_phase;
+    uint32_t recorded_samples;
+    uint32_t suppressed_samples;
+};
+
+/*
+ * A DataSource with room for N resources.
+ */
+template <uint8_t N>
+class FixedDataSource : public DataSource {
+public:
+    FixedDataSource(const char *name) : DataSource(name, table, N) {}
+private:
+    Resource table[N];
+};
+
+// Initial size of the alldata/0/json payload buffer. The buffer only ever
+// grows, and only when a serialization pass reports it needs more room.
+#ifndef ALLDATA_BUFFER_SIZE
+#define ALLDATA_BUFFER_SIZE 1024
+#endif
+
+// Updates of alldata/0/json made while offline are held in
+// OFFLINE_QUEUE_SIZE bytes, the oldest dropped first, and replayed in
+// order once registered again, OFFLINE_REPLAY_BURST with every update.
+#ifndef OFFLINE_QUEUE_SIZE
+#define OFFLINE_QUEUE_SIZE 4096
+#endif
+#ifndef OFFLINE_REPLAY_BURST
+#define OFFLINE_REPLAY_BURST 4
+#endif
+
+// Samples logged while offline are replayed in batches of at most
+// REPLAY_BATCH_SIZE records, no more often than every REPLAY_INTERVAL_MS.
+#ifndef REPLAY_BATCH_SIZE
+#define REPLAY_BATCH_SIZE 20
+#endif
+#ifndef REPLAY_INTERVAL_MS
+#define REPLAY_INTERVAL_MS 1000
+#endif
+// Longest replayed record: ["/65535/0/32767",4294967295,<value>],
+// with the value taking at most SAMPLE_TEXT_SIZE - 1 characters.
+#define REPLAY_RECORD_MAX 56
+
+/*
+ * Publishes the values of all data sources in alldata/0/json.
+ * The content format is selected by writing alldata/0/format, either by
+ * name ("json", "senml+json", "senml+cbor", "tlv") or by CoAP content
+ * format number. The resource keeps its original name so existing
+ * consumers of the default JSON representation keep working.
+ *
+ * Only values that moved past their deadband since the last update are
+ * published, and nothing is sent when no value changed. Writing "0" to
+ * alldata/0/delta publishes all values whenever any of them changed.
+ * alldata/0/stats counts what was sent and what was suppressed.
+ *
+ * The sources' own resources notify according to their LwM2M
+ * notification attributes, set by writing a path with a Write-Attributes
+ * query to alldata/0/notify, e.g. "/3313/0/5702?pmin=5&pmax=60&st=10",
+ * or "/3313/0?pmin=5" for every resource of an object.
+ *
+ * While the client is offline, each update that would have been sent is
+ * held in a queue instead, with every value rather than the changed ones,
+ * as the oldest are dropped when it fills up. Once the client is
+ * registered again they are sent in order, a few with every update,
+ * ahead of the new ones.
+ *
+ * Samples recorded while the client was offline are replayed through the
+ * observable alldata/0/backlog resource, one batch per notification:
+ *
+ *   {"boot":3,"uptime":81234,"samples":[["/3303/0/5600",60120,0.412],...]}
+ *
+ * Sample times are milliseconds since boot number `boot`; `uptime` is the
+ * time since the current boot when the batch was sent.
+ */
+class DataAggregator {
+public:
+    enum Format {
+        FORMAT_JSON,
+        FORMAT_SENML_JSON,
+        FORMAT_SENML_CBOR,
+        FORMAT_TLV
+    };
+
+    DataAggregator() : client(&mbed_client), format(FORMAT_JSON), delta(true), payload_capacity(ALLDATA_BUFFER_SIZE),
+                       offline_storage(new uint8_t[OFFLINE_QUEUE_SIZE]), offline(offline_storage, OFFLINE_QUEUE_SIZE) {
+        aggregator_object = M2MInterfaceFactory::create_object("alldata");
+        M2MObjectInstance* aggregator_inst = aggregator_object->create_object_instance();
+
+        // kept rather than looked up by name, which takes a String
+        json_resource = aggregator_inst->create_dynamic_resource("json", "AllData",
+            M2MResourceInstance::STRING, true);
+        json_resource->set_operation(M2MBase::GET_ALLOWED);
+        json_resource->clear_value();
+
+        format_resource = aggregator_inst->create_dynamic_resource("format", "AllDataFormat",
+            M2MResourceInstance::STRING, false);
+        format_resource->set_operation(M2MBase::GET_PUT_ALLOWED);
+        format_resource->set_value_updated_function(value_updated_callback(this, &DataAggregator::format_updated));
+        set_format(FORMAT_JSON);
+
+        delta_resource = aggregator_inst->create_dynamic_resource("delta", "AllDataDelta",
+            M2MResourceInstance::BOOLEAN, false);
+        delta_resource->set_operation(M2MBase::GET_PUT_ALLOWED);
+        delta_resource->set_value_updated_function(value_updated_callback(this, &DataAggregator::delta_updated));
+        delta_resource->set_value((const uint8_t*)"1", 1);
+
+        notify_resource = aggregator_inst->create_dynamic_resource("notify", "NotifyAttributes",
+            M2MResourceInstance::STRING, false);
+        notify_resource->set_operation(M2MBase::PUT_ALLOWED);
+        notify_resource->set_value_updated_function(value_updated_callback(this, &DataAggregator::notify_updated));
+
+        stats_resource = aggregator_inst->create_dynamic_resource("stats", "AllDataStats",
+            M2MResourceInstance::STRING, false);
+        stats_resource->set_operation(M2MBase::GET_ALLOWED);
+        memset(&stats, 0, sizeof(stats));
+
+        backlog_resource = aggregator_inst->create_dynamic_resource("backlog", "Backlog",
+            M2MResourceInstance::STRING, true);
+        backlog_resource->set_operation(M2MBase::GET_ALLOWED);
+        backlog_resource->set_coap_content_type(CONTENT_FORMAT_JSON);
+        backlog_resource->clear_value();
+
+        payload = new uint8_t[payload_capacity];
+        backlog = new uint8_t[BACKLOG_CAPACITY];
+    }
+    ~DataAggregator() {
+        delete[] payload;
+        delete[] backlog;
+        delete[] offline_storage;
+    }
+    void add_data_source(DataSource *ds) {
+        data_sources.push_back(ds);
+    }
+    // The client whose registration decides whether to publish;
+    // mbed_client unless set
+    void set_client(MbedClient &c) {
+        client = &c;
+    }
+    /*
+     * Publishes what the sources sampled since the last call: the changed
+     * values of every source's own resources, then alldata/0/json.
+     */
+    void update_all() {
+        MemScope scope(MEM_AGGREGATOR);
+        TRACE_SCOPE(TRACE_UPDATE_ALL, 0);
+        publish_sources();
+        MemStats::instance().record_update(scope);
+    }
+
+    /*
+     * Sends the next batch of logged samples, if registered. Called every
+     * REPLAY_INTERVAL_MS.
+     */
+    void replay(SampleLog &log) {
+        MemScope scope(MEM_AGGREGATOR);
+        replay_batch(log);
+    }
+
+    // The queue of updates made while offline
+    NotificationQueue::Stats offline_stats() const {
+        return offline.stats();
+    }
+
+    void set_format(Format new_format) {
+        format = new_format;
+        format_resource->set_value((const uint8_t*)format_names[format], strlen(format_names[format]));
+    }
+
+    M2MObject* get_object() {
+        return aggregator_object;
+    }
+private:
+    struct Stats {
+        uint32_t updates;           // alldata/0/json updates sent
+        uint32_t skipped_updates;   // updates not sent as nothing changed
+        uint32_t bytes;             // payload bytes sent
+        uint32_t full_bytes;        // bytes sending every value would take
+    };
+
+    void publish_sources() {
+        bool online = client->register_successful();
+        if (online) {
+            replay_offline();
+        }
+        bool changed = false;
+        for (std::vector<DataSource*>::iterator it = data_sources.begin(); it != data_sources.end(); ++it) {
+            changed = changed || (*it)->changed();
+        }
+        if (!changed) {
+            if (online) {
+                stats.skipped_updates++;
+                publish_stats();
+            }
+            return;
+        }
+        // offline, or still replaying: the update joins the queue, whole
+        bool hold = !online || !offline.empty();
+        bool changed_only = delta && !hold;
+        size_t len = serialize(payload, payload_capacity, changed_only);
+        if (len > payload_capacity) {
+            // Sources grew since the last pass; resize once to what
+            // the serializer asked for and write the payload again.
+            grow_payload(len);
+            len = serialize(payload, payload_capacity, changed_only);
+        }
+        if (hold) {
+            offline.push(content_formats[format], payload, len);
+        } else {
+            send(content_formats[format], len);
+            // what sending every value would have cost; a counting pass
+            // needs no buffer
+            stats.full_bytes += delta ? serialize(NULL, 0, false) : len;
+        }
+        for (std::vector<DataSource*>::iterator it = data_sources.begin(); it != data_sources.end(); ++it) {
+            (*it)->clear_changes();
+        }
+        publish_stats();
+    }
+
+    // Sends the oldest updates held while offline
+    void replay_offline() {
+        for (int i = 0; i < OFFLINE_REPLAY_BURST && !offline.empty(); i++) {
+            grow_payload(offline.front_length());
+            uint16_t content_format = 0;
+            size_t len = offline.pop(content_format, payload);
+            send((uint8_t)content_format, len);
+            stats.full_bytes += len;
+        }
+    }
+
+    // Sends the `len` bytes of the payload buffer in alldata/0/json
+    void send(uint8_t content_format, size_t len) {
+        json_resource->set_coap_content_type(content_format);
+        {
+            MemScope coap(MEM_COAP);
+            TRACE_SCOPE(TRACE_SET_VALUE, len);
+            json_resource->set_value(payload, len);
+            // a registration update that is nearly due goes out too
+            client->piggyback_registration();
+        }
+        stats.updates++;
+        stats.bytes += len;
+    }
+
+    void grow_payload(size_t len) {
+        if (len > payload_capacity) {
+            delete[] payload;
+            payload = new uint8_t[len];
+            payload_capacity = len;
+        }
+    }
+
+    void replay_batch(SampleLog &log) {
+        if (!client->register_successful() || log.empty()) {
+            return;
+        }
+        // make samples still buffered from the offline period readable
+        log.flush();
+
+        SampleLog::Record records[REPLAY_BATCH_SIZE];
+        uint16_t boot;
+        uint32_t count = log.read(records, REPLAY_BATCH_SIZE, &boot);
+        if (count == 0) {
+            return;
+        }
+        TRACE_SCOPE(TRACE_REPLAY, count);
+        PayloadWriter out(backlog, BACKLOG_CAPACITY);
+        out.put("{\"boot\":");
+        out.put_uint(boot);
+        out.put(",\"uptime\":");
+        out.put_uint(uptime_ms());
+        out.put(",\"samples\":[");
+        for (uint32_t i = 0; i < count; i++) {
+            const SampleLog::Record &r = records[i];
+            if (i) {
+                out.put(',');
+            }
+            out.put("[\"/");
+            out.put_uint(r.object);
+            out.put("/0/");
+            out.put_uint(r.resource & ~SampleLog::FLOAT_VALUE);
+            out.put("\",");
+            out.put_uint(r.timestamp);
+            out.put(',');
+            SampleValue value = SampleValue::integer((int32_t)r.value, r.timestamp);
+            if (r.resource & SampleLog::FLOAT_VALUE) {
+                value.type = SampleValue::FLOAT;
+            }
+            char text[SAMPLE_TEXT_SIZE];
+            out.put(text, format_value(value, text));
+            out.put(']');
+        }
+        out.put("]}");
+
+        {
+            MemScope coap(MEM_COAP);
+            backlog_resource->set_value(backlog, out.size());
+        }
+        log.consume(count);
+        printf("DataAggregator: replayed %" PRIu32 " samples from boot %d\n", count, boot);
+    }
+
+    /*
+     * Writes the sources into `buffer` in one pass, only their changed
+     * values if `changed_only` is set, and returns the number of bytes the
+     * full payload needs, which may exceed `capacity`.
+     */
+    size_t serialize(uint8_t *buffer, size_t capacity, bool changed_only) {
+        TRACE_BEGIN(TRACE_SERIALIZE, 0);
+        PayloadWriter out(buffer, capacity);
+        JsonEncoder json(out);
+        SenmlJsonEncoder senml_json(out);
+        SenmlCborEncoder senml_cbor(out);
+        TlvEncoder tlv(out);
+        PayloadEncoder *encoders[] = { &json, &senml_json, &senml_cbor, &tlv };
+        PayloadEncoder *enc = encoders[format];
+
+        enc->begin();
+        for (std::vector<DataSource*>::iterator it = data_sources.begin(); it != data_sources.end(); ++it) {
+            (*it)->encode(*enc, changed_only);
+        }
+        enc->end();
+        TRACE_END(TRACE_SERIALIZE, out.size());
+        return out.size();
+    }
+
+    void format_updated(const char* /*name*/) {
+        ArenaScope cycle(request_arena);
+        ArenaString value = value_text(format_resource, request_arena);
+        bool numeric = isdigit((unsigned char)value.c_str()[0]);
+        int content_format = atoi(value.c_str());
+        for (int f = FORMAT_JSON; f <= FORMAT_TLV; f++) {
+            if (value == format_names[f] || (numeric && content_format == content_formats[f])) {
+                set_format((Format)f);
+                printf("DataAggregator: format set to %s\n", format_names[format]);
+                return;
+            }
+        }
+        printf("DataAggregator: unknown format '%s'\n", value.c_str());
+        // put the name of the format still in use back into the resource
+        set_format(format);
+    }
+
+    void delta_updated(const char* /*name*/) {
+        ArenaScope cycle(request_arena);
+        ArenaString value = value_text(delta_resource, request_arena);
+        delta = value != "0" && value != "false";
+        delta_resource->set_value((const uint8_t*)(delta ? "1" : "0"), 1);
+        printf("DataAggregator: delta publishing %s\n", delta ? "on" : "off");
+    }
+
+    /*
+     * Parses "/<object>/<instance>[/<resource>]?<attributes>" and hands the
+     * attributes to the matching source.
+     */
+    void notify_updated(const char* /*name*/) {
+        ArenaScope cycle(request_arena);
+        ArenaAllocator<char> scratch(request_arena);
+        ArenaString path = value_text(notify_resource, request_arena);
+        std::size_t query = path.find('?');
+        std::size_t object_start = path.find_first_not_of('/');
+        bool applied = false;
+        if (query != ArenaString::npos && object_start != ArenaString::npos) {
+            ArenaString object(scratch);
+            object.assign(path, object_start, path.find('/', object_start) - object_start);
+            std::size_t instance_end = path.find('/', object_start + object.size() + 1);
+            ArenaString resource(scratch);
+            if (instance_end != ArenaString::npos && instance_end < query) {
+                resource.assign(path, instance_end + 1, query - instance_end - 1);
+            }
+            for (std::vector<DataSource*>::iterator it = data_sources.begin(); it != data_sources.end(); ++it) {
+                if (object == (*it)->name()) {
+                    applied = (*it)->set_notify_attributes(resource.c_str(), path.c_str() + query + 1);
+                }
+            }
+        }
+        printf("DataAggregator: notification attributes %s %s\n", path.c_str(), applied ? "applied" : "rejected");
+    }
+
+    void publish_stats() {
+        uint32_t samples = 0;
+        uint32_t suppressed = 0;
+        uint32_t notifications = 0;
+        uint32_t coalesced = 0;
+        for (std::vector<DataSource*>::iterator it = data_sources.begin(); it != data_sources.end(); ++it) {
+            samples += (*it)->samples();
+            suppressed += (*it)->suppressed();
+            notifications += (*it)->notifications();
+            coalesced += (*it)->coalesced();
+        }
+        NotificationQueue::Stats held = offline.stats();
+        char buffer[256];
+        int size = snprintf(buffer, sizeof(buffer),
+            "samples=%" PRIu32 " suppressed=%" PRIu32 " updates=%" PRIu32 " skipped=%" PRIu32
+            " bytes=%" PRIu32 " full_bytes=%" PRIu32 " notifications=%" PRIu32 " coalesced=%" PRIu32
+            " held=%u queued=%" PRIu32 " replayed=%" PRIu32 " dropped=%" PRIu32,
+            samples, suppressed, stats.updates, stats.skipped_updates, stats.bytes, stats.full_bytes,
+            notifications, coalesced, held.entries, held.queued, held.replayed, held.dropped);
+        MemScope coap(MEM_COAP);
+        stats_resource->set_value((const uint8_t*)buffer, size);
+    }
+
+    static const char* const format_names[];
+    static const uint8_t content_formats[];
+    static const size_t BACKLOG_CAPACITY = 64 + REPLAY_BATCH_SIZE * REPLAY_RECORD_MAX;
+
+    MbedClient *client;
+    std::vector<DataSource*> data_sources;
+    M2MObject* aggregator_object;
+    M2MResource* json_resource;
+    M2MResource* format_resource;
+    M2MResource* delta_resource;
+    M2MResource* notify_resource;
+    M2MResource* stats_resource;
+    M2MResource* backlog_resource;
+    Format format;
+    bool delta;
+    Stats stats;
+    uint8_t* payload;
+    size_t payload_capacity;
+    uint8_t* backlog;
+    uint8_t* offline_storage;
+    NotificationQueue offline;
+};
+
+const char* const DataAggregator::format_names[] = { "json", "senml+json", "senml+cbor", "tlv" };
+const uint8_t DataAggregator::content_formats[] = {
+    CONTENT_FORMAT_TEXT_PLAIN, CONTENT_FORMAT_SENML_JSON, CONTENT_FORMAT_SENML_CBOR, CONTENT_FORMAT_OMA_TLV
+};
+
+/*
+ * The Led contains one property (pattern) and a function (blink).
+ * When the function blink is executed, the pattern is read, and the LED
+ * will blink based on the pattern.
+ */
+class LedResource {
+public:
+    LedResource(Executor &executor) : executor(executor), blink_job(-1) {
+        M2MResource *created[SCHEMA_COUNT(led_resources)];
+        led_object = LED_SCHEMA.create(created);
+        pattern_res = created[LED_PATTERN];
+        led_res = created[LED_BLINK];
+        // when a POST comes in, we want to execute the led_execute_callback
+        led_res->set_execute_function(execute_callback(this, &LedResource::blink));
+        // Completion of execute function can take a time, that's why delayed response is used
+        led_res->set_delayed_response(true);
+        blink_args = new BlinkArgs();
+    }
+
+    ~LedResource() {
+        delete blink_args;
+    }
+
+    M2MObject* get_object() {
+        return led_object;
+    }
+
+    /*
+     * Starts blinking the pattern. A POST while a pattern is blinking
+     * starts it over; mbed Client only keeps the token of the latest POST,
+     * so that is the one answered once the pattern is done.
+     */
+    void blink(void *argument) {
+        executor.cancel(blink_job);
+        // read the value of 'Pattern'
+        status_ticker.detach();
+        green_led = LED_OFF;
+        blue_led = LED_OFF;
+        red_led = LED_OFF;
+
+        // values in mbed Client are all buffers; the pattern, something
+        // like 500:200:500, is parsed straight out of the resource's
+        const char *pattern = (const char*)pattern_res->value();
+        uint32_t length = pattern ? pattern_res->value_length() : 0;
+        printf("led_execute_callback pattern=%.*s\n", (int)length, pattern ? pattern : "");
+        blink_args->parse(pattern, length);
+        // check if POST contains payload
+        if (argument) {
+            M2MResource::M2MExecuteParameter* param = (M2MResource::M2MExecuteParameter*)argument;
+            String object_name = param->get_argument_object_name();
+            uint16_t object_instance_id = param->get_argument_object_instance_id();
+            String resource_name = param->get_argument_resource_name();
+            int payload_length = param->get_argument_value_length();
+            uint8_t* payload = param->get_argument_value();
+            printf("Resource: %s/%d/%s executed\n", object_name.c_str(), object_instance_id, resource_name.c_str());
+            printf("Payload: %.*s [%d]\n", payload_length, payload, payload_length);
+        }
+        // the executor runs blink_step for every toggle, starting now,
+        // then blink_finished once it is unlocked
+        blink_job = executor.start(LedResource::blink_step, this, 0, LedResource::blink_finished);
+        if (blink_job < 0) {
+            printf("led_execute_callback: too many jobs running\n");
+            blink_done();
+            led_res->send_delayed_post_response();
+        }
+    }
+
+private:
+    M2MObject* led_object;
+    M2MResource* pattern_res;
+    M2MResource* led_res;
+    Executor &executor;
+    int blink_job;
+    BlinkArgs *blink_args;
+
+    static uint32_t blink_step(void *led) {
+        return ((LedResource*)led)->do_blink();
+    }
+
+    // Sends the delayed response once the pattern is done, with the
+    // executor unlocked: mbed Client takes its own lock, and may call
+    // blink() with it held
+    static void blink_finished(void *led) {
+        ((LedResource*)led)->led_res->send_delayed_post_response();
+    }
+
+    // Toggles the LED and returns how long until the next toggle
+    uint32_t do_blink() {
+        // blink the LED
+        red_led = !red_led;
+        // up the position, if we reached the end of the vector
+        if (blink_args->position >= blink_args->blink_pattern.size()) {
+            blink_done();
+            return Executor::DONE;
+        }
+        // Wait requested time, then continue prosessing the blink pattern from next position.
+        return blink_args->blink_pattern.at(blink_args->position++);
+    }
+
+    void blink_done() {
+        red_led = LED_OFF;
+        status_ticker.attach_us(blinky, 250000);
+    }
+};
+
+/*
+ * The button contains one property (click count).
+ * When `handle_button_click` is executed, the counter updates.
+ */
+class ButtonResource: public FixedDataSource<SCHEMA_COUNT(button_resources)> {
+public:
+    // With an `executor`, a click held back by pmin is sent as soon as pmin
+    // is over rather than with the next sample
+    ButtonResource(Executor *executor=NULL)
+        : FixedDataSource<SCHEMA_COUNT(button_resources)>(BUTTON_SCHEMA.id), executor(executor), publish_job(-1),
+          counter(0) {
+        btn_object = create_object(BUTTON_SCHEMA);
+    }
+
+    ~ButtonResource() {
+    }
+
+    M2MObject* get_object() {
+        return btn_object;
+    }
+
+    virtual void read_data() {
+        record_data(COUNTER, (int32_t)counter);
+    }
+
+    virtual void publish() {
+        publish_changes(btn_object);
+    }
+
+    /*
+     * When you press the button, we read the current value of the click counter
+     * from mbed Device Connector, then up the value with one.
+     */
+    void handle_button_inc() {
+        counter++;
+        handle_button_click();
+    }
+    void handle_button_dec() {
+        counter--;
+        handle_button_click();
+    }
+
+private:
+    // Index of the click count in the source's resource table
+    enum { COUNTER };
+
+    void handle_button_click() {
+    #ifdef TARGET_K64F
+        printf("handle_button_click, new value of counter is %d\n", counter);
+    #else
+        printf("simulate button_click, new value of counter is %d\n", counter);
+    #endif
+        // A click is a sample like any other: it is logged while offline,
+        // and its notification waits for pmin like the others do
+        record_data(COUNTER, (int32_t)counter);
+        if (client->register_successful()) {
+            publish_changes(btn_object);
+            uint32_t wait = notification_due_in();
+            if (executor && publish_job < 0 && wait != NotifyGate::NEVER) {
+                publish_job = executor->start(publish_step, this, wait, publish_held);
+            }
+        } else {
+            printf("simulate button_click, device not registered\n");
+        }
+    }
+
+    // Waits out pmin; the notification goes out from publish_held(), as
+    // steps must not call into mbed Client
+    static uint32_t publish_step(void * /*context*/) {
+        return Executor::DONE;
+    }
+    static void publish_held(void *context) {
+        ButtonResource *b = (ButtonResource*)context;
+        b->publish_job = -1;
+        if (b->client->register_successful()) {
+            b->publish_changes(b->btn_object);
+        }
+    }
+
+    M2MObject* btn_object;
+    Executor *executor;
+    int publish_job;
+    uint16_t counter;
+};
+
+// Most of the payload one GET of 1000/0/1 returns, and the flash
+// kept for payloads PUT to it, below the sample log
+#ifndef BIG_PAYLOAD_WINDOW_SIZE
+#define BIG_PAYLOAD_WINDOW_SIZE 4096
+#endif
+#ifndef BIG_PAYLOAD_STORAGE_SIZE
+#define BIG_PAYLOAD_STORAGE_SIZE (256 * 1024)
+#endif
+
+/*
+ * Transfers payloads too large for RAM through 1000/0/1.
+ *
+ * A GET returns up to BIG_PAYLOAD_WINDOW_SIZE bytes read from `producer`
+ * at the offset in 1000/0/2; mbed Client takes each response whole and
+ * sends it block-wise, so a larger payload is read one window at a time
+ * by moving the offset on. A shorter window is the last one.
+ *
+ * A block-wise PUT is streamed block by block into `sink`. 1000/0/3 holds
+ * the bytes stored so far; if a transfer stops, writing that to 1000/0/2
+ * and PUTting the rest of the payload resumes it.
+ */
+class BigPayloadResource {
+public:
+    BigPayloadResource(ChunkProducer &producer, ChunkSink *sink)
+        : producer(producer), receiver(sink ? *sink : static_cast<ChunkSink&>(no_sink)), offset(0) {
+        big_payload = M2MInterfaceFactory::create_object("1000");
+        M2MObjectInstance* payload_inst = big_payload->create_object_instance();
+        M2MResource* payload_res = payload_inst->create_dynamic_resource("1", "BigData",
+            M2MResourceInstance::STRING, true /* observable */);
+        payload_res->set_operation(M2MBase::GET_PUT_ALLOWED);
+        payload_res->set_value((uint8_t*)"0", 1);
+        payload_res->set_incoming_block_message_callback(
+                    incoming_block_message_callback(this, &BigPayloadResource::block_message_received));
+        payload_res->set_outgoing_block_message_callback(
+                    outgoing_block_message_callback(this, &BigPayloadResource::block_message_requested));
+        payload_res->set_value_updated_function(value_updated_callback(this, &BigPayloadResource::payload_updated));
+
+        M2MResource* offset_res = payload_inst->create_dynamic_resource("2", "Offset",
+            M2MResourceInstance::INTEGER, false);
+        offset_res->set_operation(M2MBase::GET_PUT_ALLOWED);
+        offset_res->set_value(0);
+        offset_res->set_value_updated_function(value_updated_callback(this, &BigPayloadResource::offset_updated));
+
+        received_res = payload_inst->create_dynamic_resource("3", "Received",
+            M2MResourceInstance::INTEGER, true /* observable */);
+        received_res->set_operation(M2MBase::GET_ALLOWED);
+        received_res->set_value(0);
+    }
+
+    M2MObject* get_object() {
+        return big_payload;
+    }
+
+    void block_message_received(M2MBlockMessage *argument) {
+        if (!argument) {
+            return;
+        }
+        if (M2MBlockMessage::ErrorNone != argument->error_code()) {
+            printf("Error when receiving block message!  - EntityTooLarge\n");
+            return;
+        }
+        BlockReceiver::State state = receiver.block(argument->block_number(), argument->block_message_data(),
+                                                    argument->block_message_size(), argument->is_last_block());
+        stored(state);
+    }
+
+    // mbed Client sends `data`, block by block if needed, and frees it
+    void block_message_requested(const String& /*resource*/, uint8_t *&data, uint32_t &len) {
+        len = 0;
+        data = (uint8_t*)malloc(BIG_PAYLOAD_WINDOW_SIZE);
+        if (data) {
+            len = producer.read(offset, data, BIG_PAYLOAD_WINDOW_SIZE);
+        }
+    }
+
+private:
+    // Payloads small enough to arrive in a single message. Block-wise
+    // PUTs leave the placeholder "0" in place, and trigger this too.
+    void payload_updated(const char* /*name*/) {
+        M2MResource* res = big_payload->object_instance()->resource("1");
+        if (res->value_length() == 1 && res->value()[0] == '0') {
+            return;
+        }
+        stored(receiver.block(0, res->value(), res->value_length(), true));
+        res->set_value((uint8_t*)"0", 1);
+    }
+
+    void offset_updated(const char* /*name*/) {
+        M2MResource* res = big_payload->object_instance()->resource("2");
+        offset = (uint32_t)res->get_value_int();
+        receiver.start(offset);
+    }
+
+    void stored(BlockReceiver::State state) {
+        received_res->set_value(receiver.committed());
+        if (state == BlockReceiver::COMPLETE) {
+            printf("Big payload: %" PRIu32 " bytes stored\n", receiver.committed());
+        } else if (state == BlockReceiver::STOPPED) {
+            printf("Big payload: stopped after %" PRIu32 " bytes\n", receiver.committed());
+        }
+    }
+
+    // Refuses everything when there is nowhere to store payloads
+    class NoSink: public ChunkSink {
+    public:
+        virtual int begin(uint32_t) { return -1; }
+        virtual int write(uint32_t, const uint8_t*, uint32_t) { return -1; }
+        virtual int finish(uint32_t) { return -1; }
+    };
+
+    M2MObject*     big_payload;
+    M2MResource*   received_res;
+    ChunkProducer& producer;
+    NoSink         no_sink;
+    BlockReceiver  receiver;
+    uint32_t       offset;
+};
+
+// The accelerometer samples at ACCEL_RATE into its FIFO, which is drained
+// whenever it holds ACCEL_WATERMARK samples. Every ACCEL_PERIOD_MS the
+// samples of the window are summarized per axis; only the summaries are
+// recorded and published.
+#ifndef ACCEL_PERIOD_MS
+#define ACCEL_PERIOD_MS 1000
+#endif
+#ifndef ACCEL_RATE
+#define ACCEL_RATE AccelFifo::RATE_400HZ
+#endif
+#ifndef ACCEL_WATERMARK
+#define ACCEL_WATERMARK 16
+#endif
+
+/*
+ * Per-axis statistics of the accelerometer over each window. The mean
+ * keeps the IPSO resource of the axis (5702-5704), the others use
+ * resources 27000 + 10 * axis + statistic:
+ *
+ *   axis   mean  min    max    rms    peak-to-peak
+ *   X      5702  27001  27002  27003  27004
+ *   Y      5703  27011  27012  27013  27014
+ *   Z      5704  27021  27022  27023  27024
+ *
+ * All values are in counts of 1/4096 g. RMS is taken around the mean, so
+ * it measures vibration rather than orientation.
+ */
+class AccelerometerResource: public FixedDataSource<SCHEMA_COUNT(accel_resources)> {
+public:
+    AccelerometerResource() : FixedDataSource<SCHEMA_COUNT(accel_resources)>(ACCEL_SCHEMA.id), _fifo(PTE25, PTE24), _acquired(0) {
+        if (!_fifo.enable(ACCEL_RATE, ACCEL_WATERMARK)) {
+            printf("Accelerometer not found\n");
+        }
+
+        accel_object = create_object(ACCEL_SCHEMA);
+
+        set_period(ACCEL_PERIOD_MS);
+    }
+
+    M2MObject* get_object() {
+        return accel_object;
+    }
+
+    /*
+     * Moves the samples waiting in the sensor's FIFO into the window. To
+     * be called when the FIFO interrupt fires.
+     */
+    void drain() {
+        AccelSample samples[ACCEL_FIFO_DEPTH];
+        uint8_t count = _fifo.drain(samples);
+        for (uint8_t i = 0; i < count; i++) {
+            _window[0].add(samples[i].x);
+            _window[1].add(samples[i].y);
+            _window[2].add(samples[i].z);
+        }
+        _acquired += count;
+    }
+
+    // Closes the window and records its statistics
+    virtual void read_data() {
+        drain();
+        if (_window[0].count() == 0) {
+            return;
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            const WindowStats &w = _window[axis];
+            int base = axis * STAT_COUNT;
+            record_data(base + MEAN, (int32_t)lrintf(w.mean()));
+            record_data(base + MIN, w.min());
+            record_data(base + MAX, w.max());
+            record_data(base + RMS, w.rms());
+            record_data(base + PEAK_TO_PEAK, w.peak_to_peak());
+            _window[axis].reset();
+        }
+    }
+
+    virtual void publish() {
+        publish_changes(accel_object);
+    }
+
+    // Samples read from the sensor, and FIFO overflows that lost some
+    uint32_t acquired() const {
+        return _acquired;
+    }
+    uint32_t overflows() const {
+        return _fifo.overflows();
+    }
+
+private:
+    // Statistics of an axis, in the order they are declared; axis `a`
+    // has resources a * STAT_COUNT to a * STAT_COUNT + STAT_COUNT - 1
+    enum { MEAN, MIN, MAX, RMS, PEAK_TO_PEAK, STAT_COUNT };
+
+    // Configured for the FRDM-K64F with onboard sensors
+    AccelFifo _fifo;
+    WindowStats _window[3];
+    uint32_t _acquired;
+    M2MObject* accel_object;
+};
+
+// Analog readings within this many percent of the last reported reading
+// are not published
+#ifndef ANALOG_IN_DEADBAND
+#define ANALOG_IN_DEADBAND 1.0f
+#endif
+
+// Every ANALOG_IN_PERIOD_MS each analog input is read ANALOG_OVERSAMPLE
+// times and the average becomes its reading
+#ifndef ANALOG_IN_PERIOD_MS
+#define ANALOG_IN_PERIOD_MS 3000
+#endif
+#ifndef ANALOG_OVERSAMPLE
+#define ANALOG_OVERSAMPLE 64
+#endif
+// Slowly changing inputs also average over successive periods: each
+// reading moves 1/2^TEMPERATURE_EMA_SHIFT of the way to the new average
+#ifndef TEMPERATURE_EMA_SHIFT
+#define TEMPERATURE_EMA_SHIFT 2
+#endif
+#define ANALOG_MAX_CHANNELS 4
+
+/*
+ * An analog input. It does not read the ADC itself: AnalogSampler reads
+ * all inputs together and hands each its filtered reading.
+ */
+class AnalogInResource: public FixedDataSource<1> {
+public:
+    // `schema` describes an object with a single reading
+    AnalogInResource(PinName pin, const ObjectSchema &schema=ANALOG_IN_SCHEMA) : FixedDataSource<1>(schema.id), _analog_in(pin) {
+        analog_object = create_object(schema);
+        set_deadband(LEVEL, ANALOG_IN_DEADBAND, DEADBAND_PERCENT);
+        set_period(ANALOG_IN_PERIOD_MS);
+        _reading = 0.0f;
+    }
+
+    M2MObject* get_object() {
+        return analog_object;
+    }
+
+    // One raw ADC conversion, 0 to 65535
+    uint16_t read_raw() {
+        return _analog_in.read_u16();
+    }
+
+    // Sets the reading, as a fraction of full scale, read_data() records
+    void set_reading(float reading) {
+        _reading = reading;
+    }
+
+    void read_data() {
+        record_data(LEVEL, _reading);
+    }
+
+    virtual void publish() {
+        publish_changes(analog_object);
+    }
+
+private:
+    // Index of the reading in the source's resource table
+    enum { LEVEL };
+
+    AnalogIn _analog_in;
+    float _reading;
+    M2MObject* analog_object;
+};
+
 /*
- * Arguments for running "blink" in it's own thread.
+ * Samples every analog input in one pass. The inputs are read round-robin,
+ * ANALOG_OVERSAMPLE times each, so they all cover the same interval; each
+ * burst is then decimated into one reading by the input's AdcFilter and
+ * the input is sampled as a DataSource with that reading.
  */
-class BlinkArgs {
+class AnalogSampler {
 public:
-    BlinkArgs() {
-        clear();
-    }
-    void clear() {
-        position = 0;
-        blink_pattern.clear();
-    }
-    uint16_t position;
-    std::vector<uint32_t> blink_pattern;
-};
+    AnalogSampler() : _count(0) {}
 
-namespace std
-{
-    template <typename T>
-    std::string to_string(T Value)
-    {
-        std::ostringstream TempStream;
-        TempStream << Value;
-        return TempStream.str();
+    // Returns false if there is no room for another input
+    bool add(AnalogInResource *input, uint8_t ema_shift=0) {
+        if (_count == ANALOG_MAX_CHANNELS) {
+            return false;
+        }
+        _inputs[_count] = input;
+        _filters[_count] = AdcFilter(ema_shift);
+        _count++;
+        return true;
     }
-}
 
-class DataSource {
-public:
-    DataSource(const std::string &name) : ds_name(name), instance_id(0) {}
-    void set_data_description(const std::string &id, const std::string &description) {
-        data_names[id] = description;
+    // Scheduler entry point
+    static void sample(void *sampler) {
+        ((AnalogSampler*)sampler)->sample_all();
     }
-    void record_data(const std::string &id, const std::string &data) {
-        data_values[id] = data;
-    }
-    std::string json(bool include_brackets=true) {
-        std::string json;
-        bool first = true;
-        if (include_brackets) {
-            json = "[\n";
-        }
-        for (std::map<std::string,std::string>::iterator it = data_values.begin(); it != data_values.end(); ++it) {
-            if (!first) {
-                json += "    ,\n";
+
+private:
+    void sample_all() {
+        for (uint16_t n = 0; n < ANALOG_OVERSAMPLE; n++) {
+            for (uint8_t i = 0; i < _count; i++) {
+                _raw[i][n] = _inputs[i]->read_raw();
             }
-            first = false;
-            json += "    {\n        \"uri\":\"/";
-            json += ds_name + "/" + std::to_string(instance_id) + "/" + (*it).first;
-            json += "\",\n        \"desc\":\"";
-            json += data_names[(*it).first] + "\",\n        \"value\":\"";
-            json += (*it).second + "\"\n    }";
-            json += "\n";
-            //std::cout << " [" << (*it).first << ':' << (*it).second << ']';
         }
-        if (include_brackets) {
-            json += "]";
+        for (uint8_t i = 0; i < _count; i++) {
+            _filters[i].update(_raw[i], ANALOG_OVERSAMPLE);
+            _inputs[i]->set_reading(_filters[i].fraction());
+            DataSource::sample(_inputs[i]);
         }
-        return json;
     }
-    virtual void read_data() = 0;
-private:
-    std::string ds_name;
-    int instance_id;
-    std::map<std::string, std::string> data_names;
-    std::map<std::string, std::string> data_values;
+
+    AnalogInResource *_inputs[ANALOG_MAX_CHANNELS];
+    AdcFilter _filters[ANALOG_MAX_CHANNELS];
+    uint16_t _raw[ANALOG_MAX_CHANNELS][ANALOG_OVERSAMPLE];
+    uint8_t _count;
 };
 
-class DataAggregator {
+/*
+ * Answers time-range queries over the recorded history. A query is a
+ * resource path with a HistoryQuery string, written to history/0/query:
+ *
+ *   /3303/0/5600?start=0&end=3600000&res=60000&fn=avg
+ *
+ * Reading history/0/result then returns a page of the answer, computed
+ * while it is sent. If the page ends with "next", write the query again
+ * with that start for the following page.
+ */
+class HistoryResource {
 public:
-    DataAggregator() {
-        aggregator_object = M2MInterfaceFactory::create_object("alldata");
-        M2MObjectInstance* aggregator_inst = aggregator_object->create_object_instance();
+    HistoryResource() : _source(NULL) {
+        _resource[0] = '\0';
+        history_object = M2MInterfaceFactory::create_object("history");
+        M2MObjectInstance* history_inst = history_object->create_object_instance();
 
-        M2MResource* aggregator_resource = aggregator_inst->create_dynamic_resource("json", "AllData",
-            M2MResourceInstance::STRING, true);
-        aggregator_resource->set_operation(M2MBase::GET_ALLOWED);
-        aggregator_resource->clear_value();
+        query_resource = history_inst->create_dynamic_resource("query", "HistoryQuery",
+            M2MResourceInstance::STRING, false);
+        query_resource->set_operation(M2MBase::GET_PUT_ALLOWED);
+        query_resource->set_value_updated_function(value_updated_callback(this, &HistoryResource::query_updated));
+
+        M2MResource* result_resource = history_inst->create_dynamic_resource("result", "HistoryResult",
+            M2MResourceInstance::STRING, false);
+        result_resource->set_operation(M2MBase::GET_ALLOWED);
+        result_resource->set_coap_content_type(CONTENT_FORMAT_JSON);
+        result_resource->set_outgoing_block_message_callback(
+            outgoing_block_message_callback(this, &HistoryResource::result_requested));
     }
+
+    M2MObject* get_object() {
+        return history_object;
+    }
+
     void add_data_source(DataSource *ds) {
         data_sources.push_back(ds);
     }
-    void update_all() {
-        if (mbed_client.register_successful()) {
-            bool first = true;
-            M2MObjectInstance* inst = aggregator_object->object_instance();
-            M2MResource* res = inst->resource("json");
-            std::string json = "[\n";
+
+private:
+    // Parses "/<object>/<instance>/<resource>?<query>"
+    void query_updated(const char* /*name*/) {
+        ArenaScope cycle(request_arena);
+        ArenaAllocator<char> scratch(request_arena);
+        ArenaString path = value_text(query_resource, request_arena);
+        std::size_t query = path.find('?');
+        std::size_t object_start = path.find_first_not_of('/');
+        std::size_t resource_start = path.rfind('/', query) + 1;
+        HistoryQuery parsed;
+        _source = NULL;
+        if (query != ArenaString::npos && object_start != ArenaString::npos && resource_start > object_start
+                && parsed.parse(path.c_str() + query + 1)) {
+            ArenaString object(scratch);
+            object.assign(path, object_start, path.find('/', object_start) - object_start);
+            ArenaString resource(scratch);
+            resource.assign(path, resource_start, query - resource_start);
             for (std::vector<DataSource*>::iterator it = data_sources.begin(); it != data_sources.end(); ++it) {
-                (*it)->read_data();
-                if (!first) {
-                    json += "    ,\n";
+                if (object == (*it)->name() && (*it)->history(resource.c_str())) {
+                    _source = *it;
+                    _query = parsed;
+                    strncpy(_resource, resource.c_str(), sizeof(_resource) - 1);
+                    _resource[sizeof(_resource) - 1] = '\0';
                 }
-                first = false;
-                json += (*it)->json(false);
             }
-            json += "]";
-            const char *buffer = json.c_str();
-            printf("DataAggregator: set_value buffer=%p len=%d\n", buffer, strlen(buffer));
-            res->set_value((const uint8_t *)buffer, strlen(buffer));
-            printf("DataAggregator: set_value done\n");
         }
+        printf("History: query %s %s\n", path.c_str(), _source ? "accepted" : "rejected");
     }
 
-    M2MObject* get_object() {
-        return aggregator_object;
+    // mbed Client sends `data`, block by block if needed, and frees it
+    void result_requested(const String& /*resource*/, uint8_t *&data, uint32_t &len) {
+        len = 0;
+        data = (uint8_t*)malloc(QUERY_PAGE_SIZE);
+        if (!data) {
+            return;
+        }
+        PayloadWriter out(data, QUERY_PAGE_SIZE);
+        if (_source) {
+            _query.encode(_source->history(_resource), _source->rollup(_resource), out);
+        } else {
+            out.put("{\"rows\":[]}");
+        }
+        len = out.size();
     }
-private:
+
+    M2MObject* history_object;
+    M2MResource* query_resource;
     std::vector<DataSource*> data_sources;
-    M2MObject* aggregator_object;
+    DataSource *_source;
+    char _resource[DATA_SOURCE_ID_SIZE];
+    HistoryQuery _query;
 };
 
 /*
- * The Led contains one property (pattern) and a function (blink).
- * When the function blink is executed, the pattern is read, and the LED
- * will blink based on the pattern.
+ * The stored history of every series as CSV, one line per sample:
+ *
+ *   <object>/<resource>,<time in ms>,<value>
+ *
+ * Lines are formatted as they are read. A read that continues where the
+ * last one ended picks up after the last sample returned, so samples
+ * recorded meanwhile are included and evicted ones skipped; any other
+ * offset starts over from the beginning.
  */
-class LedResource {
+class HistoryExport: public ChunkProducer {
 public:
-    LedResource() {
-        // create ObjectID with metadata tag of '3201', which is 'digital output'
-        led_object = M2MInterfaceFactory::create_object("3201");
-        M2MObjectInstance* led_inst = led_object->create_object_instance();
-
-        // 5853 = Multi-state output
-        M2MResource* pattern_res = led_inst->create_dynamic_resource("5853", "Pattern",
-            M2MResourceInstance::STRING, false);
-        // read and write
-        pattern_res->set_operation(M2MBase::GET_PUT_ALLOWED);
-        // set initial pattern (toggle every 200ms. 7 toggles in total)
-        pattern_res->set_value((const uint8_t*)"500:500:500:500:500:500:500", 27);
-
-        // there's not really an execute LWM2M ID that matches... hmm...
-        M2MResource* led_res = led_inst->create_dynamic_resource("5850", "Blink",
-            M2MResourceInstance::OPAQUE, false);
-        // we allow executing a function here...
-        led_res->set_operation(M2MBase::POST_ALLOWED);
-        // when a POST comes in, we want to execute the led_execute_callback
-        led_res->set_execute_function(execute_callback(this, &LedResource::blink));
-        // Completion of execute function can take a time, that's why delayed response is used
-        led_res->set_delayed_response(true);
-        blink_args = new BlinkArgs();
-    }
-
-    ~LedResource() {
-        delete blink_args;
+    HistoryExport() {
+        rewind();
     }
 
-    M2MObject* get_object() {
-        return led_object;
+    void add_data_source(DataSource *ds) {
+        data_sources.push_back(ds);
     }
 
-    void blink(void *argument) {
-        // read the value of 'Pattern'
-        status_ticker.detach();
-        green_led = LED_OFF;
-        blue_led = LED_OFF;
-        red_led = LED_OFF;
-
-        M2MObjectInstance* inst = led_object->object_instance();
-        M2MResource* res = inst->resource("5853");
-        // Clear previous blink data
-        blink_args->clear();
-
-        // values in mbed Client are all buffers, and we need a vector of int's
-        uint8_t* buffIn = NULL;
-        uint32_t sizeIn;
-        res->get_value(buffIn, sizeIn);
-
-        // turn the buffer into a string, and initialize a vector<int> on the heap
-        std::string s((char*)buffIn, sizeIn);
-        free(buffIn);
-        printf("led_execute_callback pattern=%s\n", s.c_str());
-
-        // our pattern is something like 500:200:500, so parse that
-        std::size_t found = s.find_first_of(":");
-        while (found!=std::string::npos) {
-            blink_args->blink_pattern.push_back(atoi((const char*)s.substr(0,found).c_str()));
-            s = s.substr(found+1);
-            found=s.find_first_of(":");
-            if(found == std::string::npos) {
-                blink_args->blink_pattern.push_back(atoi((const char*)s.c_str()));
-            }
+    virtual uint32_t read(uint32_t offset, uint8_t *buffer, uint32_t size) {
+        if (offset < _offset) {
+            rewind();
         }
-        // check if POST contains payload
-        if (argument) {
-            M2MResource::M2MExecuteParameter* param = (M2MResource::M2MExecuteParameter*)argument;
-            String object_name = param->get_argument_object_name();
-            uint16_t object_instance_id = param->get_argument_object_instance_id();
-            String resource_name = param->get_argument_resource_name();
-            int payload_length = param->get_argument_value_length();
-            uint8_t* payload = param->get_argument_value();
-            printf("Resource: %s/%d/%s executed\n", object_name.c_str(), object_instance_id, resource_name.c_str());
-            printf("Payload: %.*s [%d]\n", payload_length, payload, payload_length);
+        uint32_t copied = 0;
+        bool open = false;
+        TimeSeries::Iterator samples;
+        while (copied < size) {
+            if (_line_pos == _line_size && !next_line(samples, open)) {
+                break;
+            }
+            uint32_t n = _line_size - _line_pos;
+            if (_offset < offset) {
+                // Skipping to `offset`
+                if (n > offset - _offset) {
+                    n = offset - _offset;
+                }
+            } else {
+                if (n > size - copied) {
+                    n = size - copied;
+                }
+                memcpy(buffer + copied, _line + _line_pos, n);
+                copied += n;
+            }
+            _line_pos += n;
+            _offset += n;
         }
-        // do_blink is called with the vector, and starting at -1
-        blinky_thread.start(callback(this, &LedResource::do_blink));
+        return copied;
     }
 
 private:
-    M2MObject* led_object;
-    Thread blinky_thread;
-    BlinkArgs *blink_args;
-    void do_blink() {
-        for (;;) {
-            // blink the LED
-            red_led = !red_led;
-            // up the position, if we reached the end of the vector
-            if (blink_args->position >= blink_args->blink_pattern.size()) {
-                // send delayed response after blink is done
-                M2MObjectInstance* inst = led_object->object_instance();
-                M2MResource* led_res = inst->resource("5850");
-                led_res->send_delayed_post_response();
-                red_led = LED_OFF;
-                status_ticker.attach_us(blinky, 250000);
-                return;
+    void rewind() {
+        _offset = 0;
+        _source = 0;
+        _resource = 0;
+        _line_size = 0;
+        _line_pos = 0;
+        _started = false;
+        _after = 0;
+    }
+
+    bool next_line(TimeSeries::Iterator &samples, bool &open) {
+        while (_source < data_sources.size()) {
+            DataSource *ds = data_sources[_source];
+            if (_resource >= ds->declared()) {
+                _source++;
+                _resource = 0;
+                continue;
+            }
+            const TimeSeries *series = ds->history(ds->id(_resource));
+            if (series && !open) {
+                // Iterators do not survive appends, so each read starts anew
+                samples = series->samples_from(_after);
+                open = true;
+            }
+            TimeSeries::Sample sample;
+            while (series && samples.next(sample)) {
+                if (_started && sample.timestamp <= _after) {
+                    continue;
+                }
+                _started = true;
+                _after = sample.timestamp;
+                SampleValue value = series->encoding() == TimeSeries::INTEGER
+                    ? SampleValue::integer(sample.value.i, sample.timestamp)
+                    : SampleValue::real(sample.value.f, sample.timestamp);
+                int n = snprintf(_line, sizeof(_line), "%s/%s,%" PRIu32 ",", ds->name(), ds->id(_resource), sample.timestamp);
+                n += format_value(value, _line + n);
+                _line[n++] = '\n';
+                _line_size = n;
+                _line_pos = 0;
+                return true;
             }
-            // Wait requested time, then continue prosessing the blink pattern from next position.
-            Thread::wait(blink_args->blink_pattern.at(blink_args->position));
-            blink_args->position++;
+            _resource++;
+            _started = false;
+            _after = 0;
+            open = false;
         }
+        return false;
     }
+
+    std::vector<DataSource*> data_sources;
+    uint32_t _offset;           // of the next byte to be read
+    size_t   _source;
+    uint8_t  _resource;
+    bool     _started;          // a sample of the resource was returned
+    uint32_t _after;            // timestamp of that sample
+    char     _line[2 * DATA_SOURCE_ID_SIZE + 13 + SAMPLE_TEXT_SIZE];
+    uint8_t  _line_size;
+    uint8_t  _line_pos;
 };
 
 /*
- * The button contains one property (click count).
- * When `handle_button_click` is executed, the counter updates.
+ * Publishes the timing of the scheduler's tasks in scheduler/0/stats, one
+ * line per task after an overall line:
+ *
+ *   idle=97% elapsed=120000ms
+ *   3313 runs=120 late_avg=41us late_max=912us busy_max=1830us overruns=0
  */
-class ButtonResource: public DataSource {
+class SchedulerResource {
 public:
-    ButtonResource(): DataSource("3200"), counter(0) {
-        // create ObjectID with metadata tag of '3200', which is 'digital input'
-        btn_object = M2MInterfaceFactory::create_object("3200");
-        M2MObjectInstance* btn_inst = btn_object->create_object_instance();
-        // create resource with ID '5501', which is digital input counter
-        M2MResource* btn_res = btn_inst->create_dynamic_resource("5501", "Button",
-            M2MResourceInstance::INTEGER, true /* observable */);
-        // we can read this value
-        btn_res->set_operation(M2MBase::GET_ALLOWED);
-        // set initial value (all values in mbed Client are buffers)
-        // to be able to read this data easily in the Connector console, we'll use a string
-        btn_res->set_value((uint8_t*)"0", 1);
-
-        set_data_description("5501", "Button");
-    }
-
-    ~ButtonResource() {
+    SchedulerResource(const Scheduler &scheduler) : _scheduler(scheduler) {
+        scheduler_object = M2MInterfaceFactory::create_object("scheduler");
+        M2MObjectInstance* scheduler_inst = scheduler_object->create_object_instance();
+        stats_resource = scheduler_inst->create_dynamic_resource("stats", "SchedulerStats",
+            M2MResourceInstance::STRING, false);
+        stats_resource->set_operation(M2MBase::GET_ALLOWED);
+        stats_resource->clear_value();
     }
 
     M2MObject* get_object() {
-        return btn_object;
+        return scheduler_object;
     }
 
-    virtual void read_data() {
-        char buffer[20];
-        sprintf(buffer, "%d", counter);
-        record_data("5501", buffer);
-    }
-
-    /*
-     * When you press the button, we read the current value of the click counter
-     * from mbed Device Connector, then up the value with one.
-     */
-    void handle_button_inc() {
-        counter++;
-        handle_button_click();
-    }
-    void handle_button_dec() {
-        counter--;
-        handle_button_click();
+    // Scheduler entry point
+    static void update(void *resource) {
+        ((SchedulerResource*)resource)->update_stats();
     }
 
 private:
-    void handle_button_click() {
-    #ifdef TARGET_K64F
-        printf("handle_button_click, new value of counter is %d\n", counter);
-    #else
-        printf("simulate button_click, new value of counter is %d\n", counter);
-    #endif
-        if (mbed_client.register_successful()) {
-            M2MObjectInstance* inst = btn_object->object_instance();
-            M2MResource* res = inst->resource("5501");
-
-            // serialize the value of counter as a string, and tell connector
-            char buffer[20];
-            int size = sprintf(buffer, "%d", counter);
-            res->set_value((uint8_t*)buffer, size);
-        } else {
-            printf("simulate button_click, device not registered\n");
+    void update_stats() {
+        PayloadWriter out(buffer, sizeof(buffer));
+        out.put("idle=");
+        out.put_uint(_scheduler.idle_percent());
+        out.put("% elapsed=");
+        out.put_uint((uint32_t)(_scheduler.stats().elapsed_us / 1000));
+        out.put("ms\n");
+        for (uint16_t i = 0; i < _scheduler.size(); i++) {
+            const Scheduler::TaskStats &t = _scheduler.task_stats(i);
+            out.put(_scheduler.task_name(i));
+            out.put(" runs=");
+            out.put_uint(t.runs);
+            out.put(" late_avg=");
+            out.put_uint(t.runs ? (uint32_t)(t.late_total_us / t.runs) : 0);
+            out.put("us late_max=");
+            out.put_uint(t.late_max_us);
+            out.put("us busy_max=");
+            out.put_uint(t.busy_max_us);
+            out.put("us overruns=");
+            out.put_uint(t.overruns);
+            out.put('\n');
         }
+        size_t len = out.size() < sizeof(buffer) ? out.size() : sizeof(buffer);
+        stats_resource->set_value(buffer, len);
     }
 
-    M2MObject* btn_object;
-    uint16_t counter;
+    const Scheduler &_scheduler;
+    M2MObject* scheduler_object;
+    M2MResource* stats_resource;
+    uint8_t buffer[64 + SCHEDULER_MAX_TASKS * 96];
 };
 
-class BigPayloadResource {
+// Size of the on-demand dump of diag/0/dump
+#ifndef DIAGNOSTICS_DUMP_SIZE
+#define DIAGNOSTICS_DUMP_SIZE 1024
+#endif
+
+/*
+ * Publishes heap and stack use in diag/0/stats, kept up to date by the
+ * scheduler from counters that are always on:
+ *
+ *   heap current=23816 peak=31022 blocks=212 failed=0
+ *   datasources current=5120 peak=5120
+ *   aggregator current=1024 peak=1024
+ *   coap current=96 peak=544
+ *   tls current=0 peak=0
+ *   update_all calls=40 last=312 max=1180 held=0
+ *   transient blocks=0/8 peak=2 exhausted=0 fallbacks=0
+ *   registration lifetime=3600 next=1412 updates=3 piggybacked=2 failed=0
+ *   connection state=online retry=0 disconnects=1 attempts=3 reconnects=1 offline=42 longest=42
+ *   stack main=2816/8192 event=1904/6144
+ *
+ * Reading diag/0/dump takes a detailed snapshot there and then: every
+ * subsystem's allocations, update_all() averages and the stack of every
+ * thread the RTOS has.
+ */
+class DiagnosticsResource {
 public:
-    BigPayloadResource() {
-        big_payload = M2MInterfaceFactory::create_object("1000");
-        M2MObjectInstance* payload_inst = big_payload->create_object_instance();
-        M2MResource* payload_res = payload_inst->create_dynamic_resource("1", "BigData",
-            M2MResourceInstance::STRING, true /* observable */);
-        payload_res->set_operation(M2MBase::GET_PUT_ALLOWED);
-        payload_res->set_value((uint8_t*)"0", 1);
-        payload_res->set_incoming_block_message_callback(
-                    incoming_block_message_callback(this, &BigPayloadResource::block_message_received));
-        payload_res->set_outgoing_block_message_callback(
-                    outgoing_block_message_callback(this, &BigPayloadResource::block_message_requested));
+    DiagnosticsResource(MbedClient &client, osThreadId main_thread) : _client(client), _main_thread(main_thread) {
+        diag_object = M2MInterfaceFactory::create_object("diag");
+        M2MObjectInstance* diag_inst = diag_object->create_object_instance();
+        stats_resource = diag_inst->create_dynamic_resource("stats", "DiagnosticsStats",
+            M2MResourceInstance::STRING, false);
+        stats_resource->set_operation(M2MBase::GET_ALLOWED);
+        stats_resource->clear_value();
+        M2MResource* dump_resource = diag_inst->create_dynamic_resource("dump", "DiagnosticsDump",
+            M2MResourceInstance::STRING, false);
+        dump_resource->set_operation(M2MBase::GET_ALLOWED);
+        dump_resource->set_outgoing_block_message_callback(
+            outgoing_block_message_callback(this, &DiagnosticsResource::dump_requested));
     }
 
     M2MObject* get_object() {
-        return big_payload;
+        return diag_object;
     }
 
-    void block_message_received(M2MBlockMessage *argument) {
-        if (argument) {
-            if (M2MBlockMessage::ErrorNone == argument->error_code()) {
-                if (argument->is_last_block()) {
-                    printf("Last block received\n");
-                }
-                printf("Block number: %d\n", argument->block_number());
-                // First block received
-                if (argument->block_number() == 0) {
-                    // Store block
-                // More blocks coming
+    // Scheduler entry point
+    static void update(void *resource) {
+        ((DiagnosticsResource*)resource)->update_stats();
+    }
+
+private:
+    void update_stats() {
+        PayloadWriter out(buffer, sizeof(buffer));
+        write(out, false);
+        size_t len = out.size() < sizeof(buffer) ? out.size() : sizeof(buffer);
+        stats_resource->set_value(buffer, len);
+    }
+
+    // mbed Client sends `data` and frees it afterwards
+    void dump_requested(const String& /*resource*/, uint8_t *&data, uint32_t &len) {
+        data = (uint8_t*)malloc(DIAGNOSTICS_DUMP_SIZE);
+        len = 0;
+        if (data) {
+            PayloadWriter out(data, DIAGNOSTICS_DUMP_SIZE);
+            write(out, true);
+            len = out.size() < DIAGNOSTICS_DUMP_SIZE ? out.size() : DIAGNOSTICS_DUMP_SIZE;
+        }
+    }
+
+    void write(PayloadWriter &out, bool detailed) {
+        mbed_stats_heap_t heap;
+        MemStats::heap(heap);
+        out.put("heap current=");
+        out.put_uint(heap.current_size);
+        out.put(" peak=");
+        out.put_uint(heap.max_size);
+        if (detailed) {
+            out.put(" allocated=");
+            out.put_uint(heap.total_size);
+        }
+        out.put(" blocks=");
+        out.put_uint(heap.alloc_cnt);
+        out.put(" failed=");
+        out.put_uint(heap.alloc_fail_cnt);
+        out.put('\n');
+
+        MemStats &stats = MemStats::instance();
+        for (int s = 0; s < MEM_SUBSYSTEMS; s++) {
+            MemStats::Usage u = stats.usage((MemSubsystem)s);
+            out.put(MemStats::name((MemSubsystem)s));
+            out.put(" current=");
+            out.put_int(u.current);
+            out.put(" peak=");
+            out.put_int(u.peak);
+            if (detailed) {
+                out.put(" allocated=");
+                out.put_uint(u.allocated);
+                out.put(" blocks=");
+                out.put_int(u.blocks);
+                out.put(" calls=");
+                out.put_uint(u.calls);
+            }
+            out.put('\n');
+        }
+
+        MemStats::Updates updates = stats.updates();
+        out.put("update_all calls=");
+        out.put_uint(updates.count);
+        out.put(" last=");
+        out.put_uint(updates.last_bytes);
+        out.put(" max=");
+        out.put_uint(updates.max_bytes);
+        if (detailed) {
+            out.put(" avg=");
+            out.put_uint(updates.count ? updates.total_bytes / updates.count : 0);
+        }
+        out.put(" held=");
+        out.put_int(updates.last_blocks);
+        out.put('\n');
+
+        // the pool of arenas, and the request arena's trips to the heap
+        BlockPool::Stats pool = transient_pool.stats();
+        out.put("transient blocks=");
+        out.put_uint(pool.in_use);
+        out.put('/');
+        out.put_uint(pool.blocks);
+        out.put(" peak=");
+        out.put_uint(pool.peak);
+        out.put(" exhausted=");
+        out.put_uint(pool.exhausted);
+        out.put(" fallbacks=");
+        out.put_uint(request_arena.stats().fallbacks);
+        out.put('\n');
+
+        RegistrationSchedule::Stats registration = _client.registration_stats();
+        out.put("registration lifetime=");
+        out.put_uint(_client.registration_lifetime());
+        out.put(" next=");
+        out.put_uint(_client.registration_update_in_ms() / 1000);
+        out.put(" updates=");
+        out.put_uint(registration.updates);
+        out.put(" piggybacked=");
+        out.put_uint(registration.piggybacked);
+        out.put(" failed=");
+        out.put_uint(registration.failed);
+        out.put('\n');
+
+        static const char *states[] = { "idle", "connecting", "online", "waiting" };
+        ConnectionState::Stats connection = _client.connection_stats();
+        out.put("connection state=");
+        out.put(states[_client.connection_state()]);
+        out.put(" retry=");
+        out.put_uint(_client.reconnect_in_ms() / 1000);
+        out.put(" disconnects=");
+        out.put_uint(connection.disconnects);
+        out.put(" attempts=");
+        out.put_uint(connection.attempts);
+        out.put(" reconnects=");
+        out.put_uint(connection.reconnects);
+        out.put(" offline=");
+        out.put_uint(connection.offline_ms / 1000);
+        out.put(" longest=");
+        out.put_uint(connection.longest_offline_ms / 1000);
+        out.put('\n');
+
+        if (detailed) {
+            mbed_stats_stack_t stacks[MEM_STATS_MAX_STACKS];
+            size_t count = MemStats::stacks(stacks, MEM_STATS_MAX_STACKS);
+            for (size_t i = 0; i < count; i++) {
+                out.put("stack ");
+                if (stacks[i].thread_id == (uint32_t)(uintptr_t)_main_thread) {
+                    out.put("main");
+                } else if (stacks[i].thread_id == (uint32_t)(uintptr_t)_client.event_thread()) {
+                    out.put("event");
                 } else {
-                    // Store blocks
+                    out.put_uint(stacks[i].thread_id);
                 }
-            } else {
-                printf("Error when receiving block message!  - EntityTooLarge\n");
+                out.put(" used=");
+                out.put_uint(stacks[i].max_size);
+                out.put(" reserved=");
+                out.put_uint(stacks[i].reserved_size);
+                out.put('\n');
             }
-            printf("Total message size: %" PRIu32 "\n", argument->total_message_size());
+        } else {
+            out.put("stack");
+            put_stack(out, "main", _main_thread);
+            put_stack(out, "event", _client.event_thread());
+            out.put('\n');
         }
     }
 
-    void block_message_requested(const String& resource, uint8_t *&/*data*/, uint32_t &/*len*/) {
-        printf("GET request received for resource: %s\n", resource.c_str());
-        // Copy data and length to coap response
+    static void put_stack(PayloadWriter &out, const char *name, osThreadId thread) {
+        uint32_t used;
+        uint32_t reserved;
+        if (MemStats::stack(thread, used, reserved)) {
+            out.put(' ');
+            out.put(name);
+            out.put('=');
+            out.put_uint(used);
+            out.put('/');
+            out.put_uint(reserved);
+        }
     }
 
-private:
-    M2MObject*  big_payload;
+    MbedClient &_client;
+    osThreadId _main_thread;
+    M2MObject* diag_object;
+    M2MResource* stats_resource;
+    uint8_t buffer[544];
 };
 
-class AccelerometerResource: public DataSource {
+#if TRACE_ENABLED
+// Most bytes of records one drain of the trace takes
+#ifndef TRACE_DRAIN_SIZE
+#define TRACE_DRAIN_SIZE 1024
+#endif
+
+// How often the trace is also printed on the serial port, 0 for never
+#ifndef TRACE_SERIAL_PERIOD_MS
+#define TRACE_SERIAL_PERIOD_MS 0
+#endif
+
+/*
+ * Drains the hot-path trace, see trace.h. Each GET of trace/0/data takes
+ * up to TRACE_DRAIN_SIZE bytes of records out of the rings; read it again
+ * until only the 16-byte header comes back. If TRACE_SERIAL_PERIOD_MS is
+ * set, the scheduler also prints the records as lines of "TRACE <hex>".
+ * host/trace2json turns either into a Chrome or Perfetto trace.
+ */
+class TraceResource {
 public:
-    AccelerometerResource() : DataSource("3313"), _accel(PTE25, PTE24, FXOS8700CQ_SLAVE_ADDR1) {
-        // Configure the Accelerometer
-        //_accel.config_int();           // enabled interrupts from accelerometer
-        //_accel.config_feature();       // turn on motion detection
-        _accel.enable();               // enable accelerometer
-
-        // create ObjectID with metadata tag of '3313', which is 'accelerometer'
-        accel_object = M2MInterfaceFactory::create_object("3313");
-        M2MObjectInstance* accel_inst = accel_object->create_object_instance();
-
-        M2MResource* accel_x = accel_inst->create_dynamic_resource("5702", "AccelX",
-            M2MResourceInstance::INTEGER, true);
-        accel_x->set_operation(M2MBase::GET_ALLOWED);
-        accel_x->set_value(0);
-        set_data_description("5702", "AccelX");
-
-        M2MResource* accel_y = accel_inst->create_dynamic_resource("5703", "AccelY",
-            M2MResourceInstance::INTEGER, true);
-        accel_y->set_operation(M2MBase::GET_ALLOWED);
-        accel_y->set_value(0);
-        set_data_description("5703", "AccelY");
-
-        M2MResource* accel_z = accel_inst->create_dynamic_resource("5704", "AccelZ",
-            M2MResourceInstance::INTEGER, true);
-        accel_z->set_operation(M2MBase::GET_ALLOWED);
-        accel_z->set_value(0);
-        set_data_description("5704", "AccelZ");
+    TraceResource() {
+        trace_object = M2MInterfaceFactory::create_object("trace");
+        M2MObjectInstance* trace_inst = trace_object->create_object_instance();
+        M2MResource* data_resource = trace_inst->create_dynamic_resource("data", "TraceData",
+            M2MResourceInstance::OPAQUE, false);
+        data_resource->set_operation(M2MBase::GET_ALLOWED);
+        data_resource->set_outgoing_block_message_callback(
+            outgoing_block_message_callback(this, &TraceResource::data_requested));
     }
 
     M2MObject* get_object() {
-        return accel_object;
+        return trace_object;
     }
 
-    virtual void read_data() {
-        if (mbed_client.register_successful()) {
-            M2MObjectInstance* inst = accel_object->object_instance();
-            M2MResource* res;
-            int size;
-            char buffer[20];
-
-            SRAWDATA accel;
-            SRAWDATA mag;
-            _accel.get_data(&accel, &mag);
-
-            res = inst->resource("5702");
-            size = sprintf(buffer, "%d", accel.x);
-            res->set_value((uint8_t*)buffer, size);
-            record_data("5702", buffer);
-
-            res = inst->resource("5703");
-            size = sprintf(buffer, "%d", accel.y);
-            res->set_value((uint8_t*)buffer, size);
-            record_data("5703", buffer);
-
-            res = inst->resource("5704");
-            size = sprintf(buffer, "%d", accel.z);
-            res->set_value((uint8_t*)buffer, size);
-            record_data("5704", buffer);
-
-            //printf("Updated accel to %d,%d,%d\n", accel.x, accel.y, accel.z);
-        }
+    // Scheduler entry point
+    static void print(void *resource) {
+        ((TraceResource*)resource)->print_records();
     }
 
 private:
-    // Configured for the FRDM-K64F with onboard sensors
-    //InterruptIn _accel_int_pin(PTC13);
-    FXOS8700CQ _accel;
-    M2MObject* accel_object;
-};
-
-class AnalogInResource: public DataSource {
-public:
-    AnalogInResource(PinName pin, const std::string &resource_id="3203", const std::string &name="AnalogIn") : DataSource(resource_id), _analog_in(pin) {
-        analog_object = M2MInterfaceFactory::create_object(resource_id.c_str());
-        M2MObjectInstance* analog_inst = analog_object->create_object_instance();
-
-        M2MResource* analog_resource = analog_inst->create_dynamic_resource("5600", name.c_str(),
-            M2MResourceInstance::FLOAT, true);
-        analog_resource->set_operation(M2MBase::GET_ALLOWED);
-        analog_resource->set_value(0.0f);
-        set_data_description("5600", name);
-    }
-
-    M2MObject* get_object() {
-        return analog_object;
+    // mbed Client sends `data` and frees it afterwards
+    void data_requested(const String& /*resource*/, uint8_t *&data, uint32_t &len) {
+        data = (uint8_t*)malloc(TRACE_DRAIN_SIZE);
+        len = data ? Trace::instance().drain(data, TRACE_DRAIN_SIZE) : 0;
     }
 
-    void read_data() {
-        if (mbed_client.register_successful()) {
-            char buffer[20];
-            M2MObjectInstance* inst = analog_object->object_instance();
-            M2MResource* res = inst->resource("5600");
-            int size = sprintf(buffer, "%.3f", (float)_analog_in);
-            res->set_value((uint8_t*)buffer, size);
-            record_data("5600", buffer);
+    // A few drains at most, so that a busy trace cannot hold up the tasks
+    void print_records() {
+        for (int i = 0; i < TRACE_MAX_THREADS + 1; i++) {
+            size_t len = Trace::instance().drain(buffer, sizeof(buffer));
+            if (len <= TRACE_HEADER_SIZE) {
+                break;
+            }
+            // a line at a time, so that other threads' output goes between
+            // lines rather than into them
+            for (size_t line = 0; line < len; line += 32) {
+                char hex[2 * 32 + 1];
+                char *p = hex;
+                for (size_t n = line; n < len && n < line + 32; n++, p += 2) {
+                    sprintf(p, "%02x", buffer[n]);
+                }
+                printf("TRACE %s\n", hex);
+            }
         }
     }
 
-private:
-    AnalogIn _analog_in;
-    M2MObject* analog_object;
+    M2MObject* trace_object;
+    uint8_t buffer[TRACE_DRAIN_SIZE];
 };
+#endif
+
+// How often the aggregator publishes, the registration update is checked
+// for and the scheduler and diagnostics statistics are refreshed
+#ifndef ALLDATA_PERIOD_MS
+#define ALLDATA_PERIOD_MS 3000
+#endif
+#ifndef REGISTRATION_CHECK_PERIOD_MS
+#define REGISTRATION_CHECK_PERIOD_MS 5000
+#endif
+#ifndef SCHEDULER_STATS_PERIOD_MS
+#define SCHEDULER_STATS_PERIOD_MS 10000
+#endif
+#ifndef DIAGNOSTICS_PERIOD_MS
+#define DIAGNOSTICS_PERIOD_MS 10000
+#endif
 
 // Network interaction must be performed outside of interrupt context
 Semaphore updates(0);
 volatile bool registered = false;
 volatile bool clicked_inc = false;
 volatile bool clicked_dec = false;
+volatile bool accel_fifo_full = false;
 osThreadId mainThread;
 
 void unregister() {
@@ -558,6 +2274,22 @@ void unregister() {
     updates.release();
 }
 
+void publish_all_data(void *aggregator) {
+    ((DataAggregator*)aggregator)->update_all();
+}
+
+void replay_backlog(void *aggregator) {
+    ((DataAggregator*)aggregator)->replay(*sample_log);
+}
+
+// Sends the registration update once it is due, see registration.h
+void maintain_registration(void *client) {
+    MemScope coap(MEM_COAP);
+    if (((MbedClient*)client)->maintain_registration()) {
+        printf("Updating registration\n");
+    }
+}
+
 void button_inc_clicked() {
     clicked_inc = true;
     updates.release();
@@ -568,6 +2300,15 @@ void button_dec_clicked() {
     updates.release();
 }
 
+void accel_fifo_watermark() {
+    accel_fifo_full = true;
+    updates.release();
+}
+
+void executor_job_started() {
+    updates.release();
+}
+
 // Entry point to the program
 int main() {
 
@@ -593,11 +2334,16 @@ Add MBEDTLS_NO_DEFAULT_ENTROPY_SOURCES and MBEDTLS_TEST_NULL_ENTROPY in mbed_app
 #endif
 
     srand(seed);
+#if defined(MBEDTLS_PLATFORM_MEMORY)
+    // Count mbed TLS's allocations on their own, see mem_stats.h
+    mbedtls_platform_set_calloc_free(MemStats::tls_calloc, MemStats::tls_free);
+#endif
     red_led = LED_OFF;
     green_led = LED_OFF;
     blue_led = LED_OFF;
 
     status_ticker.attach_us(blinky, 250000);
+    uptime.start();
     // Keep track of the main thread
     mainThread = osThreadGetId();
 
@@ -616,16 +2362,64 @@ Add MBEDTLS_NO_DEFAULT_ENTROPY_SOURCES and MBEDTLS_TEST_NULL_ENTROPY in mbed_app
         return -1;
     }
 
+#if DEVICE_FLASH
+    // Recover samples logged before the last reboot or disconnect
+    FlashIAPLogStorage log_storage;
+    SampleLog sample_store(log_storage);
+    Timer mount_time;
+    mount_time.start();
+    if (sample_store.mount() == 0) {
+        printf("Sample log mounted in %d ms, %" PRIu32 " segments, %" PRIu32 " reads, %" PRIu32 " torn chunks\n",
+               mount_time.read_ms(), sample_store.stats().segments, sample_store.stats().recovery_reads, sample_store.stats().torn_chunks);
+        sample_log = &sample_store;
+    } else {
+        printf("Sample log disabled: %" PRIu32 " bytes of flash at 0x%08" PRIx32 " hold fewer than %" PRIu32 " sectors\n",
+               log_storage.size(), log_storage.start(), SampleLog::MIN_SEGMENTS);
+    }
+
+    // Payloads PUT to the big payload resource go to the sectors below
+    // the log, unless those reach into the application
+    FlashIAPLogStorage upload_storage(BIG_PAYLOAD_STORAGE_SIZE, &log_storage);
+    StorageSink upload_sink(upload_storage);
+    ChunkSink *big_payload_sink = &upload_sink;
+    if (!upload_storage.ok()) {
+        printf("Uploads disabled: %d bytes of flash below 0x%08" PRIx32 " overlap the application or span unequal sectors\n",
+               BIG_PAYLOAD_STORAGE_SIZE, upload_storage.start());
+        big_payload_sink = NULL;
+    }
+#else
+    ChunkSink *big_payload_sink = NULL;
+#endif
+
     // we create our button and LED resources
-    ButtonResource button_resource;
-    LedResource led_resource;
-    BigPayloadResource big_payload_resource;
+    Executor executor(uptime_us, executor_job_started);
+    ButtonResource button_resource(&executor);
+    LedResource led_resource(executor);
+    HistoryExport history_export;
+    BigPayloadResource big_payload_resource(history_export, big_payload_sink);
     AccelerometerResource accel_resource;
-    AnalogInResource sound_level_resource(A0, "3324", "SoundLevel");
-    AnalogInResource temperature_resource(A1, "3303", "Temperature");
-    AnalogInResource luminosity_resource(A2, "3301", "Light");
-    AnalogInResource distance_resource(A3, "3330", "Distance");
+    AnalogInResource sound_level_resource(A0, SOUND_LEVEL_SCHEMA);
+    AnalogInResource temperature_resource(A1, TEMPERATURE_SCHEMA);
+    AnalogInResource luminosity_resource(A2, LIGHT_SCHEMA);
+    AnalogInResource distance_resource(A3, DISTANCE_SCHEMA);
+    AnalogSampler analog_sampler;
     DataAggregator all_data;
+    HistoryResource history_resource;
+    Scheduler scheduler(uptime_us);
+    SchedulerResource scheduler_resource(scheduler);
+    DiagnosticsResource diagnostics_resource(mbed_client, mainThread);
+#if TRACE_ENABLED
+    TraceResource trace_resource;
+#endif
+
+    // Spread the sources over time rather than reading them all at once.
+    // The analog inputs are read together; temperature changes slowly, so
+    // it is smoothed over several periods as well.
+    accel_resource.set_period(ACCEL_PERIOD_MS, 100);
+    analog_sampler.add(&sound_level_resource);
+    analog_sampler.add(&temperature_resource, TEMPERATURE_EMA_SHIFT);
+    analog_sampler.add(&luminosity_resource);
+    analog_sampler.add(&distance_resource);
 
     all_data.add_data_source(&button_resource);
     all_data.add_data_source(&accel_resource);
@@ -633,6 +2427,35 @@ Add MBEDTLS_NO_DEFAULT_ENTROPY_SOURCES and MBEDTLS_TEST_NULL_ENTROPY in mbed_app
     all_data.add_data_source(&temperature_resource);
     all_data.add_data_source(&luminosity_resource);
     all_data.add_data_source(&distance_resource);
+    history_resource.add_data_source(&button_resource);
+    history_resource.add_data_source(&accel_resource);
+    history_resource.add_data_source(&sound_level_resource);
+    history_resource.add_data_source(&temperature_resource);
+    history_resource.add_data_source(&luminosity_resource);
+    history_resource.add_data_source(&distance_resource);
+    history_export.add_data_source(&button_resource);
+    history_export.add_data_source(&accel_resource);
+    history_export.add_data_source(&sound_level_resource);
+    history_export.add_data_source(&temperature_resource);
+    history_export.add_data_source(&luminosity_resource);
+    history_export.add_data_source(&distance_resource);
+
+    DataSource *sources[] = { &button_resource, &accel_resource };
+    const char *source_names[] = { "3200", "3313" };
+    for (size_t i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        scheduler.add(source_names[i], DataSource::sample, sources[i], sources[i]->period_ms(), sources[i]->phase_ms());
+    }
+    scheduler.add("analog", AnalogSampler::sample, &analog_sampler, ANALOG_IN_PERIOD_MS, 200);
+    scheduler.add("alldata", publish_all_data, &all_data, ALLDATA_PERIOD_MS, ALLDATA_PERIOD_MS);
+    scheduler.add("register", maintain_registration, &mbed_client, REGISTRATION_CHECK_PERIOD_MS, REGISTRATION_CHECK_PERIOD_MS);
+    scheduler.add("stats", SchedulerResource::update, &scheduler_resource, SCHEDULER_STATS_PERIOD_MS, SCHEDULER_STATS_PERIOD_MS);
+    scheduler.add("diag", DiagnosticsResource::update, &diagnostics_resource, DIAGNOSTICS_PERIOD_MS, DIAGNOSTICS_PERIOD_MS);
+#if TRACE_ENABLED && TRACE_SERIAL_PERIOD_MS
+    scheduler.add("trace", TraceResource::print, &trace_resource, TRACE_SERIAL_PERIOD_MS, TRACE_SERIAL_PERIOD_MS);
+#endif
+    if (sample_log) {
+        scheduler.add("backlog", replay_backlog, &all_data, REPLAY_INTERVAL_MS, REPLAY_INTERVAL_MS);
+    }
 
 #ifdef TARGET_K64F
     // On press of SW3 button on K64F board, example application
@@ -642,6 +2465,9 @@ Add MBEDTLS_NO_DEFAULT_ENTROPY_SOURCES and MBEDTLS_TEST_NULL_ENTROPY in mbed_app
 
     // Observation Button (SW2) press will send update of endpoint resource values to connector
     inc_button.fall(&button_inc_clicked);
+
+    // Drain the accelerometer's FIFO whenever it reaches its watermark
+    accel_int.fall(&accel_fifo_watermark);
 #else
     // Send update of endpoint resource values to connector every 15 seconds periodically
     timer.attach(&button_inc_clicked, 15.0);
@@ -661,35 +2487,43 @@ Add MBEDTLS_NO_DEFAULT_ENTROPY_SOURCES and MBEDTLS_TEST_NULL_ENTROPY in mbed_app
     object_list.push_back(device_object);
     object_list.push_back(button_resource.get_object());
     object_list.push_back(led_resource.get_object());
-//    object_list.push_back(big_payload_resource.get_object());
+    object_list.push_back(big_payload_resource.get_object());
     object_list.push_back(accel_resource.get_object());
     object_list.push_back(sound_level_resource.get_object());
     object_list.push_back(temperature_resource.get_object());
     object_list.push_back(luminosity_resource.get_object());
     object_list.push_back(distance_resource.get_object());
     object_list.push_back(all_data.get_object());
+    object_list.push_back(history_resource.get_object());
+    object_list.push_back(scheduler_resource.get_object());
+    object_list.push_back(diagnostics_resource.get_object());
+#if TRACE_ENABLED
+    object_list.push_back(trace_resource.get_object());
+#endif
 
     // Set endpoint registration object
     mbed_client.set_register_object(register_object);
 
     // Register with mbed Device Connector
-    mbed_client.test_register(register_object, object_list);
+    {
+        MemScope coap(MEM_COAP);
+        mbed_client.test_register(register_object, object_list);
+    }
     registered = true;
 
-    int stepcount = 0;
-    const int update_interval = 3;
     while (true) {
-        updates.wait(1000);
-        stepcount++;
-        if (registered) {
-            if (stepcount % 25 == 0) {
-                printf("Updating registration (stepcount %d)\n", stepcount);
-                mbed_client.test_update_register();
-                printf("Registration updated\n");
-            }
-        } else {
+        // Sleep until the next task or step is due, a button is clicked,
+        // the accelerometer has samples waiting or a job is started
+        uint32_t next_task_ms = scheduler.run();
+        uint32_t next_step_ms = executor.run();
+        updates.wait(next_step_ms < next_task_ms ? next_step_ms : next_task_ms);
+        if (!registered) {
             break;
         }
+        if (accel_fifo_full) {
+            accel_fifo_full = false;
+            accel_resource.drain();
+        }
         active_led = ACTIVE_GREEN;
         if (clicked_inc) {
             clicked_inc = false;
@@ -701,12 +2535,9 @@ Add MBEDTLS_NO_DEFAULT_ENTROPY_SOURCES and MBEDTLS_TEST_NULL_ENTROPY in mbed_app
             active_led = ACTIVE_RED;
             button_resource.handle_button_dec();
         }
-
-        if (stepcount % update_interval == 0) {
-            all_data.update_all();
-        }
     }
 
     mbed_client.test_unregister();
     status_ticker.detach();
+    return 0;
 }
@@ -39,6 +39,11 @@
 // Suitable values: 0, 16, 32, 64, 128, 256, 512 and 1024
 #define SN_COAP_MAX_BLOCKWISE_PAYLOAD_SIZE  1024
 
+// Defines the largest block-wise message the client accepts. Block-wise
+// PUTs to the big payload resource are stored block by block, so this
+// only needs to match the flash kept for them.
+#define SN_COAP_MAX_INCOMING_BLOCK_MESSAGE_SIZE  (256 * 1024)
+
 // Many pure LWM2M servers doen't accept 'obs' text in registration message.
 // While using Client against such servers, this flag can be set to define to
 // disable client sending 'obs' text for observable resources.
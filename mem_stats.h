@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MEM_STATS_H__
+#define __MEM_STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mbed.h"
+
+// Threads that can have scopes open at the same time and still have
+// them nest; scopes on further threads are counted as outermost
+#ifndef MEM_STATS_MAX_THREADS
+#define MEM_STATS_MAX_THREADS 8
+#endif
+
+// Most threads whose stacks are looked through for one of them
+#ifndef MEM_STATS_MAX_STACKS
+#define MEM_STATS_MAX_STACKS 12
+#endif
+
+enum MemSubsystem {
+    MEM_DATA_SOURCES,   // sampling, and the sources' history and rollups
+    MEM_AGGREGATOR,     // alldata payloads and sample log replays
+    MEM_COAP,           // the application's calls into mbed Client
+    MEM_TLS,            // mbed TLS, through its own allocator hooks
+    MEM_SUBSYSTEMS
+};
+
+class MemScope;
+
+/*
+* Heap use per subsystem, on top of the heap statistics mbed OS keeps for
+* the heap as a whole when MBED_HEAP_STATS_ENABLED is set.
+*
+* A MemScope around a subsystem's code charges the subsystem with what the
+* heap gained meanwhile, less what scopes nested in it were charged with.
+* Allocations other threads make while a scope is open are charged to it
+* too, so the figures are exact for code that runs while the rest of the
+* application waits, as the scheduler's tasks do, and an upper bound
+* otherwise. mbed TLS allocates through tls_calloc() and tls_free(), when
+* it is built with MBEDTLS_PLATFORM_MEMORY, and is counted exactly; what
+* it allocates is taken out of any scope open on the same thread.
+*
+* Without heap statistics every figure reads zero and scopes cost two
+* calls that return straight away.
+*/
+class MemStats {
+public:
+    struct Usage {
+        int32_t  current;       // bytes held, net of what was freed
+        int32_t  peak;          // most bytes held when a scope closed
+        uint32_t allocated;     // bytes allocated
+        int32_t  blocks;        // blocks held
+        uint32_t calls;         // scopes closed, or allocations for TLS
+    };
+
+    // Heap traffic of DataAggregator::update_all(), nested scopes included
+    struct Updates {
+        uint32_t count;
+        uint32_t last_bytes;    // bytes allocated by the last call
+        uint32_t max_bytes;
+        uint32_t total_bytes;
+        int32_t  last_blocks;   // blocks the last call held on to
+    };
+
+    static MemStats &instance() {
+        static MemStats stats;
+        return stats;
+    }
+
+    static const char *name(MemSubsystem subsystem) {
+        static const char *names[MEM_SUBSYSTEMS] = { "datasources", "aggregator", "coap", "tls" };
+        return names[subsystem];
+    }
+
+    // The heap as a whole; false and zeros without heap statistics
+    static bool heap(mbed_stats_heap_t &stats) {
+#if defined(MBED_HEAP_STATS_ENABLED) && MBED_HEAP_STATS_ENABLED
+        mbed_stats_heap_get(&stats);
+        return true;
+#else
+        memset(&stats, 0, sizeof(stats));
+        return false;
+#endif
+    }
+
+    /*
+    * Fills `stacks` with the stack high-water marks of up to `count`
+    * threads and returns how many it filled, none without stack
+    * statistics.
+    */
+    static size_t stacks(mbed_stats_stack_t *stacks, size_t count) {
+#if defined(MBED_STACK_STATS_ENABLED) && MBED_STACK_STATS_ENABLED
+        return mbed_stats_stack_get_each(stacks, count);
+#else
+        (void)stacks;
+        (void)count;
+        return 0;
+#endif
+    }
+
+    // The most stack `thread` has used so far, and the size of its stack
+    static bool stack(osThreadId thread, uint32_t &used, uint32_t &reserved) {
+        mbed_stats_stack_t each[MEM_STATS_MAX_STACKS];
+        size_t count = stacks(each, MEM_STATS_MAX_STACKS);
+        for (size_t i = 0; i < count; i++) {
+            if (thread && each[i].thread_id == (uint32_t)(uintptr_t)thread) {
+                used = each[i].max_size;
+                reserved = each[i].reserved_size;
+                return true;
+            }
+        }
+        used = reserved = 0;
+        return false;
+    }
+
+    Usage usage(MemSubsystem subsystem) const {
+        core_util_critical_section_enter();
+        Usage u = _usage[subsystem];
+        core_util_critical_section_exit();
+        return u;
+    }
+
+    Updates updates() const {
+        core_util_critical_section_enter();
+        Updates u = _updates;
+        core_util_critical_section_exit();
+        return u;
+    }
+
+    // Records a call of DataAggregator::update_all() from its scope
+    inline void record_update(const MemScope &scope);
+
+    /*
+    * mbed TLS's calloc() and free(), see mbedtls_platform_set_calloc_free().
+    * Each block carries its size in front of it.
+    */
+    static void *tls_calloc(size_t count, size_t size) {
+        if (size && count > ((size_t)-1 - sizeof(Header)) / size) {
+            return NULL;
+        }
+        size_t bytes = sizeof(Header) + count * size;
+        Header *header = (Header*)calloc(1, bytes);
+        if (!header) {
+            return NULL;
+        }
+        header->size = bytes;
+        instance().charge_tls((int32_t)bytes, 1);
+        return header + 1;
+    }
+
+    static void tls_free(void *ptr) {
+        if (!ptr) {
+            return;
+        }
+        Header *header = (Header*)ptr - 1;
+        instance().charge_tls(-(int32_t)header->size, -1);
+        free(header);
+    }
+
+private:
+    friend class MemScope;
+
+    union Header {
+        size_t size;
+        double align;
+    };
+
+    struct Thread {
+        osThreadId id;
+        MemScope  *innermost;   // NULL when no scope is open on it
+    };
+
+    MemStats() {
+        memset(_usage, 0, sizeof(_usage));
+        memset(&_updates, 0, sizeof(_updates));
+        memset(_threads, 0, sizeof(_threads));
+    }
+
+    // The calling thread's slot, or NULL if every slot is in use
+    Thread *thread() {
+        osThreadId id = osThreadGetId();
+        Thread *free_slot = NULL;
+        for (int i = 0; i < MEM_STATS_MAX_THREADS; i++) {
+            if (_threads[i].id == id) {
+                return &_threads[i];
+            }
+            if (!free_slot && !_threads[i].innermost) {
+                free_slot = &_threads[i];
+            }
+        }
+        if (free_slot) {
+            free_slot->id = id;
+        }
+        return free_slot;
+    }
+
+    static void add(Usage &u, int32_t bytes, uint32_t allocated, int32_t blocks) {
+        u.current += bytes;
+        if (u.current > u.peak) {
+            u.peak = u.current;
+        }
+        u.allocated += allocated;
+        u.blocks += blocks;
+        u.calls++;
+    }
+
+    inline void charge_tls(int32_t bytes, int32_t blocks);
+    inline void open(MemScope *scope);
+    inline void close(MemScope *scope, const mbed_stats_heap_t &end);
+
+    Usage   _usage[MEM_SUBSYSTEMS];
+    Updates _updates;
+    Thread  _threads[MEM_STATS_MAX_THREADS];
+};
+
+/*
+* Charges `subsystem` with the heap its code gains from construction to
+* destruction. Scopes nest per thread: an inner scope's allocations are
+* charged to it alone. Not for interrupt handlers, as reading the heap
+* statistics takes a mutex on the board.
+*/
+class MemScope {
+public:
+    explicit MemScope(MemSubsystem subsystem)
+        : _subsystem(subsystem), _outer(NULL), _thread(NULL), _inner_bytes(0), _inner_allocated(0), _inner_blocks(0) {
+        MemStats::heap(_start);
+        MemStats::instance().open(this);
+    }
+
+    ~MemScope() {
+        mbed_stats_heap_t end;
+        MemStats::heap(end);
+        MemStats::instance().close(this, end);
+    }
+
+    // Bytes allocated since the scope opened, by it and scopes nested in it
+    uint32_t allocated() const {
+        mbed_stats_heap_t now;
+        MemStats::heap(now);
+        return now.total_size - _start.total_size;
+    }
+
+    // Blocks allocated and not freed since the scope opened
+    int32_t blocks() const {
+        mbed_stats_heap_t now;
+        MemStats::heap(now);
+        return (int32_t)(now.alloc_cnt - _start.alloc_cnt);
+    }
+
+private:
+    friend class MemStats;
+
+    MemScope(const MemScope&);
+    MemScope& operator=(const MemScope&);
+
+    MemSubsystem      _subsystem;
+    MemScope         *_outer;
+    MemStats::Thread *_thread;
+    mbed_stats_heap_t _start;
+    int32_t           _inner_bytes;     // charged to nested scopes
+    uint32_t          _inner_allocated;
+    int32_t           _inner_blocks;
+};
+
+void MemStats::open(MemScope *scope) {
+    core_util_critical_section_enter();
+    Thread *t = thread();
+    if (t) {
+        scope->_thread = t;
+        scope->_outer = t->innermost;
+        t->innermost = scope;
+    }
+    core_util_critical_section_exit();
+}
+
+void MemStats::close(MemScope *scope, const mbed_stats_heap_t &end) {
+    const mbed_stats_heap_t &start = scope->_start;
+    int32_t bytes = (int32_t)(end.current_size - start.current_size);
+    uint32_t allocated = end.total_size - start.total_size;
+    int32_t blocks = (int32_t)(end.alloc_cnt - start.alloc_cnt);
+    core_util_critical_section_enter();
+    add(_usage[scope->_subsystem], bytes - scope->_inner_bytes, allocated - scope->_inner_allocated,
+        blocks - scope->_inner_blocks);
+    if (scope->_outer) {
+        scope->_outer->_inner_bytes += bytes;
+        scope->_outer->_inner_allocated += allocated;
+        scope->_outer->_inner_blocks += blocks;
+    }
+    if (scope->_thread) {
+        scope->_thread->innermost = scope->_outer;
+    }
+    core_util_critical_section_exit();
+}
+
+void MemStats::charge_tls(int32_t bytes, int32_t blocks) {
+    core_util_critical_section_enter();
+    Usage &u = _usage[MEM_TLS];
+    u.current += bytes;
+    if (u.current > u.peak) {
+        u.peak = u.current;
+    }
+    u.blocks += blocks;
+    if (bytes > 0) {
+        u.allocated += bytes;
+        u.calls++;
+    }
+    // taken out of the scope the allocation happened in, as if TLS had
+    // opened a scope of its own
+    Thread *t = thread();
+    MemScope *scope = t ? t->innermost : NULL;
+    if (scope) {
+        scope->_inner_bytes += bytes;
+        scope->_inner_allocated += bytes > 0 ? bytes : 0;
+        scope->_inner_blocks += blocks;
+    }
+    core_util_critical_section_exit();
+}
+
+void MemStats::record_update(const MemScope &scope) {
+    uint32_t bytes = scope.allocated();
+    int32_t blocks = scope.blocks();
+    core_util_critical_section_enter();
+    _updates.count++;
+    _updates.last_bytes = bytes;
+    _updates.total_bytes += bytes;
+    if (bytes > _updates.max_bytes) {
+        _updates.max_bytes = bytes;
+    }
+    _updates.last_blocks = blocks;
+    core_util_critical_section_exit();
+}
+
+#endif // __MEM_STATS_H__
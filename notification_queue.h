@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NOTIFICATION_QUEUE_H__
+#define __NOTIFICATION_QUEUE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+* Payloads held in a ring of bytes given to the constructor, oldest
+* first, each with its content format. When a payload does not fit, the
+* oldest are dropped until it does, so the queue always holds the latest.
+* Nothing is allocated. A queue is for one thread at a time.
+*/
+class NotificationQueue {
+public:
+    struct Stats {
+        uint32_t queued;
+        uint32_t replayed;
+        uint32_t dropped;       // to make room, or too large to hold
+        uint16_t entries;       // held now
+        uint16_t bytes;         // held now, headers included
+    };
+
+    NotificationQueue(uint8_t *storage, size_t size)
+        : _storage(storage), _size(size), _head(0), _used(0) {
+        memset(&_stats, 0, sizeof(_stats));
+    }
+
+    bool empty() const {
+        return _stats.entries == 0;
+    }
+
+    // False if `length` bytes could never fit
+    bool push(uint16_t content_format, const uint8_t *payload, size_t length) {
+        if (length + HEADER > _size || length > 0xffff) {
+            _stats.dropped++;
+            return false;
+        }
+        while (_size - _used < length + HEADER) {
+            drop();
+        }
+        uint8_t header[HEADER] = { (uint8_t)length, (uint8_t)(length >> 8),
+                                   (uint8_t)content_format, (uint8_t)(content_format >> 8) };
+        size_t tail = (_head + _used) % _size;
+        copy_in(tail, header, HEADER);
+        copy_in((tail + HEADER) % _size, payload, length);
+        _used += HEADER + length;
+        _stats.entries++;
+        _stats.queued++;
+        _stats.bytes = (uint16_t)_used;
+        return true;
+    }
+
+    // Length of the oldest payload, 0 if there is none
+    size_t front_length() const {
+        if (empty()) {
+            return 0;
+        }
+        uint8_t header[HEADER];
+        copy_out(_head, header, HEADER);
+        return header[0] | (size_t)header[1] << 8;
+    }
+
+    /*
+    * Takes the oldest payload into `payload`, which holds front_length()
+    * bytes, and returns its length.
+    */
+    size_t pop(uint16_t &content_format, uint8_t *payload) {
+        if (empty()) {
+            return 0;
+        }
+        uint8_t header[HEADER];
+        copy_out(_head, header, HEADER);
+        size_t length = header[0] | (size_t)header[1] << 8;
+        content_format = (uint16_t)(header[2] | header[3] << 8);
+        copy_out((_head + HEADER) % _size, payload, length);
+        release(length);
+        _stats.replayed++;
+        return length;
+    }
+
+    Stats stats() const {
+        return _stats;
+    }
+
+private:
+    static const size_t HEADER = 4;     // length and content format, little-endian
+
+    void drop() {
+        release(front_length());
+        _stats.dropped++;
+    }
+
+    void release(size_t length) {
+        _head = (_head + HEADER + length) % _size;
+        _used -= HEADER + length;
+        _stats.entries--;
+        _stats.bytes = (uint16_t)_used;
+    }
+
+    void copy_in(size_t at, const uint8_t *data, size_t length) {
+        size_t first = length < _size - at ? length : _size - at;
+        memcpy(_storage + at, data, first);
+        memcpy(_storage, data + first, length - first);
+    }
+
+    void copy_out(size_t at, uint8_t *data, size_t length) const {
+        size_t first = length < _size - at ? length : _size - at;
+        memcpy(data, _storage + at, first);
+        memcpy(data + first, _storage, length - first);
+    }
+
+    uint8_t *_storage;
+    size_t   _size;
+    size_t   _head;         // of the oldest entry
+    size_t   _used;
+    Stats    _stats;
+};
+
+#endif // __NOTIFICATION_QUEUE_H__
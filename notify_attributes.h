@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NOTIFY_ATTRIBUTES_H__
+#define __NOTIFY_ATTRIBUTES_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Default minimum period between two notifications of a resource. Bursts
+// of samples inside this window are coalesced into one notification.
+#ifndef NOTIFY_DEFAULT_PMIN_MS
+#define NOTIFY_DEFAULT_PMIN_MS 1000
+#endif
+
+/*
+* LwM2M notification attributes of one resource. Periods are kept in
+* milliseconds; 0 means "not set".
+*/
+struct NotifyAttributes {
+    uint32_t pmin_ms;
+    uint32_t pmax_ms;
+    float    gt;
+    float    lt;
+    float    st;
+    bool     has_gt;
+    bool     has_lt;
+    bool     has_st;
+
+    NotifyAttributes()
+        : pmin_ms(NOTIFY_DEFAULT_PMIN_MS), pmax_ms(0), gt(0), lt(0), st(0),
+          has_gt(false), has_lt(false), has_st(false) {}
+
+    /*
+    * Applies a Write-Attributes query such as "pmin=5&pmax=60&st=0.5".
+    * pmin and pmax are in seconds, as on the wire. Attributes given
+    * without a value are cleared, attributes not given are left alone.
+    * Returns false, changing nothing, if the query cannot be parsed.
+    */
+    bool parse(const char *query) {
+        NotifyAttributes a = *this;
+        while (*query) {
+            const char *end = strchr(query, '&');
+            size_t len = end ? (size_t)(end - query) : strlen(query);
+            const char *eq = (const char *)memchr(query, '=', len);
+            size_t key_len = eq ? (size_t)(eq - query) : len;
+            bool clear = !eq || eq + 1 == query + len;
+            char value[16];
+            if (!clear) {
+                size_t value_len = len - key_len - 1;
+                if (value_len >= sizeof(value)) {
+                    return false;
+                }
+                memcpy(value, eq + 1, value_len);
+                value[value_len] = '\0';
+            }
+            if (key_len == 4 && strncmp(query, "pmin", 4) == 0) {
+                a.pmin_ms = clear ? 0 : (uint32_t)strtoul(value, NULL, 10) * 1000;
+            } else if (key_len == 4 && strncmp(query, "pmax", 4) == 0) {
+                a.pmax_ms = clear ? 0 : (uint32_t)strtoul(value, NULL, 10) * 1000;
+            } else if (key_len == 2 && strncmp(query, "gt", 2) == 0) {
+                a.has_gt = !clear;
+                a.gt = clear ? 0 : strtof(value, NULL);
+            } else if (key_len == 2 && strncmp(query, "lt", 2) == 0) {
+                a.has_lt = !clear;
+                a.lt = clear ? 0 : strtof(value, NULL);
+            } else if (key_len == 2 && strncmp(query, "st", 2) == 0) {
+                a.has_st = !clear;
+                a.st = clear ? 0 : strtof(value, NULL);
+            } else {
+                return false;
+            }
+            query += len;
+            if (*query == '&') {
+                query++;
+            }
+        }
+        if (a.pmax_ms && a.pmax_ms < a.pmin_ms) {
+            return false;
+        }
+        *this = a;
+        return true;
+    }
+};
+
+/*
+* Decides when a resource notifies, following its NotifyAttributes.
+*
+* Samples are offered as they are taken. A sample is significant if it
+* moved by at least `st` or crossed `gt` or `lt` since the last
+* notification, or, with none of those set, if it differs from it.
+* A notification is due once a significant sample is pending and pmin
+* has passed, or when pmax passes without one. Any number of samples
+* inside a pmin window end up in a single notification carrying the
+* latest value.
+*/
+class NotifyGate {
+public:
+    static const uint32_t NEVER = 0xffffffff;
+
+    NotifyGate() : _notified(false), _pending(false), _latest(0), _last_value(0), _last_ms(0), _offered(0), _sent(0), _coalesced(0) {}
+
+    void set_attributes(const NotifyAttributes &attributes) {
+        _attributes = attributes;
+    }
+
+    const NotifyAttributes& attributes() const {
+        return _attributes;
+    }
+
+    void offer(double value) {
+        _offered++;
+        _latest = value;
+        if (_pending) {
+            _coalesced++;
+        } else if (!_notified || significant(value)) {
+            _pending = true;
+        }
+    }
+
+    bool due(uint32_t now_ms) const {
+        if (!_notified) {
+            return _pending;
+        }
+        uint32_t since = now_ms - _last_ms;
+        if (since < _attributes.pmin_ms) {
+            return false;
+        }
+        return _pending || (_attributes.pmax_ms && since >= _attributes.pmax_ms);
+    }
+
+    // Milliseconds until due() turns true without further samples, or NEVER
+    uint32_t due_in(uint32_t now_ms) const {
+        if (!_notified) {
+            return _pending ? 0 : NEVER;
+        }
+        uint32_t since = now_ms - _last_ms;
+        uint32_t wait = 0;
+        if (!_pending) {
+            if (!_attributes.pmax_ms) {
+                return NEVER;
+            }
+            wait = since < _attributes.pmax_ms ? _attributes.pmax_ms - since : 0;
+        }
+        uint32_t pmin_left = since < _attributes.pmin_ms ? _attributes.pmin_ms - since : 0;
+        return wait > pmin_left ? wait : pmin_left;
+    }
+
+    // To be called once the notification carrying the latest value went out
+    void notified(uint32_t now_ms) {
+        _notified = true;
+        _pending = false;
+        _last_value = _latest;
+        _last_ms = now_ms;
+        _sent++;
+    }
+
+    uint32_t offered() const {
+        return _offered;
+    }
+
+    uint32_t sent() const {
+        return _sent;
+    }
+
+    // Samples folded into a later notification instead of getting their own
+    uint32_t coalesced() const {
+        return _coalesced;
+    }
+
+private:
+    bool significant(double value) const {
+        const NotifyAttributes &a = _attributes;
+        if (!a.has_st && !a.has_gt && !a.has_lt) {
+            return value != _last_value;
+        }
+        double step = value - _last_value;
+        if (a.has_st && (step >= a.st || -step >= a.st)) {
+            return true;
+        }
+        if (a.has_gt && ((_last_value > a.gt) != (value > a.gt))) {
+            return true;
+        }
+        if (a.has_lt && ((_last_value < a.lt) != (value < a.lt))) {
+            return true;
+        }
+        return false;
+    }
+
+    NotifyAttributes _attributes;
+    bool     _notified;
+    bool     _pending;
+    double   _latest;
+    double   _last_value;
+    uint32_t _last_ms;
+    uint32_t _offered;
+    uint32_t _sent;
+    uint32_t _coalesced;
+};
+
+#endif // __NOTIFY_ATTRIBUTES_H__
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PAYLOAD_ENCODERS_H__
+#define __PAYLOAD_ENCODERS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "payload_writer.h"
+#include "sample_value.h"
+
+// CoAP content formats of the aggregated payload. TLV uses the value
+// mbed Client itself uses for OMA TLV.
+#define CONTENT_FORMAT_TEXT_PLAIN   0
+#define CONTENT_FORMAT_JSON         50
+#define CONTENT_FORMAT_OMA_TLV      99
+#define CONTENT_FORMAT_SENML_JSON   110
+#define CONTENT_FORMAT_SENML_CBOR   112
+
+/*
+* Receives the values of all data sources, one source at a time, and
+* writes them straight into a PayloadWriter. Every encoder produces its
+* output in a single pass without allocating. Values arrive in binary;
+* text formats print them, binary formats copy them as they are.
+*/
+class PayloadEncoder {
+public:
+    PayloadEncoder(PayloadWriter &out) : _out(out) {}
+    virtual ~PayloadEncoder() {}
+
+    virtual void begin() {}
+    virtual void begin_source(const char *object_id, int instance_id) = 0;
+    virtual void value(const char *resource_id, const char *description, const SampleValue &value) = 0;
+    virtual void end_source() {}
+    virtual void end() {}
+
+protected:
+    void put_formatted(const SampleValue &value) {
+        char text[SAMPLE_TEXT_SIZE];
+        _out.put(text, format_value(value, text));
+    }
+
+    PayloadWriter &_out;
+};
+
+/*
+* The original, human readable alldata/0/json representation.
+*/
+class JsonEncoder: public PayloadEncoder {
+public:
+    JsonEncoder(PayloadWriter &out) : PayloadEncoder(out), _first(true), _object_id(NULL), _instance_id(0) {}
+
+    virtual void begin() {
+        _out.put("[\n");
+    }
+    virtual void begin_source(const char *object_id, int instance_id) {
+        _object_id = object_id;
+        _instance_id = instance_id;
+    }
+    virtual void value(const char *resource_id, const char *description, const SampleValue &value) {
+        if (!_first) {
+            _out.put("    ,\n");
+        }
+        _first = false;
+        _out.put("    {\n        \"uri\":\"/");
+        _out.put(_object_id);
+        _out.put('/');
+        _out.put_int(_instance_id);
+        _out.put('/');
+        _out.put(resource_id);
+        _out.put("\",\n        \"desc\":\"");
+        _out.put(description);
+        _out.put("\",\n        \"value\":\"");
+        put_formatted(value);
+        _out.put("\"\n    }\n");
+    }
+    virtual void end() {
+        _out.put("]");
+    }
+
+private:
+    bool        _first;
+    const char *_object_id;
+    int         _instance_id;
+};
+
+/*
+* SenML-JSON (RFC 8428). Each source opens with a base name, so records
+* only carry the resource ID, and values are sent as JSON numbers. JSON
+* has no NaN or infinity, so records of those are left out.
+*/
+class SenmlJsonEncoder: public PayloadEncoder {
+public:
+    SenmlJsonEncoder(PayloadWriter &out) : PayloadEncoder(out), _first(true), _object_id(NULL), _instance_id(0), _base_pending(false) {}
+
+    virtual void begin() {
+        _out.put('[');
+    }
+    virtual void begin_source(const char *object_id, int instance_id) {
+        _object_id = object_id;
+        _instance_id = instance_id;
+        _base_pending = true;
+    }
+    virtual void value(const char *resource_id, const char * /*description*/, const SampleValue &value) {
+        if (!value.finite()) {
+            return;
+        }
+        if (!_first) {
+            _out.put(',');
+        }
+        _first = false;
+        _out.put('{');
+        if (_base_pending) {
+            _base_pending = false;
+            _out.put("\"bn\":\"/");
+            _out.put(_object_id);
+            _out.put('/');
+            _out.put_int(_instance_id);
+            _out.put("/\",");
+        }
+        _out.put("\"n\":\"");
+        _out.put(resource_id);
+        _out.put("\",\"v\":");
+        put_formatted(value);
+        _out.put('}');
+    }
+    virtual void end() {
+        _out.put(']');
+    }
+
+private:
+    bool        _first;
+    const char *_object_id;
+    int         _instance_id;
+    bool        _base_pending;
+};
+
+/*
+* SenML-CBOR (RFC 8428). Same record layout as SenmlJsonEncoder, using
+* the integer map labels. The array is indefinite-length so the number
+* of records does not have to be known up front.
+*/
+class SenmlCborEncoder: public PayloadEncoder {
+public:
+    SenmlCborEncoder(PayloadWriter &out) : PayloadEncoder(out), _object_id(NULL), _instance_id(0), _base_pending(false) {}
+
+    virtual void begin() {
+        _out.put((char)0x9f);
+    }
+    virtual void begin_source(const char *object_id, int instance_id) {
+        _object_id = object_id;
+        _instance_id = instance_id;
+        _base_pending = true;
+    }
+    virtual void value(const char *resource_id, const char * /*description*/, const SampleValue &value) {
+        put_head(MAJOR_MAP, _base_pending ? 3 : 2);
+        if (_base_pending) {
+            _base_pending = false;
+            // "/<object>/<instance>/"
+            char instance[12];
+            int instance_len = sprintf(instance, "%d", _instance_id);
+            size_t object_len = strlen(_object_id);
+            put_int(LABEL_BASE_NAME);
+            put_head(MAJOR_TEXT, object_len + instance_len + 3);
+            _out.put('/');
+            _out.put(_object_id, object_len);
+            _out.put('/');
+            _out.put(instance, instance_len);
+            _out.put('/');
+        }
+        put_int(LABEL_NAME);
+        put_text(resource_id);
+        put_int(LABEL_VALUE);
+        put_value(value);
+    }
+    virtual void end() {
+        _out.put((char)0xff);
+    }
+
+private:
+    enum {
+        MAJOR_UNSIGNED = 0,
+        MAJOR_NEGATIVE = 1,
+        MAJOR_TEXT = 3,
+        MAJOR_MAP = 5,
+        MAJOR_SIMPLE = 7
+    };
+    enum {
+        LABEL_BASE_NAME = -2,
+        LABEL_NAME = 0,
+        LABEL_VALUE = 2
+    };
+
+    void put_head(uint8_t major, uint32_t arg) {
+        major <<= 5;
+        if (arg < 24) {
+            _out.put((char)(major | arg));
+        } else if (arg <= 0xff) {
+            _out.put((char)(major | 24));
+            _out.put((char)arg);
+        } else if (arg <= 0xffff) {
+            _out.put((char)(major | 25));
+            _out.put((char)(arg >> 8));
+            _out.put((char)arg);
+        } else {
+            _out.put((char)(major | 26));
+            _out.put((char)(arg >> 24));
+            _out.put((char)(arg >> 16));
+            _out.put((char)(arg >> 8));
+            _out.put((char)arg);
+        }
+    }
+    void put_int(int32_t value) {
+        if (value < 0) {
+            put_head(MAJOR_NEGATIVE, (uint32_t)(-1 - value));
+        } else {
+            put_head(MAJOR_UNSIGNED, (uint32_t)value);
+        }
+    }
+    void put_text(const char *text) {
+        size_t len = strlen(text);
+        put_head(MAJOR_TEXT, len);
+        _out.put(text, len);
+    }
+    void put_value(const SampleValue &value) {
+        if (value.type == SampleValue::INTEGER) {
+            put_int(value.value.i);
+            return;
+        }
+        if (!value.finite()) {
+            // additional info 25: half precision, which holds NaN and
+            // both infinities exactly
+            uint16_t half = value.value.f != value.value.f ? 0x7e00 : value.value.f > 0 ? 0x7c00 : 0xfc00;
+            _out.put((char)((MAJOR_SIMPLE << 5) | 25));
+            _out.put((char)(half >> 8));
+            _out.put((char)half);
+            return;
+        }
+        uint32_t bits;
+        memcpy(&bits, &value.value.f, sizeof(bits));
+        // major type 7, additional info 26: IEEE 754 single precision
+        _out.put((char)((MAJOR_SIMPLE << 5) | 26));
+        _out.put((char)(bits >> 24));
+        _out.put((char)(bits >> 16));
+        _out.put((char)(bits >> 8));
+        _out.put((char)bits);
+    }
+
+    const char *_object_id;
+    int         _instance_id;
+    bool        _base_pending;
+};
+
+/*
+* OMA LwM2M TLV. TLV names no objects, so every source is written as an
+* object instance TLV with its own instance ID whose first resource TLV,
+* OBJECT_RESOURCE, holds the object ID as an integer; one resource TLV
+* per value follows. IPSO objects number their resources from 5500 on, so
+* resource 0 is free. The instance length is written with a fixed 16-bit
+* length field and patched once the resources are out.
+*/
+class TlvEncoder: public PayloadEncoder {
+public:
+    static const uint16_t OBJECT_RESOURCE = 0;
+
+    TlvEncoder(PayloadWriter &out) : PayloadEncoder(out), _length_at(0) {}
+
+    virtual void begin_source(const char *object_id, int instance_id) {
+        uint16_t id = (uint16_t)instance_id;
+        if (id > 0xff) {
+            _out.put((char)(TYPE_OBJECT_INSTANCE | ID_16BIT | LENGTH_16BIT));
+            _out.put((char)(id >> 8));
+        } else {
+            _out.put((char)(TYPE_OBJECT_INSTANCE | LENGTH_16BIT));
+        }
+        _out.put((char)id);
+        _length_at = _out.size();
+        _out.put((char)0);
+        _out.put((char)0);
+        put_resource(OBJECT_RESOURCE, SampleValue::integer(atoi(object_id), 0));
+    }
+    virtual void value(const char *resource_id, const char * /*description*/, const SampleValue &value) {
+        put_resource((uint16_t)atoi(resource_id), value);
+    }
+    virtual void end_source() {
+        size_t len = _out.size() - _length_at - 2;
+        _out.patch(_length_at, (uint8_t)(len >> 8));
+        _out.patch(_length_at + 1, (uint8_t)len);
+    }
+
+private:
+    enum {
+        TYPE_OBJECT_INSTANCE = 0x00,
+        TYPE_RESOURCE = 0xc0,
+        ID_16BIT = 0x20,
+        LENGTH_16BIT = 0x10
+    };
+
+    void put_resource(uint16_t id, const SampleValue &value) {
+        uint8_t bytes[8];
+        uint8_t len = 0;
+        if (value.type == SampleValue::INTEGER) {
+            int32_t v = value.value.i;
+            if (v >= -128 && v <= 127) {
+                len = 1;
+            } else if (v >= -32768 && v <= 32767) {
+                len = 2;
+            } else {
+                len = 4;
+            }
+            for (uint8_t i = 0; i < len; i++) {
+                bytes[i] = (uint8_t)(v >> (8 * (len - 1 - i)));
+            }
+        } else {
+            uint32_t bits;
+            memcpy(&bits, &value.value.f, sizeof(bits));
+            len = 4;
+            for (uint8_t i = 0; i < len; i++) {
+                bytes[i] = (uint8_t)(bits >> (8 * (3 - i)));
+            }
+        }
+        uint8_t type = TYPE_RESOURCE | len;
+        if (id > 0xff) {
+            type |= ID_16BIT;
+            _out.put((char)type);
+            _out.put((char)(id >> 8));
+        } else {
+            _out.put((char)type);
+        }
+        _out.put((char)id);
+        _out.put((const char *)bytes, len);
+    }
+
+    size_t _length_at;
+};
+
+#endif // __PAYLOAD_ENCODERS_H__
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __PAYLOAD_WRITER_H__
+#define __PAYLOAD_WRITER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+* Streaming writer over a caller-owned, fixed-size buffer.
+*
+* Nothing is ever allocated. Once the buffer is full further output is
+* dropped, but size() keeps counting, so after a pass over the data it
+* reports exactly how many bytes the complete payload needs. Callers use
+* that to size their buffer once and serialize again.
+*/
+class PayloadWriter {
+public:
+    PayloadWriter(uint8_t *buffer, size_t capacity)
+        : _buffer(buffer), _capacity(capacity), _size(0) {}
+
+    void put(char c) {
+        if (_size < _capacity) {
+            _buffer[_size] = (uint8_t)c;
+        }
+        _size++;
+    }
+
+    void put(const char *str) {
+        put(str, strlen(str));
+    }
+
+    void put(const char *data, size_t len) {
+        if (_size < _capacity) {
+            size_t room = _capacity - _size;
+            memcpy(_buffer + _size, data, len < room ? len : room);
+        }
+        _size += len;
+    }
+
+    void put_uint(uint32_t value) {
+        // uint32_t never needs more than 10 digits
+        char digits[10];
+        int n = 0;
+        do {
+            digits[n++] = '0' + (value % 10);
+            value /= 10;
+        } while (value);
+        while (n) {
+            put(digits[--n]);
+        }
+    }
+
+    void put_int(int32_t value) {
+        if (value < 0) {
+            put('-');
+            put_uint(0u - (uint32_t)value);
+        } else {
+            put_uint((uint32_t)value);
+        }
+    }
+
+    /*
+    * Overwrites a byte that was written earlier, e.g. a length field that
+    * is only known once the data after it has been written.
+    */
+    void patch(size_t position, uint8_t value) {
+        if (position < _capacity) {
+            _buffer[position] = value;
+        }
+    }
+
+    /*
+    * Bytes needed for everything written so far, including whatever did
+    * not fit into the buffer.
+    */
+    size_t size() const {
+        return _size;
+    }
+
+    bool overflowed() const {
+        return _size > _capacity;
+    }
+
+    const uint8_t *data() const {
+        return _buffer;
+    }
+
+private:
+    uint8_t *_buffer;
+    size_t   _capacity;
+    size_t   _size;
+};
+
+#endif // __PAYLOAD_WRITER_H__
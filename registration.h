@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __REGISTRATION_H__
+#define __REGISTRATION_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Lifetime of the registration, in seconds, at least 60. The server drops
+// a client that sends no update for that long.
+#ifndef REGISTRATION_LIFETIME_S
+#define REGISTRATION_LIFETIME_S 3600
+#endif
+
+// An update is due this share of the lifetime, in percent, after the
+// last registration or update, ahead of the update mbed Client sends on
+// its own three quarters of the way in...
+#ifndef REGISTRATION_UPDATE_PERCENT
+#define REGISTRATION_UPDATE_PERCENT 70
+#endif
+// ...less up to this share at random, so that a fleet that booted
+// together does not update together
+#ifndef REGISTRATION_JITTER_PERCENT
+#define REGISTRATION_JITTER_PERCENT 10
+#endif
+// ...and at least this many seconds before the lifetime runs out, which
+// covers the retransmissions of an update that is lost (5 + 10 + 20 + 40 s
+// with mbed Client's defaults)
+#ifndef REGISTRATION_MARGIN_S
+#define REGISTRATION_MARGIN_S 90
+#endif
+
+// Past this share of the lifetime, an update goes out early along with
+// the application's own traffic, while the radio is up anyway
+#ifndef REGISTRATION_PIGGYBACK_PERCENT
+#define REGISTRATION_PIGGYBACK_PERCENT 50
+#endif
+
+// An update not answered after this long is taken as lost
+#ifndef REGISTRATION_UPDATE_TIMEOUT_S
+#define REGISTRATION_UPDATE_TIMEOUT_S 120
+#endif
+
+/*
+* Decides when the registration is updated, relative to its lifetime.
+*
+* Each registration or answered update starts a period. Within it the
+* update is due at REGISTRATION_UPDATE_PERCENT of the lifetime, moved
+* earlier by a random jitter; once REGISTRATION_PIGGYBACK_PERCENT has
+* passed, the same jitter applied, the update may go out with other
+* traffic instead of waking the radio on its own. An update is in flight
+* until answered, failed or timed out, and no other is sent meanwhile.
+*
+* A registration lost() with the connection may still be alive on the
+* server until its lifetime runs out; a client back online within it can
+* send an update rather than register again, unless the server refused()
+* the registration.
+*
+* Times are milliseconds of a clock that does not wrap within a
+* lifetime, such as uptime_ms(). The application calls due() or
+* piggyback() and sends the update when they say so; MbedClient does
+* this for it.
+*/
+class RegistrationSchedule {
+public:
+    struct Stats {
+        uint32_t updates;       // sent
+        uint32_t piggybacked;   // of which with other traffic
+        uint32_t failed;        // lost or refused
+    };
+
+    RegistrationSchedule(uint32_t lifetime_s=REGISTRATION_LIFETIME_S)
+        : _lifetime_s(lifetime_s), _registered(false), _alive(false), _in_flight(false), _start_ms(0), _sent_ms(0),
+          _jitter_ms(0) {
+        _stats.updates = 0;
+        _stats.piggybacked = 0;
+        _stats.failed = 0;
+    }
+
+    uint32_t lifetime_s() const {
+        return _lifetime_s;
+    }
+
+    // The lifetime the server was last told, by a registration or update
+    void set_lifetime(uint32_t lifetime_s) {
+        _lifetime_s = lifetime_s;
+    }
+
+    // Registered, or an update answered, at `now_ms`: a new period starts
+    void registered(uint32_t now_ms) {
+        _registered = true;
+        _alive = true;
+        _in_flight = false;
+        _start_ms = now_ms;
+        // a jitter of its own for every period, or updates of devices
+        // that once collided would keep colliding
+        uint32_t range = lifetime_ms() / 100 * REGISTRATION_JITTER_PERCENT;
+        _jitter_ms = range ? (uint32_t)rand() % range : 0;
+    }
+
+    // The connection is gone; nothing is due until registered() again
+    void lost() {
+        _registered = false;
+        _in_flight = false;
+    }
+
+    // The server does not know the registration, or no longer
+    void refused() {
+        lost();
+        _alive = false;
+    }
+
+    // True if the server should still hold the registration
+    bool alive(uint32_t now_ms) const {
+        return _alive && now_ms - _start_ms < lifetime_ms();
+    }
+
+    // The update in flight failed; the next check may try again
+    void failed() {
+        if (_in_flight) {
+            _in_flight = false;
+            _stats.failed++;
+        }
+    }
+
+    // True if an update must go out now
+    bool due(uint32_t now_ms) {
+        return ready(now_ms) && now_ms - _start_ms >= due_after_ms();
+    }
+
+    // True if an update may go out now, with the traffic just sent
+    bool piggyback(uint32_t now_ms) {
+        return ready(now_ms) && now_ms - _start_ms >= piggyback_after_ms();
+    }
+
+    void sent(uint32_t now_ms, bool piggybacked) {
+        _in_flight = true;
+        _sent_ms = now_ms;
+        _stats.updates++;
+        if (piggybacked) {
+            _stats.piggybacked++;
+        }
+    }
+
+    // Milliseconds until an update is due, 0 if it is, or not registered
+    uint32_t remaining_ms(uint32_t now_ms) const {
+        uint32_t since = now_ms - _start_ms;
+        return _registered && since < due_after_ms() ? due_after_ms() - since : 0;
+    }
+
+    const Stats& stats() const {
+        return _stats;
+    }
+
+private:
+    uint32_t lifetime_ms() const {
+        return _lifetime_s * 1000;
+    }
+
+    uint32_t due_after_ms() const {
+        uint32_t due = lifetime_ms() / 100 * REGISTRATION_UPDATE_PERCENT;
+        if (_lifetime_s > REGISTRATION_MARGIN_S && due > (_lifetime_s - REGISTRATION_MARGIN_S) * 1000) {
+            due = (_lifetime_s - REGISTRATION_MARGIN_S) * 1000;
+        }
+        if (due < lifetime_ms() / 2) {
+            due = lifetime_ms() / 2;
+        }
+        return due > _jitter_ms ? due - _jitter_ms : 0;
+    }
+
+    uint32_t piggyback_after_ms() const {
+        uint32_t after = lifetime_ms() / 100 * REGISTRATION_PIGGYBACK_PERCENT;
+        after = after > _jitter_ms ? after - _jitter_ms : 0;
+        return after < due_after_ms() ? after : due_after_ms();
+    }
+
+    bool ready(uint32_t now_ms) {
+        if (_in_flight && now_ms - _sent_ms >= REGISTRATION_UPDATE_TIMEOUT_S * 1000) {
+            failed();
+        }
+        return _registered && !_in_flight;
+    }
+
+    uint32_t _lifetime_s;
+    bool     _registered;
+    bool     _alive;        // on the server, as far as the client knows
+    bool     _in_flight;
+    uint32_t _start_ms;     // of the period
+    uint32_t _sent_ms;      // of the update in flight
+    uint32_t _jitter_ms;    // of the period
+    Stats    _stats;
+};
+
+#endif // __REGISTRATION_H__
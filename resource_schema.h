@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RESOURCE_SCHEMA_H__
+#define __RESOURCE_SCHEMA_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "mbed-client/m2minterfacefactory.h"
+#include "mbed-client/m2mobject.h"
+#include "mbed-client/m2mobjectinstance.h"
+#include "mbed-client/m2mresource.h"
+
+// What a data source does with a resource of its object
+enum SchemaSampling {
+    SCHEMA_PLAIN,       // nothing; the resource is not sampled
+    SCHEMA_SAMPLED,     // records, publishes and serializes its values
+    SCHEMA_HISTORY      // the same, and keeps its history and rollups
+};
+
+/*
+* One resource of an object, as a row of a constant table. Tables of
+* these are aggregates of constants, so the compiler puts them in flash
+* with the strings they point to, and nothing is formatted at start-up.
+*/
+struct ResourceSchema {
+    const char                       *id;           // "5702"
+    const char                       *type;         // resource type, and the name alldata uses
+    M2MResourceInstance::ResourceType value_type;
+    M2MBase::Operation                operation;
+    bool                              observable;
+    const char                       *initial;      // first value, NULL for none
+    uint8_t                           sampling;     // SchemaSampling
+};
+
+/*
+* An object with a single instance whose resources are `resources`, in
+* the order they are created, declared by a DataSource and serialized.
+*/
+struct ObjectSchema {
+    const char           *id;
+    const ResourceSchema *resources;
+    uint8_t               count;
+
+    // Creates resource `index` in `inst`, with its operation and first value
+    M2MResource *create_resource(M2MObjectInstance *inst, uint8_t index) const {
+        const ResourceSchema &r = resources[index];
+        M2MResource *res = inst->create_dynamic_resource(r.id, r.type, r.value_type, r.observable);
+        res->set_operation(r.operation);
+        if (r.initial) {
+            res->set_value((const uint8_t*)r.initial, strlen(r.initial));
+        }
+        return res;
+    }
+
+    /*
+    * Creates the object, its instance and every resource, and fills
+    * `created`, if given, with the resources in table order.
+    */
+    M2MObject *create(M2MResource **created=NULL) const {
+        M2MObject *object = M2MInterfaceFactory::create_object(id);
+        M2MObjectInstance *inst = object->create_object_instance();
+        for (uint8_t i = 0; i < count; i++) {
+            M2MResource *res = create_resource(inst, i);
+            if (created) {
+                created[i] = res;
+            }
+        }
+        return object;
+    }
+};
+
+// Rows in a table, for an ObjectSchema and for sizing what it describes
+#define SCHEMA_COUNT(table) (sizeof(table) / sizeof((table)[0]))
+
+#endif // __RESOURCE_SCHEMA_H__
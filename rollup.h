@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ROLLUP_H__
+#define __ROLLUP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Buckets kept by each tier of a Rollup: an hour of one-minute buckets and
+// a day of one-hour buckets by default
+#ifndef ROLLUP_MINUTE_BUCKETS
+#define ROLLUP_MINUTE_BUCKETS 60
+#endif
+#ifndef ROLLUP_HOUR_BUCKETS
+#define ROLLUP_HOUR_BUCKETS 24
+#endif
+
+/*
+* Downsampled history of one series, next to the raw samples kept by its
+* TimeSeries: every sample is folded into a one-minute and a one-hour
+* bucket, and each tier keeps a fixed ring of its most recent buckets.
+*
+* A bucket covers [start, start + width) in milliseconds, aligned to its
+* width, and holds the count, minimum, maximum, sum and last value of the
+* samples in it. Buckets without samples are not stored. The newest
+* bucket of each tier stays open, summing in double precision, until a
+* sample falls past its end. All memory is allocated by the constructor;
+* add() is O(1) and never allocates. Timestamps must not go backwards.
+*/
+class Rollup {
+public:
+    enum Tier {
+        MINUTES,
+        HOURS,
+        TIER_COUNT
+    };
+
+    struct Bucket {
+        uint32_t start;     // ms
+        uint32_t count;
+        float    min;
+        float    max;
+        float    sum;
+        float    last;
+    };
+
+    Rollup() {
+        init(_tiers[MINUTES], width(MINUTES), ROLLUP_MINUTE_BUCKETS);
+        init(_tiers[HOURS], width(HOURS), ROLLUP_HOUR_BUCKETS);
+    }
+
+    ~Rollup() {
+        for (int t = 0; t < TIER_COUNT; t++) {
+            delete[] _tiers[t].ring;
+        }
+    }
+
+    void add(uint32_t timestamp, float value) {
+        for (int t = 0; t < TIER_COUNT; t++) {
+            TierData &tier = _tiers[t];
+            uint32_t start = timestamp - timestamp % tier.width;
+            if (tier.open.count && start != tier.open.start) {
+                close(tier);
+            }
+            Bucket &b = tier.open;
+            if (b.count == 0) {
+                b.start = start;
+                b.min = value;
+                b.max = value;
+                tier.open_sum = 0;
+            } else {
+                if (value < b.min) {
+                    b.min = value;
+                }
+                if (value > b.max) {
+                    b.max = value;
+                }
+            }
+            b.count++;
+            tier.open_sum += value;
+            b.last = value;
+        }
+    }
+
+    // Bucket width of `tier` in milliseconds
+    static uint32_t width(Tier tier) {
+        return tier == MINUTES ? 60000 : 3600000;
+    }
+
+    /*
+    * Number of buckets of `tier`, the open one included, and bucket
+    * `index` of them, oldest first. The last bucket is the open one.
+    */
+    uint16_t size(Tier tier) const {
+        const TierData &t = _tiers[tier];
+        return t.used + (t.open.count ? 1 : 0);
+    }
+
+    Bucket bucket(Tier tier, uint16_t index) const {
+        const TierData &t = _tiers[tier];
+        if (index < t.used) {
+            return t.ring[(t.oldest + index) % t.capacity];
+        }
+        Bucket b = t.open;
+        b.sum = (float)t.open_sum;
+        return b;
+    }
+
+    // Total RAM reserved for the buckets
+    size_t capacity_bytes() const {
+        return sizeof(Rollup) + (ROLLUP_MINUTE_BUCKETS + ROLLUP_HOUR_BUCKETS) * sizeof(Bucket);
+    }
+
+private:
+    struct TierData {
+        uint32_t width;
+        uint16_t capacity;
+        uint16_t oldest;
+        uint16_t used;
+        Bucket  *ring;
+        Bucket   open;
+        double   open_sum;
+    };
+
+    // Not copyable, the rollup owns its storage.
+    Rollup(const Rollup&);
+    Rollup& operator=(const Rollup&);
+
+    static void init(TierData &tier, uint32_t width, uint16_t capacity) {
+        tier.width = width;
+        tier.capacity = capacity;
+        tier.oldest = 0;
+        tier.used = 0;
+        tier.ring = new Bucket[capacity];
+        tier.open.count = 0;
+        tier.open_sum = 0;
+    }
+
+    static void close(TierData &tier) {
+        Bucket &slot = tier.ring[(tier.oldest + tier.used) % tier.capacity];
+        slot = tier.open;
+        slot.sum = (float)tier.open_sum;
+        if (tier.used < tier.capacity) {
+            tier.used++;
+        } else {
+            tier.oldest = (tier.oldest + 1) % tier.capacity;
+        }
+        tier.open.count = 0;
+    }
+
+    TierData _tiers[TIER_COUNT];
+};
+
+#endif // __ROLLUP_H__
@@ -0,0 +1,602 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SAMPLE_LOG_H__
+#define __SAMPLE_LOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__MBED__)
+#include "mbed.h"
+#endif
+
+// Size of the flash region used by the sample log when it is placed in
+// internal flash. It is taken from the end of the flash.
+#ifndef SAMPLE_LOG_SIZE
+#define SAMPLE_LOG_SIZE (32 * 1024)
+#endif
+
+/*
+* Raw storage the sample log lives on. Addresses are relative to the
+* start of the region. Erased storage reads back as 0xff and a program
+* unit may only be programmed once between erases, like NOR flash.
+* All calls return 0 on success.
+*/
+class LogStorage {
+public:
+    virtual ~LogStorage() {}
+    virtual int read(uint32_t addr, void *buffer, uint32_t size) = 0;
+    virtual int program(uint32_t addr, const void *buffer, uint32_t size) = 0;
+    virtual int erase(uint32_t addr, uint32_t size) = 0;
+    virtual uint32_t size() const = 0;
+    virtual uint32_t erase_size() const = 0;
+};
+
+#if defined(__MBED__) && DEVICE_FLASH
+// End of the application image in flash: its code plus the initial
+// values of its data, from the symbols the linker scripts provide.
+#ifndef FLASHIAP_APP_ROM_END_ADDR
+#if defined(TOOLCHAIN_GCC_ARM)
+extern uint32_t __etext;
+extern uint32_t __data_start__;
+extern uint32_t __data_end__;
+#define FLASHIAP_APP_ROM_END_ADDR (((uint32_t) &__etext) + ((uint32_t) &__data_end__) - ((uint32_t) &__data_start__))
+#elif defined(TOOLCHAIN_ARM)
+extern uint32_t Load$$LR$$LR_IROM1$$Limit[];
+#define FLASHIAP_APP_ROM_END_ADDR ((uint32_t) Load$$LR$$LR_IROM1$$Limit)
+#elif defined(TOOLCHAIN_IAR)
+#pragma section=".rodata"
+#pragma section=".text"
+#pragma section=".init_array"
+#define FLASHIAP_APP_ROM_END_ADDR max_u32(max_u32((uint32_t) __section_end(".rodata"), (uint32_t) __section_end(".text")), \
+                                          (uint32_t) __section_end(".init_array"))
+static inline uint32_t max_u32(uint32_t a, uint32_t b) {
+    return a > b ? a : b;
+}
+#else
+#error "FLASHIAP_APP_ROM_END_ADDR is unknown for this toolchain"
+#endif
+#endif
+
+/*
+* At least `size` bytes at the end of the internal flash, or ending where
+* the region `above` starts, grown to whole sectors. The region is left
+* empty (ok() is false) if it would reach into the application image or
+* its sectors differ in size.
+*/
+class FlashIAPLogStorage: public LogStorage {
+public:
+    FlashIAPLogStorage(uint32_t size = SAMPLE_LOG_SIZE, const FlashIAPLogStorage *above = NULL)
+        : _start(0), _size(0), _erase_size(0) {
+        _flash.init();
+        uint32_t flash_start = _flash.get_flash_start();
+        uint32_t end = above ? above->_start : flash_start + _flash.get_flash_size();
+        uint32_t start = end;
+        uint32_t sector = 0;
+        _start = end;
+        while (end - start < size) {
+            uint32_t next = start > flash_start ? _flash.get_sector_size(start - 1) : 0;
+            if (next == 0 || next > start - flash_start || (sector && next != sector)) {
+                return;
+            }
+            sector = next;
+            start -= sector;
+        }
+        if (sector == 0 || start < FLASHIAP_APP_ROM_END_ADDR) {
+            return;
+        }
+        _start = start;
+        _size = end - start;
+        _erase_size = sector;
+    }
+    virtual ~FlashIAPLogStorage() {
+        _flash.deinit();
+    }
+    virtual int read(uint32_t addr, void *buffer, uint32_t size) {
+        return _flash.read(buffer, _start + addr, size);
+    }
+    virtual int program(uint32_t addr, const void *buffer, uint32_t size) {
+        return _flash.program(buffer, _start + addr, size);
+    }
+    virtual int erase(uint32_t addr, uint32_t size) {
+        return _flash.erase(_start + addr, size);
+    }
+    virtual uint32_t size() const {
+        return _size;
+    }
+    virtual uint32_t erase_size() const {
+        return _erase_size;
+    }
+
+    bool ok() const {
+        return _size != 0;
+    }
+
+    // Flash address of the region
+    uint32_t start() const {
+        return _start;
+    }
+
+private:
+    FlashIAP _flash;
+    uint32_t _start;
+    uint32_t _size;
+    uint32_t _erase_size;
+};
+#endif
+
+/*
+* Log-structured, power-fail safe store of DataSource samples.
+*
+* The storage is split into segments of one erase unit each, used as a
+* ring, so every sector is erased equally often. It takes at least
+* MIN_SEGMENTS of them; mount() fails on smaller storage. A segment starts with a
+* header carrying a sequence number, followed by fixed-size chunks of
+* records, each with its own CRC, and ends with a seal once it is full:
+*
+*   | header | consumed | chunk 0 | chunk 1 | ... | chunk n-1 | seal |
+*
+* Records are collected in RAM and written one chunk at a time, so at
+* most one chunk of samples is lost on power failure. A chunk torn by a
+* power failure fails its CRC; it is skipped and writing continues in a
+* fresh segment.
+*
+* mount() reads every segment header once and then only the chunk
+* headers of the newest segment, which bounds recovery time by the
+* number of segments plus the chunks of a single segment.
+*
+* Delivery is at-least-once: the read position inside a partially
+* replayed segment is not persisted, so a reboot may replay part of a
+* segment twice.
+*/
+class SampleLog {
+public:
+    struct Record {
+        uint16_t object;
+        uint16_t resource;      // FLOAT_VALUE is set for float values
+        uint32_t timestamp;     // uptime in ms within boot `boot`
+        uint32_t value;         // int32_t or float bits
+    };
+
+    static const uint16_t FLOAT_VALUE = 0x8000;
+    static const uint16_t CHUNK_RECORDS = 10;
+    // One segment is written while the oldest may still be replayed
+    static const uint32_t MIN_SEGMENTS = 2;
+
+    struct Stats {
+        uint32_t segments;
+        uint32_t recovery_reads;    // storage reads done by mount()
+        uint32_t torn_chunks;       // chunks found with a bad CRC
+        uint32_t dropped_records;   // overwritten before being replayed
+        uint32_t written_records;
+        uint32_t replayed_records;
+    };
+
+    SampleLog(LogStorage &storage)
+        : _storage(storage), _segment_size(storage.erase_size()),
+          _segment_count(storage.erase_size() ? storage.size() / storage.erase_size() : 0),
+          _sequence(0), _boot(0),
+          _write_segment(0), _write_chunk(0), _write_open(false),
+          _read_segment(0), _read_chunk(0), _read_record(0), _buffered(0), _reads(0) {
+        memset(&_stats, 0, sizeof(_stats));
+        _stats.segments = _segment_count;
+        _chunks_per_segment = 0;
+        if (_segment_size > DATA_OFFSET + sizeof(Seal)) {
+            _chunks_per_segment = (_segment_size - DATA_OFFSET - sizeof(Seal)) / sizeof(Chunk);
+        }
+    }
+
+    /*
+    * Recovers the log after a reboot or power failure. Returns 0 on
+    * success; a blank or unreadable region gives an empty log. Fails if
+    * the storage holds fewer than MIN_SEGMENTS erase units, and the log
+    * must not be used then.
+    */
+    int mount() {
+        _reads = 0;
+        if (_segment_count < MIN_SEGMENTS || _chunks_per_segment == 0) {
+            _segment_count = 0;
+            _stats.segments = 0;
+            return -1;
+        }
+        bool found = false;
+        bool pending = false;
+        uint32_t oldest_sequence = 0;
+        for (uint32_t s = 0; s < _segment_count; s++) {
+            Header h;
+            if (!read_header(s, h)) {
+                continue;
+            }
+            if (!found || (int32_t)(h.sequence - _sequence) > 0) {
+                _sequence = h.sequence;
+                _write_segment = s;
+                _boot = h.boot;
+            }
+            found = true;
+            if (!consumed(s) && (!pending || (int32_t)(h.sequence - oldest_sequence) < 0)) {
+                oldest_sequence = h.sequence;
+                _read_segment = s;
+                pending = true;
+            }
+        }
+        _read_chunk = 0;
+        _read_record = 0;
+        if (!found) {
+            _write_open = false;
+            _write_segment = 0;
+            _write_chunk = 0;
+            _read_segment = 0;
+            _stats.recovery_reads = _reads;
+            return 0;
+        }
+        if (!pending) {
+            _read_segment = _write_segment;
+        }
+
+        // Find where the newest segment ends and which boot wrote last.
+        // Only its last written chunk can have been torn.
+        _write_chunk = 0;
+        while (_write_chunk < _chunks_per_segment) {
+            ChunkHeader ch;
+            if (read_storage(chunk_address(_write_segment, _write_chunk), &ch, sizeof(ch)) != 0 || erased(&ch, sizeof(ch))) {
+                break;
+            }
+            if ((uint16_t)(ch.boot - _boot) < 0x8000) {
+                _boot = ch.boot;
+            }
+            _write_chunk++;
+        }
+        Seal seal;
+        _write_open = read_storage(seal_address(_write_segment), &seal, sizeof(seal)) != 0 || seal.magic != SEAL_MAGIC;
+        if (_write_open && _write_chunk > 0) {
+            Chunk last;
+            if (read_storage(chunk_address(_write_segment, _write_chunk - 1), &last, sizeof(last)) != 0 || !chunk_valid(last)) {
+                // Leave the torn chunk behind; writing resumes in a fresh
+                // segment and readers stop in front of it.
+                _stats.torn_chunks++;
+                _write_chunk--;
+                _write_open = false;
+            }
+        }
+        if (!pending) {
+            // Everything was replayed before the reboot
+            _read_chunk = _write_chunk;
+        }
+        _boot++;
+        _stats.recovery_reads = _reads;
+        return 0;
+    }
+
+    /*
+    * Adds a record. Records are buffered in RAM and written to storage a
+    * chunk at a time.
+    */
+    int append(const Record &record) {
+        _chunk.records[_buffered++] = record;
+        if (_buffered == CHUNK_RECORDS) {
+            return flush();
+        }
+        return 0;
+    }
+
+    /*
+    * Writes the buffered records, if any, so they survive a reboot and
+    * become visible to read().
+    */
+    int flush() {
+        if (_buffered == 0) {
+            return 0;
+        }
+        if (!_write_open || _write_chunk == _chunks_per_segment) {
+            if (open_segment() != 0) {
+                return -1;
+            }
+        }
+        for (uint16_t i = _buffered; i < CHUNK_RECORDS; i++) {
+            memset(&_chunk.records[i], 0, sizeof(Record));
+        }
+        _chunk.header.count = _buffered;
+        _chunk.header.boot = _boot;
+        _chunk.header.crc = crc32(_chunk.records, sizeof(_chunk.records));
+        int ret = _storage.program(chunk_address(_write_segment, _write_chunk), &_chunk, sizeof(_chunk));
+        _write_chunk++;
+        _stats.written_records += _buffered;
+        _buffered = 0;
+        if (_write_chunk == _chunks_per_segment) {
+            Seal seal;
+            seal.magic = SEAL_MAGIC;
+            seal.chunks = _write_chunk;
+            seal.sequence = _sequence;
+            seal.crc = crc32(&seal, offsetof(Seal, crc));
+            _storage.program(seal_address(_write_segment), &seal, sizeof(seal));
+            _write_open = false;
+        }
+        return ret;
+    }
+
+    /*
+    * Copies up to `max` of the oldest records not yet consumed into
+    * `records` and returns how many were copied. A batch never spans two
+    * boots; `boot` tells which boot the timestamps belong to.
+    */
+    uint32_t read(Record *records, uint32_t max, uint16_t *boot) {
+        uint32_t n = 0;
+        uint32_t segment = _read_segment;
+        uint16_t chunk_index = _read_chunk;
+        uint16_t record_index = _read_record;
+        bool have_boot = false;
+        while (n < max) {
+            if (segment == _write_segment && chunk_index >= _write_chunk) {
+                break;
+            }
+            Chunk chunk;
+            if (chunk_index >= _chunks_per_segment ||
+                    read_storage(chunk_address(segment, chunk_index), &chunk, sizeof(chunk)) != 0 ||
+                    erased(&chunk.header, sizeof(chunk.header)) || !chunk_valid(chunk)) {
+                // End of this segment (full, torn or never finished)
+                if (segment == _write_segment) {
+                    break;
+                }
+                if (n) {
+                    break;
+                }
+                segment = (segment + 1) % _segment_count;
+                chunk_index = 0;
+                record_index = 0;
+                Header h;
+                if (!read_header(segment, h)) {
+                    break;
+                }
+                continue;
+            }
+            if (have_boot && chunk.header.boot != *boot) {
+                break;
+            }
+            have_boot = true;
+            *boot = chunk.header.boot;
+            while (record_index < chunk.header.count && n < max) {
+                records[n++] = chunk.records[record_index++];
+            }
+            if (record_index == chunk.header.count) {
+                chunk_index++;
+                record_index = 0;
+            }
+        }
+        if (n == 0 && segment != _read_segment) {
+            // Skipped over segments holding nothing to replay
+            advance_to(segment, chunk_index, record_index);
+        }
+        return n;
+    }
+
+    /*
+    * Marks the `count` records last returned by read() as delivered.
+    */
+    void consume(uint32_t count) {
+        while (count) {
+            if (_read_segment == _write_segment && _read_chunk >= _write_chunk) {
+                break;
+            }
+            Chunk chunk;
+            if (_read_chunk >= _chunks_per_segment ||
+                    read_storage(chunk_address(_read_segment, _read_chunk), &chunk, sizeof(chunk)) != 0 ||
+                    erased(&chunk.header, sizeof(chunk.header)) || !chunk_valid(chunk)) {
+                if (_read_segment == _write_segment) {
+                    break;
+                }
+                advance_to((_read_segment + 1) % _segment_count, 0, 0);
+                continue;
+            }
+            uint32_t left = chunk.header.count - _read_record;
+            uint32_t n = count < left ? count : left;
+            _read_record += n;
+            count -= n;
+            _stats.replayed_records += n;
+            if (_read_record == chunk.header.count) {
+                _read_chunk++;
+                _read_record = 0;
+            }
+        }
+    }
+
+    // True once every record, including the ones still in RAM, has been
+    // replayed.
+    bool empty() const {
+        return _buffered == 0 && _read_segment == _write_segment && _read_chunk >= _write_chunk;
+    }
+
+    uint16_t boot() const {
+        return _boot;
+    }
+
+    const Stats& stats() const {
+        return _stats;
+    }
+
+private:
+    static const uint32_t HEADER_MAGIC = 0x534c4f47;   // "SLOG"
+    static const uint32_t SEAL_MAGIC = 0x5345414c;     // "SEAL"
+    // header and consumed marker each get a 16 byte program unit
+    static const uint32_t CONSUMED_OFFSET = 16;
+    static const uint32_t DATA_OFFSET = 32;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t sequence;
+        uint16_t boot;
+        uint16_t reserved;
+        uint32_t crc;
+    };
+
+    struct ChunkHeader {
+        uint16_t count;
+        uint16_t boot;
+        uint32_t crc;
+    };
+
+    struct Chunk {
+        ChunkHeader header;
+        Record      records[CHUNK_RECORDS];
+    };
+
+    struct Seal {
+        uint32_t magic;
+        uint32_t chunks;
+        uint32_t sequence;
+        uint32_t crc;
+    };
+
+    static uint32_t crc32(const void *data, size_t len) {
+        static const uint32_t table[16] = {
+            0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+            0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+        };
+        const uint8_t *p = (const uint8_t *)data;
+        uint32_t crc = 0xffffffff;
+        while (len--) {
+            crc = table[(crc ^ *p) & 0x0f] ^ (crc >> 4);
+            crc = table[(crc ^ (*p >> 4)) & 0x0f] ^ (crc >> 4);
+            p++;
+        }
+        return ~crc;
+    }
+
+    static bool erased(const void *data, size_t len) {
+        const uint8_t *p = (const uint8_t *)data;
+        while (len--) {
+            if (*p++ != 0xff) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool chunk_valid(const Chunk &chunk) {
+        return chunk.header.count > 0 && chunk.header.count <= CHUNK_RECORDS &&
+               chunk.header.crc == crc32(chunk.records, sizeof(chunk.records));
+    }
+
+    int read_storage(uint32_t addr, void *buffer, uint32_t size) {
+        _reads++;
+        return _storage.read(addr, buffer, size);
+    }
+
+    uint32_t segment_address(uint32_t segment) const {
+        return segment * _segment_size;
+    }
+
+    uint32_t chunk_address(uint32_t segment, uint32_t chunk) const {
+        return segment_address(segment) + DATA_OFFSET + chunk * sizeof(Chunk);
+    }
+
+    uint32_t seal_address(uint32_t segment) const {
+        return segment_address(segment) + _segment_size - sizeof(Seal);
+    }
+
+    bool read_header(uint32_t segment, Header &h) {
+        return read_storage(segment_address(segment), &h, sizeof(h)) == 0 &&
+               h.magic == HEADER_MAGIC && h.crc == crc32(&h, offsetof(Header, crc));
+    }
+
+    bool consumed(uint32_t segment) {
+        uint32_t marker;
+        return read_storage(segment_address(segment) + CONSUMED_OFFSET, &marker, sizeof(marker)) != 0 || marker != 0xffffffff;
+    }
+
+    void advance_to(uint32_t segment, uint16_t chunk, uint16_t record) {
+        if (segment != _read_segment) {
+            // everything in the segment we are leaving has been replayed
+            static const uint8_t zeros[16] = { 0 };
+            _storage.program(segment_address(_read_segment) + CONSUMED_OFFSET, zeros, sizeof(zeros));
+        }
+        _read_segment = segment;
+        _read_chunk = chunk;
+        _read_record = record;
+    }
+
+    int open_segment() {
+        if (_segment_count < MIN_SEGMENTS) {
+            return -1;
+        }
+        uint32_t next = (_write_open || _write_chunk || _sequence) ? (_write_segment + 1) % _segment_count : _write_segment;
+        if (next == _read_segment && !empty_segment_for_reader(next)) {
+            // The ring is full: the oldest segment gets overwritten
+            uint32_t dropped = 0;
+            for (uint16_t c = _read_chunk; c < _chunks_per_segment; c++) {
+                Chunk chunk;
+                if (read_storage(chunk_address(next, c), &chunk, sizeof(chunk)) != 0 || !chunk_valid(chunk)) {
+                    break;
+                }
+                dropped += chunk.header.count - (c == _read_chunk ? _read_record : 0);
+            }
+            _stats.dropped_records += dropped;
+            _read_segment = (next + 1) % _segment_count;
+            _read_chunk = 0;
+            _read_record = 0;
+        }
+        if (_storage.erase(segment_address(next), _segment_size) != 0) {
+            return -1;
+        }
+        Header h;
+        h.magic = HEADER_MAGIC;
+        h.sequence = ++_sequence;
+        h.boot = _boot;
+        h.reserved = 0xffff;
+        h.crc = crc32(&h, offsetof(Header, crc));
+        if (_storage.program(segment_address(next), &h, sizeof(h)) != 0) {
+            return -1;
+        }
+        if (next == _read_segment) {
+            _read_chunk = 0;
+            _read_record = 0;
+        }
+        _write_segment = next;
+        _write_chunk = 0;
+        _write_open = true;
+        return 0;
+    }
+
+    // True if the reader has nothing left in `segment` (it was never
+    // written or has been replayed completely).
+    bool empty_segment_for_reader(uint32_t segment) {
+        Header h;
+        return !read_header(segment, h) || consumed(segment);
+    }
+
+    LogStorage &_storage;
+    uint32_t    _segment_size;
+    uint32_t    _segment_count;
+    uint16_t    _chunks_per_segment;
+    uint32_t    _sequence;
+    uint16_t    _boot;
+
+    uint32_t    _write_segment;
+    uint16_t    _write_chunk;
+    bool        _write_open;
+
+    uint32_t    _read_segment;
+    uint16_t    _read_chunk;
+    uint16_t    _read_record;
+
+    Chunk       _chunk;
+    uint16_t    _buffered;
+    Stats       _stats;
+    uint32_t    _reads;
+};
+
+#endif // __SAMPLE_LOG_H__
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SAMPLE_VALUE_H__
+#define __SAMPLE_VALUE_H__
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Room format_value() needs, including the terminating NUL. The longest
+// texts are 11 characters for an integer or a float below a million, and
+// 15 for one above, such as -3.40282347e+38
+#define SAMPLE_TEXT_SIZE 24
+
+/*
+* A sample as the sensor produced it. Values are kept in binary and only
+* turned into text by format_value() when a text format needs them.
+*/
+struct SampleValue {
+    enum Type {
+        INTEGER,
+        FLOAT
+    };
+
+    Type     type;
+    uint32_t timestamp;     // uptime in ms
+    union {
+        int32_t i;
+        float   f;
+    } value;
+
+    SampleValue() : type(INTEGER), timestamp(0) {
+        value.i = 0;
+    }
+
+    static SampleValue integer(int32_t v, uint32_t timestamp) {
+        SampleValue s;
+        s.type = INTEGER;
+        s.timestamp = timestamp;
+        s.value.i = v;
+        return s;
+    }
+
+    static SampleValue real(float v, uint32_t timestamp) {
+        SampleValue s;
+        s.type = FLOAT;
+        s.timestamp = timestamp;
+        s.value.f = v;
+        return s;
+    }
+
+    // False for a float that is NaN or infinite, which only differ from
+    // themselves by NaN
+    bool finite() const {
+        return type == INTEGER || value.f - value.f == 0;
+    }
+
+    double as_double() const {
+        return type == FLOAT ? (double)value.f : (double)value.i;
+    }
+
+    /*
+    * True if both values print the same, i.e. integers are equal or
+    * floats agree to three decimals. Floats format_value() prints with
+    * "%.9g", a million or more, NaN or infinity, print the same only if
+    * they are the same float.
+    */
+    bool same_text(const SampleValue &other) const {
+        if (type != other.type) {
+            return false;
+        }
+        if (type == INTEGER) {
+            return value.i == other.value.i;
+        }
+        if (!(value.f > -1e6f && value.f < 1e6f) || !(other.value.f > -1e6f && other.value.f < 1e6f)) {
+            return value.i == other.value.i;
+        }
+        return milli(value.f) == milli(other.value.f);
+    }
+
+    /*
+    * `f` in thousandths, rounded the way "%.3f" rounds. The product is
+    * taken in double as a float cannot hold it exactly above 2^24 / 1000.
+    * Only for |f| below a million, as same_text() and format_value() use
+    * it; the thousandths of larger floats overflow an int32_t.
+    */
+    static int32_t milli(float f) {
+        return (int32_t)lrint((double)f * 1000.0);
+    }
+};
+
+/*
+* Writes `v` into `text` as a NUL terminated string and returns its
+* length. Integers are printed in decimal, floats with three decimals
+* like "%.3f". Both go through integer arithmetic only. Floats of a
+* million or more, and NaN or infinity, fall back to snprintf() with
+* "%.9g", which gives the float back exactly; with "%.3f" they would
+* take up to 44 characters.
+*/
+inline size_t format_value(const SampleValue &v, char *text) {
+    char digits[10];
+    uint32_t magnitude;
+    bool negative;
+    int decimals = 0;
+    if (v.type == SampleValue::INTEGER) {
+        negative = v.value.i < 0;
+        magnitude = negative ? 0u - (uint32_t)v.value.i : (uint32_t)v.value.i;
+    } else {
+        float f = v.value.f;
+        if (!(f > -1e6f && f < 1e6f)) {
+            int len = snprintf(text, SAMPLE_TEXT_SIZE, "%.9g", f);
+            return len < SAMPLE_TEXT_SIZE ? (size_t)len : SAMPLE_TEXT_SIZE - 1;
+        }
+        int32_t m = SampleValue::milli(f);
+        negative = f < 0;
+        magnitude = negative ? 0u - (uint32_t)m : (uint32_t)m;
+        decimals = 3;
+    }
+    int n = 0;
+    do {
+        digits[n++] = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude || n <= decimals);
+    size_t len = 0;
+    if (negative) {
+        text[len++] = '-';
+    }
+    while (n) {
+        if (n == decimals) {
+            text[len++] = '.';
+        }
+        text[len++] = digits[--n];
+    }
+    text[len] = '\0';
+    return len;
+}
+
+#endif // __SAMPLE_VALUE_H__
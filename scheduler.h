@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "trace.h"
+
+// Most periodic tasks a Scheduler can hold
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 16
+#endif
+
+/*
+* Runs periodic tasks, each with its own period and phase, on the thread
+* that calls run().
+*
+* Deadlines are absolute: a task due at t runs next at t + period no
+* matter how late it actually ran, so lateness never accumulates into
+* drift. When a task falls more than a whole period behind, the missed
+* runs are skipped and counted as overruns instead of being run back to
+* back. Due tasks run earliest deadline first. A task that falls due
+* while others run waits for the next call to run(), so that a scheduler
+* with more work than time still returns to the caller's loop.
+*
+* All times come from the clock given to the constructor, in
+* microseconds.
+*/
+class Scheduler {
+public:
+    typedef void (*Function)(void *context);
+    typedef uint64_t (*Clock)();
+
+    struct TaskStats {
+        uint32_t runs;
+        uint32_t overruns;      // runs skipped because the task fell behind
+        uint32_t late_max_us;   // worst start time after the deadline
+        uint64_t late_total_us;
+        uint32_t busy_max_us;   // longest single run
+    };
+
+    struct Stats {
+        uint64_t elapsed_us;    // since the first call to run()
+        uint64_t busy_us;       // spent running tasks
+    };
+
+    Scheduler(Clock clock) : _clock(clock), _count(0), _start(0), _started(false) {
+        _stats.elapsed_us = 0;
+        _stats.busy_us = 0;
+    }
+
+    /*
+    * Adds a task running every `period_ms`, first `phase_ms` after the
+    * scheduler starts. Returns its index, or -1 if the table is full.
+    * `name` is only used in reports and must outlive the scheduler.
+    */
+    int add(const char *name, Function function, void *context, uint32_t period_ms, uint32_t phase_ms = 0) {
+        if (_count == SCHEDULER_MAX_TASKS || period_ms == 0) {
+            return -1;
+        }
+        Task &t = _tasks[_count];
+        t.name = name;
+        t.function = function;
+        t.context = context;
+        t.period_us = (uint64_t)period_ms * 1000;
+        t.next_us = (uint64_t)phase_ms * 1000;
+        t.stats.runs = 0;
+        t.stats.overruns = 0;
+        t.stats.late_max_us = 0;
+        t.stats.late_total_us = 0;
+        t.stats.busy_max_us = 0;
+        if (_started) {
+            t.next_us += _clock() - _start;
+        }
+        return _count++;
+    }
+
+    /*
+    * Runs every task that is due and returns the number of milliseconds
+    * until the next deadline, rounded up, so the caller can sleep that
+    * long; 0 if one has passed already.
+    */
+    uint32_t run() {
+        uint64_t now = _clock();
+        if (!_started) {
+            _started = true;
+            _start = now;
+        }
+        uint64_t called = now - _start;
+        for (;;) {
+            Task *due = NULL;
+            for (uint16_t i = 0; i < _count; i++) {
+                Task &t = _tasks[i];
+                if (t.next_us <= called && (!due || t.next_us < due->next_us)) {
+                    due = &t;
+                }
+            }
+            if (!due) {
+                break;
+            }
+            uint64_t late = now - _start - due->next_us;
+            TRACE_BEGIN(TRACE_TASK, due - _tasks);
+            due->function(due->context);
+            TRACE_END(TRACE_TASK, due - _tasks);
+            uint64_t done = _clock();
+            uint64_t busy = done - now;
+            now = done;
+
+            TaskStats &s = due->stats;
+            s.runs++;
+            s.late_total_us += late;
+            if (late > s.late_max_us) {
+                s.late_max_us = (uint32_t)late;
+            }
+            if (busy > s.busy_max_us) {
+                s.busy_max_us = (uint32_t)busy;
+            }
+            _stats.busy_us += busy;
+
+            due->next_us += due->period_us;
+            if (due->next_us <= now - _start) {
+                uint64_t missed = (now - _start - due->next_us) / due->period_us + 1;
+                due->next_us += missed * due->period_us;
+                s.overruns += (uint32_t)missed;
+            }
+        }
+        _stats.elapsed_us = now - _start;
+
+        uint64_t next = (uint64_t)-1;
+        for (uint16_t i = 0; i < _count; i++) {
+            if (_tasks[i].next_us < next) {
+                next = _tasks[i].next_us;
+            }
+        }
+        if (next == (uint64_t)-1) {
+            return 0xffffffff;
+        }
+        if (next <= now - _start) {
+            return 0;
+        }
+        return (uint32_t)((next - (now - _start) + 999) / 1000);
+    }
+
+    uint16_t size() const {
+        return _count;
+    }
+
+    const char* task_name(uint16_t task) const {
+        return _tasks[task].name;
+    }
+
+    const TaskStats& task_stats(uint16_t task) const {
+        return _tasks[task].stats;
+    }
+
+    const Stats& stats() const {
+        return _stats;
+    }
+
+    // Share of the elapsed time not spent in tasks, in percent
+    uint32_t idle_percent() const {
+        if (_stats.elapsed_us == 0) {
+            return 100;
+        }
+        return (uint32_t)(100 - _stats.busy_us * 100 / _stats.elapsed_us);
+    }
+
+private:
+    struct Task {
+        const char *name;
+        Function    function;
+        void       *context;
+        uint64_t    period_us;
+        uint64_t    next_us;    // relative to _start
+        TaskStats   stats;
+    };
+
+    Clock    _clock;
+    Task     _tasks[SCHEDULER_MAX_TASKS];
+    uint16_t _count;
+    uint64_t _start;
+    bool     _started;
+    Stats    _stats;
+};
+
+#endif // __SCHEDULER_H__
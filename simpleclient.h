@@ -27,6 +27,8 @@
 #include "mbed-client/m2mconfig.h"
 #include "mbed-client/m2mblockmessage.h"
 #include "security.h"
+#include "registration.h"
+#include "connection.h"
 #include "mbed.h"
 
 #define ETHERNET        1
@@ -64,6 +66,21 @@
     M2MInterface::BindingMode SOCKET_MODE = M2MInterface::TCP;
 #endif
 
+// Queue mode (binding UQ or TQ) is for sleepy devices: the server holds
+// its requests until the client next sends something, a notification or
+// a registration update, so the radio can stay off in between
+#ifndef REGISTRATION_QUEUE_MODE
+#define REGISTRATION_QUEUE_MODE 0
+#endif
+bool QUEUE_MODE = REGISTRATION_QUEUE_MODE;
+
+// The lifetime the client registers with, in seconds
+uint32_t REGISTRATION_LIFETIME = REGISTRATION_LIFETIME_S;
+
+// Milliseconds since boot, from main.cpp; unlike the us ticker it does
+// not wrap within a lifetime
+uint32_t uptime_ms();
+
 
 // MBED_DOMAIN and MBED_ENDPOINT_NAME come
 // from the security.h file copied from connector.mbed.com
@@ -99,6 +116,7 @@ public:
         _value = 0;
         _object = NULL;
         _device = device;
+        _event_thread = NULL;
     }
 
     // de-constructor for MbedClient object, you can ignore this
@@ -119,26 +137,35 @@ public:
     /*
     *  Creates M2MInterface using which endpoint can
     *  setup its name, resource type, life time, connection mode,
-    *  Currently only LwIPv4 is supported.
+    *  Currently only LwIPv4 is supported. The endpoint name is
+    *  MBED_ENDPOINT_NAME unless another is given.
     */
     void create_interface(const char *server_address,
-                          void *handler=NULL) {
+                          void *handler=NULL,
+                          const char *endpoint_name=MBED_ENDPOINT_NAME) {
     // Randomizing listening port for Certificate mode connectivity
     _server_address = server_address;
     uint16_t port = 0; // Network interface will randomize with port 0
 
+    M2MInterface::BindingMode mode = SOCKET_MODE;
+    if (QUEUE_MODE) {
+        mode = (SOCKET_MODE == M2MInterface::UDP) ? M2MInterface::UDP_QUEUE : M2MInterface::TCP_QUEUE;
+    }
+    _schedule.set_lifetime(REGISTRATION_LIFETIME);
+
     // create mDS interface object, this is the base object everything else attaches to
     _interface = M2MInterfaceFactory::create_interface(*this,
-                                                      MBED_ENDPOINT_NAME,       // endpoint name string
+                                                      endpoint_name,            // endpoint name string
                                                       "test",                   // endpoint type string
-                                                      100,                      // lifetime
+                                                      REGISTRATION_LIFETIME,    // lifetime
                                                       port,                     // listen port
                                                       MBED_DOMAIN,              // domain string
-                                                      SOCKET_MODE,              // binding mode
+                                                      mode,                     // binding mode
                                                       NETWORK_STACK,            // network stack
                                                       "");                      // context address string
     const char *binding_mode = (SOCKET_MODE == M2MInterface::UDP) ? "UDP" : "TCP";
-    printf("\r\nSOCKET_MODE : %s\r\n", binding_mode);
+    printf("\r\nSOCKET_MODE : %s%s, lifetime %lu s\r\n", binding_mode, QUEUE_MODE ? " queue" : "",
+           (unsigned long)REGISTRATION_LIFETIME);
     printf("Connecting to %s\r\n", server_address);
 
     if(_interface) {
@@ -205,6 +232,11 @@ public:
     */
     void test_register(M2MSecurity *register_object, M2MObjectList object_list){
         if(_interface) {
+            // kept for registering again after the connection is lost
+            _objects = object_list;
+            core_util_critical_section_enter();
+            _connection.connecting(uptime_ms());
+            core_util_critical_section_exit();
             // Register function
             _interface->register_object(register_object, object_list);
         }
@@ -236,8 +268,13 @@ public:
     // is successful, it returns the mbed Device Server object
     // to which the resources are registered and registered objects.
     void object_registered(M2MSecurity */*security_object*/, const M2MServer &/*server_object*/){
+        _event_thread = osThreadGetId();
         _registered = true;
         _unregistered = false;
+        core_util_critical_section_enter();
+        _schedule.registered(uptime_ms());
+        _connection.connected(uptime_ms());
+        core_util_critical_section_exit();
         trace_printer("Registered object successfully!");
     }
 
@@ -248,12 +285,22 @@ public:
         trace_printer("Unregistered Object Successfully");
         _unregistered = true;
         _registered = false;
+        core_util_critical_section_enter();
+        _schedule.refused();
+        _connection.closed();
+        core_util_critical_section_exit();
     }
 
     /*
     * Callback from mbed client stack when registration is updated
     */
     void registration_updated(M2MSecurity */*security_object*/, const M2MServer & /*server_object*/){
+        _registered = true;
+        core_util_critical_section_enter();
+        _schedule.registered(uptime_ms());
+        // the update may be the one that brought the connection back
+        _connection.connected(uptime_ms());
+        core_util_critical_section_exit();
         /* The registration is updated automatically and frequently by the
         *  mbed client stack. This print statement is turned off because it
         *  tends to happen alot.
@@ -263,7 +310,8 @@ public:
 
     // Callback from mbed client stack if any error is encountered
     // during any of the LWM2M operations. Error type is passed in
-    // the callback.
+    // the callback. Errors that cost us the connection clear the
+    // registered state until maintain_registration() reconnects.
     void error(M2MInterface::Error error){
         _error = true;
         switch(error){
@@ -278,12 +326,15 @@ public:
                 break;
             case M2MInterface::NotRegistered:
                 trace_printer("[ERROR:] M2MInterface::NotRegistered");
+                _registered = false;
                 break;
             case M2MInterface::Timeout:
                 trace_printer("[ERROR:] M2MInterface::Timeout");
+                _registered = false;
                 break;
             case M2MInterface::NetworkError:
                 trace_printer("[ERROR:] M2MInterface::NetworkError");
+                _registered = false;
                 break;
             case M2MInterface::ResponseParseFailed:
                 trace_printer("[ERROR:] M2MInterface::ResponseParseFailed");
@@ -299,6 +350,7 @@ public:
                 break;
             case M2MInterface::SecureConnectionFailed:
                 trace_printer("[ERROR:] M2MInterface::SecureConnectionFailed");
+                _registered = false;
                 break;
             case M2MInterface::DnsResolvingFailed:
                 trace_printer("[ERROR:] M2MInterface::DnsResolvingFailed");
@@ -307,6 +359,22 @@ public:
             default:
                 break;
         }
+        // An update in flight is not going to be answered
+        core_util_critical_section_enter();
+        uint32_t now = uptime_ms();
+        if (_registered) {
+            _schedule.failed();
+        } else if (error == M2MInterface::NotRegistered && _schedule.alive(now)) {
+            // The server forgot the registration, so the link works:
+            // register again without waiting
+            _schedule.refused();
+            _connection.lost(now);
+            _connection.retry(now);
+        } else {
+            _schedule.lost();
+            _connection.lost(now);
+        }
+        core_util_critical_section_exit();
     }
 
     /* Callback from mbed client stack if any value has changed
@@ -326,12 +394,80 @@ public:
     }
 
     /*
-    * update the registration period
+    * update the registration now, keeping its lifetime
     */
     void test_update_register() {
         if (_registered) {
-            _interface->update_registration(_register_security, 100);
+            core_util_critical_section_enter();
+            _schedule.sent(uptime_ms(), false);
+            core_util_critical_section_exit();
+            _interface->update_registration(_register_security);
+        }
+    }
+
+    /*
+    * Updates the registration if the update is due, see registration.h,
+    * or reconnects if the connection was lost and the backoff is over,
+    * see connection.h. To be called every few seconds. Returns true if
+    * it sent an update.
+    */
+    bool maintain_registration() {
+        if (!_registered) {
+            reconnect_if_due();
+            return false;
         }
+        return update_registration_if(false);
+    }
+
+    /*
+    * To be called right after the application sent something: an update
+    * that would be due before long goes out now, while the radio is up.
+    */
+    bool piggyback_registration() {
+        return update_registration_if(true);
+    }
+
+    RegistrationSchedule::Stats registration_stats() const {
+        core_util_critical_section_enter();
+        RegistrationSchedule::Stats stats = _schedule.stats();
+        core_util_critical_section_exit();
+        return stats;
+    }
+
+    uint32_t registration_lifetime() const {
+        return _schedule.lifetime_s();
+    }
+
+    ConnectionState::Stats connection_stats() const {
+        core_util_critical_section_enter();
+        ConnectionState::Stats stats = _connection.stats(uptime_ms());
+        core_util_critical_section_exit();
+        return stats;
+    }
+
+    ConnectionState::State connection_state() const {
+        return _connection.state();
+    }
+
+    // Milliseconds until the next attempt to reconnect, 0 if none waits
+    uint32_t reconnect_in_ms() const {
+        core_util_critical_section_enter();
+        uint32_t remaining = _connection.remaining_ms(uptime_ms());
+        core_util_critical_section_exit();
+        return remaining;
+    }
+
+    // Milliseconds until the registration update is due
+    uint32_t registration_update_in_ms() const {
+        core_util_critical_section_enter();
+        uint32_t remaining = _schedule.remaining_ms(uptime_ms());
+        core_util_critical_section_exit();
+        return remaining;
+    }
+
+    // The thread mbed Client calls back on, once registered
+    osThreadId event_thread() const {
+        return _event_thread;
     }
 
     /*
@@ -345,6 +481,50 @@ public:
 
 private:
 
+    bool update_registration_if(bool piggyback) {
+        if (!_registered) {
+            return false;
+        }
+        uint32_t now = uptime_ms();
+        core_util_critical_section_enter();
+        bool send = piggyback ? _schedule.piggyback(now) : _schedule.due(now);
+        if (send) {
+            _schedule.sent(now, piggyback);
+        }
+        core_util_critical_section_exit();
+        if (send) {
+            _interface->update_registration(_register_security);
+        }
+        return send;
+    }
+
+    /*
+    * Registers again once the backoff is over. While the registration
+    * should still be alive on the server an update does, which is
+    * smaller and keeps the server's observations; if the server no
+    * longer knows it, error() has the next attempt register instead.
+    */
+    void reconnect_if_due() {
+        uint32_t now = uptime_ms();
+        core_util_critical_section_enter();
+        bool due = _register_security && _connection.due(now);
+        bool alive = _schedule.alive(now);
+        if (due) {
+            _connection.attempt(now);
+        }
+        core_util_critical_section_exit();
+        if (!due) {
+            return;
+        }
+        if (alive) {
+            trace_printer("Reconnecting: updating the registration");
+            _interface->update_registration(_register_security);
+        } else {
+            trace_printer("Reconnecting: registering");
+            _interface->register_object(_register_security, _objects);
+        }
+    }
+
     /*
     *  Private variables used in class
     */
@@ -358,6 +538,10 @@ private:
     int                      _value;
     struct MbedClientDevice  _device;
     String                   _server_address;
+    osThreadId volatile      _event_thread;
+    RegistrationSchedule     _schedule;
+    ConnectionState          _connection;
+    M2MObjectList            _objects;
 };
 
 #endif // __SIMPLECLIENT_H__
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TIMESERIES_H__
+#define __TIMESERIES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Default history of one series: TIMESERIES_BLOCK_COUNT compressed blocks
+// of TIMESERIES_BLOCK_SIZE bytes each. When all blocks are full the oldest
+// one is dropped as a whole.
+#ifndef TIMESERIES_BLOCK_COUNT
+#define TIMESERIES_BLOCK_COUNT 32
+#endif
+#ifndef TIMESERIES_BLOCK_SIZE
+#define TIMESERIES_BLOCK_SIZE 64
+#endif
+
+/*
+* Fixed-RAM history of timestamped samples, compressed the way Facebook's
+* Gorilla does it:
+*
+*  - timestamps are stored as delta-of-delta, so a steady sampling period
+*    costs one bit per sample,
+*  - FLOAT values are XORed with the previous value and only the
+*    meaningful bits are stored,
+*  - INTEGER values are stored as zig-zag varints of the difference to the
+*    previous value.
+*
+* The history is a ring of independently decodable blocks. All memory is
+* allocated by the constructor; append() is O(1) and never allocates.
+* Timestamps are in milliseconds and must not go backwards.
+*/
+class TimeSeries {
+public:
+    enum Encoding {
+        INTEGER,
+        FLOAT
+    };
+
+    struct Sample {
+        uint32_t timestamp;
+        union {
+            int32_t i;
+            float   f;
+        } value;
+    };
+
+    class Iterator {
+    public:
+        // An iterator over no samples
+        Iterator()
+            : _series(NULL), _block(0), _index(0), _data(NULL), _bit(0),
+              _timestamp(0), _delta(0), _value(0), _leading(0), _trailing(0) {}
+
+        /*
+        * Decodes the next sample, oldest first. Returns false once all
+        * samples have been visited. The iterator is invalidated by
+        * append().
+        */
+        bool next(Sample &sample) {
+            while (_series && _block < _series->_used) {
+                const Block &b = _series->_blocks[(_series->_oldest + _block) % _series->_block_count];
+                if (_index < b.count) {
+                    if (_index == 0) {
+                        _data = _series->_data + ((_series->_oldest + _block) % _series->_block_count) * _series->_block_size;
+                        _bit = 0;
+                        _timestamp = b.first_timestamp;
+                        _delta = 0;
+                        _value = b.first_value;
+                        _leading = 0;
+                        _trailing = 0;
+                    } else {
+                        decode();
+                    }
+                    _index++;
+                    sample.timestamp = _timestamp;
+                    memcpy(&sample.value, &_value, sizeof(_value));
+                    return true;
+                }
+                _block++;
+                _index = 0;
+            }
+            return false;
+        }
+
+    private:
+        friend class TimeSeries;
+        Iterator(const TimeSeries *series)
+            : _series(series), _block(0), _index(0), _data(NULL), _bit(0),
+              _timestamp(0), _delta(0), _value(0), _leading(0), _trailing(0) {}
+
+        void decode() {
+            int32_t dod;
+            if (!read_bits(_data, _bit, 1)) {
+                dod = 0;
+            } else if (!read_bits(_data, _bit, 1)) {
+                dod = (int32_t)read_bits(_data, _bit, 7) - 63;
+            } else if (!read_bits(_data, _bit, 1)) {
+                dod = (int32_t)read_bits(_data, _bit, 9) - 255;
+            } else if (!read_bits(_data, _bit, 1)) {
+                dod = (int32_t)read_bits(_data, _bit, 12) - 2047;
+            } else {
+                dod = (int32_t)read_bits(_data, _bit, 32);
+            }
+            _delta += dod;
+            _timestamp += _delta;
+
+            if (_series->_encoding == FLOAT) {
+                if (read_bits(_data, _bit, 1)) {
+                    if (read_bits(_data, _bit, 1)) {
+                        _leading = read_bits(_data, _bit, 5);
+                        _trailing = 32 - _leading - (read_bits(_data, _bit, 5) + 1);
+                    }
+                    _value ^= read_bits(_data, _bit, 32 - _leading - _trailing) << _trailing;
+                }
+            } else {
+                uint32_t zigzag = 0;
+                uint8_t shift = 0;
+                uint32_t group;
+                do {
+                    group = read_bits(_data, _bit, 8);
+                    zigzag |= (group & 0x7f) << shift;
+                    shift += 7;
+                } while (group & 0x80);
+                _value += (zigzag >> 1) ^ (0u - (zigzag & 1));
+            }
+        }
+
+        const TimeSeries *_series;
+        uint16_t          _block;
+        uint16_t          _index;
+        const uint8_t    *_data;
+        uint16_t          _bit;
+        uint32_t          _timestamp;
+        int32_t           _delta;
+        uint32_t          _value;
+        uint8_t           _leading;
+        uint8_t           _trailing;
+    };
+
+    TimeSeries(Encoding encoding,
+               uint16_t block_count = TIMESERIES_BLOCK_COUNT,
+               uint16_t block_size = TIMESERIES_BLOCK_SIZE)
+        : _encoding(encoding), _block_count(block_count), _block_size(block_size),
+          _oldest(0), _used(0), _samples(0),
+          _last_timestamp(0), _last_delta(0), _last_value(0), _leading(NO_WINDOW), _trailing(0) {
+        _blocks = new Block[_block_count];
+        _data = new uint8_t[_block_count * _block_size];
+    }
+
+    ~TimeSeries() {
+        delete[] _blocks;
+        delete[] _data;
+    }
+
+    void append(uint32_t timestamp, int32_t value) {
+        append_raw(timestamp, (uint32_t)value);
+    }
+
+    void append(uint32_t timestamp, float value) {
+        uint32_t raw;
+        memcpy(&raw, &value, sizeof(raw));
+        append_raw(timestamp, raw);
+    }
+
+    Iterator samples() const {
+        return Iterator(this);
+    }
+
+    /*
+    * Iterator that skips the blocks holding only samples older than
+    * `timestamp`. It may still return a few older samples from the block
+    * `timestamp` falls into.
+    */
+    Iterator samples_from(uint32_t timestamp) const {
+        Iterator it(this);
+        while (it._block + 1 < _used &&
+               _blocks[(_oldest + it._block + 1) % _block_count].first_timestamp <= timestamp) {
+            it._block++;
+        }
+        return it;
+    }
+
+    // Timestamp of the oldest sample held; only meaningful if size() > 0
+    uint32_t oldest_timestamp() const {
+        return _blocks[_oldest].first_timestamp;
+    }
+
+    Encoding encoding() const {
+        return _encoding;
+    }
+
+    // Number of samples currently held.
+    uint32_t size() const {
+        return _samples;
+    }
+
+    // Bytes of compressed data currently held, block headers included.
+    size_t bytes_used() const {
+        size_t bytes = 0;
+        for (uint16_t i = 0; i < _used; i++) {
+            bytes += sizeof(Block) + (_blocks[(_oldest + i) % _block_count].bits + 7) / 8;
+        }
+        return bytes;
+    }
+
+    // Total RAM reserved for the history.
+    size_t capacity_bytes() const {
+        return _block_count * (sizeof(Block) + _block_size);
+    }
+
+private:
+    // Largest encoding of one sample: 4 + 32 timestamp bits plus
+    // 2 + 5 + 5 + 32 FLOAT value bits (INTEGER needs at most 40).
+    static const uint16_t MAX_SAMPLE_BITS = 80;
+    static const uint8_t NO_WINDOW = 0xff;
+
+    struct Block {
+        uint32_t first_timestamp;
+        uint32_t first_value;
+        uint16_t count;
+        uint16_t bits;
+    };
+
+    // Not copyable, the series owns its storage.
+    TimeSeries(const TimeSeries&);
+    TimeSeries& operator=(const TimeSeries&);
+
+    static void write_bits(uint8_t *data, uint16_t &pos, uint32_t value, uint8_t nbits) {
+        while (nbits) {
+            uint8_t room = 8 - (pos & 7);
+            uint8_t n = nbits < room ? nbits : room;
+            uint8_t chunk = (uint8_t)((value >> (nbits - n)) & ((1u << n) - 1));
+            uint8_t &byte = data[pos >> 3];
+            if ((pos & 7) == 0) {
+                byte = 0;
+            }
+            byte |= chunk << (room - n);
+            pos += n;
+            nbits -= n;
+        }
+    }
+
+    static uint32_t read_bits(const uint8_t *data, uint16_t &pos, uint8_t nbits) {
+        uint32_t value = 0;
+        while (nbits) {
+            uint8_t room = 8 - (pos & 7);
+            uint8_t n = nbits < room ? nbits : room;
+            uint8_t chunk = (data[pos >> 3] >> (room - n)) & ((1u << n) - 1);
+            value = (value << n) | chunk;
+            pos += n;
+            nbits -= n;
+        }
+        return value;
+    }
+
+    static uint8_t leading_zeros(uint32_t x) {
+        uint8_t n = 0;
+        while (!(x & 0x80000000u)) {
+            x <<= 1;
+            n++;
+        }
+        return n;
+    }
+
+    static uint8_t trailing_zeros(uint32_t x) {
+        uint8_t n = 0;
+        while (!(x & 1)) {
+            x >>= 1;
+            n++;
+        }
+        return n;
+    }
+
+    void start_block(uint32_t timestamp, uint32_t raw) {
+        if (_used == _block_count) {
+            _samples -= _blocks[_oldest].count;
+            _oldest = (_oldest + 1) % _block_count;
+            _used--;
+        }
+        Block &b = _blocks[(_oldest + _used) % _block_count];
+        _used++;
+        b.first_timestamp = timestamp;
+        b.first_value = raw;
+        b.count = 1;
+        b.bits = 0;
+        _samples++;
+        _last_timestamp = timestamp;
+        _last_delta = 0;
+        _last_value = raw;
+        _leading = NO_WINDOW;
+    }
+
+    void append_raw(uint32_t timestamp, uint32_t raw) {
+        Block *b = _used ? &_blocks[(_oldest + _used - 1) % _block_count] : NULL;
+        if (!b || b->bits + MAX_SAMPLE_BITS > _block_size * 8) {
+            start_block(timestamp, raw);
+            return;
+        }
+        uint8_t *data = _data + ((_oldest + _used - 1) % _block_count) * _block_size;
+        uint16_t pos = b->bits;
+
+        int32_t delta = (int32_t)(timestamp - _last_timestamp);
+        int32_t dod = delta - _last_delta;
+        if (dod == 0) {
+            write_bits(data, pos, 0x0, 1);
+        } else if (dod >= -63 && dod <= 64) {
+            write_bits(data, pos, 0x2, 2);
+            write_bits(data, pos, dod + 63, 7);
+        } else if (dod >= -255 && dod <= 256) {
+            write_bits(data, pos, 0x6, 3);
+            write_bits(data, pos, dod + 255, 9);
+        } else if (dod >= -2047 && dod <= 2048) {
+            write_bits(data, pos, 0xe, 4);
+            write_bits(data, pos, dod + 2047, 12);
+        } else {
+            write_bits(data, pos, 0xf, 4);
+            write_bits(data, pos, (uint32_t)dod, 32);
+        }
+
+        if (_encoding == FLOAT) {
+            uint32_t x = raw ^ _last_value;
+            if (x == 0) {
+                write_bits(data, pos, 0x0, 1);
+            } else {
+                uint8_t leading = leading_zeros(x);
+                uint8_t trailing = trailing_zeros(x);
+                if (_leading != NO_WINDOW && leading >= _leading && trailing >= _trailing) {
+                    // fits the window of the previous value
+                    write_bits(data, pos, 0x2, 2);
+                    write_bits(data, pos, x >> _trailing, 32 - _leading - _trailing);
+                } else {
+                    uint8_t meaningful = 32 - leading - trailing;
+                    write_bits(data, pos, 0x3, 2);
+                    write_bits(data, pos, leading, 5);
+                    write_bits(data, pos, meaningful - 1, 5);
+                    write_bits(data, pos, x >> trailing, meaningful);
+                    _leading = leading;
+                    _trailing = trailing;
+                }
+            }
+        } else {
+            int32_t diff = (int32_t)(raw - _last_value);
+            uint32_t zigzag = ((uint32_t)diff << 1) ^ (uint32_t)(diff >> 31);
+            while (zigzag >= 0x80) {
+                write_bits(data, pos, (zigzag & 0x7f) | 0x80, 8);
+                zigzag >>= 7;
+            }
+            write_bits(data, pos, zigzag, 8);
+        }
+
+        b->bits = pos;
+        b->count++;
+        _samples++;
+        _last_timestamp = timestamp;
+        _last_delta = delta;
+        _last_value = raw;
+    }
+
+    Encoding  _encoding;
+    uint16_t  _block_count;
+    uint16_t  _block_size;
+    Block    *_blocks;
+    uint8_t  *_data;
+    uint16_t  _oldest;
+    uint16_t  _used;
+    uint32_t  _samples;
+
+    // State of the block being appended to
+    uint32_t  _last_timestamp;
+    int32_t   _last_delta;
+    uint32_t  _last_value;
+    uint8_t   _leading;
+    uint8_t   _trailing;
+};
+
+#endif // __TIMESERIES_H__
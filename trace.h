@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__MBED__)
+#include "mbed.h"
+#endif
+
+// Hot-path tracing is compiled in only when set, see Trace
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+
+// Records each thread's ring holds; a power of two
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 128
+#endif
+
+// Threads that get a ring of their own; interrupts share one more
+#ifndef TRACE_MAX_THREADS
+#define TRACE_MAX_THREADS 6
+#endif
+
+enum TraceEvent {
+    TRACE_TASK,             // a scheduler task; arg: its index
+    TRACE_SAMPLE,           // DataSource::sample(); arg: object id
+    TRACE_RECORD,           // record_data(); arg: resource id
+    TRACE_SET_VALUE,        // the application's set_value(); arg: bytes
+    TRACE_UPDATE_ALL,       // DataAggregator::update_all()
+    TRACE_SERIALIZE,        // writing alldata/0/json; arg: bytes
+    TRACE_REPLAY,           // a sample log batch; arg: samples
+    TRACE_COAP_SEND,        // a CoAP message leaving the socket; arg: bytes
+    TRACE_COAP_RECEIVE,     // a CoAP message arriving; arg: bytes
+    TRACE_EVENTS
+};
+
+// As Chrome's trace format spells them
+enum TracePhase {
+    TRACE_PHASE_BEGIN = 'B',
+    TRACE_PHASE_END = 'E',
+    TRACE_PHASE_INSTANT = 'i'
+};
+
+inline const char *trace_event_name(uint16_t event) {
+    static const char *names[TRACE_EVENTS] = {
+        "task", "sample", "record_data", "set_value", "update_all", "serialize", "replay", "coap_send",
+        "coap_receive"
+    };
+    return event < TRACE_EVENTS ? names[event] : "unknown";
+}
+
+struct TraceRecord {
+    uint32_t time_us;       // us_ticker_read()
+    uint16_t event;
+    uint8_t  phase;
+    uint8_t  reserved;
+    uint32_t arg;
+};
+
+/*
+* What drain() writes, all little-endian:
+*
+*   header  "MTRC" version:u8 record_size:u8 rings:u16 now_us:u32 unowned:u32
+*   ring    thread:u32 records:u16 reserved:u16 dropped:u32, then `records`
+*           records of time_us:u32 event:u16 phase:u8 0:u8 arg:u32
+*
+* `thread` is 0 for interrupts. `dropped` and `unowned` count the records
+* lost since the last drain, to a full ring and to threads without one.
+* Timestamps wrap every 71 minutes; `now_us` is when the drain ran.
+*/
+#define TRACE_MAGIC "MTRC"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RING_HEADER_SIZE 12
+#define TRACE_RECORD_SIZE 12
+
+#if defined(__MBED__)
+// Orders a record's contents before the index that publishes it
+#if defined(__CORTEX_M)
+#define TRACE_BARRIER() __DMB()
+#else
+#define TRACE_BARRIER() __sync_synchronize()
+#endif
+
+/*
+* Fixed-size binary records of hot-path events, written to a ring per
+* thread without locks so that tracing barely perturbs what it measures.
+* A thread takes a ring on its first event and keeps it; interrupts write
+* to a ring of their own inside a critical section. A full ring drops new
+* records and counts them rather than overwriting what was not read yet.
+*
+* drain() takes the records out in the format above, from any one thread
+* at a time, to be sent over serial or read from a resource and turned
+* into a Chrome or Perfetto trace by host/trace2json.
+*
+* Events are recorded through the TRACE_* macros, which compile to
+* nothing unless TRACE_ENABLED is set.
+*/
+class Trace {
+public:
+    static Trace &instance() {
+        static Trace trace;
+        return trace;
+    }
+
+    void record(uint16_t event, uint8_t phase, uint32_t arg) {
+        uint32_t now = us_ticker_read();
+        if (core_util_is_isr_active()) {
+            core_util_critical_section_enter();
+            write(_rings[0], now, event, phase, arg);
+            core_util_critical_section_exit();
+            return;
+        }
+        Ring *ring = mine();
+        if (ring) {
+            write(*ring, now, event, phase, arg);
+        } else {
+            _unowned++;
+        }
+    }
+
+    /*
+    * Moves as many records as fit into `buffer` and returns the number of
+    * bytes written, 0 if not even the header fits. Records that did not
+    * fit stay for the next drain.
+    */
+    size_t drain(uint8_t *buffer, size_t capacity) {
+        if (capacity < TRACE_HEADER_SIZE) {
+            return 0;
+        }
+        _drain_mutex.lock();
+        size_t size = TRACE_HEADER_SIZE;
+        uint16_t rings = 0;
+        for (int i = 0; i <= TRACE_MAX_THREADS; i++) {
+            Ring &r = _rings[i];
+            if (i && !r.owner) {
+                continue;
+            }
+            uint32_t tail = r.tail;
+            uint32_t head = r.head;
+            TRACE_BARRIER();
+            uint32_t dropped = r.dropped;
+            uint32_t count = head - tail;
+            if (capacity - size < TRACE_RING_HEADER_SIZE) {
+                break;
+            }
+            uint32_t room = (uint32_t)((capacity - size - TRACE_RING_HEADER_SIZE) / TRACE_RECORD_SIZE);
+            if (count > room) {
+                count = room;
+            }
+            if (count > 0xffff) {
+                count = 0xffff;
+            }
+            if (count == 0 && dropped == r.reported) {
+                continue;
+            }
+            uint8_t *p = buffer + size;
+            put32(p, i ? (uint32_t)(uintptr_t)r.owner : 0);
+            put16(p + 4, (uint16_t)count);
+            put16(p + 6, 0);
+            put32(p + 8, dropped - r.reported);
+            p += TRACE_RING_HEADER_SIZE;
+            for (uint32_t n = 0; n < count; n++) {
+                const TraceRecord &rec = r.records[(tail + n) & (TRACE_RING_SIZE - 1)];
+                put32(p, rec.time_us);
+                put16(p + 4, rec.event);
+                p[6] = rec.phase;
+                p[7] = 0;
+                put32(p + 8, rec.arg);
+                p += TRACE_RECORD_SIZE;
+            }
+            TRACE_BARRIER();
+            r.tail = tail + count;
+            r.reported = dropped;
+            size = p - buffer;
+            rings++;
+        }
+        uint32_t unowned = _unowned;
+        memcpy(buffer, TRACE_MAGIC, 4);
+        buffer[4] = TRACE_VERSION;
+        buffer[5] = TRACE_RECORD_SIZE;
+        put16(buffer + 6, rings);
+        put32(buffer + 8, us_ticker_read());
+        put32(buffer + 12, unowned - _unowned_reported);
+        _unowned_reported = unowned;
+        _drain_mutex.unlock();
+        return size;
+    }
+
+    // Records waiting to be drained
+    uint32_t pending() const {
+        uint32_t count = 0;
+        for (int i = 0; i <= TRACE_MAX_THREADS; i++) {
+            count += _rings[i].head - _rings[i].tail;
+        }
+        return count;
+    }
+
+private:
+    struct Ring {
+        osThreadId        owner;    // NULL while free; unused for interrupts
+        volatile uint32_t head;     // written by the owner only
+        volatile uint32_t tail;     // written by drain() only
+        volatile uint32_t dropped;
+        uint32_t          reported; // `dropped` as of the last drain
+        TraceRecord       records[TRACE_RING_SIZE];
+    };
+
+    Trace() : _unowned(0), _unowned_reported(0) {
+        memset(_rings, 0, sizeof(_rings));
+    }
+
+    // The calling thread's ring, taken on its first event
+    Ring *mine() {
+        osThreadId id = osThreadGetId();
+        for (int i = 1; i <= TRACE_MAX_THREADS; i++) {
+            if (_rings[i].owner == id) {
+                return &_rings[i];
+            }
+        }
+        Ring *ring = NULL;
+        core_util_critical_section_enter();
+        for (int i = 1; i <= TRACE_MAX_THREADS && !ring; i++) {
+            if (!_rings[i].owner) {
+                _rings[i].owner = id;
+                ring = &_rings[i];
+            }
+        }
+        core_util_critical_section_exit();
+        return ring;
+    }
+
+    static void write(Ring &r, uint32_t now, uint16_t event, uint8_t phase, uint32_t arg) {
+        uint32_t head = r.head;
+        if (head - r.tail >= TRACE_RING_SIZE) {
+            r.dropped++;
+            return;
+        }
+        TraceRecord &rec = r.records[head & (TRACE_RING_SIZE - 1)];
+        rec.time_us = now;
+        rec.event = event;
+        rec.phase = phase;
+        rec.arg = arg;
+        TRACE_BARRIER();
+        r.head = head + 1;
+    }
+
+    static void put16(uint8_t *p, uint16_t v) {
+        p[0] = (uint8_t)v;
+        p[1] = (uint8_t)(v >> 8);
+    }
+
+    static void put32(uint8_t *p, uint32_t v) {
+        put16(p, (uint16_t)v);
+        put16(p + 2, (uint16_t)(v >> 16));
+    }
+
+    Ring              _rings[TRACE_MAX_THREADS + 1];    // [0] for interrupts
+    volatile uint32_t _unowned;
+    uint32_t          _unowned_reported;
+    Mutex             _drain_mutex;
+};
+
+// Begins and ends a span over the enclosing block
+class TraceScope {
+public:
+    TraceScope(uint16_t event, uint32_t arg) : _event(event) {
+        Trace::instance().record(event, TRACE_PHASE_BEGIN, arg);
+    }
+    ~TraceScope() {
+        Trace::instance().record(_event, TRACE_PHASE_END, 0);
+    }
+
+private:
+    uint16_t _event;
+};
+#endif // __MBED__
+
+#if TRACE_ENABLED
+#define TRACE_BEGIN(event, arg) Trace::instance().record((event), TRACE_PHASE_BEGIN, (uint32_t)(arg))
+#define TRACE_END(event, arg) Trace::instance().record((event), TRACE_PHASE_END, (uint32_t)(arg))
+#define TRACE_INSTANT(event, arg) Trace::instance().record((event), TRACE_PHASE_INSTANT, (uint32_t)(arg))
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(event, arg) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)((event), (uint32_t)(arg))
+#else
+#define TRACE_BEGIN(event, arg) ((void)0)
+#define TRACE_END(event, arg) ((void)0)
+#define TRACE_INSTANT(event, arg) ((void)0)
+#define TRACE_SCOPE(event, arg) ((void)0)
+#endif
+
+#endif // __TRACE_H__
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2017 ARM Limited. All rights reserved.
+ * SPDX-License-Identifier: Apache-2.0
+ * Licensed under the Apache License, Version 2.0 (the License); you may
+ * not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an AS IS BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __WINDOW_STATS_H__
+#define __WINDOW_STATS_H__
+
+#include <math.h>
+#include <stdint.h>
+
+/*
+* Minimum, maximum, mean and RMS of the samples added since the last
+* reset(), kept up to date one sample at a time in constant space.
+*
+* Sums are exact integers, so the variance does not lose precision to
+* cancellation. With 16-bit samples the products involved stay within 64
+* bits for windows of up to 2^17 samples, over two minutes at 800 Hz.
+*/
+class WindowStats {
+public:
+    WindowStats() {
+        reset();
+    }
+
+    void reset() {
+        _count = 0;
+        _min = 0;
+        _max = 0;
+        _sum = 0;
+        _sum_squares = 0;
+    }
+
+    void add(int32_t value) {
+        if (_count == 0 || value < _min) {
+            _min = value;
+        }
+        if (_count == 0 || value > _max) {
+            _max = value;
+        }
+        _sum += value;
+        _sum_squares += (uint64_t)((int64_t)value * value);
+        _count++;
+    }
+
+    uint32_t count() const {
+        return _count;
+    }
+
+    int32_t min() const {
+        return _min;
+    }
+
+    int32_t max() const {
+        return _max;
+    }
+
+    int32_t peak_to_peak() const {
+        return _max - _min;
+    }
+
+    float mean() const {
+        return _count ? (float)((double)_sum / _count) : 0.0f;
+    }
+
+    /*
+    * Root mean square of the deviation from the mean, i.e. the AC part
+    * of the signal. For an accelerometer this is the vibration level with
+    * gravity and orientation taken out.
+    */
+    float rms() const {
+        if (_count == 0) {
+            return 0.0f;
+        }
+        // n * sum(x^2) - sum(x)^2 is n^2 times the variance, and exact
+        double n = _count;
+        uint64_t sum = _sum < 0 ? (uint64_t)-_sum : (uint64_t)_sum;
+        double scaled = (double)(_sum_squares * _count - sum * sum);
+        return (float)(sqrt(scaled) / n);
+    }
+
+private:
+    uint32_t _count;
+    int32_t  _min;
+    int32_t  _max;
+    int64_t  _sum;
+    uint64_t _sum_squares;
+};
+
+#endif // __WINDOW_STATS_H__